@@ -16,10 +16,15 @@
                  by  The TUG DVI Driver Standards Committee.
                  Appendix A, "Device-Independent File Format".
 */
-#include <stdlib.h> // EXIT_SUCCESS, EXIT_FAILURE
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L /* fileno, fork, dup2, ftruncate */
+#endif
+
+#include <stdlib.h> // EXIT_SUCCESS, EXIT_FAILURE, qsort
 #include "dt2dv.h"
 
 
+#ifndef DTL_LIBRARY
 /** Main functions.
  *
  * ## global var
@@ -34,16 +39,11 @@ int main(int argc, char* argv[]) {
     int i;
 
     program_name = argv[0]; /* name of this program */
+    msg_fp = stderr;
 
     /* memory violation signal handler */
     signal(SIGSEGV, mem_viol);
 
-    /* message about program and compiler */
-    /* NB:  LTU EE's Sun/OS library is BSD, even though gcc 2.2.2 is ANSI */
-    fprintf(stderr, "\n");
-    fprintf(stderr, "Program \"%s\" version %s compiled %s %s in standard C.\n",
-            program_name, VERSION, __DATE__, __TIME__);
-
     /* interpret command line arguments */
     nfile = 0;
     dtl_fp = dvi_fp = NULL;
@@ -51,7 +51,16 @@ int main(int argc, char* argv[]) {
 
     for (i = 1; i < argc; i++) {
         /* parse options, followed by any explicit filenames */
-        parse(argv[i]);
+        i += parse(argv[i], (i + 1 < argc ? argv[i + 1] : NULL)) - 1;
+    }
+
+    /* message about program and compiler */
+    /* NB:  LTU EE's Sun/OS library is BSD, even though gcc 2.2.2 is ANSI */
+    if (!quiet) {
+        fprintf(msg_fp, "\n");
+        fprintf(msg_fp,
+                "Program \"%s\" version %s compiled %s %s in standard C.\n",
+                program_name, VERSION, __DATE__, __TIME__);
     }
 
     if (nfile != 2) {
@@ -73,12 +82,12 @@ void mem_viol(int sig) {
 
     MSG_SATRT;
     if (sig != SIGSEGV) {
-        fprintf(stderr, "called with wrong signal!\n");
+        fprintf(msg_fp, "called with wrong signal!\n");
     }
-    fprintf(stderr, "RUNTIME MEMORY ERROR : memory violation, ");
-    fprintf(stderr, "dtl line >= ");
-    fprintf(stderr, COUNT_FMT, dtl_line.num);
-    fprintf(stderr, "\n");
+    fprintf(msg_fp, "RUNTIME MEMORY ERROR : memory violation, ");
+    fprintf(msg_fp, "dtl line >= ");
+    fprintf(msg_fp, COUNT_FMT, dtl_line.num);
+    fprintf(msg_fp, "\n");
     dexit(EXIT_FAILURE);
 } /* mem_viol */
 
@@ -87,20 +96,22 @@ void mem_viol(int sig) {
  * @param[in] opts[]
  */
 void give_help(void) {
-    fprintf(stderr, "usage:   ");
+    fprintf(msg_fp, "usage:   ");
     MSG_SATRT;
-    fprintf(stderr, "[options]  dtl_file  dvi_file");
-    fprintf(stderr, "\n");
+    fprintf(msg_fp, "[options]  dtl_file  dvi_file");
+    fprintf(msg_fp, "\n");
 
     for (int i = 0; opts[i].keyword != NULL; i++) {
-        fprintf(stderr, "    ");
-        fprintf(stderr, "[%s]", opts[i].keyword);
-        fprintf(stderr, "    ");
-        fprintf(stderr, "%s", opts[i].desc);
-        fprintf(stderr, "\n");
+        fprintf(msg_fp, "    ");
+        fprintf(msg_fp, "[%s%s%s]", opts[i].keyword,
+                (opts[i].arg != NULL ? " " : ""),
+                (opts[i].arg != NULL ? opts[i].arg : ""));
+        fprintf(msg_fp, "    ");
+        fprintf(msg_fp, "%s", opts[i].desc);
+        fprintf(msg_fp, "\n");
     }
 
-    fprintf(stderr, "Messages, like this one, go to stderr.\n");
+    fprintf(msg_fp, "Messages, like this one, go to stderr.\n");
 } /* give_help */
 
 /* do nothing */
@@ -134,12 +145,96 @@ void dvi_stdout(void) {
 } /* dvi_stdout */
 
 
+/** Set number of jobs, from option value.
+ *
+ * ## global var
+ *  @param[in]  opt_arg
+ *  @param[out] jobs
+ */
+void set_jobs(void) {
+    char* end;
+    long n = strtol(opt_arg, &end, 10);
+
+    if (*end != '\0' || n < 1 || n > 1024) {
+        MSG_SATRT;
+        fprintf(msg_fp, "number of jobs \"%s\" must be 1 to 1024.\n",
+                opt_arg);
+        exit(1);
+    }
+    jobs = (int)n;
+} /* set_jobs */
+
+/** Set how long pages may be held, with -flush, from option value.
+ *
+ * ## global var
+ *  @param[in]  opt_arg
+ *  @param[out] coalesce_ms
+ *  @param[out] flush_pages
+ */
+void set_coalesce(void) {
+    char* end;
+    long ms = strtol(opt_arg, &end, 10);
+
+    if (*end != '\0' || ms < 0 || ms > 60000) {
+        MSG_SATRT;
+        fprintf(msg_fp, "milliseconds \"%s\" must be 0 to 60000.\n",
+                opt_arg);
+        exit(1);
+    }
+    coalesce_ms = ms;
+    flush_pages = 1;
+} /* set_coalesce */
+
+/** Set how many warnings of each kind to show, from option value.
+ *
+ * ## global var
+ *  @param[in]  opt_arg
+ *  @param[out] max_warnings
+ */
+void set_max_warnings(void) {
+    char* end;
+    long n = strtol(opt_arg, &end, 10);
+
+    if (*end != '\0' || n < 0) {
+        MSG_SATRT;
+        fprintf(msg_fp, "number of warnings \"%s\" must be 0 or more.\n",
+                opt_arg);
+        exit(1);
+    }
+    max_warnings = (COUNT)n;
+} /* set_max_warnings */
+
+/** Set manifest file, from option value.
+ *
+ * ## global var
+ *  @param[in]  opt_arg
+ *  @param[out] manifest_file
+ */
+void set_manifest(void) {
+    manifest_file = opt_arg;
+} /* set_manifest */
+
+/** Set old DVI file, whose pages to reuse, from option value.
+ *
+ * ## global var
+ *  @param[in]  opt_arg
+ *  @param[out] old_dvi_file
+ */
+void set_old(void) {
+    old_dvi_file = opt_arg;
+} /* set_old */
+
+
 /** parse one command-line argument, `s'
+ *
+ * An option's value follows its keyword, either in `s' or as `next'.
  *
  * ## global var
  *  @param[in] opts[]
+ *  @param[out] opt_arg
+ *  @return number of arguments used: 2 if `next' was the value, else 1.
  */
-int parse(char* s) {
+int parse(char* s, char* next) {
     int i, kw_len;
     const char* kw;
 
@@ -147,19 +242,33 @@ int parse(char* s) {
         kw_len = strlen(kw);
         if (strncmp(s, kw, kw_len) == 0) {
             void (*pfn)(void);
+            int nargs = 1;
+
+            if (opts[i].arg != NULL) {
+                opt_arg = s + kw_len;
+                if (*opt_arg == '\0') {
+                    opt_arg = next;
+                    nargs = 2;
+                }
+                if (opt_arg == NULL) {
+                    MSG_SATRT;
+                    fprintf(msg_fp, "option %s needs a value.\n", kw);
+                    exit(1);
+                }
+            }
 
             (*(opts[i].p_var)) = 1; /* turn option on */
             if ((pfn = opts[i].p_fn) != NULL) {
                 (*pfn)(); /* call option function */
             }
-            return i;
+            return nargs;
         }
     }
 
     /* reached here, so not an option: assume it's a filename */
     process(s);
 
-    return i;
+    return 1;
 } /* parse */
 
 
@@ -175,7 +284,7 @@ int open_dtl(char* dtl_file, FILE** pdtl) {
 
     if (dtl_filename == NULL) {
         MSG_SATRT;
-        fprintf(stderr,
+        fprintf(msg_fp,
                 "INTERNAL ERROR : dtl file's name is NULL.\n");
         dexit(EXIT_FAILURE);
     }
@@ -183,7 +292,7 @@ int open_dtl(char* dtl_file, FILE** pdtl) {
     if (pdtl == NULL) {
         MSG_SATRT;
         fprintf(
-            stderr,
+            msg_fp,
             "INTERNAL ERROR : address of dtl variable is NULL.\n");
         dexit(EXIT_FAILURE);
     }
@@ -191,7 +300,7 @@ int open_dtl(char* dtl_file, FILE** pdtl) {
     *pdtl = fopen(dtl_file, "r");
     if (*pdtl == NULL) {
         MSG_SATRT;
-        fprintf(stderr,
+        fprintf(msg_fp,
                 "DTL FILE ERROR : Cannot open \"%s\" for text "
                 "reading.\n",
                 dtl_file);
@@ -213,7 +322,7 @@ int open_dvi(char* dvi_file, FILE** pdvi) {
 
     if (dvi_filename == NULL) {
         MSG_SATRT;
-        fprintf(stderr,
+        fprintf(msg_fp,
                 "INTERNAL ERROR : dvi file's name is NULL.\n");
         dexit(EXIT_FAILURE);
     }
@@ -221,7 +330,7 @@ int open_dvi(char* dvi_file, FILE** pdvi) {
     if (pdvi == NULL) {
         MSG_SATRT;
         fprintf(
-            stderr,
+            msg_fp,
             "INTERNAL ERROR : address of dvi variable is NULL.\n");
         dexit(EXIT_FAILURE);
     }
@@ -229,7 +338,7 @@ int open_dvi(char* dvi_file, FILE** pdvi) {
     *pdvi = fopen(dvi_file, "wb");
     if (*pdvi == NULL) {
         MSG_SATRT;
-        fprintf(stderr,
+        fprintf(msg_fp,
                 "DVI FILE ERROR : Cannot open \"%s\" for binary "
                 "writing.\n",
                 dvi_file);
@@ -255,12 +364,13 @@ void process(char* s) {
         open_dvi(s, &dvi_fp);
     } else {
         MSG_SATRT;
-        fprintf(stderr, "at most two filenames allowed.\n");
+        fprintf(msg_fp, "at most two filenames allowed.\n");
         exit(1);
     }
 
     ++nfile;
 } /* process */
+#endif /* DTL_LIBRARY */
 
 
 /* write byte into dvi file */
@@ -271,9 +381,10 @@ int put_byte(int byte, FILE* dvi) {
     if (fprintf(dvi, "%c", byte) < 0) {
         MSG_SATRT;
         fprintf(
-            stderr,
+            msg_fp,
             "DVI FILE ERROR (%s) : cannot write to dvi file.\n",
             dtl_filename);
+        fail_status = DTL_ERROR_OUTPUT;
         dexit(EXIT_FAILURE);
     }
     ++dvi_written;
@@ -281,19 +392,42 @@ int put_byte(int byte, FILE* dvi) {
     return 1; /* OK */
 } /* put_byte */
 
+/* write n bytes, each 0 to 255, into dvi file */
+size_t put_bytes(const char* bytes, size_t n, FILE* dvi) {
+    if (fwrite(bytes, sizeof(char), n, dvi) < n) {
+        MSG_SATRT;
+        fprintf(
+            msg_fp,
+            "DVI FILE ERROR (%s) : cannot write to dvi file.\n",
+            dtl_filename);
+        fail_status = DTL_ERROR_OUTPUT;
+        dexit(EXIT_FAILURE);
+    }
+    dvi_written += n;
+
+    return n;
+} /* put_bytes */
+
+/** Can the indexed DTL file be split at its pages, for -j and -manifest?
+ *  Not if it includes other files, whose pages are not in it;
+ *  nor if it defines macros within its pages, for later pages to call.
+ */
+static int can_split(void) {
+    return dtl_index.ninclude == 0
+           && (dtl_index.define == DTL_INDEX_NONE || dtl_index.nbop == 0
+               || dtl_index.define < dtl_index.bop[0]);
+} /* can_split */
+
 /**
  *
  * ## global var
  *  + dtl_line
  */
 int dt2dv(FILE* dtl, FILE* dvi) {
-    int nprefixes = 0;         /* number of prefixes in cmd_prefixes[] list. */
-    static Token dtl_cmd = ""; /* DTL command name */
+    init_state();
 
-    nprefixes = sizeof(cmd_prefixes) / sizeof(CmdPrefix);
-
-    /* Construct array of all NCMDS == 256 DTL commands */
-    (void)cons_cmds(nprefixes, cmd_prefixes, cmd_table);
+    /* name, hash and transfer all NCMDS == 256 DTL commands */
+    init_commands();
 
     /* DTL commands have the form "[ ]*command arg ... arg[ ]*", */
     /* possibly enclosed in a BCOM, ECOM pair, */
@@ -301,29 +435,196 @@ int dt2dv(FILE* dtl, FILE* dvi) {
     /* That is, each command and its arguments are parenthesised, */
     /* with optional spaces after the BCOM and before the ECOM, if any. */
 
+    if (flush_pages) {
+        /* let a whole page wait in the buffer, for page_done to flush; */
+        /* the buffer lasts as long as the dvi file, until exit */
+        setvbuf(dvi, (char*)gmalloc(FLUSH_BUF_SIZE), _IOFBF, FLUSH_BUF_SIZE);
+    }
+
     /* dt2dv is now at the very start of the DTL file */
     dtl_line.num = 0;
     dtl_read = 0;
+    if (!map_dtl(dtl)) {
+        dtl_pipe = dtl_pipe_open(dtl);
+    }
 
     /* The very first thing should be the "variety" signature */
     read_variety(dtl);
 
+    read_commands = (debug || group ? read_commands_full : read_commands_fast);
+
+    if (use_old && !use_manifest) {
+        WARN_SATRT;
+        fprintf(msg_fp, "option -old needs -manifest; ignored.\n");
+    }
+
+    if (use_manifest && dtl_index.text != NULL && can_split()) {
+        /* pages are encoded, or reused, one by one */
+        dt2dv_incr(dtl, dvi);
+    } else if (jobs > 1 && dtl_index.nbop > 0 && can_split() && !debug) {
+        /* pages are encoded in parallel */
+        dt2dv_pages(dtl, dvi);
+    } else {
+        read_commands(dtl, dvi, DTL_INDEX_NONE);
+    }
+
+    if (nblock > 0) {
+        Block* b = &block[nblock - 1];
+
+        MSG_SATRT;
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "%s at line ", (b->m.name != NULL ? DEFINE_STR
+                                                          : REPEAT_STR));
+        fprintf(msg_fp, COUNT_FMT, b->line);
+        fprintf(msg_fp, " has no %s.\n", (b->m.name != NULL ? ENDDEF_STR
+                                                           : ENDREPEAT_STR));
+        dexit(EXIT_FAILURE);
+    }
+
+    if (auto_post && postamble_address == -1) {
+        /* DTL file ended without a postamble */
+        write_postamble(dvi);
+    }
+
+    if (use_manifest) {
+        write_manifest();
+    }
+
+    if (!quiet) {
+        INFO_SATRT;
+        fprintf(msg_fp, "\n");
+        fprintf(msg_fp, "Read (from file \"%s\") ", dtl_filename);
+        fprintf(msg_fp, COUNT_FMT, dtl_read);
+        fprintf(msg_fp, " DTL bytes (");
+        fprintf(msg_fp, COUNT_FMT, dtl_line.num);
+        fprintf(msg_fp, " lines);\n");
+        fprintf(msg_fp, "wrote (to file \"%s\") ", dvi_filename);
+        fprintf(msg_fp, COUNT_FMT, dvi_written);
+        fprintf(msg_fp, " DVI bytes;\n");
+        fprintf(msg_fp, "completely interpreted ");
+        fprintf(msg_fp, COUNT_FMT, ncom);
+        fprintf(msg_fp, " DVI command%s.\n", (ncom == 1 ? "" : "s"));
+        fprintf(msg_fp, "\n");
+    }
+    warn_summary();
+
+    free_state();
+
+    return 1; /* OK */
+} /* dt2dv */
+
+#ifdef DTL_LIBRARY
+/** libdtl: convert DTL file dtl to DVI file dvi, as dt2dv would,
+ *  with the options in *ctx; report there how it went.
+ *
+ *  @return ctx->status
+ */
+DtlStatus dtl_dt2dv(DtlContext* ctx, FILE* dtl, FILE* dvi) {
+    jmp_buf fail;
+
+    program_name = "dt2dv";
+    msg_fp = (ctx->messages != NULL ? ctx->messages : stderr);
+    debug = ctx->debug;
+    group = ctx->group;
+    auto_post = ctx->auto_post;
+    quiet = ctx->quiet;
+    max_warnings = ctx->max_warnings;
+    dtl_filename = (char*)(ctx->name != NULL ? ctx->name : "");
+    dvi_filename = "";
+
+    fail_status = DTL_ERROR_INPUT;
+    if (setjmp(fail) == 0) {
+        fail_jmp = &fail;
+        dt2dv(dtl, dvi);
+        if (fflush(dvi) == EOF) {
+            MSG_SATRT;
+            fprintf(msg_fp, "DVI FILE ERROR : cannot write to dvi file.\n");
+            fail_status = DTL_ERROR_OUTPUT;
+            dexit(EXIT_FAILURE);
+        }
+        ctx->status = DTL_OK;
+    } else {
+        ctx->status = fail_status;
+        free_state();
+    }
+    fail_jmp = NULL;
+
+    ctx->dvi_bytes = dvi_written;
+    ctx->ncom = ncom;
+    return ctx->status;
+} /* dtl_dt2dv */
+#endif /* DTL_LIBRARY */
+
+/** Carry out a command of dt2dv's own, that is not a DVI command:
+ *  include, or define, enddef, call, repeat or endrepeat.
+ *  out is where the command is encoded, within any block.
+ *
+ *  @return 1 if done, 0 if cmd is no such command.
+ */
+static int own_command(const char* cmd, FILE* dtl, FILE* out, FILE* dvi) {
+    if (strcmp(cmd, CALL_STR) == 0) {
+        call_macro(dtl, out);
+    } else if (strcmp(cmd, INCLUDE_STR) == 0) {
+        /* other DTL files, read in place of this command */
+        include_dtl(dtl, out);
+    } else if (strcmp(cmd, DEFINE_STR) == 0) {
+        begin_block(dtl, 1);
+    } else if (strcmp(cmd, ENDDEF_STR) == 0) {
+        end_block(1, dvi);
+    } else if (strcmp(cmd, REPEAT_STR) == 0) {
+        begin_block(dtl, 0);
+    } else if (strcmp(cmd, ENDREPEAT_STR) == 0) {
+        end_block(0, dvi);
+    } else {
+        return 0;
+    }
+
+    return 1;
+} /* own_command */
+
+/** Read, interpret, and write DTL commands,
+ *  until end of dtl file, or reading error, or position stop.
+ *
+ * stop is a position in mapped DTL text, where the next command starts;
+ * DTL_INDEX_NONE means read to the end.
+ *
+ * debug and group stand for the global options: where they are constant,
+ * the code for them is compiled away.
+ *
+ * ## global var
+ *  + ncom
+ *  + com_read
+ */
+static ALWAYS_INLINE int command_loop(FILE* dtl, FILE* dvi, size_t stop,
+                                      const int debug, const int group) {
+    static DTL_TLS Token dtl_cmd = ""; /* DTL command name */
+
     /* while not end of dtl file or reading error, */
     /*   read, interpret, and write commands */
     while (!feof(dtl)) {
         int opcode;
+        int dvi_command = 1; /* not an include, nor a block's command */
+        /* where the command is encoded: the dvi file, or a block */
+        FILE* out = (nblock > 0 ? block[nblock - 1].fp : dvi);
+
+        if (stop != DTL_INDEX_NONE
+            && dtl_index_next(&dtl_index, dtl_index.start, map_pos()) >= stop) {
+            /* the rest is another's to read */
+            map_advance(stop);
+            break;
+        }
 
         com_read = 0;
 
         if (group) {
             /* BCOM check */
-            static Token token = ""; /* DTL token */
+            static DTL_TLS Token token = ""; /* DTL token */
             read_token(dtl, token);
             /* test for end of input, or reading error */
             if (strlen(token) == 0) {
                 if (debug) {
                     MSG_SATRT;
-                    fprintf(stderr,
+                    fprintf(msg_fp,
                             "end of input, or reading error.\n");
                 }
                 break;
@@ -331,10 +632,10 @@ int dt2dv(FILE* dtl, FILE* dvi) {
             /* test whether this command begins correctly */
             else if (strcmp(token, BCOM) != 0) {
                 MSG_SATRT;
-                fprintf(stderr,
+                fprintf(msg_fp,
                         "DTL FILE ERROR (%s) : ", dtl_filename);
-                fprintf(stderr, "command must begin with \"%s\", ", BCOM);
-                fprintf(stderr, "not `%c' (char %d).\n", token[0], token[0]);
+                fprintf(msg_fp, "command must begin with \"%s\", ", BCOM);
+                fprintf(msg_fp, "not `%c' (char %d).\n", token[0], token[0]);
                 dexit(EXIT_FAILURE);
             }
             /* end BCOM check */
@@ -346,31 +647,45 @@ int dt2dv(FILE* dtl, FILE* dvi) {
         if (strlen(dtl_cmd) == 0) {
             if (debug) {
                 MSG_SATRT;
-                fprintf(stderr, "end of input, or reading error.\n");
+                fprintf(msg_fp, "end of input, or reading error.\n");
             }
             break;
         } else {
             if (debug) {
                 MSG_SATRT;
-                fprintf(stderr, "command ");
-                fprintf(stderr, COUNT_FMT, ncom);
-                fprintf(stderr, " = \"%s\".\n", dtl_cmd);
+                fprintf(msg_fp, "command ");
+                fprintf(msg_fp, COUNT_FMT, ncom);
+                fprintf(msg_fp, " = \"%s\".\n", dtl_cmd);
             }
 
             /* find opcode for this command */
             if (find_command(dtl_cmd, &opcode) == 1) {
+                if (nblock > 0) {
+                    check_block_opcode(opcode);
+                }
+
                 /* write the opcode, if we can */
-                put_byte(opcode, dvi);
+                put_byte(opcode, out);
 
                 /* treat the arguments, if any */
-                xfer_args(dtl, dvi, opcode);
+                xfer_args(dtl, out, opcode);
+            } else if (find_sized_command(dtl_cmd, &opcode) == 1) {
+                if (nblock > 0) {
+                    check_block_opcode(opcode);
+                }
+
+                /* command without suffix: its arguments choose the opcode */
+                xfer_sized(dtl, out, opcode);
             } else if (dtl_cmd[0] == BSEQ_CHAR) {
                 /* sequence of font characters for SETCHAR */
-                set_seq(dtl, dvi);
+                set_seq(dtl, out);
+            } else if (own_command(dtl_cmd, dtl, out, dvi)) {
+                /* not a DVI command */
+                dvi_command = 0;
             } else {
                 MSG_SATRT;
                 fprintf(
-                    stderr,
+                    msg_fp,
                     "DTL FILE ERROR (%s) : unknown command \"%s\".\n",
                     dtl_filename, dtl_cmd);
                 dexit(EXIT_FAILURE);
@@ -380,227 +695,1649 @@ int dt2dv(FILE* dtl, FILE* dvi) {
         if (group) {
             /* seek ECOM after command's last argument and optional whitespace
              */
-            static Token token = ""; /* DTL token */
+            static DTL_TLS Token token = ""; /* DTL token */
             read_token(dtl, token);
             /* test for end of input, or reading error */
             if (strlen(token) == 0) {
                 if (debug) {
                     MSG_SATRT;
-                    fprintf(stderr,
+                    fprintf(msg_fp,
                             "end of input, or reading error.\n");
                 }
                 break;
             }
             if (strcmp(token, ECOM) != 0) {
                 MSG_SATRT;
-                fprintf(stderr,
+                fprintf(msg_fp,
                         "DTL FILE ERROR (%s) : ", dtl_filename);
-                fprintf(stderr, "ECOM (\"%s\") expected, not `%c' (char %d).\n",
+                fprintf(msg_fp, "ECOM (\"%s\") expected, not `%c' (char %d).\n",
                         ECOM, token[0], token[0]);
                 dexit(EXIT_FAILURE);
             }
             /* end ECOM check */
         }
 
-        ++ncom; /* one more command successfully read and interpreted */
+        if (dvi_command) {
+            ++ncom; /* one more command successfully read and interpreted */
+        }
     }
     /* end while */
 
-    INFO_SATRT;
-    fprintf(stderr, "\n");
-    fprintf(stderr, "Read (from file \"%s\") ", dtl_filename);
-    fprintf(stderr, COUNT_FMT, dtl_read);
-    fprintf(stderr, " DTL bytes (");
-    fprintf(stderr, COUNT_FMT, dtl_line.num);
-    fprintf(stderr, " lines);\n");
-    fprintf(stderr, "wrote (to file \"%s\") ", dvi_filename);
-    fprintf(stderr, COUNT_FMT, dvi_written);
-    fprintf(stderr, " DVI bytes;\n");
-    fprintf(stderr, "completely interpreted ");
-    fprintf(stderr, COUNT_FMT, ncom);
-    fprintf(stderr, " DVI command%s.\n", (ncom == 1 ? "" : "s"));
-    fprintf(stderr, "\n");
-
-    free_cmds(cmd_table);
-
     return 1; /* OK */
-} /* dt2dv */
+} /* command_loop */
 
-/// used by: cons_cmds[2], init_lstr[1], alloc_lstr[1].
-void* gmalloc(size_t size) {
-    void* p = NULL;
+/* command loop, for a run without -debug or -group */
+int read_commands_fast(FILE* dtl, FILE* dvi, size_t stop) {
+    return command_loop(dtl, dvi, stop, 0, 0);
+} /* read_commands_fast */
 
-    if (size < 1) {
+/* command loop, for any run */
+int read_commands_full(FILE* dtl, FILE* dvi, size_t stop) {
+    return command_loop(dtl, dvi, stop, debug, group);
+} /* read_commands_full */
+
+/* does an included file begin with the variety signature? */
+static int at_variety(FILE* dtl) {
+    int ch;
+    size_t left;
+
+    (void)skip_space(dtl, &ch);
+    if (ch < 0) {
+        return 0;
+    }
+    (void)unread_char();
+
+    left = dtl_line.wrote - dtl_line.read;
+    return (left > 7 && strncmp(dtl_line.buf + dtl_line.read, "variety", 7) == 0
+            && isspace((unsigned char)dtl_line.buf[dtl_line.read + 7]));
+} /* at_variety */
+
+/** Read the DTL files that an include command names, in its place:
+ *  one file, or each .dtl file of a directory, in the order of their
+ *  names.  A relative name is taken from the including file's directory.
+ *
+ * Each file is read as a DTL file of its own, that may begin with
+ * the variety signature; a command must lie within one file.
+ * Its bop and postamble addresses are taken as `auto'.
+ * While one file is read, the next few are indexed in other threads.
+ *
+ * ## global var
+ *  + dtl_index
+ *  + dtl_line
+ *  + dtl_pipe
+ *  + dtl_filename
+ *  + include, include_depth
+ */
+int include_dtl(FILE* dtl, FILE* dvi) {
+    Include* in;
+    size_t n;
+    int nblock_before = nblock;
+
+    /* file or directory to include */
+    init_lstr(&include_lstr, LSTR_SIZE);
+    get_lstr(dtl, &include_lstr);
+    putch_lstr('\0', &include_lstr);
+
+    if (include_depth >= MAX_INCLUDE_DEPTH) {
         MSG_SATRT;
-        fprintf(stderr, "INTERNAL ERROR : ");
-        fprintf(stderr, "unreasonable request to malloc %zd bytes\n", size);
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "include commands nested more than %d deep.\n",
+                MAX_INCLUDE_DEPTH);
         dexit(EXIT_FAILURE);
     }
 
-    p = malloc(size);
-    if (p == NULL) {
+    in = &include[include_depth];
+    memset(in, 0, sizeof(*in));
+    in->inc = dtl_include_open((include_depth == 0 && rd_stdin ? NULL
+                                                               : dtl_filename),
+                               include_lstr.s, group);
+    if (in->inc == NULL) {
         MSG_SATRT;
-        fprintf(stderr, "MEMORY ALLOCATION ERROR : ");
-        fprintf(stderr, "operating system failed to malloc %zd bytes\n", size);
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "cannot include \"%s\" (%s).\n", include_lstr.s,
+                strerror(errno));
         dexit(EXIT_FAILURE);
     }
-    return (p);
-} /* gmalloc */
+    n = dtl_include_count(in->inc);
+    if (n == 0) {
+        WARN_SATRT;
+        fprintf(msg_fp, "line " COUNT_FMT ": no .dtl files in \"%s\".\n",
+                dtl_line.num, include_lstr.s);
+    }
+    clear_lstr(&include_lstr);
+
+    /* the including file's reader, to go back to */
+    in->index = dtl_index;
+    in->line = dtl_line;
+    in->pipe = dtl_pipe;
+    in->filename = dtl_filename;
+    memset(&dtl_index, 0, sizeof(dtl_index));
+    dtl_pipe = NULL;
+    ++include_depth;
+    if (in->index.text == NULL) {
+        in->buf = (char*)gmalloc(sizeof(linebuf));
+        memcpy(in->buf, linebuf, sizeof(linebuf));
+    }
+
+    for (size_t k = 0; k < n; k++) {
+        in->fp = dtl_include_take(in->inc, k, &dtl_index);
+        dtl_filename = (char*)dtl_include_path(in->inc, k);
+        if (in->fp == NULL) {
+            MSG_SATRT;
+            fprintf(msg_fp, "ERROR : cannot open included DTL file ");
+            fprintf(msg_fp, "\"%s\" (%s).\n", dtl_filename, strerror(errno));
+            dexit(EXIT_FAILURE);
+        }
+        if (debug) {
+            DEBUG_SATRT;
+            fprintf(msg_fp, "including \"%s\" (%s).\n", dtl_filename,
+                    (dtl_index.text != NULL ? "mapped" : "stream"));
+        }
 
+        /* as dt2dv does, at the start of a DTL file */
+        dtl_line.num = 0;
+        dtl_line.buf = (dtl_index.text != NULL ? (char*)dtl_index.text
+                                               : linebuf);
+        dtl_line.wrote = 0;
+        dtl_line.read = 0;
+        if (at_variety(in->fp)) {
+            read_variety(in->fp);
+        }
+        read_commands(in->fp, dvi, DTL_INDEX_NONE);
+        if (nblock != nblock_before) {
+            MSG_SATRT;
+            fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+            fprintf(msg_fp, "a block must end in the file it begins in.\n");
+            dexit(EXIT_FAILURE);
+        }
 
-void dinfo(void) {
-    MSG_SATRT;
-    fprintf(stderr, "Current DTL input line ");
-    fprintf(stderr, COUNT_FMT, dtl_line.num);
-    fprintf(stderr, " :\n");
-    fprintf(stderr, "\"%s\"\n", dtl_line.buf);
-    fprintf(stderr, "Read ");
-    fprintf(stderr, COUNT_FMT, dtl_read);
-    fprintf(stderr, " DTL bytes (");
-    fprintf(stderr, COUNT_FMT, com_read);
-    fprintf(stderr, " in current command), wrote ");
-    fprintf(stderr, COUNT_FMT, dvi_written);
-    fprintf(stderr, " DVI bytes.\n");
-    fprintf(stderr, "Successfully interpreted ");
-    fprintf(stderr, COUNT_FMT, ncom);
-    fprintf(stderr, " DVI command%s.\n", (ncom == 1 ? "" : "s"));
-} /* dinfo */
+        fclose(in->fp);
+        in->fp = NULL;
+        dtl_index_free(&dtl_index);
+    }
 
+    --include_depth;
+    dtl_include_close(in->inc);
+    dtl_index = in->index;
+    dtl_line = in->line;
+    dtl_pipe = in->pipe;
+    dtl_filename = in->filename;
+    if (in->buf != NULL) {
+        memcpy(linebuf, in->buf, sizeof(linebuf));
+        free(in->buf);
+    }
 
-void dexit(int n) {
-    dinfo();
-    MSG_SATRT;
-    fprintf(stderr, "exiting with status %d.\n", n);
-    exit(n);
-} /* dexit */
+    return 1; /* OK */
+} /* include_dtl */
 
 
-int cons_cmds(int nprefixes, CmdPrefix prefix[], CmdTable cmds) {
-    int code;        /* first opcode for a given command prefix */
-    int opcode;      /* command's opcode */
-    int nsuffixes;   /* number of commands with a given prefix */
-    int isuffix;     /**** integer suffix, of at most three digits ****/
-    String suffix;   /* suffix string generated from integer suffix */
-    size_t plen = 0; /* prefix length */
-    size_t slen;     /* suffix length */
-    size_t clen;     /* whole command name length */
-    int i, j;        /* loop indices */
-
-    for (i = 0; i < nprefixes; prefix++, i++) {
-        code = prefix->first_code;
-        if (code < 0 || code > 255) {
-            MSG_SATRT;
-            fprintf(stderr, "INTERNAL ERROR : ");
-            fprintf(
-                stderr,
-                "prefix listed internally with code = %d, must be 0 to 255\n",
-                code);
-            dexit(EXIT_FAILURE);
-        }
+/** Blocks of DTL commands, encoded once and written often.
+ *
+ * `define name' ... `enddef' encodes the commands between, once, as the
+ * macro name, and `call name' writes the macro's DVI bytes as they are.
+ * `repeat n' ... `endrepeat' encodes the commands between once, and
+ * writes them n times.  Blocks may nest, and may call macros.
+ * A block's commands must not depend on where they are written:
+ * so no bop, eop, fnt_def, pre, post nor post_post.
+ * A block is encoded into memory, with dvi_written, ncom and the
+ * push depth counted from 0; what they were outside is kept in the Block,
+ * and put back at its end.
+ */
 
-        if (prefix->has_suffix) {
-            plen = strlen(prefix->name);
-            /**** Suffixes in DTL are Integers, in Sequence */
-            if (prefix->last_suffix < prefix->first_suffix) {
-                MSG_SATRT;
-                fprintf(stderr, "INTERNAL ERROR : ");
-                fprintf(stderr, "prefix's last suffix %d < first suffix (%d)\n",
-                        prefix->last_suffix, prefix->first_suffix);
-                dexit(EXIT_FAILURE);
-            }
+/* the file into which a block is encoded, as it is read */
+static FILE* block_file(Block* b) {
+    FILE* fp;
 
-            nsuffixes = prefix->last_suffix - prefix->first_suffix + 1;
-            opcode = prefix->first_code;
-            for (j = 0; j < nsuffixes; j++, opcode++) {
-                isuffix = prefix->first_suffix + j;
-                if (0 <= code && code <= 127) { /* SETCHAR */
-                    /* SETCHAR's suffix is written in uppercase hexadecimal */
-                    sprintf(suffix, "%02X", isuffix);
-                } else { /* 128 <= code && code <= 255; other DTL commands */
-                    /* other commands' suffices are written in decimal */
-                    sprintf(suffix, "%d", isuffix);
-                }
-                slen = strlen(suffix);
-                clen = plen + slen;
-                cmds[opcode] = (char*)gmalloc(clen + 1);
-                strcpy(cmds[opcode], prefix->name);
-                strcat(cmds[opcode], suffix);
-            }
-        } else {
-            /* command name = prefix */
-            plen = strlen(prefix->name);
-            clen = plen;
-            opcode = prefix->first_code;
-            cmds[opcode] = (char*)gmalloc(clen + 1);
-            strcpy(cmds[opcode], prefix->name);
+#ifdef HAVE_FORK
+    fp = open_memstream(&b->m.bytes, &b->m.len);
+#else
+    fp = tmpfile();
+#endif
+    if (fp == NULL) {
+        MSG_SATRT;
+        fprintf(msg_fp, "ERROR : cannot open memory for %s block (%s).\n",
+                (b->m.name != NULL ? DEFINE_STR : REPEAT_STR),
+                strerror(errno));
+        fail_status = DTL_ERROR_MEMORY;
+        dexit(EXIT_FAILURE);
+    }
+    return fp;
+} /* block_file */
+
+/* close a block's file, leaving its bytes in b->m */
+static void close_block_file(Block* b) {
+    int ok;
+
+#ifdef HAVE_FORK
+    ok = (fclose(b->fp) == 0);
+#else
+    long len = ftell(b->fp);
+
+    ok = (len >= 0 && fseek(b->fp, 0L, SEEK_SET) == 0);
+    if (ok) {
+        b->m.len = (size_t)len;
+        b->m.bytes = (char*)gmalloc(b->m.len + 1);
+        ok = (fread(b->m.bytes, 1, b->m.len, b->fp) == b->m.len);
+    }
+    fclose(b->fp);
+#endif
+    b->fp = NULL;
+    if (!ok) {
+        MSG_SATRT;
+        fprintf(msg_fp, "ERROR : cannot read back block begun at line ");
+        fprintf(msg_fp, COUNT_FMT, b->line);
+        fprintf(msg_fp, ".\n");
+        dexit(EXIT_FAILURE);
+    }
+} /* close_block_file */
+
+/** Write macro m's bytes, times times, into dvi,
+ *  and account for its commands and pushes, as though they were read.
+ *
+ * ## global var
+ *  + ncom
+ *  + post_info
+ */
+static void write_macro(const Macro* m, U4 times, FILE* dvi) {
+    for (U4 i = 0; i < times; i++) {
+        if (post_info.depth + m->max_depth > post_info.max_depth) {
+            post_info.max_depth = post_info.depth + m->max_depth;
         }
+        post_info.depth += m->depth;
+        ncom += m->ncom;
+        put_bytes(m->bytes, m->len, dvi);
     }
+} /* write_macro */
 
-    return 1; /* OK */
-} /* cons_cmds */
+/* the macro called name, or NULL if there is none */
+static Macro* find_macro(const char* name) {
+    for (size_t i = 0; i < nmacro; i++) {
+        if (strcmp(macro[i].name, name) == 0) {
+            return &macro[i];
+        }
+    }
+    return NULL;
+} /* find_macro */
+
+/* read a macro's name, in define or call */
+static void read_macro_name(FILE* dtl, Token name, const char* cmd) {
+    read_token(dtl, name);
 
-void free_cmds(CmdTable cmd_table) {
-    for (int i = 0; i < NCMDS; i++){ 
-        free(cmd_table[i]);
+    if (name[0] == '\0' || name[0] == BMES_CHAR || name[0] == BSEQ_CHAR
+        || name[0] == ESEQ_CHAR || (group && strcmp(name, ECOM) == 0)) {
+        MSG_SATRT;
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "macro name expected after %s, not \"%s\".\n", cmd,
+                name);
+        dexit(EXIT_FAILURE);
     }
-} /* free_cmds */
+} /* read_macro_name */
 
-/* read a (Line *) line from fp, return length */
-/* adapted from K&R (second, alias ANSI C, edition, 1988), page 165 */
-int get_line(FILE* fp, Line* line, int max) {
-    if (fgets(line->buf, max, fp) == NULL)
-        return 0;
-    else {
-        ++line->num;
-        line->wrote = strlen(line->buf);
-        line->read = 0;
-        return 1;
+/** Begin a define block (define != 0), or a repeat block,
+ *  whose commands are then encoded into memory.
+ *
+ * ## global var
+ *  + block
+ *  + nblock
+ *  + dvi_written
+ *  + ncom
+ *  + post_info
+ */
+void begin_block(FILE* dtl, int define) {
+    static DTL_TLS Token name = "";
+    Block* b;
+
+    if (nblock == MAX_BLOCK_DEPTH) {
+        MSG_SATRT;
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "blocks nested more than %d deep.\n",
+                MAX_BLOCK_DEPTH);
+        dexit(EXIT_FAILURE);
     }
-}
-/* get_line */
 
-/** read one character from dtl_line if possible,
- * otherwise read another dtl_line from fp
- * return 1 if a character is read, 0 if at end of fp file.
+    b = &block[nblock++];
+    memset(b, 0, sizeof(*b));
+    b->line = dtl_line.num;
+    if (define) {
+        read_macro_name(dtl, name, DEFINE_STR);
+        b->m.name = (char*)gmalloc(strlen(name) + 1);
+        strcpy(b->m.name, name);
+    } else {
+        b->count = get_unsigned(dtl);
+    }
+    b->fp = block_file(b);
+
+    b->dvi_written = dvi_written;
+    b->ncom = ncom;
+    b->depth = post_info.depth;
+    b->max_depth = post_info.max_depth;
+    dvi_written = 0;
+    ncom = 0;
+    post_info.depth = 0;
+    post_info.max_depth = 0;
+} /* begin_block */
+
+/** End the innermost block, which must be a define block (define != 0)
+ *  or a repeat block, as said; keep a macro, or write a repeat block
+ *  into the enclosing block, or the dvi file.
  *
  * ## global var
- *  + dtl_line
+ *  + block
+ *  + nblock
+ *  + macro
  */
-int read_line_char(FILE* fp, int* ch) {
-    if (dtl_line.wrote == 0 || dtl_line.read >= dtl_line.wrote) {
-        int line_status;
-        /* refill line buffer */
-        line_status = get_line(fp, &dtl_line, MAX_LINE);
-        if (line_status == 0) {
-            /* at end of DTL file */
-            if (debug) {
-                MSG_SATRT;
-                fprintf(stderr, "end of DTL file\n");
-                dinfo();
-            }
-            return 0;
+void end_block(int define, FILE* dvi) {
+    Block* b;
+
+    if (nblock == 0 || (block[nblock - 1].m.name != NULL) != define) {
+        MSG_SATRT;
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "%s without %s.\n",
+                (define ? ENDDEF_STR : ENDREPEAT_STR),
+                (define ? DEFINE_STR : REPEAT_STR));
+        dexit(EXIT_FAILURE);
+    }
+
+    b = &block[--nblock];
+    close_block_file(b);
+    b->m.ncom = ncom;
+    b->m.depth = post_info.depth;
+    b->m.max_depth = post_info.max_depth;
+
+    dvi_written = b->dvi_written;
+    ncom = b->ncom;
+    post_info.depth = b->depth;
+    post_info.max_depth = b->max_depth;
+
+    if (!define) {
+        write_macro(&b->m, b->count,
+                    (nblock > 0 ? block[nblock - 1].fp : dvi));
+        free(b->m.bytes);
+    } else {
+        Macro* m = find_macro(b->m.name);
+
+        if (m != NULL) {
+            /* defined again: later calls write the new definition */
+            free(m->name);
+            free(m->bytes);
         } else {
-            /* new DTL line was read */
-            if (debug) {
-                MSG_SATRT;
-                fprintf(stderr, "new DTL input line:\n");
-                fprintf(stderr, "\"%s\"\n", dtl_line.buf);
+            if (nmacro == max_macro) {
+                size_t max = (max_macro == 0 ? 16 : 2 * max_macro);
+                Macro* p = (Macro*)realloc(macro, max * sizeof(Macro));
+
+                if (p == NULL) {
+                    MSG_SATRT;
+                    fprintf(msg_fp, "ERROR : no memory for macros.\n");
+                    fail_status = DTL_ERROR_MEMORY;
+                    dexit(EXIT_FAILURE);
+                }
+                macro = p;
+                max_macro = max;
             }
+            m = &macro[nmacro++];
         }
+        *m = b->m;
     }
+} /* end_block */
 
-    *ch = dtl_line.buf[dtl_line.read++];
-    ++dtl_read;
-    ++com_read; /* count another DTL command character */
+/* call a macro: write its bytes into dvi */
+int call_macro(FILE* dtl, FILE* dvi) {
+    static DTL_TLS Token name = "";
+    Macro* m;
 
-    return 1;
-}
-/* read_line_char */
+    read_macro_name(dtl, name, CALL_STR);
+    m = find_macro(name);
+    if (m == NULL) {
+        MSG_SATRT;
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "macro \"%s\" is not defined.\n", name);
+        dexit(EXIT_FAILURE);
+    }
 
-/* Read next character, if any, from file fp. */
-/* Write it into *ch. */
-/* If no character is read, then *ch value < 0. */
-/* Return 1 if OK, 0 if EOF or error. */
+    write_macro(m, 1, dvi);
+
+    return 1; /* OK */
+} /* call_macro */
+
+/* check that a command may be in a block */
+void check_block_opcode(int opcode) {
+    if (opcode == BOP || opcode == EOP || (opcode >= 243 && opcode <= 249)) {
+        MSG_SATRT;
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "command \"%s\" cannot be in a %s block.\n",
+                dvi_op[opcode].name,
+                (block[nblock - 1].m.name != NULL ? DEFINE_STR : REPEAT_STR));
+        dexit(EXIT_FAILURE);
+    }
+} /* check_block_opcode */
+
+
+/** Page-parallel conversion.
+ *
+ * The indexed DTL file is split at its bop commands.
+ * dt2dv encodes the preamble itself, then forks jobs, each of which
+ * encodes a run of pages into its own temporary file, noting in a PageRec
+ * the DVI size of each page and the bop address that the DTL gave for it,
+ * and writing its messages into a temporary file of its own.
+ * dt2dv then goes through the pages in order: it checks each bop's
+ * address, as xfer_bop_address would, shows the page's messages,
+ * and copies the page into the dvi file, with the bop address patched.
+ * Finally it encodes the postamble itself, now that all the addresses
+ * are known.  So the DVI file and messages are as from a serial run.
+ * A page that a job could not finish, or whose last command read on
+ * into the next page, is where dt2dv goes on alone, serially.
+ */
+
+/* shared memory for n PageRecs, zeroed; NULL if there is none */
+static PageRec* alloc_page_recs(size_t n) {
+#ifdef HAVE_FORK
+    FILE* fp = tmpfile();
+    void* p = MAP_FAILED;
+
+    if (fp != NULL && ftruncate(fileno(fp), n * sizeof(PageRec)) == 0) {
+        p = mmap(NULL, n * sizeof(PageRec), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fileno(fp), 0);
+    }
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    return (p == MAP_FAILED ? NULL : (PageRec*)p);
+#else
+    (void)n;
+    return NULL;
+#endif
+} /* alloc_page_recs */
+
+/* open a temporary file, for a job */
+static FILE* job_tmpfile(void) {
+    FILE* fp = tmpfile();
+
+    if (fp == NULL) {
+        MSG_SATRT;
+        fprintf(msg_fp, "ERROR : cannot open temporary file for job (%s).\n",
+                strerror(errno));
+        dexit(EXIT_FAILURE);
+    }
+    return fp;
+} /* job_tmpfile */
+
+/* Point the reader at the start of page k, or of the postamble */
+/* if k is the number of pages. */
+static void seek_page(size_t k) {
+    if (k < dtl_index.nbop) {
+        map_seek(dtl_index.bop[k], dtl_index.bop_line[k]);
+    } else {
+        map_seek(dtl_index.post, dtl_index.post_line);
+    }
+} /* seek_page */
+
+/* position in DTL text where page k ends */
+static size_t page_end(size_t k) {
+    return (k + 1 < dtl_index.nbop ? dtl_index.bop[k + 1] : dtl_index.post);
+} /* page_end */
+
+/** Encode DTL pages in parallel jobs, then assemble the DVI file.
+ *
+ * ## global var
+ *  + dtl_index
+ *  + jobs
+ *  + dvi_written
+ *  + last_bop_address
+ */
+int dt2dv_pages(FILE* dtl, FILE* dvi) {
+#ifdef HAVE_FORK
+    size_t npages = dtl_index.nbop;
+    size_t njobs = ((size_t)jobs < npages ? (size_t)jobs : npages);
+    size_t total;          /* DTL bytes in all pages */
+    size_t first, last;    /* pages of a job */
+    size_t j, k;
+    PageRec* rec;
+    FILE** out;            /* each job's DVI pages */
+    FILE** err;            /* each job's messages */
+    FILE** fonts;          /* each job's font definitions, for -post */
+    pid_t* pid;
+    size_t* job_of;        /* job that encodes each page */
+
+    /* preamble, and anything else before the first page */
+    read_commands(dtl, dvi, dtl_index.bop[0]);
+
+    rec = (map_pos() == dtl_index.bop[0] ? alloc_page_recs(npages) : NULL);
+    if (rec == NULL) {
+        read_commands(dtl, dvi, DTL_INDEX_NONE);
+        return 1;
+    }
+
+    out = (FILE**)gmalloc(njobs * sizeof(FILE*));
+    err = (FILE**)gmalloc(njobs * sizeof(FILE*));
+    fonts = (FILE**)gmalloc(njobs * sizeof(FILE*));
+    pid = (pid_t*)gmalloc(njobs * sizeof(pid_t));
+    job_of = (size_t*)gmalloc(npages * sizeof(size_t));
+
+    /* nothing buffered may be written twice */
+    fflush(dvi);
+    fflush(stdout);
+    fflush(msg_fp);
+
+    /* give each job a run of pages, of about equal DTL size */
+    total = (dtl_index.post != DTL_INDEX_NONE ? dtl_index.post
+                                               : dtl_index.size)
+            - dtl_index.bop[0];
+    for (j = 0, first = 0; j < njobs; j++, first = last + 1) {
+        size_t share = total / njobs * (j + 1) + dtl_index.bop[0];
+
+        last = first;
+        while (last + 1 < npages && npages - (last + 1) > njobs - 1 - j
+               && (j + 1 == njobs || page_end(last) < share)) {
+            ++last;
+        }
+        for (k = first; k <= last; k++) {
+            job_of[k] = j;
+        }
+
+        out[j] = job_tmpfile();
+        err[j] = job_tmpfile();
+        fonts[j] = (auto_post ? job_tmpfile() : NULL);
+        pid[j] = fork();
+        if (pid[j] < 0) {
+            MSG_SATRT;
+            fprintf(msg_fp, "ERROR : cannot fork job (%s).\n",
+                    strerror(errno));
+            dexit(EXIT_FAILURE);
+        } else if (pid[j] == 0) {
+            /* job: messages go to its own file */
+            if (dup2(fileno(err[j]), fileno(msg_fp)) < 0) {
+                exit(EXIT_FAILURE);
+            }
+            job_fonts = fonts[j];
+            encode_pages(dtl, out[j], rec, first, last);
+            fflush(out[j]);
+            if (job_fonts != NULL) {
+                fflush(job_fonts);
+            }
+            exit(EXIT_SUCCESS);
+        }
+    }
+
+    for (j = 0; j < njobs; j++) {
+        /* a job that failed has left its pages not done */
+        while (waitpid(pid[j], NULL, 0) < 0 && errno == EINTR) {
+            continue;
+        }
+        rewind(out[j]);
+        rewind(err[j]);
+    }
+
+    /* serial pass: bop addresses, messages, and DVI bytes, in page order */
+    for (k = 0; k < npages && rec[k].done; k++) {
+        j = job_of[k];
+        copy_page(out[j], &rec[k], err[j], fonts[j], dvi);
+        dtl_read += rec[k].dtl_bytes;
+        ncom += rec[k].ncom;
+        dtl_line.num = rec[k].lines;
+    }
+
+    for (j = 0; j < njobs; j++) {
+        fclose(out[j]);
+        fclose(err[j]);
+        if (fonts[j] != NULL) {
+            fclose(fonts[j]);
+        }
+    }
+    free(out);
+    free(err);
+    free(fonts);
+    free(pid);
+    free(job_of);
+    munmap(rec, npages * sizeof(PageRec));
+
+    /* If a job failed in page k, or read on beyond it, read on from there, */
+    /* so that the outcome is as in a serial run. */
+    /* Otherwise, now that the last bop address is known, read postamble. */
+    if (k < npages || dtl_index.post != DTL_INDEX_NONE) {
+        seek_page(k);
+        read_commands(dtl, dvi, DTL_INDEX_NONE);
+    }
+#else
+    read_commands(dtl, dvi, DTL_INDEX_NONE);
+#endif
+
+    return 1; /* OK */
+} /* dt2dv_pages */
+
+/** In a job, encode pages first to last into file out,
+ *  and report on each in rec[].
+ *
+ * ## global var
+ *  + page_rec
+ *  + dvi_written
+ *  + dtl_read
+ *  + ncom
+ */
+void encode_pages(FILE* dtl, FILE* out, PageRec* rec, size_t first,
+                  size_t last) {
+    for (size_t k = first; k <= last; k++) {
+        page_rec = &rec[k];
+        page_rec->err_start = ftell(msg_fp);
+        page_rec->fonts_start = (job_fonts != NULL ? ftell(job_fonts) : 0);
+        post_info.max_depth = 0;
+
+        dvi_written = 0;
+        dtl_read = 0;
+        ncom = 0;
+        seek_page(k);
+        read_commands(dtl, out, page_end(k));
+
+        page_rec->dvi_bytes = dvi_written;
+        page_rec->dtl_bytes = dtl_read;
+        page_rec->ncom = ncom;
+        page_rec->lines = dtl_line.num;
+        page_rec->err_end = ftell(msg_fp);
+        page_rec->fonts_end = (job_fonts != NULL ? ftell(job_fonts) : 0);
+        page_rec->max_depth = post_info.max_depth;
+        /* a command that read on into the next page spoils both */
+        page_rec->done = (page_end(k) == DTL_INDEX_NONE
+                          || map_pos() == page_end(k));
+        if (!page_rec->done) break;
+    }
+    page_rec = NULL;
+} /* encode_pages */
+
+/* remember the font definitions of a page, from its job's font file */
+static void read_job_fonts(FILE* fonts, PageRec* rec) {
+    if (fseek(fonts, rec->fonts_start, SEEK_SET) != 0) {
+        MSG_SATRT;
+        fprintf(msg_fp, "ERROR : cannot read fonts back from job's file.\n");
+        dexit(EXIT_FAILURE);
+    }
+
+    while (ftell(fonts) < rec->fonts_end) {
+        U4 k;
+        size_t len;
+        Byte* def;
+
+        if (fread(&k, sizeof(k), 1, fonts) != 1
+            || fread(&len, sizeof(len), 1, fonts) != 1) {
+            MSG_SATRT;
+            fprintf(msg_fp,
+                    "ERROR : cannot read fonts back from job's file.\n");
+            dexit(EXIT_FAILURE);
+        }
+        def = (Byte*)gmalloc(len);
+        if (fread(def, 1, len, fonts) != len) {
+            MSG_SATRT;
+            fprintf(msg_fp,
+                    "ERROR : cannot read fonts back from job's file.\n");
+            dexit(EXIT_FAILURE);
+        }
+        note_font(k, def, len);
+        free(def);
+    }
+} /* read_job_fonts */
+
+/** Copy a page's DVI bytes from its job's file to the dvi file,
+ *  with its bop address corrected, after the page's messages;
+ *  and account for the page in post_info.
+ *
+ * ## global var
+ *  + dvi_written
+ *  + last_bop_address
+ *  + post_info
+ */
+int copy_page(FILE* page, PageRec* rec, FILE* err, FILE* fonts, FILE* dvi) {
+    Byte buf[LSTR_SIZE];
+    S4 count0;
+    COUNT left = rec->dvi_bytes;
+    size_t n;
+    int ch;
+
+    if (left < BOP_ADDRESS_OFFSET + 4) {
+        MSG_SATRT;
+        fprintf(msg_fp, "INTERNAL ERROR : page of ");
+        fprintf(msg_fp, COUNT_FMT, left);
+        fprintf(msg_fp, " bytes is too short for a bop.\n");
+        dexit(EXIT_FAILURE);
+    }
+
+    /* as xfer_bop_address would have done, in page order */
+    if (!rec->bop_auto && rec->bop_address != last_bop_address
+        && warn_counted(WARN_BOP_ADDRESS, rec->bop_line, __FILE__, __LINE__,
+                        "xfer_bop_address")) {
+        warn_address("previous bop", rec->bop_address, last_bop_address);
+    }
+
+    if (err != NULL && fseek(err, rec->err_start, SEEK_SET) == 0) {
+        int at_line_start = 1;
+        int show = 1; /* show the current line */
+
+        for (long i = rec->err_start; i < rec->err_end; i++) {
+            if ((ch = getc(err)) == EOF) break;
+            if (at_line_start && ch == WARN_MARK) {
+                /* a counted warning: count it here, in page order */
+                int kind = getc(err) - 'A';
+
+                ++i;
+                if (kind >= 0 && kind < NWARN) {
+                    show = (++warn_count[kind] <= max_warnings && !quiet);
+                }
+                continue;
+            }
+            if (show) {
+                putc(ch, msg_fp);
+            }
+            at_line_start = (ch == '\n');
+            if (at_line_start) {
+                show = 1;
+            }
+        }
+    }
+
+    n = fread(buf, 1, BOP_ADDRESS_OFFSET + 4, page);
+    if (n < BOP_ADDRESS_OFFSET + 4 || buf[0] != BOP) {
+        MSG_SATRT;
+        fprintf(msg_fp, "INTERNAL ERROR : page does not begin with bop.\n");
+        dexit(EXIT_FAILURE);
+    }
+    count0 = (S4)(((U4)buf[1] << 24) | ((U4)buf[2] << 16) | ((U4)buf[3] << 8)
+                  | (U4)buf[4]);
+    for (int i = 0; i < 4; i++) {
+        buf[BOP_ADDRESS_OFFSET + i] =
+            (Byte)(((U4)last_bop_address >> (8 * (3 - i))) & 0xFF);
+    }
+    last_bop_address = dvi_written;
+
+    ++post_info.pages;
+    if (rec->max_depth > post_info.max_depth) {
+        post_info.max_depth = rec->max_depth;
+    }
+    if (fonts != NULL) {
+        read_job_fonts(fonts, rec);
+    }
+
+    do {
+        put_bytes((const char*)buf, n, dvi);
+        left -= n;
+        n = fread(buf, 1, (left < sizeof(buf) ? left : sizeof(buf)), page);
+    } while (n > 0);
+
+    if (left != 0) {
+        MSG_SATRT;
+        fprintf(msg_fp, "ERROR : cannot read page back from job's file.\n");
+        dexit(EXIT_FAILURE);
+    }
+
+    page_done(dvi, count0);
+
+    return 1; /* OK */
+} /* copy_page */
+
+#ifdef CLOCK_MONOTONIC
+/* milliseconds since *t */
+static long ms_since(const struct timespec* t) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long)(now.tv_sec - t->tv_sec) * 1000
+           + (now.tv_nsec - t->tv_nsec) / 1000000;
+} /* ms_since */
+#endif
+
+/** A page, from its bop at last_bop_address to its eop, has been written:
+ *  flush it, for -flush, and report it, for -progress.
+ *
+ * With -coalesce, the page is held, with any pages before it, until the
+ * oldest of them has waited coalesce_ms, or they fill half the buffer;
+ * get_line also flushes them before it waits for DTL text.
+ *
+ * ## global var
+ *  + flush_pages
+ *  + flush_pending
+ *  + progress
+ */
+void page_done(FILE* dvi, S4 count0) {
+    if (flush_pages) {
+#ifdef CLOCK_MONOTONIC
+        if (!flush_pending) {
+            clock_gettime(CLOCK_MONOTONIC, &flush_pending_since);
+        }
+        flush_pending = 1;
+        /* flush before the buffer fills, and would split the next page */
+        if (ms_since(&flush_pending_since) >= coalesce_ms
+            || dvi_written - flushed_at > FLUSH_BUF_SIZE / 2) {
+            flush_dvi(dvi);
+        }
+#else
+        flush_dvi(dvi);
+#endif
+    }
+
+    if (progress) {
+        /* page number, \count0, and where the page lies in the DVI file */
+        fprintf(msg_fp, "[page] " U4_FMT " ", post_info.pages);
+        fprintf(msg_fp, S4_FMT " ", count0);
+        fprintf(msg_fp, WORD_FMT " ", last_bop_address);
+        fprintf(msg_fp, COUNT_FMT "\n", dvi_written);
+    }
+} /* page_done */
+
+/* write out the pages held for -flush */
+void flush_dvi(FILE* dvi) {
+    if (fflush(dvi) == EOF) {
+        MSG_SATRT;
+        fprintf(msg_fp, "DVI FILE ERROR (%s) : cannot write to dvi file.\n",
+                dvi_filename);
+        fail_status = DTL_ERROR_OUTPUT;
+        dexit(EXIT_FAILURE);
+    }
+    flush_pending = 0;
+    flushed_at = dvi_written;
+} /* flush_dvi */
+
+/** Open the DVI file of the last run, and read its manifest into *old,
+ *  if they can be trusted to match each other, and this run.
+ *
+ *  @return the old DVI file, or NULL if no page is to be reused.
+ */
+static FILE* open_old(DtlManifest* old, FILE* dvi) {
+    FILE* fp = NULL;
+    const char* why = NULL;
+
+    if (manifest_file == NULL || old_dvi_file == NULL) {
+        return NULL;
+    }
+
+    if (auto_post) {
+        /* the postamble would lack the fonts of pages not encoded */
+        why = "is not used with -post";
+    } else if ((fp = fopen(old_dvi_file, "rb")) == NULL) {
+        why = "cannot be opened";
+    } else if (!dtl_manifest_read(old, manifest_file)) {
+        why = "has no manifest";
+    } else if (old->group != group) {
+        why = "was built with another -group";
+    } else {
+        struct stat st, dvi_st;
+
+        if (fstat(fileno(fp), &st) != 0 || (size_t)st.st_size != old->dvi_size) {
+            why = "does not match its manifest";
+        } else if (fstat(fileno(dvi), &dvi_st) == 0
+                   && st.st_dev == dvi_st.st_dev
+                   && st.st_ino == dvi_st.st_ino) {
+            why = "is the output DVI file";
+        }
+    }
+
+    if (why != NULL) {
+        WARN_SATRT;
+        fprintf(msg_fp, "old DVI file \"%s\" %s; encoding every page.\n",
+                old_dvi_file, why);
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        dtl_manifest_free(old);
+        return NULL;
+    }
+
+    return fp;
+} /* open_old */
+
+/* line of the DTL file where the bop address of page k is, */
+/* as dt2dv's reader would count it: the line of bop's last token */
+static COUNT bop_address_line(size_t k) {
+    size_t pos = dtl_index.bop[k];
+    COUNT line = dtl_index.bop_line[k];
+    int ntokens = 1 + 11 + (group ? 1 : 0); /* [BCOM] bop c0..c9 p */
+
+    while (ntokens-- > 0) {
+        size_t start = dtl_index_next(&dtl_index, dtl_index.start, pos);
+        const char* nl;
+
+        if (start == DTL_INDEX_NONE) break;
+        while ((nl = (const char*)memchr(dtl_index.text + pos, '\n',
+                                         start - pos)) != NULL) {
+            ++line;
+            pos = nl - dtl_index.text + 1;
+        }
+        pos = start + 1;
+    }
+
+    return line;
+} /* bop_address_line */
+
+/* copy page was from old DVI file, for the page whose bop's address */
+/* is at DTL line `line'; return 0 if it is not a page there */
+static int reuse_page(FILE* old_dvi, const DtlManifestPage* was, COUNT line,
+                      FILE* dvi) {
+    PageRec rec;
+
+    if (fseek(old_dvi, (long)was->offset, SEEK_SET) != 0
+        || getc(old_dvi) != BOP || fseek(old_dvi, -1L, SEEK_CUR) != 0) {
+        return 0;
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.dvi_bytes = was->dvi_bytes;
+    rec.bop_address = (S4)was->bop_address;
+    rec.bop_auto = was->bop_auto;
+    rec.bop_line = line;
+
+    return copy_page(old_dvi, &rec, NULL, NULL, dvi);
+} /* reuse_page */
+
+/** Page-by-page conversion, for -manifest.
+ *
+ * Each page's DTL text is hashed, and recorded with the page's place in
+ * the DVI file, in the manifest.  With -old, a page whose text has the
+ * same hash as a page in the last run's manifest is not encoded again:
+ * its bytes are copied from the old DVI file, as copy_page copies a job's
+ * page, with its bop address corrected.  The preamble and postamble are
+ * always encoded, as are pages whose text has changed.
+ * A page whose last command read on into the next page is where dt2dv
+ * goes on alone, as in dt2dv_pages; no manifest is written then.
+ *
+ * ## global var
+ *  + dtl_index
+ *  + manifest
+ *  + manifest_ok
+ */
+int dt2dv_incr(FILE* dtl, FILE* dvi) {
+    DtlManifest old;  /* pages of the last run */
+    FILE* old_dvi = NULL;
+    size_t npages = dtl_index.nbop;
+    size_t nreused = 0;
+    size_t k;
+    uint64_t defs = 0; /* hash of macro definitions, if any */
+
+    memset(&manifest, 0, sizeof(manifest));
+    manifest.group = group;
+    memset(&old, 0, sizeof(old));
+
+    if (use_old) {
+        old_dvi = open_old(&old, dvi);
+    }
+
+    /* preamble, and anything else before the first page */
+    read_commands(dtl, dvi, (npages > 0 ? dtl_index.bop[0] : DTL_INDEX_NONE));
+    manifest_ok = (npages == 0 || map_pos() == dtl_index.bop[0]);
+
+    if (npages > 0 && dtl_index.define != DTL_INDEX_NONE) {
+        /* a page that calls a macro changes when the macro does */
+        defs = dtl_index_hash(&dtl_index, 0, dtl_index.bop[0]);
+    }
+
+    for (k = 0; manifest_ok && k < npages; k++) {
+        size_t end = page_end(k);
+        size_t text_end = (end != DTL_INDEX_NONE ? end : dtl_index.size);
+        const DtlManifestPage* was = NULL;
+        DtlManifestPage page;
+
+        memset(&page, 0, sizeof(page));
+        page.hash = dtl_index_hash(&dtl_index, dtl_index.bop[k], text_end)
+                    ^ defs;
+        page.offset = dvi_written;
+
+        /* the last page of a file without postamble is always read, */
+        /* so that the reader ends as in a serial run */
+        if (old_dvi != NULL && end != DTL_INDEX_NONE) {
+            was = dtl_manifest_find(&old, page.hash, k);
+        }
+
+        if (was != NULL
+            && reuse_page(old_dvi, was, bop_address_line(k), dvi)) {
+            page.ncom = was->ncom;
+            page.bop_address = was->bop_address;
+            page.bop_auto = was->bop_auto;
+            ncom += was->ncom;
+            dtl_read += end - dtl_index.bop[k];
+            seek_page(k + 1);
+            ++nreused;
+        } else {
+            COUNT ncom_before = ncom;
+
+            read_commands(dtl, dvi, end);
+            page.ncom = ncom - ncom_before;
+            page.bop_address = bop_given;
+            page.bop_auto = bop_given_auto;
+            /* a command that read on into the next page spoils both */
+            manifest_ok = (end == DTL_INDEX_NONE || map_pos() == end);
+        }
+
+        page.dvi_bytes = dvi_written - page.offset;
+        if (!dtl_manifest_add(&manifest, &page)) {
+            MSG_SATRT;
+            fprintf(msg_fp, "MEMORY ALLOCATION ERROR : ");
+            fprintf(msg_fp, "no room for page manifest.\n");
+            dexit(EXIT_FAILURE);
+        }
+    }
+
+    /* the postamble, or what is left after a page that read on */
+    if (!manifest_ok || dtl_index.post != DTL_INDEX_NONE) {
+        read_commands(dtl, dvi, DTL_INDEX_NONE);
+    }
+
+    if (old_dvi != NULL) {
+        fclose(old_dvi);
+    }
+    if (old_dvi != NULL && !quiet) {
+        INFO_SATRT;
+        fprintf(msg_fp, "reused %zu of %zu page%s from \"%s\".\n", nreused,
+                npages, (npages == 1 ? "" : "s"), old_dvi_file);
+    }
+    dtl_manifest_free(&old);
+
+    return 1; /* OK */
+} /* dt2dv_incr */
+
+/** Write the manifest of the pages built, for -manifest;
+ *  or, if they could not all be recorded, remove any old manifest.
+ *
+ * ## global var
+ *  + manifest
+ *  + manifest_ok
+ */
+void write_manifest(void) {
+    if (!manifest_ok) {
+        WARN_SATRT;
+        fprintf(msg_fp, "no page manifest written to \"%s\" ", manifest_file);
+        fprintf(msg_fp, "(DTL file must be a regular file, split by bop).\n");
+        remove(manifest_file);
+    } else {
+        manifest.dvi_size = dvi_written;
+        if (!dtl_manifest_write(&manifest, manifest_file)) {
+            WARN_SATRT;
+            fprintf(msg_fp, "cannot write page manifest \"%s\" (%s).\n",
+                    manifest_file, strerror(errno));
+        }
+    }
+    dtl_manifest_free(&manifest);
+} /* write_manifest */
+
+/// used by: init_lstr[1], alloc_lstr[1].
+void* gmalloc(size_t size) {
+    void* p = NULL;
+
+    if (size < 1) {
+        MSG_SATRT;
+        fprintf(msg_fp, "INTERNAL ERROR : ");
+        fprintf(msg_fp, "unreasonable request to malloc %zd bytes\n", size);
+        dexit(EXIT_FAILURE);
+    }
+
+    p = malloc(size);
+    if (p == NULL) {
+        MSG_SATRT;
+        fprintf(msg_fp, "MEMORY ALLOCATION ERROR : ");
+        fprintf(msg_fp, "operating system failed to malloc %zd bytes\n", size);
+        fail_status = DTL_ERROR_MEMORY;
+        dexit(EXIT_FAILURE);
+    }
+    return (p);
+} /* gmalloc */
+
+
+void dinfo(void) {
+    MSG_SATRT;
+    fprintf(msg_fp, "Current DTL input line ");
+    fprintf(msg_fp, COUNT_FMT, dtl_line.num);
+    fprintf(msg_fp, " :\n");
+    fprintf(msg_fp, "\"%.*s\"\n", (int)dtl_line.wrote, dtl_line.buf);
+    fprintf(msg_fp, "Read ");
+    fprintf(msg_fp, COUNT_FMT, dtl_read);
+    fprintf(msg_fp, " DTL bytes (");
+    fprintf(msg_fp, COUNT_FMT, com_read);
+    fprintf(msg_fp, " in current command), wrote ");
+    fprintf(msg_fp, COUNT_FMT, dvi_written);
+    fprintf(msg_fp, " DVI bytes.\n");
+    fprintf(msg_fp, "Successfully interpreted ");
+    fprintf(msg_fp, COUNT_FMT, ncom);
+    fprintf(msg_fp, " DVI command%s.\n", (ncom == 1 ? "" : "s"));
+} /* dinfo */
+
+
+/** Stop, after an error: exit with status n;
+ *  or, in a libdtl call, return to it, for it to return fail_status.
+ */
+void dexit(int n) {
+    dinfo();
+    MSG_SATRT;
+    if (fail_jmp != NULL) {
+        fprintf(msg_fp, "conversion failed.\n");
+        longjmp(*fail_jmp, 1);
+    }
+    fprintf(msg_fp, "exiting with status %d.\n", n);
+    exit(n);
+} /* dexit */
+
+
+/** Start a conversion: no DTL read, nor DVI written, nor anything held.
+ *  Options, and the files' names, are as they were set.
+ */
+void init_state(void) {
+    dtl_line.num = 0;
+    dtl_line.max = 0;
+    dtl_line.wrote = 0;
+    dtl_line.read = MAX_LINE;
+    dtl_line.buf = linebuf;
+    memset(&dtl_index, 0, sizeof(dtl_index));
+    read_commands = read_commands_full;
+    dtl_pipe = NULL;
+    include_depth = 0;
+    nblock = 0;
+    macro = NULL;
+    nmacro = 0;
+    max_macro = 0;
+    memset(&string_lstr, 0, sizeof(LString));
+    memset(&area_lstr, 0, sizeof(LString));
+    memset(&font_lstr, 0, sizeof(LString));
+    memset(&include_lstr, 0, sizeof(LString));
+
+    dtl_read = 0;
+    dvi_written = 0;
+    last_bop_address = -1;
+    postamble_address = -1;
+    ncom = 0;
+    com_read = 0;
+    memset(&post_info, 0, sizeof(post_info));
+    job_fonts = NULL;
+    page_rec = NULL;
+    bop_given = 0;
+    bop_given_auto = 0;
+    memset(&manifest, 0, sizeof(manifest));
+    manifest_ok = 0;
+    memset(warn_count, 0, sizeof(warn_count));
+    page_count0 = 0;
+    flush_pending = 0;
+    flushed_at = 0;
+} /* init_state */
+
+/** End a conversion, whether it is done or has failed:
+ *  close and free all it holds, going back out of any include commands,
+ *  but leave its counts.
+ */
+void free_state(void) {
+    while (include_depth > 0) {
+        Include* in = &include[--include_depth];
+
+        if (in->fp != NULL) {
+            fclose(in->fp);
+        }
+        dtl_index_free(&dtl_index);
+        dtl_include_close(in->inc);
+        free(in->buf);
+        dtl_index = in->index;
+        dtl_pipe = in->pipe;
+        dtl_filename = in->filename;
+    }
+    dtl_index_free(&dtl_index);
+    dtl_pipe_close(dtl_pipe);
+    dtl_pipe = NULL;
+
+    while (nblock > 0) {
+        Block* b = &block[--nblock];
+
+        if (b->fp != NULL) {
+            fclose(b->fp);
+        }
+        free(b->m.name);
+        free(b->m.bytes);
+    }
+    for (size_t i = 0; i < nmacro; i++) {
+        free(macro[i].name);
+        free(macro[i].bytes);
+    }
+    free(macro);
+    macro = NULL;
+    nmacro = max_macro = 0;
+
+    clear_lstr(&string_lstr);
+    clear_lstr(&area_lstr);
+    clear_lstr(&font_lstr);
+    clear_lstr(&include_lstr);
+
+    for (size_t i = 0; i < post_info.nfont; i++) {
+        free(post_info.font[i].def);
+    }
+    free(post_info.font);
+    post_info.font = NULL;
+    post_info.nfont = post_info.maxfont = 0;
+} /* free_state */
+
+
+/* hash of a DTL command name, for cmd_hash */
+static unsigned hash_command(const char* name) {
+    unsigned h = 0;
+
+    while (*name != '\0') {
+        h = h * 31 + (unsigned char)*name++;
+    }
+    return h & (CMD_HASH_SIZE - 1);
+} /* hash_command */
+
+/* enter name, with code, in cmd_hash */
+static void hash_add(const char* name, int code) {
+    unsigned h = hash_command(name);
+
+    while (cmd_hash[h].name != NULL) {
+        h = (h + 1) & (CMD_HASH_SIZE - 1);
+    }
+    cmd_hash[h].name = name;
+    cmd_hash[h].code = code;
+} /* hash_add */
+
+/* code of the DTL command name in cmd_hash, or -1 */
+static int hash_find(const char* name) {
+    unsigned h = hash_command(name);
+
+    while (cmd_hash[h].name != NULL) {
+        if (strcmp(cmd_hash[h].name, name) == 0) {
+            return cmd_hash[h].code;
+        }
+        h = (h + 1) & (CMD_HASH_SIZE - 1);
+    }
+    return -1;
+} /* hash_find */
+
+/* how xfer_args transfers each kind of command */
+static const XferFn xfer_kind[NKINDS] = {
+    [KIND_SETCHAR] = xfer_none,     [KIND_CHAR] = xfer_char,
+    [KIND_RULE] = xfer_rule,        [KIND_NONE] = xfer_none,
+    [KIND_BOP] = xfer_bop,          [KIND_EOP] = xfer_eop,
+    [KIND_PUSH] = xfer_push,        [KIND_POP] = xfer_pop,
+    [KIND_MOVE] = xfer_move,        [KIND_SPECIAL] = xfer_special,
+    [KIND_FONT_DEF] = xfer_fontdef, [KIND_PRE] = xfer_pre,
+    [KIND_POST] = xfer_post,        [KIND_POSTPOST] = xfer_post_post,
+};
+
+/* Fill in dvi_op[], cmd_hash[] and xfer_op[], from DVI_COMMANDS. */
+void init_commands(void) {
+    init_dvi_ops();
+
+    memset(cmd_hash, 0, sizeof(cmd_hash));
+    for (int opcode = 0; opcode < NCMDS; opcode++) {
+        hash_add(dvi_op[opcode].name, opcode);
+        xfer_op[opcode] = xfer_kind[dvi_op[opcode].kind];
+    }
+
+    /* runs whose suffix is the width, 1 to 4, of an argument */
+    for (int i = 0; i < NRUNS; i++) {
+        const DviRun* run = &dvi_runs[i];
+
+        if (run->suffix >= 0 && run->suffix <= 1
+            && run->suffix + run->last - run->first == 4) {
+            hash_add(run->prefix, SIZED_CMD + run->first + 1 - run->suffix);
+        }
+    }
+} /* init_commands */
+
+/* read a (Line *) line from fp, return length */
+/* adapted from K&R (second, alias ANSI C, edition, 1988), page 165 */
+int get_line(FILE* fp, Line* line, int max) {
+    if (flush_pending && dtl_pipe != NULL && !dtl_pipe_ready(dtl_pipe)) {
+        /* pages held for -coalesce need not wait for the DTL writer */
+        flush_dvi(dvi_fp);
+    }
+    if ((dtl_pipe != NULL ? dtl_pipe_gets(dtl_pipe, line->buf, max)
+                          : fgets(line->buf, max, fp))
+        == NULL)
+        return 0;
+    else {
+        ++line->num;
+        line->wrote = strlen(line->buf);
+        line->read = 0;
+        return 1;
+    }
+}
+/* get_line */
+
+
+/** Reading mapped DTL text.
+ *
+ * dtl_line.buf then points into dtl_index.text, at the current line,
+ * and dtl_line.wrote == 0 only before the first line is read.
+ */
+
+/** Map the DTL file into memory, and index it, if possible.
+ *
+ * A file with characters that read_char would reject is read as a stream,
+ * so that it is diagnosed exactly as before.
+ *
+ * ## global var
+ *  + dtl_index
+ *  + dtl_line
+ *
+ *  @return 1 if mapped, 0 if dtl is to be read as a stream.
+ */
+int map_dtl(FILE* dtl) {
+    if (dtl_index_map(&dtl_index, dtl) == 0) {
+        return 0;
+    }
+
+    if (dtl_index_build(&dtl_index, group) == 0 || !dtl_index.clean) {
+        dtl_index_free(&dtl_index);
+        return 0;
+    }
+
+    dtl_line.buf = (char*)dtl_index.text;
+    dtl_line.wrote = 0;
+    dtl_line.read = 0;
+
+    if (debug) {
+        DEBUG_SATRT;
+        fprintf(msg_fp, "mapped %zd DTL bytes; %zd bop commands.\n",
+                dtl_index.size, dtl_index.nbop);
+    }
+
+    return 1;
+} /* map_dtl */
+
+/* position in mapped DTL text of the next character to read */
+size_t map_pos(void) {
+    if (dtl_line.wrote == 0) {
+        return 0;
+    }
+    return (size_t)(dtl_line.buf - dtl_index.text) + dtl_line.read;
+} /* map_pos */
+
+/* point line at the next line of mapped DTL text; */
+/* return 1 if there was one, 0 at end of text. */
+int map_line(Line* line) {
+    size_t pos = map_pos();
+    const char* nl;
+
+    if (pos >= dtl_index.size) {
+        return 0;
+    }
+
+    line->buf = (char*)dtl_index.text + pos;
+    nl = (const char*)memchr(line->buf, '\n', dtl_index.size - pos);
+    line->wrote = (nl != NULL ? nl - line->buf + 1 : dtl_index.size - pos);
+    line->read = 0;
+    ++line->num;
+
+    return 1;
+} /* map_line */
+
+/** Move the reader on to position pos of mapped DTL text,
+ * as though every character before pos had been read by read_char.
+ *
+ * ## global var
+ *  + dtl_line
+ *  + dtl_read
+ *  + com_read
+ */
+void map_advance(size_t pos) {
+    size_t now = map_pos();
+    size_t ls; /* start of current line */
+
+    if (pos <= now) {
+        return;
+    }
+    dtl_read += pos - now;
+    com_read += pos - now;
+
+    if (dtl_line.wrote == 0) {
+        (void)map_line(&dtl_line);
+    }
+
+    ls = (size_t)(dtl_line.buf - dtl_index.text);
+    if (pos > ls + dtl_line.wrote) {
+        /* character pos - 1 is on a later line: count the lines between */
+        const char* s = dtl_line.buf;
+        const char* last = s;
+        const char* stop = dtl_index.text + pos - 1;
+
+        while ((s = (const char*)memchr(s, '\n', stop - s)) != NULL) {
+            ++dtl_line.num;
+            last = ++s;
+        }
+        dtl_line.buf = (char*)last;
+        ls = (size_t)(last - dtl_index.text);
+        s = (const char*)memchr(last, '\n', dtl_index.size - ls);
+        dtl_line.wrote = (s != NULL ? s - last + 1 : dtl_index.size - ls);
+    }
+    dtl_line.read = pos - ls;
+} /* map_advance */
+
+/** Point the reader at position pos of mapped DTL text, on line line.
+ *
+ * ## global var
+ *  + dtl_line
+ */
+void map_seek(size_t pos, COUNT line) {
+    size_t ls = pos; /* start of line */
+    const char* nl;
+
+    while (ls > 0 && dtl_index.text[ls - 1] != '\n') {
+        --ls;
+    }
+
+    dtl_line.buf = (char*)dtl_index.text + ls;
+    nl = (const char*)memchr(dtl_line.buf, '\n', dtl_index.size - ls);
+    dtl_line.wrote = (nl != NULL ? nl - dtl_line.buf + 1 : dtl_index.size - ls);
+    dtl_line.read = pos - ls;
+    dtl_line.num = line;
+} /* map_seek */
+
+/** skip_space, by jumping to the next token start in dtl_index.
+ *
+ *  @return 1 if done, 0 if skip_space must read characters itself.
+ */
+int skip_space_map(int* ch, COUNT* count) {
+    size_t pos, start;
+
+    if (!INDEXED) {
+        return 0;
+    }
+
+    pos = map_pos();
+    start = dtl_index_next(&dtl_index, dtl_index.start, pos);
+    if (start != pos && pos < dtl_index.size
+        && !isspace((unsigned char)dtl_index.text[pos])) {
+        /* not between tokens, so the index cannot help */
+        return 0;
+    }
+
+    if (start == DTL_INDEX_NONE) {
+        /* only white space is left */
+        map_advance(dtl_index.size);
+        *ch = -1;
+        *count = dtl_index.size - pos;
+    } else {
+        /* read the token's first character, too */
+        map_advance(start + 1);
+        *ch = dtl_index.text[start];
+        *count = start + 1 - pos;
+    }
+
+    return 1;
+} /* skip_space_map */
+
+/* position just after the indexed token whose first character was read, */
+/* or DTL_INDEX_NONE if unknown */
+static size_t map_token_end(void) {
+    size_t pos;
+
+    if (!INDEXED) {
+        return DTL_INDEX_NONE;
+    }
+
+    pos = map_pos();
+    if (pos == 0 || !DTL_INDEX_BIT(dtl_index.start, pos - 1)) {
+        return DTL_INDEX_NONE;
+    }
+
+    return dtl_index_next(&dtl_index, dtl_index.end, pos);
+} /* map_token_end */
+
+/** read_misc, by copying the indexed token at once.
+ *
+ *  @return 1 if done, 0 if read_misc must read characters itself.
+ */
+int read_misc_map(Token token, COUNT* count) {
+    size_t pos = map_pos();
+    size_t end = map_token_end();
+
+    if (end == DTL_INDEX_NONE || end - pos >= MAXTOKLEN) {
+        return 0;
+    }
+
+    memcpy(token, dtl_index.text + pos, end - pos);
+    token[end - pos] = '\0';
+    *count = end - pos;
+
+    /* like read_misc, read a white space that ends the token */
+    if (end < dtl_index.size && isspace((unsigned char)dtl_index.text[end])) {
+        ++end;
+    }
+    map_advance(end);
+
+    return 1;
+} /* read_misc_map */
+
+/** read_mes, over the indexed string token.
+ *
+ *  @return 1 if done, 0 if read_mes must read characters itself.
+ */
+int read_mes_map(char* token, COUNT* count) {
+    size_t pos = map_pos();
+    size_t end = map_token_end();
+    int escape = 0;
+
+    if (end == DTL_INDEX_NONE || end - pos >= MAXTOKLEN) {
+        return 0;
+    }
+
+    for (const char* s = dtl_index.text + pos; s < dtl_index.text + end; s++) {
+        if (*s == ESC_CHAR && escape == 0) {
+            escape = 1;
+        } else {
+            /* including final EMES_CHAR */
+            *token++ = *s;
+            escape = 0;
+        }
+    }
+    *token = '\0';
+    *count = end - pos;
+    map_advance(end);
+
+    return 1;
+} /* read_mes_map */
+
+/** set_seq, writing each unescaped run of the indexed sequence at once.
+ *
+ *  @return 1 if done, 0 if set_seq must read characters itself.
+ */
+int set_seq_map(FILE* dvi) {
+    size_t end = map_token_end();
+    const char* s;
+    const char* stop; /* final ESEQ_CHAR */
+
+    if (end == DTL_INDEX_NONE) {
+        return 0;
+    }
+
+    s = dtl_index.text + map_pos();
+    stop = dtl_index.text + end - 1;
+    while (s < stop) {
+        const char* esc = (const char*)memchr(s, ESC_CHAR, stop - s);
+
+        if (esc == NULL) {
+            esc = stop;
+        }
+        /* every character is ASCII, so can use SETCHAR */
+        put_bytes(s, esc - s, dvi);
+        if (esc < stop) {
+            put_byte(esc[1], dvi);
+            esc += 2;
+        }
+        s = esc;
+    }
+    map_advance(end);
+
+    return 1;
+} /* set_seq_map */
+
+/** get_lstr's loop, over the indexed string token.
+ *
+ * Leaves the EMES_CHAR to be read by check_emes.
+ *
+ *  @return 1 if done, 0 if get_lstr must read characters itself.
+ */
+int get_lstr_map(LStringPtr lsp) {
+    size_t end = map_token_end();
+    const char* s;
+    const char* stop; /* final EMES_CHAR */
+
+    if (end == DTL_INDEX_NONE) {
+        return 0;
+    }
+
+    stop = dtl_index.text + end - 1;
+    s = dtl_index.text + map_pos();
+    if (lsp->fp == NULL && lsp->n == 0
+        && (size_t)(stop - s) > lsp->m - lsp->l) {
+        /* may not fit: let the slow way say where it overflows */
+        return 0;
+    }
+    for (; s < stop; s++) {
+        if (*s == ESC_CHAR) {
+            /* accept the next character literally */
+            ++s;
+        }
+        putch_lstr(*s, lsp);
+    }
+    map_advance(end - 1);
+
+    return 1;
+} /* get_lstr_map */
+
+/** read one character from dtl_line if possible,
+ * otherwise read another dtl_line from fp
+ * return 1 if a character is read, 0 if at end of fp file.
+ *
+ * ## global var
+ *  + dtl_line
+ */
+int read_line_char(FILE* fp, int* ch) {
+    if (dtl_line.wrote == 0 || dtl_line.read >= dtl_line.wrote) {
+        int line_status;
+        /* refill line buffer */
+        if (dtl_index.text != NULL) {
+            line_status = map_line(&dtl_line);
+        } else {
+            line_status = get_line(fp, &dtl_line, MAX_LINE);
+        }
+        if (line_status == 0) {
+            /* at end of DTL file */
+            if (debug) {
+                MSG_SATRT;
+                fprintf(msg_fp, "end of DTL file\n");
+                dinfo();
+            }
+            return 0;
+        } else {
+            /* new DTL line was read */
+            if (debug) {
+                MSG_SATRT;
+                fprintf(msg_fp, "new DTL input line:\n");
+                fprintf(msg_fp, "\"%.*s\"\n", (int)dtl_line.wrote,
+                        dtl_line.buf);
+            }
+        }
+    }
+
+    *ch = dtl_line.buf[dtl_line.read++];
+    ++dtl_read;
+    ++com_read; /* count another DTL command character */
+
+    return 1;
+}
+/* read_line_char */
+
+/* Read next character, if any, from file fp. */
+/* Write it into *ch. */
+/* If no character is read, then *ch value < 0. */
+/* Return 1 if OK, 0 if EOF or error. */
 int read_char(FILE* fp, int* ch) {
     int status = 1;
     int c; /* in case ch points awry, we still have something in c. */
@@ -612,13 +2349,13 @@ int read_char(FILE* fp, int* ch) {
     } else {
         if (c > 255) {
             MSG_SATRT;
-            fprintf(stderr,
+            fprintf(msg_fp,
                     "character %d not in range 0 to 255\n", c);
             dinfo();
             status = 0;
         } else if (!isprint(c) && !isspace(c)) {
             MSG_SATRT;
-            fprintf(stderr, "character %d %s.\n", c,
+            fprintf(msg_fp, "character %d %s.\n", c,
                     "not printable and not white space");
             dinfo();
             status = 0;
@@ -639,15 +2376,15 @@ int read_char(FILE* fp, int* ch) {
  */
 COUNT read_variety(FILE* dtl) {
     COUNT nread = 0; /* number of DTL bytes read by read_token */
-    static Token token = "";
+    static DTL_TLS Token token = "";
 
     /* read the DTL VARIETY keyword */
     nread += read_token(dtl, token);
     /* test whether signature begins correctly */
     if (strcmp(token, "variety") != 0) {
         ERROR_SATRT;
-        fprintf(stderr, "DTL FILE ERROR (%s) : ", dtl_filename);
-        fprintf(stderr, "DTL signature must begin with \"%s\", not \"%s\".\n",
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "DTL signature must begin with \"%s\", not \"%s\".\n",
                 "variety", token);
         dexit(EXIT_FAILURE);
     }
@@ -657,14 +2394,16 @@ COUNT read_variety(FILE* dtl) {
     /* test whether variety is correct */
     if (strcmp(token, VARIETY) != 0) {
         ERROR_SATRT;
-        fprintf(stderr, "DTL FILE ERROR (%s) : ", dtl_filename);
-        fprintf(stderr, "DTL variety must be \"%s\", not \"%s\".\n", 
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "DTL variety must be \"%s\", not \"%s\".\n",
                 VARIETY, token);
         dexit(EXIT_FAILURE);
     }
 
-    INFO_SATRT;
-    fprintf(stderr, "DTL variety '%s' is OK.\n", VARIETY);
+    if (!quiet && include_depth == 0) {
+        INFO_SATRT;
+        fprintf(msg_fp, "DTL variety '%s' is OK.\n", VARIETY);
+    }
 
     return nread; /* OK */
 } /* read_variety */
@@ -684,6 +2423,10 @@ COUNT skip_space(FILE* fp, int* ch) {
     COUNT count; /* number (0 or more) of whitespace characters read */
     int nchar;   /* number (0 or 1) of characters read by read_char */
 
+    if (skip_space_map(ch, &count)) {
+        return count;
+    }
+
     /* loop ends at:  end of fp file, or reading error, or not a white space */
     for (count = 0; ((nchar = read_char(fp, &c)) == 1 && isspace(c)); ++count) {
         /* otherwise, more white spaces to skip */
@@ -691,9 +2434,9 @@ COUNT skip_space(FILE* fp, int* ch) {
             /* report when each DTL end of line is reached */
             if (c == '\n') {
                 DEBUG_SATRT;
-                fprintf(stderr, "end of DTL line (at least) ");
-                fprintf(stderr, COUNT_FMT, dtl_line.num);
-                fprintf(stderr, "\n");
+                fprintf(msg_fp, "end of DTL line (at least) ");
+                fprintf(msg_fp, COUNT_FMT, dtl_line.num);
+                fprintf(msg_fp, "\n");
             }
         }
     }
@@ -730,7 +2473,7 @@ COUNT read_token(FILE* dtl, char* token) {
         strcpy(token, "");
         if (debug) {
             DEBUG_SATRT;
-            fprintf(stderr, "end of dtl file.\n");
+            fprintf(msg_fp, "end of dtl file.\n");
         }
     } else if (group && ch == BCOM_CHAR) {
         strcpy(token, BCOM);
@@ -753,7 +2496,7 @@ COUNT read_token(FILE* dtl, char* token) {
 
     if (debug) {
         DEBUG_SATRT;
-        fprintf(stderr, "token = \"%s\"\n", token);
+        fprintf(msg_fp, "token = \"%s\"\n", token);
     }
 
     return nread; /* number of bytes read from dtl file */
@@ -783,6 +2526,11 @@ CharStatus read_string_char(FILE* fp, int* ch) {
 COUNT read_misc(FILE* fp, Token token) {
     int c;
     int count;
+    COUNT nread;
+
+    if (read_misc_map(token, &nread)) {
+        return nread;
+    }
 
     /* loop ends at:  end of fp file, or reading error, or a space */
     for (count = 0; count <= MAXTOKLEN; ++count) {
@@ -813,6 +2561,10 @@ COUNT read_mes(FILE* fp, char* token) {
     int escape;      /* flag escape == 1 if previous character was ESC_CHAR */
     int ch;          /* current DTL character */
 
+    if (read_mes_map(token, &dtl_count)) {
+        return dtl_count;
+    }
+
     escape = 0;
     more = 1;
     dtl_count = 0;
@@ -865,81 +2617,196 @@ int unread_char(void) {
         status = 0; /* error */
     }
 
-    return status;
-} /* unread_char */
+    return status;
+} /* unread_char */
+
+int find_command(char* command, int* opcode) {
+    int code = hash_find(command);
+
+    if (code < 0 || code >= SIZED_CMD) {
+        return 0;
+    }
+    *opcode = code;
+
+    return 1;
+}
+/* find_command */
+
+/* find a command that is named without its suffix, as `r' for r1 to r4; */
+/* set *opcode to the opcode of its 1-byte form */
+int find_sized_command(char* command, int* opcode) {
+    int code = hash_find(command);
+
+    if (code < SIZED_CMD) {
+        return 0;
+    }
+    *opcode = code - SIZED_CMD;
+
+    return 1;
+}
+/* find_sized_command */
+
+/* transfer an unsuffixed command, whose 1-byte form has the given opcode, */
+/* and its arguments, from dtl to dvi file, in the smallest form */
+/* that fits its first argument */
+int xfer_sized(FILE* dtl, FILE* dvi, int opcode) {
+    S4 snum;
+    int n;
+
+    if (opcode == XXX1) {
+        special(dtl, dvi, 0);
+        return 1;
+    }
+    if (opcode == FNT_DEF1) {
+        fontdef(dtl, dvi, 0);
+        return 1;
+    }
+
+    snum = get_signed(dtl);
+
+    if (opcode == SET1 || opcode == PUT1 || opcode == FONT1) {
+        /* character or font number, unsigned except in 4 bytes */
+        if (opcode == SET1 && snum >= 0 && snum <= 127) {
+            put_byte(snum, dvi); /* SETCHAR */
+            return 1;
+        }
+        if (opcode == FONT1 && snum >= 0 && snum <= FNT_NUM_63 - FNT_NUM_0) {
+            put_byte(FNT_NUM_0 + snum, dvi); /* FONTNUM */
+            return 1;
+        }
+        n = (snum < 0 ? 4 : dvi_build_unsigned_width((U4)snum));
+    } else {
+        /* movement */
+        n = dvi_build_signed_width(snum);
+    }
+
+    if (debug) {
+        MSG_SATRT;
+        fprintf(msg_fp, "opcode %d, for ", opcode + n - 1);
+        fprintf(msg_fp, S4_FMT, snum);
+        fprintf(msg_fp, ".\n");
+    }
+
+    put_byte(opcode + n - 1, dvi);
+    put_signed(n, snum, dvi);
+
+    return 1; /* OK */
+}
+/* xfer_sized */
+
+int check_byte(int byte) {
+    if (byte < 0 || byte > 255) {
+        MSG_SATRT;
+        fprintf(msg_fp, "INTERNAL ERROR : ");
+        fprintf(msg_fp, "byte %d not in the range of 0 to 255.\n", byte);
+        dexit(EXIT_FAILURE);
+    }
+    return 1; /* OK */
+} /* check_byte */
+
+int xfer_args(FILE* dtl, FILE* dvi, int opcode) {
+    xfer_op[opcode](dtl, dvi, opcode);
+
+    return 1; /* OK */
+}
+/* xfer_args */
+
+/* setchar, nop, fnt_num and the undefined opcodes use no data */
+void xfer_none(FILE* dtl, FILE* dvi, int opcode) {
+}
+/* xfer_none */
+
+/* set, put, fnt: character or font number, unsigned except in 4 bytes */
+void xfer_char(FILE* dtl, FILE* dvi, int opcode) {
+    int n = dvi_op[opcode].suffix;
+
+    if (n == 4) {
+        xfer_signed(n, dtl, dvi);
+    } else {
+        xfer_unsigned(n, dtl, dvi);
+    }
+}
+/* xfer_char */
+
+/* set_rule, put_rule: height and width */
+void xfer_rule(FILE* dtl, FILE* dvi, int opcode) {
+    xfer_signed(4, dtl, dvi);
+    xfer_signed(4, dtl, dvi);
+}
+/* xfer_rule */
+
+/* bop: ten counts, and the previous bop's address */
+void xfer_bop(FILE* dtl, FILE* dvi, int opcode) {
+    word_t this_bop_address = dvi_written - 1;
+    S4 count0;
 
-int find_command(char* command, int* opcode) {
-    int found;
-    int i;
+    ++post_info.pages;
+    post_info.depth = 0;
 
-    found = 0;
-    for (i = 0; i < NCMDS; i++) {
-        if ((cmd_table[i] != 0) && (strcmp(command, cmd_table[i]) == 0)) {
-            found = 1;
-            break;
-        }
+    count0 = xfer_signed(4, dtl, dvi);
+    for (int i = 1; i < 10; i++) {
+        xfer_signed(4, dtl, dvi);
     }
+    xfer_bop_address(dtl, dvi);
+    last_bop_address = this_bop_address;
+    page_count0 = count0;
+}
+/* xfer_bop */
 
-    *opcode = i;
-
-    return found;
+void xfer_eop(FILE* dtl, FILE* dvi, int opcode) {
+    if (page_rec == NULL) {
+        /* a job's pages are done when dt2dv copies them */
+        page_done(dvi, page_count0);
+    }
 }
-/* find_command */
+/* xfer_eop */
 
-int check_byte(int byte) {
-    if (byte < 0 || byte > 255) {
-        MSG_SATRT;
-        fprintf(stderr, "INTERNAL ERROR : ");
-        fprintf(stderr, "byte %d not in the range of 0 to 255.\n", byte);
-        dexit(EXIT_FAILURE);
+void xfer_push(FILE* dtl, FILE* dvi, int opcode) {
+    if (++post_info.depth > post_info.max_depth) {
+        post_info.max_depth = post_info.depth;
     }
-    return 1; /* OK */
-} /* check_byte */
+}
+/* xfer_push */
 
-int xfer_args(FILE* dtl, FILE* dvi, int opcode) {
-    int n;
+void xfer_pop(FILE* dtl, FILE* dvi, int opcode) {
+    --post_info.depth;
+}
+/* xfer_pop */
 
-    if (opcode >= 0 && opcode <= 127)
-        ; /* SETCHAR uses no data */
-    else if (opcode >= 128 && opcode <= 170) {
-        word_t this_bop_address = last_bop_address;
+/* right, w, x, down, y, z: signed, in as many bytes as the suffix */
+void xfer_move(FILE* dtl, FILE* dvi, int opcode) {
+    int n = dvi_op[opcode].suffix;
 
-        if (opcode == 139) /* BOP */
-        {
-            this_bop_address = dvi_written - 1;
-        }
-        put_table(op_128_170, opcode, dtl, dvi);
-        if (opcode == 139) /* BOP */
-        {
-            xfer_bop_address(dtl, dvi);
-            last_bop_address = this_bop_address;
-        }
-    } else if (opcode >= 171 && opcode <= 234)
-        ; /* FONTNUM uses no data */
-    else if (opcode >= 235 && opcode <= 238)
-        put_table(fnt, opcode, dtl, dvi);
-    else if (opcode >= 239 && opcode <= 242) {
-        n = opcode - 238;
-        special(dtl, dvi, n);
-    } else if (opcode >= 243 && opcode <= 246) {
-        n = opcode - 242;
-        fontdef(dtl, dvi, n);
-    } else if (opcode == 247)
-        preamble(dtl, dvi);
-    else if (opcode == 248)
-        postamble(dtl, dvi);
-    else if (opcode == 249)
-        post_post(dtl, dvi);
-    else if (opcode >= 250 && opcode <= 255)
-        ; /* these, undefined, opcodes use no data */
-    else {
-        MSG_SATRT;
-        fprintf(stderr, "opcode %d not handled.\n", opcode);
+    if (n > 0) {
+        xfer_signed(n, dtl, dvi);
     }
+}
+/* xfer_move */
 
-    return 1; /* OK */
+void xfer_special(FILE* dtl, FILE* dvi, int opcode) {
+    special(dtl, dvi, dvi_op[opcode].suffix);
 }
-/* xfer_args */
+/* xfer_special */
+
+void xfer_fontdef(FILE* dtl, FILE* dvi, int opcode) {
+    fontdef(dtl, dvi, dvi_op[opcode].suffix);
+}
+/* xfer_fontdef */
+
+void xfer_pre(FILE* dtl, FILE* dvi, int opcode) {
+    preamble(dtl, dvi);
+}
+/* xfer_pre */
+
+void xfer_post(FILE* dtl, FILE* dvi, int opcode) {
+    postamble(dtl, dvi);
+}
+/* xfer_post */
+
+void xfer_post_post(FILE* dtl, FILE* dvi, int opcode) {
+    post_post(dtl, dvi);
+}
+/* xfer_post_post */
 
 /* Called _after_ a BSEQ_CHAR command */
 /* Read bytes from dtl file, */
@@ -953,6 +2820,11 @@ int set_seq(FILE* dtl, FILE* dvi) {
     int more;       /* sequence of font characters continuing? */
     int escape = 0; /* flag set if previous character was an escape */
     int ch;         /* character read from DTL file */
+
+    if (set_seq_map(dvi)) {
+        return status;
+    }
+
     more = 1;
     while (more) {
         /* ignore read_char status, to allow unprintable characters */
@@ -960,8 +2832,8 @@ int set_seq(FILE* dtl, FILE* dvi) {
         /* but check for end of dtl file, or serious file reading error */
         if (ch < 0) {
             MSG_SATRT;
-            fprintf(stderr, "end of dtl file, ");
-            fprintf(stderr, "or serious dtl file reading error\n");
+            fprintf(msg_fp, "end of dtl file, ");
+            fprintf(msg_fp, "or serious dtl file reading error\n");
             dinfo();
             more = 0;
             status = 0; /* bad news */
@@ -984,7 +2856,7 @@ int set_seq(FILE* dtl, FILE* dvi) {
                 } else {
                     MSG_SATRT;
                     fprintf(
-                        stderr,
+                        msg_fp,
                         "DTL character %d is not in range 0 to 255\n",
                         ch);
                     dexit(EXIT_FAILURE);
@@ -1005,11 +2877,11 @@ int set_seq(FILE* dtl, FILE* dvi) {
 U4 xfer_hex(int n, FILE* dtl, FILE* dvi) {
     U4 unum = 0;             /* at most this space needed */
     int nconv = 0;           /* number of arguments converted by sscanf */
-    static Token token = ""; /* DTL token */
+    static DTL_TLS Token token = ""; /* DTL token */
 
     if (n < 1 || n > 4) {
         MSG_SATRT;
-        fprintf(stderr,
+        fprintf(msg_fp,
                 "INTERNAL ERROR : asked for %d bytes.  Must be 1 "
                 "to 4.\n",
                 n);
@@ -1021,7 +2893,7 @@ U4 xfer_hex(int n, FILE* dtl, FILE* dvi) {
 
     if (nconv < 1) {
         MSG_SATRT;
-        fprintf(stderr, "DTL FILE ERROR (%s) :  %s \"%s\".\n",
+        fprintf(msg_fp, "DTL FILE ERROR (%s) :  %s \"%s\".\n",
                 dtl_filename, "hexadecimal number expected, not", token);
         dexit(EXIT_FAILURE);
     }
@@ -1037,11 +2909,11 @@ U4 xfer_hex(int n, FILE* dtl, FILE* dvi) {
 U4 xfer_oct(int n, FILE* dtl, FILE* dvi) {
     U4 unum = 0;             /* at most this space needed */
     int nconv = 0;           /* number of arguments converted by sscanf */
-    static Token token = ""; /* DTL token */
+    static DTL_TLS Token token = ""; /* DTL token */
 
     if (n < 1 || n > 4) {
         MSG_SATRT;
-        fprintf(stderr,
+        fprintf(msg_fp,
                 "INTERNAL ERROR : asked for %d bytes.  Must be 1 "
                 "to 4.\n",
                 n);
@@ -1053,7 +2925,7 @@ U4 xfer_oct(int n, FILE* dtl, FILE* dvi) {
 
     if (nconv < 1) {
         MSG_SATRT;
-        fprintf(stderr, "DTL FILE ERROR (%s) :  %s \"%s\".\n",
+        fprintf(msg_fp, "DTL FILE ERROR (%s) :  %s \"%s\".\n",
                 dtl_filename, "octal number expected, not", token);
         dexit(EXIT_FAILURE);
     }
@@ -1093,14 +2965,14 @@ S4 xfer_signed(int n, FILE* dtl, FILE* dvi) {
 U4 get_unsigned(FILE* dtl) {
     U4 unum = 0;             /* at most this space needed */
     int nconv = 0;           /* number of arguments converted by sscanf */
-    static Token token = ""; /* DTL token */
+    static DTL_TLS Token token = ""; /* DTL token */
 
     read_token(dtl, token);
     nconv = sscanf(token, U4_FMT, &unum);
 
     if (nconv < 1) {
         MSG_SATRT;
-        fprintf(stderr, "DTL FILE ERROR (%s) :  %s \"%s\".\n",
+        fprintf(msg_fp, "DTL FILE ERROR (%s) :  %s \"%s\".\n",
                 dtl_filename, "unsigned number expected, not", token);
         dexit(EXIT_FAILURE);
     }
@@ -1114,14 +2986,14 @@ U4 get_unsigned(FILE* dtl) {
 S4 get_signed(FILE* dtl) {
     S4 snum = 0;
     int nconv = 0;   /* number of sscanf arguments converted and assigned */
-    static Token token = "";
+    static DTL_TLS Token token = "";
 
     read_token(dtl, token);
     nconv = sscanf(token, S4_FMT, &snum);
 
     if (nconv < 1) {
         MSG_SATRT;
-        fprintf(stderr, "DTL FILE ERROR (%s) :  %s \"%s\".\n",
+        fprintf(msg_fp, "DTL FILE ERROR (%s) :  %s \"%s\".\n",
                 dtl_filename, "signed number expected, not", token);
         dexit(EXIT_FAILURE);
     }
@@ -1140,7 +3012,7 @@ int put_unsigned(int n, U4 unum, FILE* dvi) {
 
     if (n < 1 || n > 4) {
         MSG_SATRT;
-        fprintf(stderr,
+        fprintf(msg_fp,
                 "INTERNAL ERROR : asked for %d bytes.  Must "
                 "be 1 to 4.\n",
                 n);
@@ -1170,7 +3042,7 @@ int put_signed(int n, S4 snum, FILE* dvi) {
 
     if (n < 1 || n > 4) {
         MSG_SATRT;
-        fprintf(stderr,
+        fprintf(msg_fp,
                 "INTERNAL ERROR : asked for %d bytes.  Must be "
                 "1 to 4.\n",
                 n);
@@ -1188,6 +3060,61 @@ int put_signed(int n, S4 snum, FILE* dvi) {
 }
 /* put_signed */
 
+/* check that unsigned number unum fits in n bytes */
+int check_unsigned(int n, U4 unum) {
+    if (n < 4 && unum >> (8 * n) != 0) {
+        MSG_SATRT;
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "value ");
+        fprintf(msg_fp, U4_FMT, unum);
+        fprintf(msg_fp, " does not fit in %d byte%s.\n", n, (n == 1 ? "" : "s"));
+        dexit(EXIT_FAILURE);
+    }
+    return 1; /* OK */
+}
+/* check_unsigned */
+
+/* overwrite unsigned n-byte integer at byte position pos of dvi file, */
+/* then return to the end of the dvi file. */
+/* dvi_written is unchanged, as those bytes were counted when reserved. */
+/* return number of bytes written. */
+int patch_unsigned(int n, U4 unum, long pos, FILE* dvi) {
+    long end; /* current position of dvi file */
+    int i;
+
+    end = ftell(dvi);
+    if (end < 0 || fseek(dvi, pos, SEEK_SET) != 0) {
+        MSG_SATRT;
+        fprintf(msg_fp, "DVI FILE ERROR (%s) : ", dvi_filename);
+        fprintf(msg_fp, "cannot seek to byte %ld (%s).\n", pos,
+                strerror(errno));
+        fail_status = DTL_ERROR_OUTPUT;
+        dexit(EXIT_FAILURE);
+    }
+
+    /* Big-endian storage. */
+    for (i = n - 1; i >= 0; i--) {
+        if (putc((int)((unum >> (8 * i)) & 0xFF), dvi) == EOF) {
+            MSG_SATRT;
+            fprintf(msg_fp, "DVI FILE ERROR (%s) : ", dvi_filename);
+            fprintf(msg_fp, "cannot write to dvi file.\n");
+            fail_status = DTL_ERROR_OUTPUT;
+            dexit(EXIT_FAILURE);
+        }
+    }
+
+    if (fseek(dvi, end, SEEK_SET) != 0) {
+        MSG_SATRT;
+        fprintf(msg_fp, "DVI FILE ERROR (%s) : ", dvi_filename);
+        fprintf(msg_fp, "cannot seek back to byte %ld.\n", end);
+        fail_status = DTL_ERROR_OUTPUT;
+        dexit(EXIT_FAILURE);
+    }
+
+    return n;
+}
+/* patch_unsigned */
+
 /* check that a BMES_CHAR is the next non-whitespace character in dtl */
 int check_bmes(FILE* dtl) {
     int ch; /* next non-whitespace character in dtl */
@@ -1197,15 +3124,15 @@ int check_bmes(FILE* dtl) {
 
     if (ch < 0) {
         MSG_SATRT;
-        fprintf(stderr, "DTL FILE ERROR (%s) : ", dtl_filename);
-        fprintf(stderr, "end of dtl file, or reading error\n");
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "end of dtl file, or reading error\n");
         dexit(EXIT_FAILURE);
     }
 
     if (ch != BMES_CHAR) {
         MSG_SATRT;
-        fprintf(stderr, "DTL FILE ERROR (%s) : ", dtl_filename);
-        fprintf(stderr, "BMES_CHAR (`%c') %s, not `%c' (char %d).\n", BMES_CHAR,
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "BMES_CHAR (`%c') %s, not `%c' (char %d).\n", BMES_CHAR,
                 "expected before string", ch, ch);
         dexit(EXIT_FAILURE);
     }
@@ -1220,15 +3147,15 @@ int check_emes(FILE* dtl) {
 
     if (read_char(dtl, &ch) == 0) {
         MSG_SATRT;
-        fprintf(stderr, "DTL FILE ERROR (%s) : ", dtl_filename);
-        fprintf(stderr, "end of dtl file, or reading error\n");
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "end of dtl file, or reading error\n");
         dexit(EXIT_FAILURE);
     }
 
     if (ch != EMES_CHAR) {
         MSG_SATRT;
-        fprintf(stderr, "DTL FILE ERROR (%s) : ", dtl_filename);
-        fprintf(stderr, "EMES_CHAR (`%c') %s, not `%c' (char %d).\n", EMES_CHAR,
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "EMES_CHAR (`%c') %s, not `%c' (char %d).\n", EMES_CHAR,
                 "expected to follow string", ch, ch);
         dexit(EXIT_FAILURE);
     }
@@ -1247,16 +3174,79 @@ void init_lstr(LStringPtr lsp, size_t n) {
     lsp->l = 0;
     lsp->m = n;
     lsp->s = (char*)gmalloc(n);
+    lsp->n = 0;
+    lsp->dvi = NULL;
+    lsp->fp = NULL;
+    lsp->pos = -1;
+    lsp->op = -1;
 } /* init_lstr */
 
 /// used in: xfer_len_string, fontdef.
 void clear_lstr(LStringPtr lsp) {
+    if (lsp->fp != NULL && lsp->fp != lsp->dvi) {
+        fclose(lsp->fp); /* temporary file is removed when closed */
+    }
+    lsp->fp = NULL;
     lsp->l = 0;
     lsp->m = 0;
     free(lsp->s);
     lsp->s = NULL; /* to be sure */
 } /* clear_lstr */
 
+/** let *lsp, when full, stream on into dvi file, after a k[n] length field.
+ *
+ * used in: xfer_len_string.
+ */
+void stream_lstr(LStringPtr lsp, int n, FILE* dvi) {
+    lsp->n = n;
+    lsp->dvi = dvi;
+} /* stream_lstr */
+
+/** move the full in-memory part of *lsp out to a file.
+ *
+ * If the dvi file can seek, reserve k[n] there and write the string after it,
+ * so that only the length needs patching later;
+ * otherwise, hold the string in a temporary file until its length is known.
+ *
+ * used in: putch_lstr.
+ */
+void spill_lstr(LStringPtr lsp) {
+    size_t fw_ret;
+
+    lsp->pos = ftell(lsp->dvi);
+    if (lsp->pos >= 0 && fseek(lsp->dvi, 0L, SEEK_CUR) == 0) {
+        if (lsp->op >= 0) {
+            /* command whose form was to wait for the string's length */
+            put_byte(lsp->op, lsp->dvi);
+            ++(lsp->pos);
+        }
+        put_unsigned(lsp->n, 0, lsp->dvi); /* placeholder for k[n] */
+        lsp->fp = lsp->dvi;
+    } else {
+        lsp->pos = -1;
+        lsp->fp = tmpfile();
+        if (lsp->fp == NULL) {
+            MSG_SATRT;
+            fprintf(msg_fp, "ERROR : cannot open temporary file ");
+            fprintf(msg_fp, "for long string (%s).\n", strerror(errno));
+            fail_status = DTL_ERROR_OUTPUT;
+            dexit(EXIT_FAILURE);
+        }
+    }
+
+    fw_ret = fwrite(lsp->s, sizeof(char), lsp->l, lsp->fp);
+    if (fw_ret < lsp->l) {
+        MSG_SATRT;
+        fprintf(msg_fp, "ERROR : cannot write long string ");
+        fprintf(msg_fp, "(%zd of %zd bytes written).\n", fw_ret, lsp->l);
+        fail_status = DTL_ERROR_OUTPUT;
+        dexit(EXIT_FAILURE);
+    }
+    if (lsp->fp == lsp->dvi) {
+        dvi_written += fw_ret;
+    }
+} /* spill_lstr */
+
 /// [NOT_USED]
 LStringPtr alloc_lstr(size_t n) {
     LStringPtr lsp;
@@ -1279,12 +3269,27 @@ void free_lstr(LStringPtr lsp) {
  * used in: get_lstr
  */
 void putch_lstr(int ch, LStringPtr lsp) {
-    if (lsp->l >= lsp->m) {
+    if (lsp->fp != NULL) {
+        /* string has outgrown memory */
+        if (putc(ch, lsp->fp) == EOF) {
+            MSG_SATRT;
+            fprintf(msg_fp, "ERROR : cannot write long string.\n");
+            fail_status = DTL_ERROR_OUTPUT;
+            dexit(EXIT_FAILURE);
+        }
+        if (lsp->fp == lsp->dvi) {
+            ++dvi_written;
+        }
+        ++(lsp->l);
+    } else if (lsp->l < lsp->m) {
+        lsp->s[(lsp->l)++] = ch;
+    } else if (lsp->n > 0) {
+        spill_lstr(lsp);
+        putch_lstr(ch, lsp);
+    } else {
         MSG_SATRT;
-        fprintf(stderr, "ERROR : No more room in LString.\n");
+        fprintf(msg_fp, "ERROR : No more room in LString.\n");
         dexit(EXIT_FAILURE);
-    } else {
-        lsp->s[(lsp->l)++] = ch;
     }
 } /* putch_lstr */
 
@@ -1302,68 +3307,71 @@ size_t get_lstr(FILE* dtl, LStringPtr lsp) {
 
     if (debug) {
         MSG_SATRT;
-        fprintf(stderr, "entering get_lstr.\n");
+        fprintf(msg_fp, "entering get_lstr.\n");
     } /* if (debug) */
 
     check_bmes(dtl);
 
     if (debug) {
         MSG_SATRT;
-        fprintf(stderr, "string is: \"");
+        fprintf(msg_fp, "string is: \"");
     } /* if (debug) */
 
-    for (nch = 0; /***/; nch++) {
-        int ch;
+    if (!get_lstr_map(lsp)) {
+        for (nch = 0; /***/; nch++) {
+            int ch;
 
-        char_status = read_string_char(dtl, &ch);
-        if (char_status == CHAR_FAIL) {
-            /* end of dtl file, or reading error */
-            fprintf(stderr, "\n");
-            MSG_SATRT;
-            fprintf(stderr,
-                    "DTL FILE ERROR (%s) : ", dtl_filename);
-            fprintf(stderr, "cannot read string[");
-            fprintf(stderr, U4_FMT, nch);
-            fprintf(stderr, "] from dtl file.\n");
-            dexit(EXIT_FAILURE);
-        }
+            char_status = read_string_char(dtl, &ch);
+            if (char_status == CHAR_FAIL) {
+                /* end of dtl file, or reading error */
+                fprintf(msg_fp, "\n");
+                MSG_SATRT;
+                fprintf(msg_fp,
+                        "DTL FILE ERROR (%s) : ", dtl_filename);
+                fprintf(msg_fp, "cannot read string[");
+                fprintf(msg_fp, U4_FMT, nch);
+                fprintf(msg_fp, "] from dtl file.\n");
+                dexit(EXIT_FAILURE);
+            }
 
-        if (debug) {
-            fprintf(stderr, "%c", ch);
-        } /* if (debug) */
+            if (debug) {
+                fprintf(msg_fp, "%c", ch);
+            } /* if (debug) */
 
-        if (char_status == CHAR_EOS) {
-            if (ch != EMES_CHAR) {
+            if (char_status == CHAR_EOS) {
+                if (ch != EMES_CHAR) {
+                    MSG_SATRT;
+                    fprintf(msg_fp, "INTERNAL ERROR : ");
+                    fprintf(msg_fp, "char_status = CHAR_FAIL,\n");
+                    fprintf(msg_fp,
+                            "but ch = %c (char %d) is not "
+                            "EMES_CHAR = %c (char %d)\n",
+                            ch, ch, EMES_CHAR, EMES_CHAR);
+                    dexit(EXIT_FAILURE);
+                }
+                (void)unread_char();
+                break; /* end of string */
+            } else if (char_status == CHAR_OK) {
+                putch_lstr(ch, lsp);
+            } else {
                 MSG_SATRT;
-                fprintf(stderr, "INTERNAL ERROR : ");
-                fprintf(stderr, "char_status = CHAR_FAIL,\n");
-                fprintf(
-                    stderr,
-                    "but ch = %c (char %d) is not EMES_CHAR = %c (char %d)\n",
-                    ch, ch, EMES_CHAR, EMES_CHAR);
+                fprintf(msg_fp, "INTERNAL ERROR : ");
+                fprintf(msg_fp, "char_status = %d is unfamiliar!\n",
+                        char_status);
                 dexit(EXIT_FAILURE);
-            }
-            (void)unread_char();
-            break; /* end of string */
-        } else if (char_status == CHAR_OK) {
-            putch_lstr(ch, lsp);
-        } else {
-            MSG_SATRT;
-            fprintf(stderr, "INTERNAL ERROR : ");
-            fprintf(stderr, "char_status = %d is unfamiliar!\n", char_status);
-            dexit(EXIT_FAILURE);
-        } // end if (char_status <=>)
-    } /* end for (nch = 0 ;; nch++) */
+            } // end if (char_status <=>)
+        } /* end for (nch = 0 ;; nch++) */
+    }
 
     if (debug) {
-        fprintf(stderr, "\".\n");
+        fprintf(msg_fp, "\".\n");
     } /* if (debug) */
 
     check_emes(dtl);
 
     if (debug) {
         MSG_SATRT;
-        fprintf(stderr, "leaving get_lstr.\n");
+        fprintf(msg_fp, "leaving get_lstr.\n");
     } /* if (debug) */
 
     return lsp->l;
@@ -1373,93 +3381,213 @@ size_t get_lstr(FILE* dtl, LStringPtr lsp) {
 void put_lstr(LStringPtr lsp, FILE* dvi) {
     size_t fw_ret;
 
-    fw_ret = fwrite(lsp->s, sizeof(char), lsp->l, dvi);
+    if (lsp->fp == dvi) {
+        /* string was already streamed into dvi file */
+        return;
+    }
+
+    if (lsp->fp == NULL) {
+        fw_ret = fwrite(lsp->s, sizeof(char), lsp->l, dvi);
+    } else {
+        /* copy string back from its temporary file, using s as buffer */
+        size_t fr_ret;
+
+        rewind(lsp->fp);
+        fw_ret = 0;
+        while ((fr_ret = fread(lsp->s, sizeof(char), lsp->m, lsp->fp)) > 0) {
+            size_t nw = fwrite(lsp->s, sizeof(char), fr_ret, dvi);
+            fw_ret += nw;
+            if (nw < fr_ret) break;
+        }
+    }
     dvi_written += fw_ret;
 
     if (fw_ret < lsp->l) {
         MSG_SATRT;
-        fprintf(stderr,
+        fprintf(msg_fp,
                 "DVI File ERROR : not all bytes written ");
-        fprintf(stderr, "(%zd of %zd).\n", fw_ret, lsp->l);
+        fprintf(msg_fp, "(%zd of %zd).\n", fw_ret, lsp->l);
         dexit(EXIT_FAILURE);
     }
 } /* put_lstr */
 
 /** transfer (length and) quoted string from dtl to dvi file,
  * return number of bytes written to dvi file.
+ *
+ * If n is 0, the command is not yet written: op is the opcode of its
+ * 1-byte form, and the smallest k[n] that fits the string is chosen.
+ * A string that outgrows memory gets k[4], as it may stream into the
+ * dvi file before its length is known.
  */
-U4 xfer_len_string(int n, FILE* dtl, FILE* dvi) {
+U4 xfer_len_string(int n, int op, FILE* dtl, FILE* dvi) {
     U4 k, k2;
-    LString lstr;
 
     if (debug) {
         MSG_SATRT;
-        fprintf(stderr, "entering xfer_len_string.\n");
+        fprintf(msg_fp, "entering xfer_len_string.\n");
     } /* if (debug) */
 
-    init_lstr(&lstr, LSTR_SIZE);
+    init_lstr(&string_lstr, LSTR_SIZE);
+    /* a long string streams into dvi, rather than being held in memory */
+    if (n == 0) {
+        stream_lstr(&string_lstr, 4, dvi);
+        string_lstr.op = op + 3;
+    } else {
+        stream_lstr(&string_lstr, n, dvi);
+    }
 
     /* k[n] : length of special string */
     k = get_unsigned(dtl);
     if (debug) {
         MSG_SATRT;
-        fprintf(stderr, "string's nominal length k = ");
-        fprintf(stderr, U4_FMT, k);
-        fprintf(stderr, " characters.\n");
+        fprintf(msg_fp, "string's nominal length k = ");
+        fprintf(msg_fp, U4_FMT, k);
+        fprintf(msg_fp, " characters.\n");
     } /* if (debug) */
 
-    k2 = get_lstr(dtl, &lstr);
-    if (k2 != k) {
-        MSG_SATRT;
-        fprintf(stderr, "WARNING : string length (");
-        fprintf(stderr, U4_FMT, k);
-        fprintf(stderr, ") in DTL file is wrong\n");
-        fprintf(stderr, "Writing correct value (");
-        fprintf(stderr, U4_FMT, k2);
-        fprintf(stderr, ") to DVI file\n");
+    k2 = get_lstr(dtl, &string_lstr);
+    if (k2 != k && WARN_COUNTED(WARN_STRING_LENGTH)) {
+        fprintf(msg_fp, "string length ");
+        fprintf(msg_fp, U4_FMT, k);
+        fprintf(msg_fp, " is wrong; writing ");
+        fprintf(msg_fp, U4_FMT, k2);
+        fprintf(msg_fp, ".\n");
     }
 
-    put_unsigned(n, k2, dvi);
-    put_lstr(&lstr, dvi);
+    if (n == 0) {
+        if (string_lstr.fp == NULL) {
+            n = dvi_build_unsigned_width(k2);
+            put_byte(op + n - 1, dvi);
+        } else {
+            n = 4;
+            if (string_lstr.fp != dvi) {
+                put_byte(op + n - 1, dvi);
+            } /* else written when the string overflowed into dvi */
+        }
+    }
+
+    check_unsigned(n, k2);
+    if (string_lstr.fp == dvi) {
+        /* k[n] was reserved when the string overflowed into dvi */
+        patch_unsigned(n, k2, string_lstr.pos, dvi);
+    } else {
+        put_unsigned(n, k2, dvi);
+    }
+    put_lstr(&string_lstr, dvi);
 
-    clear_lstr(&lstr);
+    clear_lstr(&string_lstr);
     if (debug) {
         MSG_SATRT;
-        fprintf(stderr, "leaving xfer_len_string.\n");
+        fprintf(msg_fp, "leaving xfer_len_string.\n");
     } /* if (debug) */
 
     return (n + k2);
 } /* xfer_len_string */
 
+/* warn that byte address snum, given in DTL file for `what', is wrong; */
+/* the caller has started the message. */
+void warn_address(const char* what, S4 snum, word_t correct) {
+    fprintf(msg_fp, "byte address ");
+    fprintf(msg_fp, S4_FMT, snum);
+    fprintf(msg_fp, " for %s is wrong; writing ", what);
+    fprintf(msg_fp, WORD_FMT, correct);
+    fprintf(msg_fp, ".\n");
+} /* warn_address */
+
+/** Count a warning of the given kind, found at DTL line `line',
+ *  and start its message, if it is to be shown.
+ *
+ * In a job, every such warning is shown, with its mark,
+ * for dt2dv to count when it shows the job's messages.
+ *
+ * @return 1 if the caller is to finish the message, else 0.
+ */
+int warn_counted(WarnKind kind, COUNT line, const char* file, int ln,
+                 const char* func) {
+    if (page_rec == NULL) {
+        if (++warn_count[kind] > max_warnings || quiet) {
+            return 0;
+        }
+    } else {
+        fprintf(msg_fp, "%c%c", WARN_MARK, 'A' + kind);
+    }
+
+    dtl_msg_start("[warning] ", file, ln, func);
+    if (include_depth > 0) {
+        fprintf(msg_fp, "%s ", dtl_filename);
+    }
+    fprintf(msg_fp, "line " COUNT_FMT ": ", line);
+    return 1;
+} /* warn_counted */
+
+/* summarise the warnings counted, if any */
+void warn_summary(void) {
+    int any = 0;
+
+    for (int i = 0; i < NWARN; i++) {
+        if (warn_count[i] == 0) continue;
+
+        if (!any) {
+            WARN_SATRT;
+            fprintf(msg_fp, "summary of warnings:\n");
+            any = 1;
+        }
+        fprintf(msg_fp, "  %10zd  %s", warn_count[i], warn_what[i]);
+        if (quiet || warn_count[i] > max_warnings) {
+            COUNT shown = (quiet ? 0 : max_warnings);
+
+            fprintf(msg_fp, " (" COUNT_FMT " not shown)",
+                    warn_count[i] - shown);
+        }
+        fprintf(msg_fp, "\n");
+    }
+} /* warn_summary */
+
 /* translate signed 4-byte bop address from dtl to dvi file. */
 /* return value of bop address written to DVI file */
+/* In a job, the address is left in page_rec, for dt2dv to check and patch. */
 S4 xfer_bop_address(FILE* dtl, FILE* dvi) {
     S4 snum = 0;             /* at most this space needed for byte address */
     COUNT nread = 0;         /* number of DTL bytes read by read_token */
     int nconv = 0;           /* number of arguments converted by sscanf */
-    static Token token = ""; /* DTL token */
+    static DTL_TLS Token token = ""; /* DTL token */
 
     nread += read_token(dtl, token);
 
-    nconv = sscanf(token, S4_FMT, &snum);
+    bop_given_auto = (strcmp(token, AUTO_ADDRESS) == 0);
+    if (bop_given_auto) {
+        /* the address is for dt2dv to supply */
+        snum = last_bop_address;
+        if (page_rec != NULL) {
+            page_rec->bop_auto = 1;
+        }
+    } else {
+        nconv = sscanf(token, S4_FMT, &snum);
 
-    if (nconv != 1) {
-        MSG_SATRT;
-        fprintf(stderr,
-                "DTL FILE ERROR (%s) : ", dtl_filename);
-        fprintf(stderr, "signed number expected, not \"%s\".\n", token);
-        dexit(EXIT_FAILURE);
+        if (nconv != 1) {
+            MSG_SATRT;
+            fprintf(msg_fp,
+                    "DTL FILE ERROR (%s) : ", dtl_filename);
+            fprintf(msg_fp, "signed number expected, not \"%s\".\n", token);
+            dexit(EXIT_FAILURE);
+        }
     }
 
-    if (snum != last_bop_address) {
-        MSG_SATRT;
-        fprintf(stderr, "WARNING : byte address (");
-        fprintf(stderr, S4_FMT, snum);
-        fprintf(stderr, ")\n");
-        fprintf(stderr, "for previous bop in DTL file is wrong\n");
-        fprintf(stderr, "Writing correct value (");
-        fprintf(stderr, WORD_FMT, last_bop_address);
-        fprintf(stderr, ") to DVI file\n");
+    if (include_depth > 0) {
+        /* an included file cannot know where its pages will be */
+        snum = last_bop_address;
+    }
+
+    bop_given = snum;
+    if (page_rec != NULL) {
+        page_rec->bop_address = snum;
+        page_rec->bop_line = dtl_line.num;
+        put_signed(4, snum, dvi);
+        return snum;
+    }
+
+    if (snum != last_bop_address && WARN_COUNTED(WARN_BOP_ADDRESS)) {
+        warn_address("previous bop", snum, last_bop_address);
     }
 
     put_signed(4, last_bop_address, dvi);
@@ -1474,29 +3602,32 @@ S4 xfer_postamble_address(FILE* dtl, FILE* dvi) {
     S4 snum = 0;             /* at most this space needed for byte address */
     COUNT nread = 0;         /* number of DTL bytes read by read_token */
     int nconv = 0;           /* number of arguments converted by sscanf */
-    static Token token = ""; /* DTL token */
+    static DTL_TLS Token token = ""; /* DTL token */
 
     nread += read_token(dtl, token);
 
-    nconv = sscanf(token, S4_FMT, &snum);
+    if (strcmp(token, AUTO_ADDRESS) == 0) {
+        /* the address is for dt2dv to supply */
+        snum = postamble_address;
+    } else {
+        nconv = sscanf(token, S4_FMT, &snum);
 
-    if (nconv != 1) {
-        MSG_SATRT;
-        fprintf(stderr, "DTL FILE ERROR (%s) : ",
-                dtl_filename);
-        fprintf(stderr, "signed number expected, not \"%s\".\n", token);
-        dexit(EXIT_FAILURE);
+        if (nconv != 1) {
+            MSG_SATRT;
+            fprintf(msg_fp, "DTL FILE ERROR (%s) : ",
+                    dtl_filename);
+            fprintf(msg_fp, "signed number expected, not \"%s\".\n", token);
+            dexit(EXIT_FAILURE);
+        }
     }
 
-    if (snum != postamble_address) {
-        MSG_SATRT;
-        fprintf(stderr, "WARNING : byte address (");
-        fprintf(stderr, S4_FMT, snum);
-        fprintf(stderr, ")\n");
-        fprintf(stderr, "for postamble in DTL file is wrong\n");
-        fprintf(stderr, "Writing correct value (");
-        fprintf(stderr, WORD_FMT, postamble_address);
-        fprintf(stderr, ") to DVI file\n");
+    if (include_depth > 0) {
+        /* an included file cannot know where the postamble will be */
+        snum = postamble_address;
+    }
+
+    if (snum != postamble_address && WARN_COUNTED(WARN_POST_ADDRESS)) {
+        warn_address("postamble", snum, postamble_address);
     }
 
     put_signed(4, postamble_address, dvi);
@@ -1505,77 +3636,6 @@ S4 xfer_postamble_address(FILE* dtl, FILE* dvi) {
 }
 /* xfer_postamble_address */
 
-int put_table(op_table table, int opcode, FILE* dtl, FILE* dvi) {
-    /* table:  {char * name; int first, last; op_info * list; }; */
-    /* op_info:   {int code; char * name; int nargs; char * args; }; */
-
-    op_info op; /* entry in table */
-    int i;
-    int pos; /* current position in string being scanned */
-    static String args = "";
-
-    /* Defensive programming. */
-    if (opcode < table.first || opcode > table.last) {
-        MSG_SATRT;
-        fprintf(stderr,
-                "DTL FILE (OR INTERNAL) ERROR : opcode %d ",
-                opcode);
-        fprintf(stderr, "is outside table %s [ %d to %d ] !\n", table.name,
-                table.first, table.last);
-        dexit(EXIT_FAILURE);
-    }
-
-    op = table.list[opcode - table.first];
-
-    /* More defensive programming. */
-    if (opcode != op.code) {
-        MSG_SATRT;
-        fprintf(stderr,
-                "INTERNAL ERROR : opcode %d for command \"%s\"",
-                opcode, op.name);
-        fprintf(stderr, " faulty in table \"%s\".\n", table.name);
-        dexit(EXIT_FAILURE);
-    }
-
-    /* process all the arguments, according to size and sign */
-
-    strncpy(args, op.args, MAXSTRLEN);
-
-    pos = 0;
-    for (i = 0; i < op.nargs; i++) {
-        int argtype = 0;
-        int nscan = 0; /* number of bytes read by sscanf */
-        int nconv = 0; /* number of sscanf arguments converted & assigned */
-
-        /* sscanf() does NOT advance over its input: */
-        /* C strings lack internal state information, which C files have. */
-        /* On Sun/OS, sscanf calls ungetc on the string it reads, */
-        /* which therefore has to be writable. */
-
-        nconv = sscanf(args + pos, "%d%n", &argtype, &nscan);
-
-        if (nconv < 1 || nscan < 1) {
-            MSG_SATRT;
-            fprintf(stderr,
-                    "INTERNAL ERROR : internal read of table %s "
-                    "failed!\n",
-                    table.name);
-            dexit(EXIT_FAILURE);
-        }
-
-        pos += nscan;
-
-        if (argtype < 0)
-            xfer_signed(-argtype, dtl, dvi);
-        else
-            xfer_unsigned(argtype, dtl, dvi);
-    }
-    /* end for */
-
-    return 1; /* OK */
-}
-/* put_table */
-
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
 /* read special (1 <= n <= 4 byte) data from dtl, and write in dvi */
@@ -1585,25 +3645,26 @@ U4 special(FILE* dtl, FILE* dvi, int n) {
 
     if (debug) {
         MSG_SATRT;
-        fprintf(stderr, "entering special.\n");
+        fprintf(msg_fp, "entering special.\n");
     }
 
-    if (n < 1 || n > 4) {
+    if (n < 0 || n > 4) {
         MSG_SATRT;
-        fprintf(stderr, "DTL FILE ERROR (%s) : special %d, ",
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : special %d, ",
                 dtl_filename, n);
-        fprintf(stderr, "range is 1 to 4.\n");
+        fprintf(msg_fp, "range is 1 to 4.\n");
         dexit(EXIT_FAILURE);
     }
 
     /* k[n] : length of special string */
     /* x[k] : special string */
     /* nk = n + k */
-    nk = xfer_len_string(n, dtl, dvi);
+    /* n = 0 : unsuffixed special, whose opcode is still to be chosen */
+    nk = xfer_len_string(n, XXX1, dtl, dvi);
 
     if (debug) {
         MSG_SATRT;
-        fprintf(stderr, "leaving special.\n");
+        fprintf(msg_fp, "leaving special.\n");
     }
 
     return (nk);
@@ -1611,59 +3672,66 @@ U4 special(FILE* dtl, FILE* dvi, int n) {
 /* special */
 
 /* read fontdef fnt_def1 .. fnt_def4 from dtl, and write in dvi */
-/* suffix is the fontdef suffix : 1 to 4 */
+/* suffix is the fontdef suffix : 1 to 4, */
+/* or 0 for unsuffixed fd, whose suffix the font number chooses */
 /* return number of bytes written */
 int fontdef(FILE* dtl, FILE* dvi, int suffix) {
     U4 a, l, a2, l2;
-    U4 k;
-    LString lstr1, lstr2;
+    U4 k, c, s, d;
 
     if (debug) {
         MSG_SATRT;
-        fprintf(stderr, "entering fontdef.\n");
+        fprintf(msg_fp, "entering fontdef.\n");
     }
 
-    if (suffix < 1 || suffix > 4) {
+    if (suffix < 0 || suffix > 4) {
         MSG_SATRT;
-        fprintf(stderr, "DTL FILE ERROR (%s) : ", dtl_filename);
-        fprintf(stderr, "font def %d, but range is 1 to 4.\n", suffix);
+        fprintf(msg_fp, "DTL FILE ERROR (%s) : ", dtl_filename);
+        fprintf(msg_fp, "font def %d, but range is 1 to 4.\n", suffix);
         dexit(EXIT_FAILURE);
     }
 
-    init_lstr(&lstr1, LSTR_SIZE);
-    init_lstr(&lstr2, LSTR_SIZE);
+    init_lstr(&area_lstr, LSTR_SIZE);
+    init_lstr(&font_lstr, LSTR_SIZE);
 
     if (debug) {
         MSG_SATRT;
-        fprintf(stderr, "about to read font number.\n");
+        fprintf(msg_fp, "about to read font number.\n");
     }
 
     /* k[suffix] : font number */
-    if (suffix == 4)
+    if (suffix == 0) {
+        S4 snum = get_signed(dtl);
+
+        suffix = (snum < 0 ? 4 : dvi_build_unsigned_width((U4)snum));
+        put_byte(FNT_DEF1 + suffix - 1, dvi);
+        put_signed(suffix, snum, dvi);
+        k = (U4)snum;
+    } else if (suffix == 4)
         k = xfer_signed(suffix, dtl, dvi);
     else
         k = xfer_unsigned(suffix, dtl, dvi);
 
     if (debug) {
         MSG_SATRT;
-        fprintf(stderr, "font ");
-        fprintf(stderr, U4_FMT, k);
-        fprintf(stderr, ".\n");
+        fprintf(msg_fp, "font ");
+        fprintf(msg_fp, U4_FMT, k);
+        fprintf(msg_fp, ".\n");
     }
 
 #ifdef HEX_CHECKSUM
     /* c[4] : (hexadecimal) checksum : I (gt) would prefer this */
-    xfer_hex(4, dtl, dvi);
+    c = xfer_hex(4, dtl, dvi);
 #else /* NOT HEX_CHECKSUM */
     /* c[4] : checksum (octal, for comparison with tftopl's .pl file) */
-    xfer_oct(4, dtl, dvi);
+    c = xfer_oct(4, dtl, dvi);
 #endif
 
     /* s[4] */
-    xfer_unsigned(4, dtl, dvi);
+    s = xfer_unsigned(4, dtl, dvi);
 
     /* d[4] */
-    xfer_unsigned(4, dtl, dvi);
+    d = xfer_unsigned(4, dtl, dvi);
 
     /* If DTL file's edited, a and l may be wrong. */
 
@@ -1674,41 +3742,57 @@ int fontdef(FILE* dtl, FILE* dvi, int suffix) {
     l = get_unsigned(dtl);
 
     /* n[a+l] : font pathname string <= area + font */
-    a2 = get_lstr(dtl, &lstr1);
-    if (a2 != a) {
-        MSG_SATRT;
-        fprintf(stderr, "WARNING : font area string's length (");
-        fprintf(stderr, U4_FMT, a);
-        fprintf(stderr, ") in DTL file is wrong\n");
-        fprintf(stderr, "Writing correct value (");
-        fprintf(stderr, U4_FMT, a2);
-        fprintf(stderr, ") to DVI file\n");
+    a2 = get_lstr(dtl, &area_lstr);
+    if (a2 != a && WARN_COUNTED(WARN_FONT_AREA_LENGTH)) {
+        fprintf(msg_fp, "font area string's length ");
+        fprintf(msg_fp, U4_FMT, a);
+        fprintf(msg_fp, " is wrong; writing ");
+        fprintf(msg_fp, U4_FMT, a2);
+        fprintf(msg_fp, ".\n");
     }
 
     put_unsigned(1, a2, dvi);
 
-    l2 = get_lstr(dtl, &lstr2);
-    if (l2 != l) {
-        MSG_SATRT;
-        fprintf(stderr, "WARNING : font string's length (");
-        fprintf(stderr, U4_FMT, l);
-        fprintf(stderr, ") in DTL file is wrong\n");
-        fprintf(stderr, "Writing correct value (");
-        fprintf(stderr, U4_FMT, l2);
-        fprintf(stderr, ") to DVI file\n");
+    l2 = get_lstr(dtl, &font_lstr);
+    if (l2 != l && WARN_COUNTED(WARN_FONT_NAME_LENGTH)) {
+        fprintf(msg_fp, "font string's length ");
+        fprintf(msg_fp, U4_FMT, l);
+        fprintf(msg_fp, " is wrong; writing ");
+        fprintf(msg_fp, U4_FMT, l2);
+        fprintf(msg_fp, ".\n");
     }
 
     put_unsigned(1, l2, dvi);
 
-    put_lstr(&lstr1, dvi);
-    put_lstr(&lstr2, dvi);
+    put_lstr(&area_lstr, dvi);
+    put_lstr(&font_lstr, dvi);
+
+    if (auto_post) {
+        /* the same definition, for the postamble */
+        size_t len = 1 + suffix + 3 * 4 + 2 + a2 + l2;
+        Byte* def = (Byte*)gmalloc(len);
+        Byte* p = def;
+
+        *p++ = (Byte)(FNT_DEF1 + suffix - 1);
+        p = encode_unsigned(p, suffix, k);
+        p = encode_unsigned(p, 4, c);
+        p = encode_unsigned(p, 4, s);
+        p = encode_unsigned(p, 4, d);
+        p = encode_unsigned(p, 1, a2);
+        p = encode_unsigned(p, 1, l2);
+        memcpy(p, area_lstr.s, a2);
+        memcpy(p + a2, font_lstr.s, l2);
+
+        note_font(k, def, len);
+        free(def);
+    }
 
-    clear_lstr(&lstr1);
-    clear_lstr(&lstr2);
+    clear_lstr(&area_lstr);
+    clear_lstr(&font_lstr);
 
     if (debug) {
         MSG_SATRT;
-        fprintf(stderr, "leaving fontdef.\n");
+        fprintf(msg_fp, "leaving fontdef.\n");
     }
 
     return (suffix + 4 * 4 + 2 * 1 + a2 + l2);
@@ -1722,29 +3806,29 @@ U4 preamble(FILE* dtl, FILE* dvi) {
 
     if (debug) {
         MSG_SATRT;
-        fprintf(stderr, "entering preamble.\n");
+        fprintf(msg_fp, "entering preamble.\n");
     }
 
     /* i[1] */
-    xfer_unsigned(1, dtl, dvi);
+    post_info.id = xfer_unsigned(1, dtl, dvi);
 
     /* num[4] */
-    xfer_unsigned(4, dtl, dvi);
+    post_info.num = xfer_unsigned(4, dtl, dvi);
 
     /* den[4] */
-    xfer_unsigned(4, dtl, dvi);
+    post_info.den = xfer_unsigned(4, dtl, dvi);
 
     /* mag[4] */
-    xfer_unsigned(4, dtl, dvi);
+    post_info.mag = xfer_unsigned(4, dtl, dvi);
 
     /* k[1] : length of comment */
     /* x[k] : comment string */
     /* k1 = 1 + k */
-    k1 = xfer_len_string(1, dtl, dvi);
+    k1 = xfer_len_string(1, -1, dtl, dvi);
 
     if (debug) {
         MSG_SATRT;
-        fprintf(stderr, "leaving preamble.\n");
+        fprintf(msg_fp, "leaving preamble.\n");
     }
 
     return (1 + 3 * 4 + k1);
@@ -1804,7 +3888,7 @@ int post_post(FILE* dtl, FILE* dvi) {
 
     for (n223 = 0; true; n223++) {
         COUNT nread = 0; /* number of DTL bytes read by read_token */
-        static Token token;
+        static DTL_TLS Token token;
 
         strcpy(token, "");
 
@@ -1815,13 +3899,13 @@ int post_post(FILE* dtl, FILE* dvi) {
             if (group) {
                 /* dtl file shouldn't end before an ECOM */
                 MSG_SATRT;
-                fprintf(stderr,
+                fprintf(msg_fp,
                         "DTL FILE ERROR (%s) : ", dtl_filename);
-                fprintf(stderr, "premature end of DTL file!\n");
-                fprintf(stderr,
+                fprintf(msg_fp, "premature end of DTL file!\n");
+                fprintf(msg_fp,
                         "%d complete iterations of \"padding byte\" loop;\n",
                         n223);
-                fprintf(stderr, "troublesome token = \"%s\"\n", token);
+                fprintf(msg_fp, "troublesome token = \"%s\"\n", token);
                 dexit(EXIT_FAILURE);
             }
             /* leave the "223" loop */
@@ -1838,9 +3922,9 @@ int post_post(FILE* dtl, FILE* dvi) {
                 } else {
                     /* error : expected end of post_post */
                     MSG_SATRT;
-                    fprintf(stderr, "DTL FILE ERROR (%s) : ",
+                    fprintf(msg_fp, "DTL FILE ERROR (%s) : ",
                             dtl_filename);
-                    fprintf(stderr, "token \"%s\" should be ECOM (\"%s\")\n",
+                    fprintf(msg_fp, "token \"%s\" should be ECOM (\"%s\")\n",
                             token, ECOM);
                     dexit(EXIT_FAILURE);
                 }
@@ -1852,22 +3936,17 @@ int post_post(FILE* dtl, FILE* dvi) {
     /* end for */
 
     if (n223 < 4) {
-        MSG_SATRT;
-        fprintf(stderr, "DTL FILE ERROR (%s) : \n", dtl_filename);
-        fprintf(stderr, "fewer than four `223' padding bytes.\n");
-        fprintf(stderr, "Will write at least four `223' padding bytes.\n");
-    }
-
-    /* check whether the DVI file size is a multiple of 4 bytes */
-    if ((dvi_written + n223) % 4 != 0) {
-        MSG_SATRT;
-        fprintf(stderr, "WARNING : \n");
-        fprintf(stderr, "DVI size ");
-        fprintf(stderr, COUNT_FMT, dvi_written);
-        fprintf(stderr, " (bytes) wouldn't be a multiple of 4 !\n");
-        fprintf(
-            stderr,
-            "Will write (at least four) `223' padding bytes until it is.\n");
+        if (WARN_COUNTED(WARN_PADDING)) {
+            fprintf(msg_fp, "fewer than four `223' padding bytes; "
+                    "writing at least four.\n");
+        }
+    } else if ((dvi_written + n223) % 4 != 0) {
+        /* the DVI file size would not be a multiple of 4 bytes */
+        if (WARN_COUNTED(WARN_PADDING)) {
+            fprintf(msg_fp, "DVI size " COUNT_FMT " would not be a multiple "
+                    "of 4; writing `223' padding bytes until it is.\n",
+                    dvi_written + n223);
+        }
     }
 
     /* final padding of DVI file by "223" bytes to a multiple of 4 bytes, */
@@ -1882,4 +3961,120 @@ int post_post(FILE* dtl, FILE* dvi) {
 }
 /* post_post */
 
+/* write unum into n bytes at p, big-endian; return p + n */
+Byte* encode_unsigned(Byte* p, int n, U4 unum) {
+    for (int i = n - 1; i >= 0; i--) {
+        p[i] = (Byte)(unum & 0xFF);
+        unum >>= 8;
+    }
+    return p + n;
+} /* encode_unsigned */
+
+/** Remember a font definition, of len bytes at def, for -post.
+ *  Only the first definition of font number k is kept.
+ *  In a job, it is written to job_fonts, for dt2dv to remember.
+ *
+ * ## global var
+ *  + post_info
+ */
+void note_font(U4 k, const Byte* def, size_t len) {
+    FontRec* f;
+
+    if (job_fonts != NULL) {
+        if (fwrite(&k, sizeof(k), 1, job_fonts) != 1
+            || fwrite(&len, sizeof(len), 1, job_fonts) != 1
+            || fwrite(def, 1, len, job_fonts) != len) {
+            MSG_SATRT;
+            fprintf(msg_fp, "ERROR : cannot write font definition for job.\n");
+            dexit(EXIT_FAILURE);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < post_info.nfont; i++) {
+        if (post_info.font[i].k == k) {
+            return;
+        }
+    }
+
+    if (post_info.nfont == post_info.maxfont) {
+        size_t m = (post_info.maxfont == 0 ? 16 : 2 * post_info.maxfont);
+        f = (FontRec*)realloc(post_info.font, m * sizeof(FontRec));
+        if (f == NULL) {
+            MSG_SATRT;
+            fprintf(msg_fp, "ERROR : no memory for font definitions.\n");
+            fail_status = DTL_ERROR_MEMORY;
+            dexit(EXIT_FAILURE);
+        }
+        post_info.font = f;
+        post_info.maxfont = m;
+    }
+
+    f = &post_info.font[post_info.nfont];
+    f->k = k;
+    f->len = len;
+    f->def = (Byte*)gmalloc(len);
+    memcpy(f->def, def, len);
+    ++post_info.nfont;
+} /* note_font */
+
+/* the higher font number first */
+static int by_number_down(const void* a, const void* b) {
+    U4 j = ((const FontRec*)a)->k;
+    U4 k = ((const FontRec*)b)->k;
+
+    return (j > k ? -1 : j < k);
+} /* by_number_down */
+
+/** Write a postamble for a DTL file that has none (-post):
+ *  post, the font definitions, and post_post with its padding.
+ *  The fonts are defined as TeX defines them there, the higher
+ *  font number first.
+ *
+ *  l[4] and u[4], the tallest page's height plus depth and the widest
+ *  page's width, need the fonts' metrics, which dt2dv does not have;
+ *  they are written as 0.
+ *
+ * ## global var
+ *  + post_info
+ *  + postamble_address
+ *  + last_bop_address
+ */
+int write_postamble(FILE* dvi) {
+    int n223;
+
+    postamble_address = dvi_written;
+
+    put_byte(POST, dvi);
+    put_signed(4, last_bop_address, dvi);
+    put_unsigned(4, post_info.num, dvi);
+    put_unsigned(4, post_info.den, dvi);
+    put_unsigned(4, post_info.mag, dvi);
+    put_unsigned(4, 0, dvi); /* l[4] */
+    put_unsigned(4, 0, dvi); /* u[4] */
+    put_unsigned(2, post_info.max_depth, dvi);
+    put_unsigned(2, post_info.pages, dvi);
+
+    qsort(post_info.font, post_info.nfont, sizeof(FontRec), by_number_down);
+    for (size_t i = 0; i < post_info.nfont; i++) {
+        put_bytes((const char*)post_info.font[i].def, post_info.font[i].len,
+                  dvi);
+        free(post_info.font[i].def);
+    }
+    free(post_info.font);
+    post_info.font = NULL;
+    post_info.nfont = post_info.maxfont = 0;
+
+    put_byte(POSTPOST, dvi);
+    put_signed(4, postamble_address, dvi);
+    put_unsigned(1, post_info.id, dvi);
+
+    /* at least four "223" bytes, to a multiple of 4 bytes */
+    for (n223 = 0; (n223 < 4) || (dvi_written % 4 != 0); n223++) {
+        put_byte(223, dvi);
+    }
+
+    return 1; /* OK */
+} /* write_postamble */
+
 /* end of dt2dv.c */
\ No newline at end of file
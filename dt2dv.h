@@ -21,18 +21,28 @@
 
 /* unix version; read from stdin, write to stdout, by default. */
 
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_FORK 1
+#include <sys/mman.h> // mmap
+#include <sys/wait.h> // waitpid
+#include <unistd.h>   // fork, dup2, ftruncate
+#endif
+
 #include <ctype.h>
 #include <errno.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-/// bop:  not counting last argument, a signed address:
-#define OP_INFO_BOP \
-    { BOP, BOP_STR, 10, "-4 -4 -4 -4 -4 -4 -4 -4 -4 -4" }
+#include <sys/stat.h> // fstat
+#include <time.h>     // clock_gettime
 
 #include "dtl.h"
+#include "dtlinclude.h"
+#include "dtlindex.h"
+#include "dtlmanifest.h"
+#include "dtlpipe.h"
+#include "dvibuild.h"
 
 
 /** Set command-line options.
@@ -45,15 +55,56 @@ typedef struct _Options {
     int* p_var;          /* pointer to option variable */
     const char* desc;    /* description of keyword and value */
     void (*p_fn)(void);  /* pointer to function called when option is set */
+    const char* arg;     /* name of option's value, in opt_arg, or NULL */
 } Options;
 
 /* by default, read and write regular files */
-int rd_stdin = 0;
-int wr_stdout = 0;
+DTL_TLS int rd_stdin = 0;
+DTL_TLS int wr_stdout = 0;
+
+/* number of jobs encoding pages at once; by default, one */
+DTL_TLS int jobs = 1;
+
+/* write a postamble, if the DTL file has none? by default, no */
+DTL_TLS int auto_post = 0;
+
+/* flush the DVI file at the end of every page? by default, no */
+DTL_TLS int flush_pages = 0;
+
+/* with -coalesce, pages are held until the oldest has waited this long */
+DTL_TLS int coalesce = 0;
+DTL_TLS long coalesce_ms = 0;
+
+/* report each page written, on stderr? by default, no */
+DTL_TLS int progress = 0;
+
+/* show no warnings, only their summary, and no information? */
+DTL_TLS int quiet = 0;
 
+/* how many warnings of each kind to show; the rest are only counted */
+DTL_TLS int limit_warnings = 0;
+DTL_TLS COUNT max_warnings = 10;
+
+/* page manifest to write, if any */
+DTL_TLS int use_manifest = 0;
+DTL_TLS char* manifest_file = NULL;
+
+/* DVI file of the last run, whose unchanged pages to reuse, if any */
+DTL_TLS int use_old = 0;
+DTL_TLS char* old_dvi_file = NULL;
+
+/* value of the option being parsed, if it takes one */
+DTL_TLS char* opt_arg = NULL;
+
+#ifndef DTL_LIBRARY
 void no_op(void);
 void dtl_stdin(void);
 void dvi_stdout(void);
+void set_jobs(void);
+void set_coalesce(void);
+void set_max_warnings(void);
+void set_manifest(void);
+void set_old(void);
 
 Options opts[] = {
     {"-debug", &debug, "detailed debugging", no_op},
@@ -61,21 +112,51 @@ Options opts[] = {
     {"-si", &rd_stdin, "read all DTL commands from standard input", dtl_stdin},
     {"-so", &wr_stdout, "write all DVI commands to standard output",
      dvi_stdout},
+    {"-j", &jobs, "encode pages in N parallel jobs", set_jobs, "N"},
+    {"-post", &auto_post, "write postamble, if DTL file has none", no_op},
+    {"-flush", &flush_pages, "flush DVI file at the end of every page", no_op},
+    {"-coalesce", &coalesce, "flush pages when the oldest is MS ms old",
+     set_coalesce, "MS"},
+    {"-progress", &progress, "report each page written, on stderr", no_op},
+    {"-quiet", &quiet, "show only a summary of warnings", no_op},
+    {"-warnings", &limit_warnings, "show N warnings of each kind",
+     set_max_warnings, "N"},
+    {"-manifest", &use_manifest, "write page manifest to FILE", set_manifest,
+     "FILE"},
+    {"-old", &use_old, "reuse unchanged pages of DVI FILE, by manifest",
+     set_old, "FILE"},
     {NULL, NULL, NULL, NULL}
 }; /* opts[] */
+#endif /* DTL_LIBRARY */
 
 
 /* Size typically used in this program for LString variables */
 #define LSTR_SIZE 1024
 
 /* string s of length l and maximum length m */
+/* A string preceded in the DVI file by its length k[n] may outgrow s; */
+/* its bytes then go to fp, which is either the dvi file itself */
+/* (k[n] is reserved at pos, and patched once l is known) */
+/* or, for a dvi file that cannot seek, a temporary file. */
 typedef struct _LString {
-    size_t l; ///< string length.
-    size_t m; ///< string maximum length.
-    char* s;  ///< string.
+    size_t l;  ///< string length.
+    size_t m;  ///< string maximum length, in memory.
+    char* s;   ///< string.
+    int n;     ///< width of length field k[n], or 0 if s cannot overflow.
+    FILE* dvi; ///< dvi file the string is written to, if n > 0.
+    FILE* fp;  ///< file holding the string once s overflows, else NULL.
+    long pos;  ///< position of k[n] in dvi, if fp == dvi.
+    int op;    ///< opcode to write before k[n] when s overflows, or -1.
 } LString;
 typedef LString* LStringPtr;
 
+/* strings being read, here rather than on the stack, */
+/* so that free_state can free them when a conversion fails */
+DTL_TLS LString string_lstr;  /* special or pre, in xfer_len_string */
+DTL_TLS LString area_lstr;    /* fnt_def's area, in fontdef */
+DTL_TLS LString font_lstr;    /* fnt_def's name, in fontdef */
+DTL_TLS LString include_lstr; /* include's name, in include_dtl */
+
 
 typedef enum _CharStatus {
     CHAR_EOS = -1, ///< end of LString.
@@ -96,8 +177,97 @@ typedef struct _Line {
     char* buf;   /* line buffer */
 } Line;
 
-char linebuf[MAX_LINE + 1];
-Line dtl_line = {0, 0, 0, MAX_LINE, linebuf};
+/* set to read from linebuf, by init_state */
+DTL_TLS char linebuf[MAX_LINE + 1];
+DTL_TLS Line dtl_line;
+
+/* A DTL file that can be mapped into memory is read in place, */
+/* a whole line at a time, and the reader can jump from token to token */
+/* through its index; otherwise lines are read into linebuf. */
+DTL_TLS DtlIndex dtl_index;
+
+/* The command loop is compiled twice: read_commands_fast, */
+/* with no debugging and no BCOM/ECOM checks, and read_commands_full. */
+/* dt2dv chooses one for the run. */
+int read_commands_fast(FILE* dtl, FILE* dvi, size_t stop);
+int read_commands_full(FILE* dtl, FILE* dvi, size_t stop);
+DTL_TLS int (*read_commands)(FILE* dtl, FILE* dvi, size_t stop) =
+    read_commands_full;
+
+#ifdef __GNUC__
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+/* DTL stream being read ahead, if not mapped; else NULL */
+DTL_TLS DtlPipe* dtl_pipe = NULL;
+
+/* DTL command that reads other DTL files in its place */
+#define INCLUDE_STR "include"
+
+/* how deep include commands may nest, in included files */
+#define MAX_INCLUDE_DEPTH 16
+
+/* an include command being read: the files it names, */
+/* and the including file's reader, to go back to */
+typedef struct _Include {
+    DtlInclude* inc; /* files named */
+    FILE* fp;        /* file being read, or NULL */
+    DtlIndex index;  /* including file's index */
+    Line line;
+    DtlPipe* pipe;
+    char* filename;
+    char* buf;       /* its line, if read from a stream; else NULL */
+} Include;
+
+/* include commands being read, one within another */
+DTL_TLS Include include[MAX_INCLUDE_DEPTH];
+DTL_TLS int include_depth = 0;
+
+/* DTL commands for blocks of commands, encoded once and written often */
+#define DEFINE_STR "define"
+#define ENDDEF_STR "enddef"
+#define CALL_STR "call"
+#define REPEAT_STR "repeat"
+#define ENDREPEAT_STR "endrepeat"
+
+/* a macro: DTL commands encoded once, by define, for call to write */
+typedef struct _Macro {
+    char* name;    /* name given in define; NULL for a repeat block */
+    char* bytes;   /* DVI bytes encoded */
+    size_t len;    /* number of bytes */
+    COUNT ncom;    /* DVI commands encoded */
+    int depth;     /* push depth at end, from 0 at start */
+    int max_depth; /* greatest push depth, from 0 at start */
+} Macro;
+
+/* a define or repeat block being read, and what its encoding displaced */
+typedef struct _Block {
+    Macro m;           /* what is encoded so far */
+    U4 count;          /* times to write a repeat block */
+    COUNT line;        /* DTL line of the define or repeat */
+    FILE* fp;          /* where the block is encoded */
+    COUNT dvi_written; /* outside the block */
+    COUNT ncom;
+    int depth;
+    int max_depth;
+} Block;
+
+/* how deep blocks may nest */
+#define MAX_BLOCK_DEPTH 16
+
+/* blocks being read, innermost last */
+DTL_TLS Block block[MAX_BLOCK_DEPTH];
+DTL_TLS int nblock = 0;
+
+/* macros defined */
+DTL_TLS Macro* macro = NULL;
+DTL_TLS size_t nmacro = 0;
+DTL_TLS size_t max_macro = 0;
+
+/* may the reader use dtl_index to skip per-character work? */
+#define INDEXED (dtl_index.start != NULL && !debug)
 
 
 /* a DTL token either is:
@@ -117,77 +287,200 @@ typedef char Boolean;
 #define true 1
 #define false 0
 
-/* command prefixes */
+/* DTL command names, in an open hash: each entry is a name in dvi_op[],
+   with its opcode; or an unsuffixed name of a sized command, like `r' for
+   r1 to r4, with SIZED_CMD plus the opcode of its 1-byte form. */
 typedef struct {
-    Byte first_code;
-    char* name;
-    Boolean has_suffix;
-    Byte first_suffix, last_suffix;
-} CmdPrefix;
-
-CmdPrefix cmd_prefixes[] = {
-    {0, SETCHAR_STR, true, 0, 127},   {128, SET_STR, true, 1, 4},
-    {132, SET_RULE_STR, false, 0, 0}, {133, PUT_STR, true, 1, 4},
-    {137, PUT_RULE_STR, false, 0, 0}, {138, NOP_STR, false, 0, 0},
-    {139, BOP_STR, false, 0, 0},      {140, EOP_STR, false, 0, 0},
-    {141, PUSH_STR, false, 0, 0},     {142, POP_STR, false, 0, 0},
-    {143, RIGHT_STR, true, 1, 4},     {147, W_STR, true, 0, 4},
-    {152, X_STR, true, 0, 4},         {157, DOWN_STR, true, 1, 4},
-    {161, Y_STR, true, 0, 4},         {166, Z_STR, true, 0, 4},
-    {171, FONT_NUM_STR, true, 0, 63}, {235, FONT_STR, true, 1, 4},
-    {239, SPECIAL_STR, true, 1, 4},   {243, FONT_DEF_STR, true, 1, 4},
-    {247, PRE_STR, false, 0, 0},      {248, POST_STR, false, 0, 0},
-    {249, POSTPOST_STR, false, 0, 0}, {250, OPCODE_STR, true, 250, 255}};
-/* cmd_prefixes[] */
-
-/* Number of DVI commands, including those officially undefined */
-#define NCMDS 256
-
-/* table of command name (string) pointers */
-typedef char* CmdTable[NCMDS];
-
-/* initially all command name pointers are NULL */
-CmdTable cmd_table;
-
-
-int nfile = 0;       /* number of filename arguments on the command line */
-
-FILE* dtl_fp = NULL;
-FILE* dvi_fp = NULL;
-
-char* dtl_filename = "";
-char* dvi_filename = "";
-
-COUNT dtl_read = 0;            /* bytes read from dtl file */
-COUNT dvi_written = 0;         /* bytes written to dvi file */
-word_t last_bop_address = -1;  /* byte address of last bop; first bop uses -1 */
-word_t postamble_address = -1; /* byte address of postamble */
-COUNT ncom = 0; /* commands successfully read and interpreted from dtl file */
-COUNT com_read = 0; /* bytes read in current (command and arguments), */
-                    /* since and including the opening BCOM_CHAR, if any */
+    const char* name;
+    int code;
+} CmdEntry;
+
+#define SIZED_CMD 256
+/* a power of 2, over 4 times the number of names, for few collisions */
+#define CMD_HASH_SIZE 2048
+
+/* built by init_commands; empty entries have a NULL name */
+DTL_TLS CmdEntry cmd_hash[CMD_HASH_SIZE];
+
+/* transfers a command's arguments, after its opcode is written */
+typedef void (*XferFn)(FILE* dtl, FILE* dvi, int opcode);
+
+/* the XferFn for each opcode; xfer_args dispatches on this */
+DTL_TLS XferFn xfer_op[NCMDS];
+
+
+/* number of filename arguments on the command line */
+DTL_TLS int nfile = 0;
+
+DTL_TLS FILE* dtl_fp = NULL;
+DTL_TLS FILE* dvi_fp = NULL;
+
+DTL_TLS char* dtl_filename = "";
+DTL_TLS char* dvi_filename = "";
+
+/* bytes read from dtl file */
+DTL_TLS COUNT dtl_read = 0;
+/* bytes written to dvi file */
+DTL_TLS COUNT dvi_written = 0;
+/* byte address of last bop; first bop uses -1 */
+DTL_TLS word_t last_bop_address = -1;
+/* byte address of postamble */
+DTL_TLS word_t postamble_address = -1;
+/* commands successfully read and interpreted from dtl file */
+DTL_TLS COUNT ncom = 0;
+/* bytes read in current (command and arguments), */
+/* since and including the opening BCOM_CHAR, if any */
+DTL_TLS COUNT com_read = 0;
+
+
+/* what a job reports to dt2dv, about one page it encoded */
+typedef struct _PageRec {
+    int done;         /* page completely interpreted, within its bounds */
+    int max_depth;    /* greatest push depth */
+    long fonts_start; /* page's font definitions, in job's font file */
+    long fonts_end;
+    S4 bop_address;   /* address of previous bop, as given in DTL file */
+    int bop_auto;     /* that address was given as AUTO_ADDRESS */
+    COUNT dvi_bytes;  /* DVI bytes written */
+    COUNT dtl_bytes;  /* DTL bytes read */
+    COUNT ncom;       /* commands interpreted */
+    COUNT lines;      /* DTL line number at end of page */
+    COUNT bop_line;   /* DTL line number of bop's address */
+    long err_start;   /* page's messages, in job's message file */
+    long err_end;
+} PageRec;
+
+/* a font definition, as written to the DVI file */
+typedef struct _FontRec {
+    U4 k;        /* font number */
+    size_t len;  /* bytes in def */
+    Byte* def;   /* fnt_def command */
+} FontRec;
+
+/* what a postamble must say about the rest of the DVI file, for -post */
+typedef struct _PostInfo {
+    U4 id;          /* from preamble: DVI format identification */
+    U4 num, den;    /* from preamble: unit of measurement */
+    U4 mag;         /* from preamble: magnification */
+    U4 pages;       /* number of bop commands */
+    int depth;      /* current push depth */
+    int max_depth;  /* greatest push depth */
+    size_t nfont;   /* number of fonts defined */
+    size_t maxfont; /* room in font[] */
+    FontRec* font;  /* fonts defined, in order of definition */
+} PostInfo;
+
+DTL_TLS PostInfo post_info = {0, 0, 0, 0, 0, 0, 0, 0, 0, NULL};
+
+/* In a job, file for the font definitions in its pages; otherwise NULL. */
+DTL_TLS FILE* job_fonts = NULL;
+
+/* In a job, the page being encoded, whose bop address is left to dt2dv; */
+/* otherwise NULL. */
+DTL_TLS PageRec* page_rec = NULL;
+
+/* address of previous bop, as given in the last bop command, for -manifest */
+DTL_TLS S4 bop_given = 0;
+DTL_TLS int bop_given_auto = 0; /* it was given as AUTO_ADDRESS */
+
+/* pages built, for -manifest */
+DTL_TLS DtlManifest manifest;
+DTL_TLS int manifest_ok = 0; /* pages are as in manifest, and can be reused */
+
+/* warnings that may recur, once for each page or font, */
+/* which are counted, and summarised at exit */
+typedef enum _WarnKind {
+    WARN_BOP_ADDRESS,
+    WARN_POST_ADDRESS,
+    WARN_STRING_LENGTH,
+    WARN_FONT_AREA_LENGTH,
+    WARN_FONT_NAME_LENGTH,
+    WARN_PADDING,
+    NWARN
+} WarnKind;
+
+const char* warn_what[NWARN] = {
+    "wrong bop address",   "wrong postamble address", "wrong string length",
+    "wrong font area length", "wrong font name length",
+    "wrong post_post padding"};
+
+DTL_TLS COUNT warn_count[NWARN];
+
+/* In a job's messages, a counted warning's line begins with WARN_MARK, */
+/* then 'A' + its kind, for dt2dv to count it, and show it or not. */
+#define WARN_MARK '\001'
+
+#define WARN_COUNTED(kind) \
+    warn_counted(kind, dtl_line.num, __FILE__, __LINE__, __func__)
+
+/* \count0 of the page being written */
+DTL_TLS S4 page_count0 = 0;
+
+/* pages written but not yet flushed, for -flush, and since when */
+DTL_TLS int flush_pending = 0;
+DTL_TLS COUNT flushed_at = 0; /* dvi_written at last flush */
+#ifdef CLOCK_MONOTONIC
+DTL_TLS struct timespec flush_pending_since;
+#endif
+
+/* stdio buffer for the DVI file, with -flush: room for a whole page */
+#define FLUSH_BUF_SIZE (1 << 20)
+
+/* offset of bop's address p[4] in a bop command */
+#define BOP_ADDRESS_OFFSET (1 + 10 * 4)
 
 
 /* Function prototypes */
 
+#ifndef DTL_LIBRARY
 void mem_viol(int sig);
 void give_help(void);
-int parse(char* s);
+int parse(char* s, char* next);
 void process(char* s);
 
 int open_dtl(char* dtl_file, FILE** pdtl);
 int open_dvi(char* dvi_file, FILE** pdvi);
+#endif
+
+void init_state(void);
+void free_state(void);
 
 int dt2dv(FILE* dtl, FILE* dvi);
+int dt2dv_pages(FILE* dtl, FILE* dvi);
+void encode_pages(FILE* dtl, FILE* out, PageRec* rec, size_t first,
+                  size_t last);
+int copy_page(FILE* page, PageRec* rec, FILE* err, FILE* fonts, FILE* dvi);
+int dt2dv_incr(FILE* dtl, FILE* dvi);
+int include_dtl(FILE* dtl, FILE* dvi);
+void begin_block(FILE* dtl, int define);
+void end_block(int define, FILE* dvi);
+int call_macro(FILE* dtl, FILE* dvi);
+void check_block_opcode(int opcode);
+void page_done(FILE* dvi, S4 count0);
+void flush_dvi(FILE* dvi);
+int warn_counted(WarnKind kind, COUNT line, const char* file, int ln,
+                 const char* func);
+void warn_summary(void);
+void write_manifest(void);
 
 void* gmalloc(size_t size);
 
 void dinfo(void);
 void dexit(int n);
 
-int cons_cmds(int nprefixes, CmdPrefix prefix[], CmdTable cmds);
-void free_cmds(CmdTable cmd_table);
+void init_commands(void);
 
 int get_line(FILE* fp, Line* line, int max);
+int map_dtl(FILE* dtl);
+size_t map_pos(void);
+int map_line(Line* line);
+void map_advance(size_t pos);
+void map_seek(size_t pos, COUNT line);
+int skip_space_map(int* ch, COUNT* count);
+int read_misc_map(Token token, COUNT* count);
+int read_mes_map(char* token, COUNT* count);
+int set_seq_map(FILE* dvi);
+int get_lstr_map(LStringPtr lsp);
 int read_line_char(FILE* fp, int* ch);
 int read_char(FILE* fp, int* ch);
 int unread_char(void);
@@ -200,12 +493,28 @@ COUNT read_misc(FILE* fp, Token token);
 COUNT read_mes(FILE* fp, char* token);
 
 int find_command(char* command, int* opcode);
+int find_sized_command(char* command, int* opcode);
+int xfer_sized(FILE* dtl, FILE* dvi, int opcode);
 int xfer_args(FILE* dtl, FILE* dvi, int opcode);
+void xfer_none(FILE* dtl, FILE* dvi, int opcode);
+void xfer_char(FILE* dtl, FILE* dvi, int opcode);
+void xfer_rule(FILE* dtl, FILE* dvi, int opcode);
+void xfer_bop(FILE* dtl, FILE* dvi, int opcode);
+void xfer_eop(FILE* dtl, FILE* dvi, int opcode);
+void xfer_push(FILE* dtl, FILE* dvi, int opcode);
+void xfer_pop(FILE* dtl, FILE* dvi, int opcode);
+void xfer_move(FILE* dtl, FILE* dvi, int opcode);
+void xfer_special(FILE* dtl, FILE* dvi, int opcode);
+void xfer_fontdef(FILE* dtl, FILE* dvi, int opcode);
+void xfer_pre(FILE* dtl, FILE* dvi, int opcode);
+void xfer_post(FILE* dtl, FILE* dvi, int opcode);
+void xfer_post_post(FILE* dtl, FILE* dvi, int opcode);
 
 int set_seq(FILE* dtl, FILE* dvi);
 
 int check_byte(int byte);
 int put_byte(int onebyte, FILE* dvi);
+size_t put_bytes(const char* bytes, size_t n, FILE* dvi);
 
 U4 xfer_hex(int n, FILE* dtl, FILE* dvi);
 U4 xfer_oct(int n, FILE* dtl, FILE* dvi);
@@ -220,22 +529,26 @@ void clear_lstr(LStringPtr lsp);
 LStringPtr alloc_lstr(size_t n);
 void free_lstr(LStringPtr lsp);
 
+void stream_lstr(LStringPtr lsp, int n, FILE* dvi);
+void spill_lstr(LStringPtr lsp);
 void putch_lstr(int ch, LStringPtr lsp);
 size_t get_lstr(FILE* dtl, LStringPtr lsp);
 void put_lstr(LStringPtr lsp, FILE* dvi);
-U4 xfer_len_string(int n, FILE* dtl, FILE* dvi);
+U4 xfer_len_string(int n, int op, FILE* dtl, FILE* dvi);
 
 U4 get_unsigned(FILE* dtl);
 S4 get_signed(FILE* dtl);
 
 int put_unsigned(int n, U4 unum, FILE* dvi);
+Byte* encode_unsigned(Byte* p, int n, U4 unum);
 int put_signed(int n, S4 snum, FILE* dvi);
+int check_unsigned(int n, U4 unum);
+int patch_unsigned(int n, U4 unum, long pos, FILE* dvi);
 
+void warn_address(const char* what, S4 snum, word_t correct);
 S4 xfer_bop_address(FILE* dtl, FILE* dvi);
 S4 xfer_postamble_address(FILE* dtl, FILE* dvi);
 
-int put_table(op_table table, int opcode, FILE* dtl, FILE* dvi);
-
 U4 special(FILE* dtl, FILE* dvi, int n);
 int fontdef(FILE* dtl, FILE* dvi, int n);
 
@@ -243,4 +556,7 @@ U4 preamble(FILE* dtl, FILE* dvi);
 int postamble(FILE* dtl, FILE* dvi);
 int post_post(FILE* dtl, FILE* dvi);
 
+void note_font(U4 k, const Byte* def, size_t len);
+int write_postamble(FILE* dvi);
+
 #endif /* INC_DT2DV_H */
\ No newline at end of file
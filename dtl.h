@@ -17,6 +17,11 @@
 */
 #define INC_DTL_H
 #include <inttypes.h>
+#include <setjmp.h> // jmp_buf
+#include <stdio.h>  // FILE
+
+#include "dviop.h"
+#include "libdtl.h"
 
 /// variety of DTL produced
 #define VARIETY     "sequences-6"
@@ -55,23 +60,51 @@ typedef char        String[MAXSTRLEN+1];
 
 
 /** global variable
+ *
+ * Each program keeps these to itself (static), since libdtl holds both;
+ * and in libdtl each thread has its own (DTL_TLS), so that conversions
+ * may run on many threads at once.
  */
 
+#if defined(DTL_LIBRARY) && defined(__GNUC__)
+#define DTL_TLS __thread
+#else
+#define DTL_TLS
+#endif
+
+/// the DVI tools (dvopt and the like) use the messages and the command
+/// table, but not all of the converters' globals
+#if defined(__GNUC__)
+#define DTL_UNUSED __attribute__((unused))
+#else
+#define DTL_UNUSED
+#endif
+
 /// normally, debugging is off
-int debug = 0;  
+static DTL_TLS int debug DTL_UNUSED = 0;
 
 /// Is each DTL command parenthesised by a BCOM and an ECOM? 
 /// by default, no grouping 
-int group = 0;
+static DTL_TLS int group DTL_UNUSED = 0;
 
 /// name of this program
-char* program_name;
-void dtl_msg_start(char* level, const char* _file, int _ln, const char* _func) {
-    fprintf(stderr, "%s", level);
+static DTL_TLS char* program_name;
+
+/// where messages go: stderr, or the file a libdtl caller gave
+static DTL_TLS FILE* msg_fp;
+
+/// In a libdtl call, where dexit returns to, so that the call returns
+/// fail_status; otherwise NULL, and dexit exits.
+static DTL_TLS jmp_buf* fail_jmp DTL_UNUSED = NULL;
+static DTL_TLS DtlStatus fail_status DTL_UNUSED = DTL_ERROR_INPUT;
+
+static void dtl_msg_start(char* level, const char* _file, int _ln,
+                          const char* _func) {
+    fprintf(msg_fp, "%s", level);
     if (debug) {
-        fprintf(stderr, "%s:%d: In function '%s': ", _file, _ln, _func);
+        fprintf(msg_fp, "%s:%d: In function '%s': ", _file, _ln, _func);
     } else {
-        fprintf(stderr, "%s: In function '%s': ", program_name, _func);
+        fprintf(msg_fp, "%s: In function '%s': ", program_name, _func);
     }
 }
 #define _MSG_SATRT(level) dtl_msg_start(level, __FILE__, __LINE__, __func__)
@@ -120,227 +153,58 @@ void dtl_msg_start(char* level, const char* _file, int _ln, const char* _func) {
 #define  QUOTE_CHAR '\"'
 
 
-/** command names in DTL 
+/** placeholder for a byte address that dt2dv supplies itself:
+ * p[4] in bop and post, q[4] in post_post
  */
-enum DVICmd {
-    SET1 = 128,
-    SET2,
-    SET3,
-    SET4,
-    SET_RULE,
-
-    PUT1 = 133,
-    PUT2,
-    PUT3,
-    PUT4,
-    PUT_RULE,
-
-    NOP = 138,
-    BOP,
-    EOP,
-    PUSH,
-    POP,
-
-    RIGHT1 = 143,
-    RIGHT2,
-    RIGHT3,
-    RIGHT4,
-
-    W0 = 147,
-    W1,
-    W2,
-    W3,
-    W4,
-
-    X0 = 152,
-    X1,
-    X2,
-    X3,
-    X4,
-
-    DOWN1 = 157,
-    DOWN2,
-    DOWN3,
-    DOWN4,
-
-    Y0 = 161,
-    Y1,
-    Y2,
-    Y3,
-    Y4,
-
-    Z0 = 166,
-    Z1,
-    Z2,
-    Z3,
-    Z4,
-
-    FNT_NUM_0 = 171,
-    /// [171, 234] fnt_num_N
-    FNT_NUM_63 = 234,
-
-    FONT1 = 235,
-    FONT2,
-    FONT3,
-    FONT4,
-
-    XXX1 = 239,
-    XXX2,
-    XXX3,
-    XXX4,
-
-    FNT_DEF1 = 243,
-    FNT_DEF2,
-    FNT_DEF3,
-    FNT_DEF4,
-
-    PRE = 247,
-    POST,
-    POSTPOST,
-
-    UNDEFINED = 250,
-}; /* enum DVICmd */
-
-#define SETCHAR_STR     "\\"
-#define SET_STR         "s"
-#define SET1_STR        "s1"
-#define SET2_STR        "s2"
-#define SET3_STR        "s3"
-#define SET4_STR        "s4"
-#define SET_RULE_STR    "sr"
-#define PUT_STR         "p"
-#define PUT1_STR        "p1"
-#define PUT2_STR        "p2"
-#define PUT3_STR        "p3"
-#define PUT4_STR        "p4"
-#define PUT_RULE_STR    "pr"
-#define NOP_STR         "nop"
-#define BOP_STR         "bop"
-#define EOP_STR         "eop"
-#define PUSH_STR        "["
-#define POP_STR         "]"
-#define RIGHT_STR       "r"
-#define RIGHT1_STR      "r1"
-#define RIGHT2_STR      "r2"
-#define RIGHT3_STR      "r3"
-#define RIGHT4_STR      "r4"
-#define W_STR           "w"
-#define W0_STR          "w0"
-#define W1_STR          "w1"
-#define W2_STR          "w2"
-#define W3_STR          "w3"
-#define W4_STR          "w4"
-#define X_STR           "x"
-#define X0_STR          "x0"
-#define X1_STR          "x1"
-#define X2_STR          "x2"
-#define X3_STR          "x3"
-#define X4_STR          "x4"
-#define DOWN_STR        "d"
-#define DOWN1_STR       "d1"
-#define DOWN2_STR       "d2"
-#define DOWN3_STR       "d3"
-#define DOWN4_STR       "d4"
-#define Y_STR           "y"
-#define Y0_STR          "y0"
-#define Y1_STR          "y1"
-#define Y2_STR          "y2"
-#define Y3_STR          "y3"
-#define Y4_STR          "y4"
-#define Z_STR           "z"
-#define Z0_STR          "z0"
-#define Z1_STR          "z1"
-#define Z2_STR          "z2"
-#define Z3_STR          "z3"
-#define Z4_STR          "z4"
-#define FONT_STR        "f"
-#define FONT1_STR       "f1"
-#define FONT2_STR       "f2"
-#define FONT3_STR       "f3"
-#define FONT4_STR       "f4"
-#define FONT_DEF_STR    "fd"
-#define FONT_NUM_STR    "fn"
-#define SPECIAL_STR     "special"
-#define PRE_STR         "pre"
-#define POST_STR        "post"
-#define POSTPOST_STR    "post_post"
-#define OPCODE_STR      "opcode"
-
-/* operation's opcode, name, number of args, string of arguments. */
+
+#define  AUTO_ADDRESS  "auto"
+
+
+/* a run of opcodes, as a row of DVI_COMMANDS */
 typedef struct {
-    int code;
-    char* name;
-    int nargs;
-    char* args;
-} op_info;
+    int first, last;
+    const char* prefix;
+    int suffix;
+    DviKind kind;
+} DviRun;
+
+#define DVI_RUN(first, last, prefix, suffix, kind) \
+    {first, last, prefix, suffix, kind},
+static const DviRun dvi_runs[] = {DVI_COMMANDS(DVI_RUN)};
+#undef DVI_RUN
 
-/* name of table, first opcode, last opcode, pointer to opcode info. */
+#define NRUNS ((int)(sizeof(dvi_runs) / sizeof(dvi_runs[0])))
+
+/* a DVI command, by opcode */
 typedef struct {
-    char* name;
-    int first;
-    int last;
-    op_info* list;
-} op_table;
-
-
-/* Table for opcodes 128 to 170 inclusive. */
-op_info op_info_128_170[] = {
-    {SET1, SET1_STR, 1, "1"},
-    {SET2, SET2_STR, 1, "2"},
-    {SET3, SET3_STR, 1, "3"},
-    {SET4, SET4_STR, 1, "-4"},
-    {SET_RULE, SET_RULE_STR, 2, "-4 -4"},
-    {PUT1, PUT1_STR, 1, "1"},
-    {PUT2, PUT2_STR, 1, "2"},
-    {PUT3, PUT3_STR, 1, "3"},
-    {PUT4, PUT4_STR, 1, "-4"},
-    {PUT_RULE, PUT_RULE_STR, 2, "-4 -4"},
-    {NOP, NOP_STR, 0, ""},
-    OP_INFO_BOP,
-    {EOP, EOP_STR, 0, ""},
-    {PUSH, PUSH_STR, 0, ""},
-    {POP, POP_STR, 0, ""},
-    {RIGHT1, RIGHT1_STR, 1, "-1"},
-    {RIGHT2, RIGHT2_STR, 1, "-2"},
-    {RIGHT3, RIGHT3_STR, 1, "-3"},
-    {RIGHT4, RIGHT4_STR, 1, "-4"},
-    {W0, W0_STR, 0, ""},
-    {W1, W1_STR, 1, "-1"},
-    {W2, W2_STR, 1, "-2"},
-    {W3, W3_STR, 1, "-3"},
-    {W4, W4_STR, 1, "-4"},
-    {X0, X0_STR, 0, ""},
-    {X1, X1_STR, 1, "-1"},
-    {X2, X2_STR, 1, "-2"},
-    {X3, X3_STR, 1, "-3"},
-    {X4, X4_STR, 1, "-4"},
-    {DOWN1, DOWN1_STR, 1, "-1"},
-    {DOWN2, DOWN2_STR, 1, "-2"},
-    {DOWN3, DOWN3_STR, 1, "-3"},
-    {DOWN4, DOWN4_STR, 1, "-4"},
-    {Y0, Y0_STR, 0, ""},
-    {Y1, Y1_STR, 1, "-1"},
-    {Y2, Y2_STR, 1, "-2"},
-    {Y3, Y3_STR, 1, "-3"},
-    {Y4, Y4_STR, 1, "-4"},
-    {Z0, Z0_STR, 0, ""},
-    {Z1, Z1_STR, 1, "-1"},
-    {Z2, Z2_STR, 1, "-2"},
-    {Z3, Z3_STR, 1, "-3"},
-    {Z4, Z4_STR, 1, "-4"}
-}; /* op_info  op_info_128_170 [] */
-
-op_table op_128_170 = {"op_128_170", SET1, Z4, op_info_128_170};
-
-
-/* Table for fnt1 to fnt4 (opcodes 235 to 238) inclusive. */
-op_info fnt_n[] = {
-    {FONT1, FONT1_STR, 1, "1"},
-    {FONT2, FONT2_STR, 1, "2"},
-    {FONT3, FONT3_STR, 1, "3"},
-    {FONT4, FONT4_STR, 1, "-4"}
-}; /* op_info  fnt_n [] */
-
-op_table fnt = {FONT_STR, FONT1, FONT4, fnt_n};
-
-#endif /* INC_DTL_H */
\ No newline at end of file
+    char name[12];  ///< DTL name: prefix and suffix.
+    int suffix;     ///< its suffix, or -1; the argument's width, if sized.
+    DviKind kind;
+} DviOp;
+
+/* all NCMDS commands, filled in by init_dvi_ops */
+static DTL_TLS DviOp dvi_op[NCMDS];
+
+/* fill in dvi_op[] from DVI_COMMANDS */
+static DTL_UNUSED void init_dvi_ops(void) {
+    for (int i = 0; i < NRUNS; i++) {
+        const DviRun* run = &dvi_runs[i];
+
+        for (int opcode = run->first; opcode <= run->last; opcode++) {
+            DviOp* op = &dvi_op[opcode];
+
+            op->kind = run->kind;
+            if (run->suffix < 0) {
+                op->suffix = -1;
+                snprintf(op->name, sizeof(op->name), "%s", run->prefix);
+            } else {
+                op->suffix = run->suffix + opcode - run->first;
+                snprintf(op->name, sizeof(op->name),
+                         (run->kind == KIND_SETCHAR ? "%s%02X" : "%s%d"),
+                         run->prefix, op->suffix);
+            }
+        }
+    }
+} /* init_dvi_ops */
+
+#endif /* INC_DTL_H */
@@ -0,0 +1,360 @@
+/* dtlinclude.c - DTL fragments named by an `include' command, for dt2dv.
+
+   This file is public domain.
+
+   Fragment k may be indexed once dt2dv has taken fragment
+   k - DTL_INCLUDE_AHEAD or a later one, so that only a few fragments
+   are mapped at a time, however many a directory holds.  `next' is the
+   next fragment for a thread to index, and `taken' the last one dt2dv
+   has asked for; these, `stop', and each fragment's `ready' are under
+   `lock'.
+*/
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L /* fileno, sysconf, pthreads */
+#endif
+
+#include <errno.h>  // errno, ENOMEM
+#include <stdlib.h> // malloc, realloc, free, qsort
+#include <string.h> // memset, strcmp, strlen, strrchr
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_DIRENT 1
+#include <dirent.h>   // opendir, readdir
+#include <sys/stat.h> // stat
+#include <unistd.h>   // sysconf
+#endif
+
+#if (defined(__unix__) || defined(__APPLE__)) && defined(__GNUC__)
+#define HAVE_INCLUDE_THREADS 1
+#include <pthread.h>
+#endif
+
+#include "dtlinclude.h"
+
+/* most threads indexing fragments at once */
+#define DTL_INCLUDE_THREADS 8
+
+/* most fragments indexed ahead of the one dt2dv is reading */
+#define DTL_INCLUDE_AHEAD (4 * DTL_INCLUDE_THREADS)
+
+/* one fragment */
+typedef struct _DtlFragment {
+    char* path;     ///< file name, as opened.
+    FILE* fp;       ///< the file, or NULL if it could not be opened.
+    int err;        ///< errno, if it could not be opened.
+    DtlIndex index; ///< its index; text is NULL if it is to be read as a stream.
+    int ready;      ///< fp and index are set.
+} DtlFragment;
+
+struct _DtlInclude {
+    size_t n;          ///< number of fragments.
+    DtlFragment* frag; ///< the fragments, in order.
+    int group;         ///< are commands grouped by BCOM and ECOM?
+    size_t next;       ///< next fragment to index.
+    size_t taken;      ///< fragment dt2dv has asked for last.
+    int stop;          ///< threads are to index no more.
+#ifdef HAVE_INCLUDE_THREADS
+    int nthreads;
+    pthread_t thread[DTL_INCLUDE_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+};
+
+/* open fragment f, and map and index it if possible, as map_dtl would */
+static void index_fragment(DtlFragment* f, int group) {
+    f->fp = fopen(f->path, "r");
+    if (f->fp == NULL) {
+        f->err = errno;
+        return;
+    }
+    if (dtl_index_map(&f->index, f->fp)
+        && (dtl_index_build(&f->index, group) == 0 || !f->index.clean)) {
+        dtl_index_free(&f->index);
+    }
+} /* index_fragment */
+
+/* dir/name, or name if it is absolute or dir is empty; NULL if no memory */
+static char* join_path(const char* dir, size_t ndir, const char* name) {
+    size_t nname = strlen(name);
+    char* path;
+
+    if (name[0] == '/') {
+        ndir = 0;
+    }
+    path = (char*)malloc(ndir + 1 + nname + 1);
+    if (path == NULL) {
+        return NULL;
+    }
+    if (ndir > 0) {
+        memcpy(path, dir, ndir);
+        path[ndir++] = '/';
+    }
+    memcpy(path + ndir, name, nname + 1);
+    return path;
+} /* join_path */
+
+/* append a fragment of file name path, which is now inc's to free */
+static int add_fragment(DtlInclude* inc, size_t* max, char* path) {
+    if (path == NULL) {
+        return 0;
+    }
+    if (inc->n == *max) {
+        size_t m = (*max == 0 ? 64 : 2 * *max);
+        DtlFragment* f = (DtlFragment*)realloc(inc->frag, m * sizeof(*f));
+
+        if (f == NULL) {
+            free(path);
+            return 0;
+        }
+        inc->frag = f;
+        *max = m;
+    }
+    memset(&inc->frag[inc->n], 0, sizeof(DtlFragment));
+    inc->frag[inc->n++].path = path;
+    return 1;
+} /* add_fragment */
+
+static int by_path_cmp(const void* a, const void* b) {
+    return strcmp(((const DtlFragment*)a)->path, ((const DtlFragment*)b)->path);
+} /* by_path_cmp */
+
+#ifdef HAVE_DIRENT
+/* add the files of directory path whose names end in .dtl, sorted by name */
+static int add_directory(DtlInclude* inc, size_t* max, const char* path) {
+    DIR* dir = opendir(path);
+    struct dirent* e;
+    size_t npath = strlen(path);
+
+    if (dir == NULL) {
+        return 0;
+    }
+    while (npath > 1 && path[npath - 1] == '/') {
+        --npath;
+    }
+
+    errno = 0;
+    while ((e = readdir(dir)) != NULL) {
+        size_t len = strlen(e->d_name);
+        struct stat st;
+        char* file;
+
+        if (e->d_name[0] == '.' || len <= 4
+            || strcmp(e->d_name + len - 4, ".dtl") != 0) {
+            continue;
+        }
+        file = join_path(path, npath, e->d_name);
+        if (file != NULL && (stat(file, &st) != 0 || !S_ISREG(st.st_mode))) {
+            free(file);
+            continue;
+        }
+        if (!add_fragment(inc, max, file)) {
+            closedir(dir);
+            errno = ENOMEM;
+            return 0;
+        }
+        errno = 0;
+    }
+    if (errno != 0) {
+        int err = errno;
+
+        closedir(dir);
+        errno = err;
+        return 0;
+    }
+    closedir(dir);
+
+    /* the names in a directory differ only after its path */
+    qsort(inc->frag, inc->n, sizeof(DtlFragment), by_path_cmp);
+    return 1;
+} /* add_directory */
+#endif /* HAVE_DIRENT */
+
+#ifdef HAVE_INCLUDE_THREADS
+/* an indexing thread */
+static void* index_ahead(void* arg) {
+    DtlInclude* inc = (DtlInclude*)arg;
+
+    pthread_mutex_lock(&inc->lock);
+    for (;;) {
+        size_t k;
+
+        while (!inc->stop && inc->next < inc->n
+               && inc->next >= inc->taken + DTL_INCLUDE_AHEAD) {
+            pthread_cond_wait(&inc->cond, &inc->lock);
+        }
+        if (inc->stop || inc->next >= inc->n) {
+            break;
+        }
+        k = inc->next++;
+
+        pthread_mutex_unlock(&inc->lock);
+        index_fragment(&inc->frag[k], inc->group);
+        pthread_mutex_lock(&inc->lock);
+
+        inc->frag[k].ready = 1;
+        pthread_cond_broadcast(&inc->cond);
+    }
+    pthread_mutex_unlock(&inc->lock);
+    return NULL;
+} /* index_ahead */
+#endif /* HAVE_INCLUDE_THREADS */
+
+/** List the fragments that an include command names: file name,
+ *  relative to the directory of file base (if base is not NULL),
+ *  or each .dtl file in directory name; and start indexing them.
+ *
+ *  @return the fragments, or NULL (with errno set) if name cannot be read.
+ */
+DtlInclude* dtl_include_open(const char* base, const char* name, int group) {
+    DtlInclude* inc;
+    const char* slash = (base != NULL ? strrchr(base, '/') : NULL);
+    size_t ndir = (slash == NULL ? 0 : slash == base ? 1 : slash - base);
+    char* path = join_path(base, ndir, name);
+    size_t max = 0;
+    int ok;
+
+    inc = (DtlInclude*)calloc(1, sizeof(DtlInclude));
+    if (inc == NULL || path == NULL) {
+        free(inc);
+        free(path);
+        errno = ENOMEM;
+        return NULL;
+    }
+    inc->group = group;
+
+#ifdef HAVE_DIRENT
+    {
+        struct stat st;
+
+        if (stat(path, &st) != 0) {
+            ok = 0;
+        } else if (S_ISDIR(st.st_mode)) {
+            ok = add_directory(inc, &max, path);
+            free(path);
+            path = NULL;
+        } else {
+            ok = add_fragment(inc, &max, path);
+            path = NULL;
+        }
+    }
+#else
+    ok = add_fragment(inc, &max, path);
+    path = NULL;
+#endif
+    if (!ok) {
+        int err = errno;
+
+        free(path);
+        dtl_include_close(inc);
+        errno = err;
+        return NULL;
+    }
+
+#ifdef HAVE_INCLUDE_THREADS
+    if (inc->n > 1) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        int want = (ncpu < 1 ? 1
+                    : ncpu > DTL_INCLUDE_THREADS ? DTL_INCLUDE_THREADS
+                                                 : (int)ncpu);
+
+        if ((size_t)want > inc->n) {
+            want = (int)inc->n;
+        }
+        pthread_mutex_init(&inc->lock, NULL);
+        pthread_cond_init(&inc->cond, NULL);
+        while (inc->nthreads < want
+               && pthread_create(&inc->thread[inc->nthreads], NULL, index_ahead,
+                                 inc) == 0) {
+            ++inc->nthreads;
+        }
+        if (inc->nthreads == 0) {
+            pthread_cond_destroy(&inc->cond);
+            pthread_mutex_destroy(&inc->lock);
+        }
+    }
+#endif
+
+    return inc;
+} /* dtl_include_open */
+
+/* number of fragments */
+size_t dtl_include_count(const DtlInclude* inc) {
+    return inc->n;
+} /* dtl_include_count */
+
+/* file name of fragment k, as it is opened */
+const char* dtl_include_path(const DtlInclude* inc, size_t k) {
+    return inc->frag[k].path;
+} /* dtl_include_path */
+
+/** Take fragment k, once it is indexed, and let the threads index
+ *  fragments further ahead.  Fragments must be taken in order.
+ *  Its index goes to *ix, with text NULL if it is to be read as a stream;
+ *  the caller is to free the index, and close the file.
+ *
+ *  @return the fragment's file, or NULL (with errno set) if it cannot
+ *          be opened.
+ */
+FILE* dtl_include_take(DtlInclude* inc, size_t k, DtlIndex* ix) {
+    DtlFragment* f = &inc->frag[k];
+    FILE* fp;
+
+#ifdef HAVE_INCLUDE_THREADS
+    if (inc->nthreads > 0) {
+        pthread_mutex_lock(&inc->lock);
+        inc->taken = k;
+        pthread_cond_broadcast(&inc->cond);
+        while (!f->ready) {
+            pthread_cond_wait(&inc->cond, &inc->lock);
+        }
+        pthread_mutex_unlock(&inc->lock);
+    }
+#endif
+    if (!f->ready) {
+        index_fragment(f, inc->group);
+        f->ready = 1;
+    }
+
+    fp = f->fp;
+    *ix = f->index;
+    f->fp = NULL;
+    memset(&f->index, 0, sizeof(f->index));
+    if (fp == NULL) {
+        errno = f->err;
+    }
+    return fp;
+} /* dtl_include_take */
+
+/* stop indexing, and free the fragments that were not taken */
+void dtl_include_close(DtlInclude* inc) {
+    if (inc == NULL) {
+        return;
+    }
+
+#ifdef HAVE_INCLUDE_THREADS
+    if (inc->nthreads > 0) {
+        pthread_mutex_lock(&inc->lock);
+        inc->stop = 1;
+        pthread_cond_broadcast(&inc->cond);
+        pthread_mutex_unlock(&inc->lock);
+        for (int i = 0; i < inc->nthreads; i++) {
+            pthread_join(inc->thread[i], NULL);
+        }
+        pthread_cond_destroy(&inc->cond);
+        pthread_mutex_destroy(&inc->lock);
+    }
+#endif
+
+    for (size_t k = 0; k < inc->n; k++) {
+        if (inc->frag[k].fp != NULL) {
+            fclose(inc->frag[k].fp);
+        }
+        dtl_index_free(&inc->frag[k].index);
+        free(inc->frag[k].path);
+    }
+    free(inc->frag);
+    free(inc);
+} /* dtl_include_close */
+
+/* end of "dtlinclude.c" */
@@ -0,0 +1,28 @@
+#ifndef INC_DTLINCLUDE_H
+/* dtlinclude.h - DTL fragments named by an `include' command, for dt2dv.
+
+   This file is public domain.
+
+   - An `include' command names a DTL file, or a directory, whose
+     files ending in `.dtl' are taken in the sorted order of their names.
+   - While dt2dv encodes one fragment, threads of its own map and
+     index the next few, so that dt2dv seldom waits to read one.
+   - dt2dv takes the fragments in order, one at a time, and reads each
+     as it would a DTL file of its own.
+*/
+#define INC_DTLINCLUDE_H
+
+#include <stddef.h> // size_t
+#include <stdio.h>  // FILE
+
+#include "dtlindex.h"
+
+typedef struct _DtlInclude DtlInclude;
+
+DtlInclude* dtl_include_open(const char* base, const char* name, int group);
+size_t dtl_include_count(const DtlInclude* inc);
+const char* dtl_include_path(const DtlInclude* inc, size_t k);
+FILE* dtl_include_take(DtlInclude* inc, size_t k, DtlIndex* ix);
+void dtl_include_close(DtlInclude* inc);
+
+#endif /* INC_DTLINCLUDE_H */
@@ -0,0 +1,435 @@
+/* dtlindex.c - structural index of a DTL file, for dt2dv.
+
+   This file is public domain.
+
+   The index pass works like the first stage of simdjson:
+   each 64-byte block of text is classified, 16 bytes at a time,
+   into bitmaps of white space, quotes, escapes and parentheses;
+   a small state machine then walks those bitmaps with bit scans,
+   one token at a time, to mark where each token starts and ends.
+
+   Tokens are as read by dt2dv's read_token:
+    + a message, from BMES_CHAR to the next unescaped EMES_CHAR;
+    + a sequence, from BSEQ_CHAR to the next unescaped ESEQ_CHAR;
+    + a lone ESEQ_CHAR, or (if grouped) a lone BCOM_CHAR or ECOM_CHAR;
+    + any other run of non-space characters, ended (if grouped)
+      also by ECOM_CHAR.
+*/
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L /* fileno, mmap */
+#endif
+
+#include <stdlib.h> // calloc, free
+#include <string.h> // memcpy, memset
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_MMAP 1
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "dtlindex.h"
+
+/* the DTL characters of interest, as in dtl.h */
+#define IX_BCOM_CHAR '{'
+#define IX_ECOM_CHAR '}'
+#define IX_MES_CHAR  '\''
+#define IX_BSEQ_CHAR '('
+#define IX_ESEQ_CHAR ')'
+#define IX_ESC_CHAR  '\\'
+
+/* classification of one 64-byte block; bit i is byte i */
+typedef struct {
+    uint64_t space; ///< white space, as isspace() in the C locale.
+    uint64_t nl;    ///< newline.
+    uint64_t mes;   ///< BMES_CHAR, EMES_CHAR.
+    uint64_t esc;   ///< ESC_CHAR.
+    uint64_t eseq;  ///< ESEQ_CHAR.
+    uint64_t ecom;  ///< ECOM_CHAR.
+    uint64_t bad;   ///< neither printable ASCII nor white space.
+} Block;
+
+/* where the index pass is, between blocks */
+typedef enum _IxState {
+    IX_SPACE, ///< between tokens.
+    IX_MISC,  ///< in a token of non-space characters.
+    IX_MES,   ///< in a message.
+    IX_SEQ,   ///< in a sequence.
+} IxState;
+
+
+#ifdef __SSE2__
+
+/* 16 bits, one per byte of v equal to c */
+#define EQ16(v, c) \
+    ((uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c))))
+
+static void classify(const char* p, Block* b) {
+    memset(b, 0, sizeof(*b));
+
+    for (int i = 0; i < 64; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        /* bytes 0x80 to 0xFF compare as negative */
+        __m128i ctl = _mm_cmplt_epi8(v, _mm_set1_epi8(0x20));
+        __m128i tab_cr = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(8)),
+                                       _mm_cmplt_epi8(v, _mm_set1_epi8(14)));
+        uint64_t sp = EQ16(v, ' ')
+                      | (uint64_t)(unsigned)_mm_movemask_epi8(tab_cr);
+
+        b->space |= sp << i;
+        b->nl |= EQ16(v, '\n') << i;
+        b->mes |= EQ16(v, IX_MES_CHAR) << i;
+        b->esc |= EQ16(v, IX_ESC_CHAR) << i;
+        b->eseq |= EQ16(v, IX_ESEQ_CHAR) << i;
+        b->ecom |= EQ16(v, IX_ECOM_CHAR) << i;
+        b->bad |= (((uint64_t)(unsigned)_mm_movemask_epi8(ctl) & ~sp)
+                   | EQ16(v, 0x7F)) << i;
+    }
+} /* classify */
+
+#else /* NOT __SSE2__ */
+
+static void classify(const char* p, Block* b) {
+    memset(b, 0, sizeof(*b));
+
+    for (int i = 0; i < 64; i++) {
+        unsigned char c = (unsigned char)p[i];
+        uint64_t bit = (uint64_t)1 << i;
+
+        if (c == ' ' || (c >= '\t' && c <= '\r')) {
+            b->space |= bit;
+            if (c == '\n') b->nl |= bit;
+        } else if (c < 0x20 || c >= 0x7F) {
+            b->bad |= bit;
+        } else if (c == IX_MES_CHAR) {
+            b->mes |= bit;
+        } else if (c == IX_ESC_CHAR) {
+            b->esc |= bit;
+        } else if (c == IX_ESEQ_CHAR) {
+            b->eseq |= bit;
+        } else if (c == IX_ECOM_CHAR) {
+            b->ecom |= bit;
+        }
+    }
+} /* classify */
+
+#endif /* __SSE2__ */
+
+
+/* number of the lowest set bit of m, which is nonzero */
+static int lowest_bit(uint64_t m) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(m);
+#else
+    int n = 0;
+    while ((m & 1) == 0) {
+        m >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+} /* lowest_bit */
+
+/* number of set bits in m */
+static int count_bits(uint64_t m) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(m);
+#else
+    int n = 0;
+    for (; m != 0; m &= m - 1) ++n;
+    return n;
+#endif
+} /* count_bits */
+
+#define SET_BIT(bits, i) ((bits)[(i) >> 6] |= (uint64_t)1 << ((i)&63))
+
+
+/** Map the DTL file fp into memory, if it is a nonempty regular file
+ *  that has not been read yet.
+ *
+ *  @param[out] ix
+ *  @param[in]  fp
+ *  @return 1 if mapped, 0 if fp must be read as a stream.
+ */
+int dtl_index_map(DtlIndex* ix, FILE* fp) {
+    memset(ix, 0, sizeof(*ix));
+
+#ifdef HAVE_MMAP
+    {
+        struct stat st;
+        int fd = fileno(fp);
+        void* p;
+
+        if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)
+            || st.st_size <= 0 || ftell(fp) != 0) {
+            return 0;
+        }
+
+        p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            return 0;
+        }
+        (void)posix_madvise(p, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+        ix->text = (const char*)p;
+        ix->size = (size_t)st.st_size;
+        return 1;
+    }
+#else
+    (void)fp;
+    return 0;
+#endif
+} /* dtl_index_map */
+
+/* is the token starting at text[at] the command name, of length len? */
+static int is_command(const char* text, size_t size, size_t at,
+                      const char* name, size_t len, int group) {
+    char c;
+
+    if (at + len > size || memcmp(text + at, name, len) != 0) return 0;
+    if (at + len == size) return 1;
+
+    c = text[at + len];
+    return (c == ' ' || (c >= '\t' && c <= '\r')
+            || (group && c == IX_ECOM_CHAR));
+} /* is_command */
+
+/* record a bop command at byte offset off, on line number line */
+static int add_bop(DtlIndex* ix, size_t* max, size_t off, size_t line) {
+    if (ix->nbop >= *max) {
+        size_t m = (*max == 0 ? 256 : 2 * *max);
+        size_t* b = (size_t*)realloc(ix->bop, m * sizeof(size_t));
+        size_t* l;
+
+        if (b == NULL) return 0;
+        ix->bop = b;
+        l = (size_t*)realloc(ix->bop_line, m * sizeof(size_t));
+        if (l == NULL) return 0;
+        ix->bop_line = l;
+        *max = m;
+    }
+    ix->bop[ix->nbop] = off;
+    ix->bop_line[ix->nbop] = line;
+    ++ix->nbop;
+
+    return 1;
+} /* add_bop */
+
+/* line number at text[from], given line number line at text[to] */
+static size_t line_before(const char* text, size_t from, size_t to,
+                          size_t line) {
+    for (size_t i = from; i < to; i++) {
+        if (text[i] == '\n') --line;
+    }
+    return line;
+} /* line_before */
+
+/** Index the mapped DTL text: token boundaries, and `bop' commands.
+ *
+ *  @param[inout] ix     mapped by dtl_index_map
+ *  @param[in]    group  are commands grouped by BCOM and ECOM?
+ *  @return 1 if OK, 0 if out of memory.
+ */
+int dtl_index_build(DtlIndex* ix, int group) {
+    const char* text = ix->text;
+    size_t size = ix->size;
+    size_t nwords = size / 64 + 2; /* room for an end bit at text[size] */
+    size_t nbop_max = 0;
+    size_t lines = 0;       /* newlines before current block */
+    size_t resume = 0;      /* where dt2dv stops reading the last token */
+    size_t prev_resume = 0; /* where it stopped before the previous token */
+    int prev_bcom = 0;      /* previous token was BCOM_CHAR */
+    IxState state = IX_SPACE;
+    int skip = 0;           /* skip escaped first byte of next block */
+
+    ix->clean = 1;
+    ix->post = DTL_INDEX_NONE;
+    ix->define = DTL_INDEX_NONE;
+    ix->start = (uint64_t*)calloc(nwords, sizeof(uint64_t));
+    ix->end = (uint64_t*)calloc(nwords, sizeof(uint64_t));
+    if (ix->start == NULL || ix->end == NULL) return 0;
+
+    for (size_t base = 0; base < size; base += 64) {
+        char pad[64];
+        const char* p = text + base;
+        size_t n = size - base;
+        Block b;
+        int pos;
+
+        if (n < 64) {
+            /* last block: pad with spaces, which end any token */
+            memset(pad, ' ', sizeof(pad));
+            memcpy(pad, p, n);
+            p = pad;
+        }
+        classify(p, &b);
+        if (b.bad != 0) ix->clean = 0;
+
+        for (pos = skip, skip = 0; pos < 64;) {
+            uint64_t from = ~(uint64_t)0 << pos;
+            uint64_t m;
+            size_t at;
+
+            switch (state) {
+                case IX_SPACE:
+                    m = ~b.space & from;
+                    if (m == 0) {
+                        pos = 64;
+                        break;
+                    }
+                    pos = lowest_bit(m);
+                    at = base + pos;
+                    SET_BIT(ix->start, at);
+                    if (p[pos] == IX_MES_CHAR) {
+                        state = IX_MES;
+                    } else if (p[pos] == IX_BSEQ_CHAR) {
+                        state = IX_SEQ;
+                    } else if (p[pos] == IX_ESEQ_CHAR
+                               || (group && (p[pos] == IX_BCOM_CHAR
+                                             || p[pos] == IX_ECOM_CHAR))) {
+                        SET_BIT(ix->end, at + 1);
+                    } else {
+                        /* newlines before this token, in this block */
+                        uint64_t before = ~(~(uint64_t)0 << pos);
+
+                        state = IX_MISC;
+                        if (p[pos] == 'b'
+                            && is_command(text, size, at, "bop", 3, group)) {
+                            size_t off = (prev_bcom ? prev_resume : resume);
+                            size_t line = line_before(
+                                text, off, at,
+                                lines + 1 + count_bits(b.nl & before));
+
+                            if (!add_bop(ix, &nbop_max, off, line)) {
+                                return 0;
+                            }
+                            ix->post = DTL_INDEX_NONE;
+                        } else if (p[pos] == 'p' && ix->post == DTL_INDEX_NONE
+                                   && is_command(text, size, at, "post", 4,
+                                                 group)) {
+                            ix->post = (prev_bcom ? prev_resume : resume);
+                            ix->post_line = line_before(
+                                text, ix->post, at,
+                                lines + 1 + count_bits(b.nl & before));
+                        } else if (p[pos] == 'i'
+                                   && is_command(text, size, at, "include", 7,
+                                                 group)) {
+                            ++ix->ninclude;
+                        } else if (p[pos] == 'd'
+                                   && is_command(text, size, at, "define", 6,
+                                                 group)) {
+                            ix->define = at;
+                        }
+                    }
+                    prev_bcom = (group && p[pos] == IX_BCOM_CHAR);
+                    prev_resume = resume;
+                    if (state == IX_SPACE) {
+                        /* a token of one character */
+                        resume = at + 1;
+                    }
+                    ++pos;
+                    break;
+
+                case IX_MISC:
+                    m = (b.space | (group ? b.ecom : 0)) & from;
+                    if (m == 0) {
+                        pos = 64;
+                        break;
+                    }
+                    pos = lowest_bit(m);
+                    SET_BIT(ix->end, base + pos);
+                    state = IX_SPACE;
+                    /* dt2dv reads a white space that ends the token */
+                    resume = base + pos;
+                    if (((b.space >> pos) & 1) && resume < size) ++resume;
+                    break;
+
+                case IX_MES:
+                case IX_SEQ:
+                    m = (b.esc | (state == IX_MES ? b.mes : b.eseq)) & from;
+                    if (m == 0) {
+                        pos = 64;
+                        break;
+                    }
+                    pos = lowest_bit(m);
+                    if ((b.esc >> pos) & 1) {
+                        /* accept the next character literally */
+                        pos += 2;
+                        if (pos > 64) skip = 1;
+                    } else {
+                        ++pos;
+                        SET_BIT(ix->end, base + pos);
+                        state = IX_SPACE;
+                        resume = base + pos;
+                    }
+                    break;
+            }
+        }
+
+        if (n < 64) {
+            /* padding is not text */
+            uint64_t valid = ((uint64_t)1 << n) - 1;
+            lines += count_bits(b.nl & valid);
+        } else {
+            lines += count_bits(b.nl);
+        }
+    }
+
+    /* An unterminated message or sequence gets no end bit, */
+    /* so that dt2dv reads it the slow way, and reports it. */
+
+    return 1;
+} /* dtl_index_build */
+
+/** Find the first bit set, at or after position pos, in bitmap bits.
+ *
+ *  @return position of that bit, or DTL_INDEX_NONE.
+ */
+size_t dtl_index_next(const DtlIndex* ix, const uint64_t* bits, size_t pos) {
+    size_t nwords = ix->size / 64 + 2;
+    size_t w = pos >> 6;
+    uint64_t m;
+
+    if (w >= nwords) return DTL_INDEX_NONE;
+
+    m = bits[w] & (~(uint64_t)0 << (pos & 63));
+    while (m == 0) {
+        if (++w >= nwords) return DTL_INDEX_NONE;
+        m = bits[w];
+    }
+
+    return w * 64 + lowest_bit(m);
+} /* dtl_index_next */
+
+/** Hash the text from position from to position to (FNV-1a, 64 bits),
+ *  to tell whether a page is as it was.
+ */
+uint64_t dtl_index_hash(const DtlIndex* ix, size_t from, size_t to) {
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+
+    for (const char* p = ix->text + from; p < ix->text + to; p++) {
+        h ^= (unsigned char)*p;
+        h *= UINT64_C(0x100000001b3);
+    }
+
+    return h;
+} /* dtl_index_hash */
+
+/* release the index, and unmap its text */
+void dtl_index_free(DtlIndex* ix) {
+    free(ix->start);
+    free(ix->end);
+    free(ix->bop);
+    free(ix->bop_line);
+#ifdef HAVE_MMAP
+    if (ix->text != NULL) {
+        munmap((void*)ix->text, ix->size);
+    }
+#endif
+    memset(ix, 0, sizeof(*ix));
+} /* dtl_index_free */
+
+/* end of "dtlindex.c" */
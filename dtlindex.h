@@ -0,0 +1,56 @@
+#ifndef INC_DTLINDEX_H
+/* dtlindex.h - structural index of a DTL file, for dt2dv.
+
+   This file is public domain.
+
+   - A DTL file that is a regular file is mapped into memory whole,
+     then indexed in one pass: SIMD comparisons classify each block
+     of 64 bytes (white space, quotes, escapes, parentheses), and the
+     boundaries of every token are recorded in two bitmaps.
+   - dt2dv's reader then jumps from token to token by bit scans,
+     instead of classifying characters one at a time.
+   - The byte offset and line number of every `bop' command is kept,
+     and of the `post' command after the last page,
+     so that the file can be split into pages.  The offset is where
+     dt2dv begins to read the command, or its BCOM in group mode:
+     just after the previous token, and any white space that ended it.
+   - `include' commands are counted, since their pages are not in the
+     file, and it cannot then be split; and the last `define' is kept,
+     since pages after it may call its macro.
+*/
+#define INC_DTLINDEX_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+#include <stdio.h>  // FILE
+
+/// no more bits set in an index bitmap
+#define DTL_INDEX_NONE ((size_t)-1)
+
+/* structural index of DTL text */
+typedef struct _DtlIndex {
+    const char* text; ///< DTL text, mapped read-only; NULL if not mapped.
+    size_t size;      ///< number of bytes of text.
+    int clean;  ///< every byte of text is printable ASCII or white space.
+    uint64_t* start; ///< bit i set if a token starts at text[i].
+    uint64_t* end;   ///< bit i set if a token ends just before text[i].
+    size_t nbop;     ///< number of `bop' commands.
+    size_t* bop;      ///< byte offset where dt2dv begins reading each `bop'.
+    size_t* bop_line; ///< line number (from 1) of that byte.
+    size_t post;      ///< same, for `post' after last `bop', or NONE.
+    size_t post_line; ///< line number of that byte.
+    size_t ninclude;  ///< number of `include' commands.
+    size_t define;    ///< where the last `define' command starts, or NONE.
+} DtlIndex;
+
+int dtl_index_map(DtlIndex* ix, FILE* fp);
+int dtl_index_build(DtlIndex* ix, int group);
+void dtl_index_free(DtlIndex* ix);
+
+size_t dtl_index_next(const DtlIndex* ix, const uint64_t* bits, size_t pos);
+uint64_t dtl_index_hash(const DtlIndex* ix, size_t from, size_t to);
+
+/// is bit i of bitmap bits set?
+#define DTL_INDEX_BIT(bits, i) (((bits)[(i) >> 6] >> ((i)&63)) & 1)
+
+#endif /* INC_DTLINDEX_H */
@@ -0,0 +1,202 @@
+/* dtlmanifest.c - page manifest of a DVI file built by dt2dv.
+
+   This file is public domain.
+
+   The manifest's first lines give its version, whether the DTL was
+   read with -group, the size of the DVI file and the number of pages;
+   each line after that is one page:
+
+       dt2dv manifest 1
+       group 0
+       size 10008
+       pages 2
+       <hash> <offset> <dvi bytes> <commands> <bop address, or auto>
+       ...
+
+   with the hash in hexadecimal, and the other numbers in decimal.
+*/
+#include <inttypes.h> // PRIx64, SCNx64
+#include <stdio.h>    // FILE, fopen, fprintf, fscanf
+#include <stdlib.h>   // malloc, realloc, free, qsort
+#include <string.h>   // memset, strcmp
+
+#include "dtlmanifest.h"
+
+#define MANIFEST_MAGIC "dt2dv manifest"
+#define MANIFEST_VERSION 1
+
+/** Read the manifest in file path into *m.
+ *
+ *  @return 1 if OK, 0 if there is no such file, or it is not a manifest.
+ */
+int dtl_manifest_read(DtlManifest* m, const char* path) {
+    FILE* fp;
+    int version;
+    size_t npages;
+    size_t k;
+
+    memset(m, 0, sizeof(*m));
+    if ((fp = fopen(path, "r")) == NULL) {
+        return 0;
+    }
+
+    if (fscanf(fp, MANIFEST_MAGIC " %d group %d size %zu pages %zu",
+               &version, &m->group, &m->dvi_size, &npages) != 4
+        || version != MANIFEST_VERSION) {
+        fclose(fp);
+        return 0;
+    }
+
+    for (k = 0; k < npages; k++) {
+        DtlManifestPage page;
+        char address[32];
+
+        memset(&page, 0, sizeof(page));
+        if (fscanf(fp, "%" SCNx64 " %zu %zu %zu %31s", &page.hash,
+                   &page.offset, &page.dvi_bytes, &page.ncom, address) != 5) {
+            break;
+        }
+        if (strcmp(address, "auto") == 0) {
+            page.bop_auto = 1;
+        } else if (sscanf(address, "%ld", &page.bop_address) != 1) {
+            break;
+        }
+        if (!dtl_manifest_add(m, &page)) {
+            break;
+        }
+    }
+
+    fclose(fp);
+    if (k < npages) {
+        dtl_manifest_free(m);
+        return 0;
+    }
+    return 1;
+} /* dtl_manifest_read */
+
+/** Write manifest *m to file path.
+ *
+ *  @return 1 if OK, 0 if the file could not be written.
+ */
+int dtl_manifest_write(const DtlManifest* m, const char* path) {
+    FILE* fp;
+    size_t k;
+    int ok;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        return 0;
+    }
+
+    fprintf(fp, "%s %d\n", MANIFEST_MAGIC, MANIFEST_VERSION);
+    fprintf(fp, "group %d\n", m->group);
+    fprintf(fp, "size %zu\n", m->dvi_size);
+    fprintf(fp, "pages %zu\n", m->npages);
+    for (k = 0; k < m->npages; k++) {
+        const DtlManifestPage* page = &m->page[k];
+
+        fprintf(fp, "%016" PRIx64 " %zu %zu %zu ", page->hash, page->offset,
+                page->dvi_bytes, page->ncom);
+        if (page->bop_auto) {
+            fprintf(fp, "auto\n");
+        } else {
+            fprintf(fp, "%ld\n", page->bop_address);
+        }
+    }
+
+    ok = !ferror(fp);
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    return ok;
+} /* dtl_manifest_write */
+
+/** Append a page to manifest *m.
+ *
+ *  @return 1 if OK, 0 if out of memory.
+ */
+int dtl_manifest_add(DtlManifest* m, const DtlManifestPage* page) {
+    if (m->npages == m->max) {
+        size_t max = (m->max == 0 ? 64 : 2 * m->max);
+        DtlManifestPage* p =
+            (DtlManifestPage*)realloc(m->page, max * sizeof(*p));
+
+        if (p == NULL) {
+            return 0;
+        }
+        m->page = p;
+        m->max = max;
+    }
+
+    m->page[m->npages++] = *page;
+    free(m->by_hash); /* to be sorted again */
+    m->by_hash = NULL;
+    return 1;
+} /* dtl_manifest_add */
+
+/* the manifest being sorted, for by_hash_cmp */
+static const DtlManifest* sorting;
+
+static int by_hash_cmp(const void* a, const void* b) {
+    uint64_t ha = sorting->page[*(const size_t*)a].hash;
+    uint64_t hb = sorting->page[*(const size_t*)b].hash;
+
+    return (ha > hb) - (ha < hb);
+} /* by_hash_cmp */
+
+/** Find a page whose DTL text had the given hash:
+ *  page k, if it had, as pages mostly stay where they were;
+ *  otherwise any such page.
+ *
+ *  @return the page, or NULL if there is none.
+ */
+const DtlManifestPage* dtl_manifest_find(DtlManifest* m, uint64_t hash,
+                                         size_t k) {
+    size_t lo, hi;
+
+    if (k < m->npages && m->page[k].hash == hash) {
+        return &m->page[k];
+    }
+    if (m->npages == 0) {
+        return NULL;
+    }
+
+    if (m->by_hash == NULL) {
+        m->by_hash = (size_t*)malloc(m->npages * sizeof(size_t));
+        if (m->by_hash == NULL) {
+            return NULL;
+        }
+        for (k = 0; k < m->npages; k++) {
+            m->by_hash[k] = k;
+        }
+        sorting = m;
+        qsort(m->by_hash, m->npages, sizeof(size_t), by_hash_cmp);
+        sorting = NULL;
+    }
+
+    /* first page whose hash is not less than hash */
+    lo = 0;
+    hi = m->npages;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (m->page[m->by_hash[mid]].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo < m->npages && m->page[m->by_hash[lo]].hash == hash) {
+        return &m->page[m->by_hash[lo]];
+    }
+    return NULL;
+} /* dtl_manifest_find */
+
+/* release the manifest's pages */
+void dtl_manifest_free(DtlManifest* m) {
+    free(m->page);
+    free(m->by_hash);
+    memset(m, 0, sizeof(*m));
+} /* dtl_manifest_free */
+
+/* end of "dtlmanifest.c" */
@@ -0,0 +1,46 @@
+#ifndef INC_DTLMANIFEST_H
+/* dtlmanifest.h - page manifest of a DVI file built by dt2dv.
+
+   This file is public domain.
+
+   - A manifest lists, for each page of a DVI file, a hash of the DTL
+     text that the page was encoded from, and where the page's bytes
+     lie in the DVI file.
+   - dt2dv, given the manifest and the DVI file of its last run,
+     re-encodes only the pages whose DTL text has changed, and copies
+     the others from the old DVI file.
+   - A manifest is a text file, of one line per page.
+*/
+#define INC_DTLMANIFEST_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+
+/* one page, as it was built */
+typedef struct _DtlManifestPage {
+    uint64_t hash;      ///< hash of the page's DTL text.
+    size_t offset;      ///< where the page's bop is, in the DVI file.
+    size_t dvi_bytes;   ///< DVI size of the page.
+    size_t ncom;        ///< number of DTL commands in the page.
+    long bop_address;   ///< previous bop address, as the DTL gave it.
+    int bop_auto;       ///< the DTL gave it as `auto'.
+} DtlManifestPage;
+
+/* pages of a DVI file */
+typedef struct _DtlManifest {
+    int group;             ///< the DTL was read with -group.
+    size_t dvi_size;       ///< size of the whole DVI file.
+    size_t npages;         ///< number of pages.
+    size_t max;            ///< pages allocated.
+    DtlManifestPage* page; ///< the pages, in order.
+    size_t* by_hash;       ///< page numbers, sorted by hash.
+} DtlManifest;
+
+int dtl_manifest_read(DtlManifest* m, const char* path);
+int dtl_manifest_write(const DtlManifest* m, const char* path);
+int dtl_manifest_add(DtlManifest* m, const DtlManifestPage* page);
+const DtlManifestPage* dtl_manifest_find(DtlManifest* m, uint64_t hash,
+                                         size_t k);
+void dtl_manifest_free(DtlManifest* m);
+
+#endif /* INC_DTLMANIFEST_H */
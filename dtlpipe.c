@@ -0,0 +1,273 @@
+/* dtlpipe.c - read a DTL stream ahead, in a thread of its own, for dt2dv.
+
+   This file is public domain.
+
+   The ring holds DTL_PIPE_BLOCKS blocks.  `head' counts the blocks
+   the reader thread has filled, and only it writes `head';
+   `tail' counts the blocks dt2dv has finished with, and only dt2dv
+   writes `tail'.  Each publishes its count with a release store,
+   after the block's contents; the other reads it with an acquire load.
+
+   A side that finds the ring full (reader) or empty (dt2dv) sleeps on
+   a condition variable.  Each side, after publishing, takes the lock
+   only to wake the other, so no wakeup is lost.
+
+   Closing the pipe before the end of the stream (as when a conversion
+   fails) sets `stop', and wakes the reader, if it is waiting for room;
+   if it is waiting in read, it is cancelled there: it can be cancelled
+   nowhere else.  Then it is joined, so that it does not outlive the
+   pipe, nor read the stream after dt2dv has returned.
+*/
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L /* fileno, pthreads */
+#endif
+
+#include <errno.h>  // EINTR
+#include <stdlib.h> // malloc, free
+#include <string.h> // memchr, memcpy
+
+#if (defined(__unix__) || defined(__APPLE__)) && defined(__GNUC__)
+#define HAVE_PIPE_THREAD 1
+#include <pthread.h>
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // read
+#endif
+
+#include "dtlpipe.h"
+
+#ifdef HAVE_PIPE_THREAD
+
+#define DTL_PIPE_BLOCKS 16
+#define DTL_PIPE_BLOCK_SIZE 65536
+
+#define LOAD_ACQUIRE(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+struct _DtlPipe {
+    int fd;                          ///< stream being read.
+    char* buf;                       ///< DTL_PIPE_BLOCKS blocks.
+    size_t len[DTL_PIPE_BLOCKS];     ///< bytes in each filled block.
+    size_t head;                     ///< blocks filled, by reader.
+    size_t tail;                     ///< blocks finished with, by dt2dv.
+    int eof;                         ///< reader has reached end of stream.
+    int stop;                        ///< dt2dv wants the reader to stop.
+    size_t at;                       ///< bytes taken from block `tail'.
+    int have;                        ///< dt2dv is taking from block `tail'.
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+/* wake the other side, after publishing a count */
+static void wake(DtlPipe* p) {
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+} /* wake */
+
+/* the reader thread */
+static void* read_ahead(void* arg) {
+    DtlPipe* p = (DtlPipe*)arg;
+    size_t head = p->head;
+    int old;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old);
+    for (;;) {
+        char* block;
+        ssize_t n;
+
+        if (head - LOAD_ACQUIRE(&p->tail) == DTL_PIPE_BLOCKS) {
+            /* ring is full */
+            pthread_mutex_lock(&p->lock);
+            while (head - LOAD_ACQUIRE(&p->tail) == DTL_PIPE_BLOCKS
+                   && !LOAD_ACQUIRE(&p->stop)) {
+                pthread_cond_wait(&p->cond, &p->lock);
+            }
+            pthread_mutex_unlock(&p->lock);
+        }
+        if (LOAD_ACQUIRE(&p->stop)) {
+            return NULL;
+        }
+
+        block = p->buf + (head % DTL_PIPE_BLOCKS) * DTL_PIPE_BLOCK_SIZE;
+        do {
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old);
+            n = read(p->fd, block, DTL_PIPE_BLOCK_SIZE);
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old);
+        } while (n < 0 && errno == EINTR);
+
+        if (n <= 0) {
+            /* end of stream, or reading error, as for fgets */
+            STORE_RELEASE(&p->eof, 1);
+            wake(p);
+            return NULL;
+        }
+
+        p->len[head % DTL_PIPE_BLOCKS] = (size_t)n;
+        STORE_RELEASE(&p->head, ++head);
+        wake(p);
+    }
+} /* read_ahead */
+
+/* make block `tail' available to dt2dv; return 0 at end of stream */
+static int next_block(DtlPipe* p) {
+    if (p->have) {
+        STORE_RELEASE(&p->tail, p->tail + 1);
+        p->have = 0;
+        p->at = 0;
+        wake(p);
+    }
+
+    if (LOAD_ACQUIRE(&p->head) == p->tail) {
+        /* ring is empty */
+        pthread_mutex_lock(&p->lock);
+        while (LOAD_ACQUIRE(&p->head) == p->tail && !LOAD_ACQUIRE(&p->eof)) {
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+        pthread_mutex_unlock(&p->lock);
+        if (LOAD_ACQUIRE(&p->head) == p->tail) {
+            return 0;
+        }
+    }
+
+    p->have = 1;
+    return 1;
+} /* next_block */
+
+/** Start reading stream fp ahead, if it is a pipe or the like.
+ *
+ *  Nothing must have been read from fp yet, nor be read from it after,
+ *  except by dtl_pipe_gets.
+ *
+ *  @return the pipe, or NULL if fp is to be read as it is.
+ */
+DtlPipe* dtl_pipe_open(FILE* fp) {
+    struct stat st;
+    DtlPipe* p;
+    int fd = fileno(fp);
+
+    if (fd < 0 || fstat(fd, &st) != 0 || S_ISREG(st.st_mode)) {
+        return NULL;
+    }
+
+    p = (DtlPipe*)calloc(1, sizeof(DtlPipe));
+    if (p == NULL) {
+        return NULL;
+    }
+    p->fd = fd;
+    p->buf = (char*)malloc(DTL_PIPE_BLOCKS * DTL_PIPE_BLOCK_SIZE);
+    if (p->buf == NULL) {
+        free(p);
+        return NULL;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+
+    if (pthread_create(&p->thread, NULL, read_ahead, p) != 0) {
+        pthread_cond_destroy(&p->cond);
+        pthread_mutex_destroy(&p->lock);
+        free(p->buf);
+        free(p);
+        return NULL;
+    }
+
+    return p;
+} /* dtl_pipe_open */
+
+/** Read a line, as fgets would: at most max - 1 characters,
+ *  up to and including a newline.
+ *
+ *  @return s, or NULL at end of stream with nothing read.
+ */
+char* dtl_pipe_gets(DtlPipe* p, char* s, int max) {
+    int n = 0;
+
+    while (n < max - 1) {
+        size_t b = p->tail % DTL_PIPE_BLOCKS;
+        const char* from;
+        const char* nl;
+        size_t count;
+
+        if (!p->have || p->at == p->len[b]) {
+            if (!next_block(p)) break;
+            b = p->tail % DTL_PIPE_BLOCKS;
+        }
+
+        from = p->buf + b * DTL_PIPE_BLOCK_SIZE + p->at;
+        count = p->len[b] - p->at;
+        if (count > (size_t)(max - 1 - n)) {
+            count = (size_t)(max - 1 - n);
+        }
+        nl = (const char*)memchr(from, '\n', count);
+        if (nl != NULL) {
+            count = (size_t)(nl - from) + 1;
+        }
+
+        memcpy(s + n, from, count);
+        n += (int)count;
+        p->at += count;
+        if (nl != NULL) break;
+    }
+
+    if (n == 0) {
+        return NULL;
+    }
+    s[n] = '\0';
+    return s;
+} /* dtl_pipe_gets */
+
+/** Can dtl_pipe_gets take something without waiting for the stream?
+ *
+ *  @return 1 if text is ready, or the stream has ended; else 0.
+ */
+int dtl_pipe_ready(DtlPipe* p) {
+    return (p->have && p->at < p->len[p->tail % DTL_PIPE_BLOCKS])
+           || LOAD_ACQUIRE(&p->head) != p->tail + (size_t)p->have
+           || LOAD_ACQUIRE(&p->eof);
+} /* dtl_pipe_ready */
+
+/** Stop reading ahead, and free the pipe.
+ *  If the stream was not read to its end, the reader thread is stopped,
+ *  and what it has read and dt2dv has not is lost.
+ */
+void dtl_pipe_close(DtlPipe* p) {
+    if (p == NULL) {
+        return;
+    }
+
+    if (!LOAD_ACQUIRE(&p->eof)) {
+        STORE_RELEASE(&p->stop, 1);
+        wake(p);
+        pthread_cancel(p->thread);
+    }
+    pthread_join(p->thread, NULL);
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->lock);
+    free(p->buf);
+    free(p);
+} /* dtl_pipe_close */
+
+#else /* !HAVE_PIPE_THREAD */
+
+DtlPipe* dtl_pipe_open(FILE* fp) {
+    (void)fp;
+    return NULL;
+} /* dtl_pipe_open */
+
+char* dtl_pipe_gets(DtlPipe* p, char* s, int max) {
+    (void)p;
+    (void)max;
+    s[0] = '\0';
+    return NULL;
+} /* dtl_pipe_gets */
+
+int dtl_pipe_ready(DtlPipe* p) {
+    (void)p;
+    return 1;
+} /* dtl_pipe_ready */
+
+void dtl_pipe_close(DtlPipe* p) {
+    (void)p;
+} /* dtl_pipe_close */
+
+#endif /* HAVE_PIPE_THREAD */
@@ -0,0 +1,26 @@
+#ifndef INC_DTLPIPE_H
+/* dtlpipe.h - read a DTL stream ahead, in a thread of its own, for dt2dv.
+
+   This file is public domain.
+
+   - When DTL arrives on a pipe (as with `-si'), it cannot be mapped and
+     indexed like a file; but reading it need not wait on dt2dv.
+   - A reader thread fills a ring of blocks from the stream, while dt2dv
+     takes lines out of the blocks it has filled.
+   - The ring has one producer and one consumer, so each side owns its
+     own index, and neither takes a lock to move a block along; a lock
+     is taken only to sleep, when the ring is full or empty.
+*/
+#define INC_DTLPIPE_H
+
+#include <stdio.h> // FILE
+
+/* a DTL stream being read ahead */
+typedef struct _DtlPipe DtlPipe;
+
+DtlPipe* dtl_pipe_open(FILE* fp);
+char* dtl_pipe_gets(DtlPipe* p, char* s, int max);
+int dtl_pipe_ready(DtlPipe* p);
+void dtl_pipe_close(DtlPipe* p);
+
+#endif /* INC_DTLPIPE_H */
@@ -0,0 +1,183 @@
+/* dtlround - a DVI file, round through libdtl's buffers.
+
+   This file is public domain.
+
+   - Usage:  dtlround [-build] input-DVI-file output-DVI-file
+   - The DVI file is turned into DTL by dtl_dv2dt_buffer, and back into
+     DVI by dtl_dt2dv_buffer, in memory, on each of four threads at
+     once; the DVI bytes of every thread must be the same, and those
+     of the first are written.  As dv2dt then dt2dv do, a DVI file
+     that dt2dv wrote comes back as it was.
+   - With -build, each command of the DVI file, as dviread reads it,
+     is encoded anew by dvi_build_command, in memory, up to its post;
+     dvi_build_finish then writes the postamble.  So the pages come
+     back as they were, and the postamble as dt2dv -post writes it.
+   - dtlround is for the tests of libdtl.a (make check), which compare
+     its output with its input.
+*/
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L /* fileno */
+#endif
+
+#include <pthread.h> // pthread_create, pthread_join
+#include <stdint.h>  // uint32_t
+#include <stdlib.h>  // EXIT_SUCCESS, EXIT_FAILURE, free
+#include <string.h>  // memcmp, strcmp
+
+#include "dtl.h"
+#include "dvibuild.h"
+#include "dviread.h"
+#include "dvtool.h"
+#include "libdtl.h"
+
+/// threads converting at once
+#define NTHREADS 4
+
+/* one thread's round */
+typedef struct _Round {
+    const char* in;   /* the DVI file */
+    size_t in_len;
+    char* dtl;        /* its DTL */
+    size_t dtl_len;
+    char* out;        /* the DVI from that DTL */
+    size_t out_len;
+    DtlStatus status;
+} Round;
+
+/* turn round->in into DTL, and that back into DVI */
+static void* run_round(void* arg) {
+    Round* round = (Round*)arg;
+    DtlContext ctx;
+
+    dtl_context_init(&ctx);
+    round->status = dtl_dv2dt_buffer(&ctx, round->in, round->in_len,
+                                     &round->dtl, &round->dtl_len);
+    if (round->status == DTL_OK) {
+        round->status = dtl_dt2dv_buffer(&ctx, round->dtl, round->dtl_len,
+                                         &round->out, &round->out_len);
+    }
+    return NULL;
+} /* run_round */
+
+/* turn what r holds into DTL and back, on each of the threads, and
+   return the DVI bytes of the first, *len long, for the caller to free;
+   stop if a thread fails, or the threads' bytes differ */
+static unsigned char* round_trip(const DviReader* r, size_t* len) {
+    Round round[NTHREADS];
+    pthread_t thread[NTHREADS];
+
+    for (int i = 0; i < NTHREADS; i++) {
+        round[i].in = (const char*)r->dvi;
+        round[i].in_len = r->size;
+        round[i].dtl = round[i].out = NULL;
+        round[i].dtl_len = round[i].out_len = 0;
+        if (pthread_create(&thread[i], NULL, run_round, &round[i]) != 0) {
+            ERROR_SATRT;
+            fprintf(msg_fp, "cannot start a thread.\n");
+            dexit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < NTHREADS; i++) {
+        pthread_join(thread[i], NULL);
+    }
+    for (int i = 0; i < NTHREADS; i++) {
+        if (round[i].status != DTL_OK) {
+            ERROR_SATRT;
+            fprintf(msg_fp, "thread %d: %s.\n", i,
+                    dtl_status_string(round[i].status));
+            dexit(EXIT_FAILURE);
+        }
+        if (round[i].out_len != round[0].out_len
+            || memcmp(round[i].out, round[0].out, round[0].out_len) != 0) {
+            ERROR_SATRT;
+            fprintf(msg_fp, "threads 0 and %d wrote different DVI files.\n",
+                    i);
+            dexit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < NTHREADS; i++) {
+        free(round[i].dtl);
+        if (i > 0) {
+            free(round[i].out);
+        }
+    }
+    *len = round[0].out_len;
+    return (unsigned char*)round[0].out;
+} /* round_trip */
+
+/* encode each command that r reads anew, in memory, up to the post, and
+   finish the DVI file; return its bytes, *len long, for the caller to
+   free; stop if r cannot be read, or the bytes cannot be built */
+static unsigned char* build(DviReader* r, size_t* len) {
+    DviBuilder b;
+    DviCommand cmd;
+    unsigned char* out;
+    int post = 0;
+
+    dvi_build_init(&b, -1);
+    while (!post && b.error == NULL && dvi_read_next(r, &cmd)) {
+        if (cmd.opcode == POST) {
+            /* the greatest height plus depth, and width, of the pages */
+            dvi_build_finish(&b, (uint32_t)cmd.arg[4], (uint32_t)cmd.arg[5]);
+            post = 1;
+        } else {
+            dvi_build_command(&b, &cmd);
+        }
+    }
+    if (r->error != NULL || b.error != NULL || !post) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "cannot build the DVI file: %s.\n",
+                (r->error != NULL ? r->error
+                 : b.error != NULL ? b.error : "it has no post"));
+        dexit(EXIT_FAILURE);
+    }
+    out = dvi_build_take(&b, len);
+    dvi_build_free(&b);
+    return out;
+} /* build */
+
+int main(int argc, char* argv[]) {
+    FILE* dvi;
+    FILE* out;
+    DviReader r;
+    unsigned char* bytes;
+    size_t len;
+    int with_builder = 0;
+    int arg = 1;
+
+    program_name = argv[0];
+    msg_fp = stderr;
+
+    if (arg < argc && strcmp(argv[arg], "-build") == 0) {
+        with_builder = 1;
+        ++arg;
+    }
+    if (argc - arg != 2) {
+        fprintf(msg_fp, "usage: %s [-build] input-DVI-file output-DVI-file\n",
+                program_name);
+        dexit(EXIT_FAILURE);
+    }
+    if ((dvi = fopen(argv[arg], "rb")) == NULL) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "Cannot open \"%s\" for binary reading.\n", argv[arg]);
+        dexit(EXIT_FAILURE);
+    }
+    read_input(dvi, &r);
+    bytes = (with_builder ? build(&r, &len) : round_trip(&r, &len));
+
+    if ((out = fopen(argv[arg + 1], "wb")) == NULL) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "Cannot open \"%s\" for binary writing.\n",
+                argv[arg + 1]);
+        dexit(EXIT_FAILURE);
+    }
+    if (fwrite(bytes, 1, len, out) != len || fclose(out) != 0) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "cannot write \"%s\".\n", argv[arg + 1]);
+        dexit(EXIT_FAILURE);
+    }
+    free(bytes);
+    return EXIT_SUCCESS;
+} /* main */
+
+/* end of "dtlround.c" */
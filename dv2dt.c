@@ -19,11 +19,13 @@
 #include "dv2dt.h"
 
 
+#ifndef DTL_LIBRARY
 int main(int argc, char* argv[]) {
     FILE* dvi = stdin;
     FILE* dtl = stdout;
 
     program_name = argv[0];
+    msg_fp = stderr;
 
     if (argc > 1) open_dvi(argv[1], &dvi);
     if (argc > 2) open_dtl(argv[2], &dtl);
@@ -37,20 +39,20 @@ int main(int argc, char* argv[]) {
  *  @param[in]      dvi_fname
  *  @param[inout]   pdvi
  */
-int open_dvi(char* dvi_fname, FILE** pdvi) {
+static int open_dvi(char* dvi_fname, FILE** pdvi) {
     if (pdvi == NULL) {
         ERROR_SATRT;
-        fprintf(stderr, "address of dvi variable is NULL.\n");
-        exit(EXIT_FAILURE);
+        fprintf(msg_fp, "address of dvi variable is NULL.\n");
+        dexit(EXIT_FAILURE);
     }
 
     *pdvi = fopen(dvi_fname, "rb");
 
     if (*pdvi == NULL) {
         ERROR_SATRT;
-        fprintf(stderr, "Cannot open \"%s\" for binary reading.\n",
+        fprintf(msg_fp, "Cannot open \"%s\" for binary reading.\n",
                 dvi_fname);
-        exit(EXIT_FAILURE);
+        dexit(EXIT_FAILURE);
     }
 
     return 1; /* OK */
@@ -61,28 +63,39 @@ int open_dvi(char* dvi_fname, FILE** pdvi) {
  *  @param[in]      dtl_fname
  *  @param[inout]   pdtl
  */
-int open_dtl(char* dtl_fname, FILE** pdtl) {
+static int open_dtl(char* dtl_fname, FILE** pdtl) {
     if (pdtl == NULL) {
         ERROR_SATRT;
-        fprintf(stderr, "address of dtl variable is NULL.\n");
-        exit(EXIT_FAILURE);
+        fprintf(msg_fp, "address of dtl variable is NULL.\n");
+        dexit(EXIT_FAILURE);
     }
 
     *pdtl = fopen(dtl_fname, "w");
 
     if (*pdtl == NULL) {
         ERROR_SATRT;
-        fprintf(stderr, "Cannot open \"%s\" for text writing.\n",
+        fprintf(msg_fp, "Cannot open \"%s\" for text writing.\n",
                 dtl_fname);
-        exit(EXIT_FAILURE);
+        dexit(EXIT_FAILURE);
     }
 
     return 1; /* OK */
 } /* open_dtl */
+#endif /* DTL_LIBRARY */
 
-int dv2dt(FILE* dvi, FILE* dtl) {
+/** Stop, after an error: exit with status n;
+ *  or, in a libdtl call, return to it, for it to return fail_status.
+ */
+static void dexit(int n) {
+    if (fail_jmp != NULL) {
+        longjmp(*fail_jmp, 1);
+    }
+    exit(n);
+} /* dexit */
+
+static int dv2dt(FILE* dvi, FILE* dtl) {
     int opcode;
-    COUNT count; /* intended to count bytes to DVI file; as yet unused. */
+    COUNT count; /* DVI bytes read */
 
     PRINT_BCOM;
     fputs("variety ", dtl);
@@ -92,56 +105,71 @@ int dv2dt(FILE* dvi, FILE* dtl) {
     PRINT_ECOM;
     fputc('\n', dtl);
 
+    /* each opcode's handler, by its kind */
+    init_dvi_ops();
+    for (int i = 0; i < NCMDS; i++) {
+        dv_handler[i] = dv_kind[dvi_op[i].kind];
+    }
+
     /* start counting DVI bytes */
     count = 0;
+    ncom = 0;
     while ((opcode = fgetc(dvi)) != EOF) {
         PRINT_BCOM; /* start of command and parameters */
         if (opcode < 0 || opcode > 255) {
             count += 1;
             ERROR_SATRT;
-            fprintf(stderr, "Non-byte from \"fgetc()\"!\n");
-            exit(EXIT_FAILURE);
-        } else if (opcode <= 127) {
-            /* setchar commands */
-            count += set_seq(opcode, dvi, dtl);
-        } else if (opcode >= SET1 && opcode <= Z4) {
-            count += write_table(op_128_170, opcode, dvi, dtl);
-        } else if (opcode >= FNT_NUM_0 && opcode <= FNT_NUM_63) {
-            count += 1;
-            fprintf(dtl, "%s%d", FONT_NUM_STR, opcode - FNT_NUM_0);
-        } else if (opcode >= FONT1 && opcode <= FONT4) {
-            count += write_table(fnt, opcode, dvi, dtl);
-        } else if (opcode >= XXX1 && opcode <= XXX4) {
-            count += special(opcode - XXX1 + 1, dvi, dtl);
-        } else if (opcode >= FNT_DEF1 && opcode <= FNT_DEF4) {
-            count += fontdef(opcode - FNT_DEF1 + 1, dvi, dtl);
-        } else if (opcode == PRE) {
-            count += preamble(dvi, dtl);
-        } else if (opcode == POST) {
-            count += postamble(dvi, dtl);
-        } else if (opcode == POSTPOST) {
-            count += postpost(dvi, dtl);
-        } else if (opcode >= UNDEFINED && opcode <= 255) {
-            count += 1;
-            fprintf(dtl, "opcode%d", opcode);
-        } else {
-            count += 1;
-            ERROR_SATRT;
-            fprintf(stderr, "unknown byte.\n");
-            exit(EXIT_FAILURE);
+            fprintf(msg_fp, "Non-byte from \"fgetc()\"!\n");
+            dexit(EXIT_FAILURE);
         }
+        count += dv_handler[opcode](opcode, dvi, dtl);
         PRINT_ECOM; /* end of command and parameters */
         fputc('\n', dtl);
         if (fflush(dtl) == EOF) {
             ERROR_SATRT;
-            fprintf(stderr, "fflush on dtl file gave write error!\n");
-            exit(EXIT_FAILURE);
+            fprintf(msg_fp, "fflush on dtl file gave write error!\n");
+            fail_status = DTL_ERROR_OUTPUT;
+            dexit(EXIT_FAILURE);
         }
+        ++ncom;
+        dvi_read = count;
     } /* end while */
 
     return EXIT_SUCCESS;
 } /* dv2dt */
 
+#ifdef DTL_LIBRARY
+/** libdtl: convert DVI file dvi to DTL file dtl, as dv2dt would,
+ *  with the options in *ctx; report there how it went.
+ *
+ *  @return ctx->status
+ */
+DtlStatus dtl_dv2dt(DtlContext* ctx, FILE* dvi, FILE* dtl) {
+    jmp_buf fail;
+
+    program_name = "dv2dt";
+    msg_fp = (ctx->messages != NULL ? ctx->messages : stderr);
+    debug = ctx->debug;
+    group = ctx->group;
+    dvi_read = 0;
+    ncom = 0;
+
+    fail_status = DTL_ERROR_INPUT;
+    if (setjmp(fail) == 0) {
+        fail_jmp = &fail;
+        dv2dt(dvi, dtl);
+        ctx->status = DTL_OK;
+    } else {
+        ctx->status = fail_status;
+    }
+    fail_jmp = NULL;
+
+    ctx->dvi_bytes = dvi_read;
+    ctx->ncom = ncom;
+    return ctx->status;
+} /* dtl_dv2dt */
+#endif /* DTL_LIBRARY */
+
 
 /** read 1 <= n <= 4 bytes for an unsigned integer from dvi file
  * DVI format uses Big-endian storage of numbers.
@@ -150,16 +178,16 @@ int dv2dt(FILE* dvi, FILE* dtl) {
  *  @param[in] dvi file
  *  @return unsign int
  */
-U4 read_unsigned(int nBytes, FILE* dvi) {
+static U4 read_unsigned(int nBytes, FILE* dvi) {
     U4 integer = 0;
     int ibyte = 0;
 
     if (nBytes < 1 || nBytes > 4) {
         ERROR_SATRT;
-        fprintf(stderr,
+        fprintf(msg_fp,
                 "read_unsigned() asked for %d bytes.  Must be 1 to 4.\n",
                 nBytes);
-        exit(EXIT_FAILURE);
+        dexit(EXIT_FAILURE);
     }
 
     /* Following calculation works iff storage is big-endian. */
@@ -178,7 +206,7 @@ U4 read_unsigned(int nBytes, FILE* dvi) {
  *  @param[in]  dvi     input DVI file
  *  @param[out] dtl     output DTL file
  */
-U4 xref_unsigned(int nBytes, FILE* dvi, FILE* dtl) {
+static U4 xref_unsigned(int nBytes, FILE* dvi, FILE* dtl) {
     U4 unum;
 
     fputc(' ', dtl);
@@ -195,16 +223,16 @@ U4 xref_unsigned(int nBytes, FILE* dvi, FILE* dtl) {
  *  @param[in] dvi file
  *  @return sign int
  */
-S4 read_signed(int nBytes, FILE* dvi) {
+static S4 read_signed(int nBytes, FILE* dvi) {
     S4 integer = 0;
     int ibyte = 0;
 
     if (nBytes < 1 || nBytes > 4) {
         ERROR_SATRT;
-        fprintf(stderr, 
+        fprintf(msg_fp,
                 "read_signed() asked for %d bytes.  Must be 1 to 4.\n",
                 nBytes);
-        exit(EXIT_FAILURE);
+        dexit(EXIT_FAILURE);
     }
 
     /* Following calculation works iff storage is big-endian. */
@@ -227,7 +255,7 @@ S4 read_signed(int nBytes, FILE* dvi) {
  *  @param[in]  dvi     input DVI file
  *  @param[out] dtl     output DTL file
  */
-S4 xref_signed(int nBytes, FILE* dvi, FILE* dtl) {
+static S4 xref_signed(int nBytes, FILE* dvi, FILE* dtl) {
     S4 snum;
 
     fputc(' ', dtl);
@@ -237,68 +265,63 @@ S4 xref_signed(int nBytes, FILE* dvi, FILE* dtl) {
     return snum;
 } /* end xref_signed */
 
-/** Write command with given opcode in given table.
+/** Write a command with no arguments: nop, eop, push, pop, fnt_num,
+ *  or an undefined opcode.
  *
- *  @param[in]  table
  *  @param[in]  opcode
  *  @param[in]  dvi
  *  @param[out] dtl
- *  @return bytes_count  number of DVI bytes in this command
+ *  @return number of DVI bytes in this command
  */
-COUNT write_table(op_table table, int opcode, FILE* dvi, FILE* dtl) {
-    op_info op; /* pointer into table of operations and arguments */
-    COUNT bytes_count = 0; /* number of bytes in arguments of this opcode */
-    String args; /* arguments string */
-    int arg_pos; /* position in args */
-
-    /* Defensive programming. */
-    if (opcode < table.first || opcode > table.last) {
-        ERROR_SATRT;
-        fprintf(stderr, "opcode %d is outside table %s [ %d to %d ] !\n",
-                opcode, table.name, table.first, table.last);
-        exit(EXIT_FAILURE);
-    }
+static COUNT write_name(int opcode, FILE* dvi, FILE* dtl) {
+    fputs(dvi_op[opcode].name, dtl);
+    return 1;
+} /* write_name */
 
-    op = table.list[opcode - table.first];
+/** Write set, put or fnt: a character or font number, unsigned in 1 to 3
+ *  bytes, signed in 4.
+ */
+static COUNT write_char(int opcode, FILE* dvi, FILE* dtl) {
+    int n = dvi_op[opcode].suffix;
 
-    /* Further defensive programming. */
-    if (op.code != opcode) {
-        fprintf(stderr, "internal table %s wrong!\n", 
-                table.name);
-        exit(EXIT_FAILURE);
+    fputs(dvi_op[opcode].name, dtl);
+    if (n == 4) {
+        xref_signed(n, dvi, dtl);
+    } else {
+        xref_unsigned(n, dvi, dtl);
     }
+    return 1 + n;
+} /* write_char */
+
+/** Write set_rule or put_rule: height and width. */
+static COUNT write_rule(int opcode, FILE* dvi, FILE* dtl) {
+    fputs(dvi_op[opcode].name, dtl);
+    xref_signed(4, dvi, dtl); /* a[4] = height */
+    xref_signed(4, dvi, dtl); /* b[4] = width  */
+    return 1 + 4 + 4;
+} /* write_rule */
+
+/** Write bop: c0[4] .. c9[4], and p[4], the previous bop's address. */
+static COUNT write_bop(int opcode, FILE* dvi, FILE* dtl) {
+    fputs(dvi_op[opcode].name, dtl);
+    for (int i = 0; i < 11; i++) {
+        xref_signed(4, dvi, dtl);
+    }
+    return 1 + 11 * 4;
+} /* write_bop */
 
-    bytes_count = 1;
-    fputs(op.name, dtl);
-
-    /* NB:  sscanf does an ungetc, */
-    /*      so args must be writable. */
-
-    strncpy(args, op.args, MAXSTRLEN);
-
-    arg_pos = 0;
-    for (int i = 0; i < op.nargs; i++) {
-        int arg_type; /* sign and number of bytes in current argument */
-        int n_conv;   /* number of successful conversions from args */
-        int n_read;   /* number of bytes read from args */
-
-        n_conv = sscanf(args + arg_pos, "%d%n", &arg_type, &n_read);
-
-        /* internal consistency checks */
-        if (n_conv != 1 || n_read <= 0) {
-            ERROR_SATRT;
-            fprintf(stderr, "internal read of table %s failed!\n",
-                    table.name);
-            exit(EXIT_FAILURE);
-        }
-
-        arg_pos += n_read;
-        bytes_count += (arg_type < 0 ? xref_signed(-arg_type, dvi, dtl)
-                                     : xref_unsigned(arg_type, dvi, dtl));
-    } /* end for */
+/** Write a movement: right, w, x, down, y or z, whose suffix is the
+ *  number of bytes in its signed argument (none, for w0 .. z0).
+ */
+static COUNT write_move(int opcode, FILE* dvi, FILE* dtl) {
+    int n = dvi_op[opcode].suffix;
 
-    return bytes_count;
-} /* write_table */
+    fputs(dvi_op[opcode].name, dtl);
+    if (n > 0) {
+        xref_signed(n, dvi, dtl);
+    }
+    return 1 + n;
+} /* write_move */
 
 /** Write a sequence of setchar commands.
  *
@@ -307,7 +330,7 @@ COUNT write_table(op_table table, int opcode, FILE* dvi, FILE* dtl) {
  *  @param[out] dtl
  *  @return count of DVI bytes interpreted into DTL.
  */
-COUNT set_seq(int opcode, FILE* dvi, FILE* dtl) {
+static COUNT set_seq(int opcode, FILE* dvi, FILE* dtl) {
     int char_code = opcode; /* fortuitous */
     int char_count = 0;
 
@@ -344,13 +367,16 @@ COUNT set_seq(int opcode, FILE* dvi, FILE* dtl) {
 
     /* prepare to reread opcode of next DVI command */
     if (ungetc(opcode, dvi) == EOF) {
-        fprintf(stderr, "set_seq:  cannot push back a byte\n");
-        exit(EXIT_FAILURE);
+        fprintf(msg_fp, "set_seq:  cannot push back a byte\n");
+        dexit(EXIT_FAILURE);
     }
 
     /* end of sequence of font characters */
     fputc(ESEQ_CHAR, dtl);
 
+    /* one DTL command, for char_count DVI commands */
+    ncom += char_count - 1;
+
     return char_count;
 } /* set_seq */
 
@@ -360,7 +386,7 @@ COUNT set_seq(int opcode, FILE* dvi, FILE* dtl) {
  *  @param[out] dtl
  *  @return void
  */
-void set_pchar(int charcode, FILE* dtl) {
+static void set_pchar(int charcode, FILE* dtl) {
     switch (charcode) {
         case ESC_CHAR:
             fputc(ESC_CHAR, dtl);
@@ -390,7 +416,7 @@ void set_pchar(int charcode, FILE* dtl) {
  *  @param[in]  dvi
  *  @param[out] dtl
  */
-void xfer_string(int nChars, FILE* dvi, FILE* dtl) {
+static void xfer_string(int nChars, FILE* dvi, FILE* dtl) {
     fputc(' ', dtl);
     fputc('\'', dtl);
 
@@ -408,19 +434,20 @@ void xfer_string(int nChars, FILE* dvi, FILE* dtl) {
 
 /** read special 1 .. 4 from dvi and write in dtl.
  *
- *  @param[in]  nBytes
+ *  @param[in]  opcode
  *  @param[in]  dvi
  *  @param[out] dtl
  *  @return number of DVI bytes interpreted into DTL.
  */
-COUNT special(int nBytes, FILE* dvi, FILE* dtl) {
+static COUNT special(int opcode, FILE* dvi, FILE* dtl) {
+    int nBytes = opcode - XXX1 + 1;
     U4 k;
 
     if (nBytes < 1 || nBytes > 4) {
         ERROR_SATRT;
-        fprintf(stderr, "special %d, range is 1 to 4.\n", 
+        fprintf(msg_fp, "special %d, range is 1 to 4.\n",
                 nBytes);
-        exit(EXIT_FAILURE);
+        dexit(EXIT_FAILURE);
     }
 
     fprintf(dtl, "%s%d", SPECIAL_STR, nBytes);
@@ -432,19 +459,20 @@ COUNT special(int nBytes, FILE* dvi, FILE* dtl) {
 
 /** read fontdef 1 .. 4 from dvi and write in dtl
  *
- *  @param[in]  nBytes
+ *  @param[in]  opcode
  *  @param[in]  dvi
  *  @param[out] dtl
  *  @return number of DVI bytes interpreted into DTL.
  */
-COUNT fontdef(int nBytes, FILE* dvi, FILE* dtl) {
+static COUNT fontdef(int opcode, FILE* dvi, FILE* dtl) {
+    int nBytes = opcode - FNT_DEF1 + 1;
     U4 c, a, l;
 
     if (nBytes < 1 || nBytes > 4) {
         ERROR_SATRT;
-        fprintf(stderr, "font def %d, range is 1 to 4.\n", 
+        fprintf(msg_fp, "font def %d, range is 1 to 4.\n",
                 nBytes);
-        exit(EXIT_FAILURE);
+        dexit(EXIT_FAILURE);
     }
 
     fprintf(dtl, "%s%d", FONT_DEF_STR, nBytes);
@@ -482,7 +510,7 @@ COUNT fontdef(int nBytes, FILE* dvi, FILE* dtl) {
  *
  *  @return number of DVI bytes interpreted into DTL
  */
-COUNT preamble(FILE* dvi, FILE* dtl) {
+static COUNT preamble(int opcode, FILE* dvi, FILE* dtl) {
     U4 k;
 
     fputs("pre", dtl);
@@ -500,7 +528,7 @@ COUNT preamble(FILE* dvi, FILE* dtl) {
  *
  *  @return number of bytes
  */
-COUNT postamble(FILE* dvi, FILE* dtl) {
+static COUNT postamble(int opcode, FILE* dvi, FILE* dtl) {
     fputs("post", dtl);
     xref_unsigned(4, dvi, dtl); /*   p[4] = pointer to final bop            */
     xref_unsigned(4, dvi, dtl); /* num[4] = numerator of DVI unit           */
@@ -519,7 +547,7 @@ COUNT postamble(FILE* dvi, FILE* dtl) {
  * 
  *  @return  number of bytes
  */
-COUNT postpost(FILE* dvi, FILE* dtl) {
+static COUNT postpost(int opcode, FILE* dvi, FILE* dtl) {
     int b223; /* hope this is 8-bit clean */
     int n223; /* number of "223" bytes in final padding */
 
@@ -535,13 +563,13 @@ COUNT postpost(FILE* dvi, FILE* dtl) {
     }
     if (n223 < 4) {
         ERROR_SATRT;
-        fprintf(stderr, "bad post_post:  fewer than four \"223\" bytes.\n");
-        exit(EXIT_FAILURE);
+        fprintf(msg_fp, "bad post_post:  fewer than four \"223\" bytes.\n");
+        dexit(EXIT_FAILURE);
     }
     if (b223 != EOF) {
         ERROR_SATRT;
-        fprintf(stderr, "bad post_post:  doesn't end with a \"223\".\n");
-        exit(EXIT_FAILURE);
+        fprintf(msg_fp, "bad post_post:  doesn't end with a \"223\".\n");
+        dexit(EXIT_FAILURE);
     }
 
     return (1 + 4 + 1 + n223);
@@ -22,9 +22,6 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define OP_INFO_BOP \
-    { BOP, BOP_STR, 11, "-4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4" }
-
 #include "dtl.h"
 
 
@@ -34,25 +31,54 @@
     if (group) fputc(ECOM_CHAR, dtl)
 
 
-/* function prototypes */
+/* DVI bytes read, and DVI commands written as DTL, so far */
+static DTL_TLS COUNT dvi_read = 0;
+static DTL_TLS COUNT ncom = 0;
+
+/* function prototypes; static, as libdtl holds dt2dv's functions too */
+
+#ifndef DTL_LIBRARY
+static int open_dvi(char* dvi_fname, FILE** pdvi);
+static int open_dtl(char* dtl_fname, FILE** pdtl);
+#endif
+static void dexit(int n);
+static int dv2dt(FILE* dvi, FILE* dtl);
+
+static U4 xref_unsigned(int nBytes, FILE* dvi, FILE* dtl);
+static S4 xref_signed(int nBytes, FILE* dvi, FILE* dtl);
+
+static COUNT write_name(int opcode, FILE* dvi, FILE* dtl);
+static COUNT write_char(int opcode, FILE* dvi, FILE* dtl);
+static COUNT write_rule(int opcode, FILE* dvi, FILE* dtl);
+static COUNT write_bop(int opcode, FILE* dvi, FILE* dtl);
+static COUNT write_move(int opcode, FILE* dvi, FILE* dtl);
 
-int open_dvi(char* dvi_fname, FILE** pdvi);
-int open_dtl(char* dtl_fname, FILE** pdtl);
-int dv2dt(FILE* dvi, FILE* dtl);
+static COUNT set_seq(int opcode, FILE* dvi, FILE* dtl);
+static void set_pchar(int charcode, FILE* dtl);
+static void xfer_string(int nChars, FILE* dvi, FILE* dtl);
 
-U4 xref_unsigned(int nBytes, FILE* dvi, FILE* dtl);
-S4 xref_signed(int nBytes, FILE* dvi, FILE* dtl);
+static COUNT special(int opcode, FILE* dvi, FILE* dtl);
+static COUNT fontdef(int opcode, FILE* dvi, FILE* dtl);
+static COUNT preamble(int opcode, FILE* dvi, FILE* dtl);
+static COUNT postamble(int opcode, FILE* dvi, FILE* dtl);
+static COUNT postpost(int opcode, FILE* dvi, FILE* dtl);
 
-COUNT write_table(op_table table, int opcode, FILE* dvi, FILE* dtl);
+/* writes a command as DTL, after its opcode is read; */
+/* returns the number of DVI bytes in it, and any it ran on to */
+typedef COUNT (*DvHandler)(int opcode, FILE* dvi, FILE* dtl);
 
-COUNT set_seq(int opcode, FILE* dvi, FILE* dtl);
-void set_pchar(int charcode, FILE* dtl);
-void xfer_string(int nChars, FILE* dvi, FILE* dtl);
+/* the handler for each kind of command */
+static const DvHandler dv_kind[NKINDS] = {
+    [KIND_SETCHAR] = set_seq,    [KIND_CHAR] = write_char,
+    [KIND_RULE] = write_rule,    [KIND_NONE] = write_name,
+    [KIND_BOP] = write_bop,      [KIND_EOP] = write_name,
+    [KIND_PUSH] = write_name,    [KIND_POP] = write_name,
+    [KIND_MOVE] = write_move,    [KIND_SPECIAL] = special,
+    [KIND_FONT_DEF] = fontdef,   [KIND_PRE] = preamble,
+    [KIND_POST] = postamble,     [KIND_POSTPOST] = postpost,
+};
 
-COUNT special(int nBytes, FILE* dvi, FILE* dtl);
-COUNT fontdef(int nBytes, FILE* dvi, FILE* dtl);
-COUNT preamble(FILE* dvi, FILE* dtl);
-COUNT postamble(FILE* dvi, FILE* dtl);
-COUNT postpost(FILE* dvi, FILE* dtl);
+/* the handler for each opcode, from dv_kind; dv2dt dispatches on this */
+static DTL_TLS DvHandler dv_handler[NCMDS];
 
 #endif /* INC_DV2DT_H */
\ No newline at end of file
@@ -0,0 +1,375 @@
+/* dvcat - one DVI file of the pages of several, with their fonts made one.
+
+   This file is public domain.
+
+   - Usage:  dvcat [-v] [-o output-DVI-file] input-DVI-file ...
+     (stdout, if the output file is not named).
+   - The inputs' preambles must agree in num, den and mag; the output's
+     preamble is the first input's.
+   - Fonts of the same name, checksum, scale and design size are one
+     font, defined once in the output, by one number.  Each input's
+     fonts are numbered from its postamble, before its pages are read:
+     a font that the output has keeps the output's number; a new font
+     keeps its own, if no font of the output has it; otherwise it is
+     given the lowest number that neither the output nor the input
+     has.
+   - The pages are copied by dvifilter, one input after another, each
+     in one pass: as they are, but for bop addresses, the definitions
+     of fonts that the output already has, which are left out, and, if
+     any of an input's fonts is renumbered, its fnt_num, fnt and
+     fnt_def commands.  The postamble is written anew, with the
+     greatest l and u of the inputs.
+*/
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L /* fileno */
+#endif
+
+#include <stdlib.h> // EXIT_SUCCESS, EXIT_FAILURE, qsort, realloc
+#include <string.h> // memcmp, strcmp
+
+#include "dtl.h"
+#include "dvibuild.h"
+#include "dvifilter.h"
+#include "dviread.h"
+#include "dvtool.h"
+
+/* no font of the output */
+#define NO_FONT ((size_t)-1)
+
+/* a font of the output */
+typedef struct {
+    int32_t k;         /* its number in the output */
+    uint32_t checksum, scale, design;
+    const char* name;  /* in the bytes of the input that first had it */
+    size_t name_len;
+    int defined;       /* has the output defined it? */
+} Font;
+
+/* a font of the input being copied */
+typedef struct {
+    int32_t k;       /* its number in the input */
+    size_t font;     /* its index in fonts, or NO_FONT while it has none */
+    DviCommand def;  /* its fnt_def, in the postamble */
+} InFont;
+
+static DviBuilder out;  /* the output file */
+static uint32_t max_height = 0, max_width = 0; /* the inputs' l and u */
+
+static Font* fonts = NULL;  /* the output's fonts, in order of arrival */
+static size_t nfont = 0, max_font = 0;
+
+static InFont* in_fonts = NULL; /* the input's fonts, in order of k */
+static size_t nin_font = 0, max_in_font = 0;
+static int renumbered;          /* are any of them renumbered? */
+
+/* stop: input file name is bad, because of why, at offset at */
+static void bad_file(const char* name, const char* why, size_t at) {
+    ERROR_SATRT;
+    fprintf(msg_fp, "bad DVI file \"%s\", at byte %zu: %s.\n", name, at,
+            why);
+    dexit(EXIT_FAILURE);
+} /* bad_file */
+
+/* index in fonts of the font that fnt_def def defines, or NO_FONT */
+static size_t find_font(const DviCommand* def) {
+    const char* name = def->str + def->arg[4];
+    size_t name_len = (size_t)def->arg[5];
+
+    for (size_t i = 0; i < nfont; i++) {
+        const Font* f = &fonts[i];
+
+        if (f->checksum == (uint32_t)def->arg[1]
+            && f->scale == (uint32_t)def->arg[2]
+            && f->design == (uint32_t)def->arg[3]
+            && f->name_len == name_len
+            && memcmp(f->name, name, name_len) == 0) {
+            return i;
+        }
+    }
+    return NO_FONT;
+} /* find_font */
+
+/* has a font of the output number k? */
+static int output_has(int32_t k) {
+    for (size_t i = 0; i < nfont; i++) {
+        if (fonts[i].k == k) {
+            return 1;
+        }
+    }
+    return 0;
+} /* output_has */
+
+/* index in in_fonts of the input's font k; nin_font if none */
+static size_t in_font_index(int32_t k) {
+    size_t lo = 0, hi = nin_font;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (in_fonts[mid].k < k) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < nin_font && in_fonts[lo].k == k ? lo : nin_font);
+} /* in_font_index */
+
+/* the lower font number first */
+static int by_number(const void* a, const void* b) {
+    int32_t j = ((const InFont*)a)->k;
+    int32_t k = ((const InFont*)b)->k;
+
+    return (j < k ? -1 : j > k);
+} /* by_number */
+
+/* give the output the font of the input's in_fonts[i], numbered k */
+static void add_font(size_t i, int32_t k) {
+    const DviCommand* def = &in_fonts[i].def;
+    Font* f;
+
+    if (nfont == max_font) {
+        max_font = (max_font == 0 ? 64 : 2 * max_font);
+        fonts = (Font*)realloc(fonts, max_font * sizeof(Font));
+        if (fonts == NULL) {
+            no_memory("fonts");
+        }
+    }
+    f = &fonts[nfont];
+    f->k = k;
+    f->checksum = (uint32_t)def->arg[1];
+    f->scale = (uint32_t)def->arg[2];
+    f->design = (uint32_t)def->arg[3];
+    f->name = def->str + def->arg[4];
+    f->name_len = (size_t)def->arg[5];
+    f->defined = 0;
+    in_fonts[i].font = nfont++;
+} /* add_font */
+
+/* number the fonts of input r, of file name, from its postamble;
+   and note its l and u */
+static void number_fonts(const DviReader* r, const char* name,
+                         size_t* nshared) {
+    DviReader post;
+    DviCommand cmd;
+    int32_t k = 0;
+
+    nin_font = 0;
+    renumbered = 0;
+    *nshared = 0;
+    if (!dvi_read_postamble(r, &post)) {
+        bad_file(name, post.error, post.error_at);
+    }
+    while (dvi_read_next(&post, &cmd) && cmd.opcode != POSTPOST) {
+        if (cmd.opcode == POST) {
+            if ((uint32_t)cmd.arg[4] > max_height) {
+                max_height = (uint32_t)cmd.arg[4];
+            }
+            if ((uint32_t)cmd.arg[5] > max_width) {
+                max_width = (uint32_t)cmd.arg[5];
+            }
+        } else if (cmd.opcode >= FNT_DEF1 && cmd.opcode <= FNT_DEF4) {
+            if (nin_font == max_in_font) {
+                max_in_font = (max_in_font == 0 ? 64 : 2 * max_in_font);
+                in_fonts = (InFont*)realloc(in_fonts,
+                                            max_in_font * sizeof(InFont));
+                if (in_fonts == NULL) {
+                    no_memory("fonts");
+                }
+            }
+            in_fonts[nin_font].k = (int32_t)cmd.arg[0];
+            in_fonts[nin_font].font = find_font(&cmd);
+            in_fonts[nin_font].def = cmd;
+            ++nin_font;
+        } else if (cmd.opcode != NOP) {
+            bad_file(name, "not a font definition, in the postamble",
+                     cmd.offset);
+        }
+    }
+    if (post.error != NULL) {
+        bad_file(name, post.error, post.error_at);
+    }
+    if (nin_font > 1) {
+        qsort(in_fonts, nin_font, sizeof(InFont), by_number);
+    }
+
+    /* fonts that the output has keep its numbers; new fonts their own */
+    for (size_t i = 0; i < nin_font; i++) {
+        size_t f = in_fonts[i].font;
+
+        if (f != NO_FONT) {
+            ++*nshared;
+            renumbered |= (fonts[f].k != in_fonts[i].k);
+        } else if (!output_has(in_fonts[i].k)) {
+            add_font(i, in_fonts[i].k);
+        }
+    }
+    /* new fonts whose numbers the output has take the lowest free */
+    for (size_t i = 0; i < nin_font; i++) {
+        if (in_fonts[i].font != NO_FONT) {
+            continue;
+        }
+        while (output_has(k) || in_font_index(k) < nin_font) {
+            ++k;
+        }
+        add_font(i, k);
+        renumbered = 1;
+    }
+} /* number_fonts */
+
+/* the input's font k, as a font of the output; NULL (with the filter's
+   error set) if the input's postamble has no font k */
+static Font* output_font(DviFilter* filter, int32_t k) {
+    size_t i = in_font_index(k);
+
+    if (i == nin_font) {
+        filter->error = "font is not defined in the postamble";
+        return NULL;
+    }
+    return &fonts[in_fonts[i].font];
+} /* output_font */
+
+/* fnt_num, fnt: select the font by its number in the output */
+static DviFilterAction select_font(DviFilter* filter, const DviCommand* cmd,
+                                   void* data) {
+    int32_t k = (cmd->opcode <= FNT_NUM_63 ? cmd->opcode - FNT_NUM_0
+                                           : (int32_t)cmd->arg[0]);
+    Font* f = output_font(filter, k);
+
+    (void)data;
+    if (f == NULL) {
+        return DVI_FILTER_ERROR;
+    }
+    dvi_build_font(filter->out, f->k);
+    return DVI_FILTER_DROP;
+} /* select_font */
+
+/* fnt_def: define the font, by its number in the output, unless the
+   output has defined it */
+static DviFilterAction define_font(DviFilter* filter, const DviCommand* cmd,
+                                   void* data) {
+    Font* f = output_font(filter, (int32_t)cmd->arg[0]);
+    size_t area_len = (size_t)cmd->arg[4];
+
+    (void)data;
+    if (f == NULL) {
+        return DVI_FILTER_ERROR;
+    }
+    if (f->defined) {
+        return DVI_FILTER_DROP;
+    }
+    f->defined = 1;
+    if (f->k == (int32_t)cmd->arg[0]) {
+        return DVI_FILTER_KEEP;
+    }
+    dvi_build_define_font(filter->out, f->k, (uint32_t)cmd->arg[1],
+                          (uint32_t)cmd->arg[2], (uint32_t)cmd->arg[3],
+                          cmd->str, area_len, cmd->str + area_len,
+                          (size_t)cmd->arg[5]);
+    return DVI_FILTER_DROP;
+} /* define_font */
+
+int main(int argc, char* argv[]) {
+    FILE* dvo = stdout;
+    const char* out_name = NULL;
+    int64_t num = 0, den = 0, mag = 0;
+    int verbose = 0;
+    int arg = 1;
+
+    program_name = argv[0];
+    msg_fp = stderr;
+
+    for (; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-v") == 0) {
+            verbose = 1;
+        } else if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc) {
+            out_name = argv[++arg];
+        } else {
+            break;
+        }
+    }
+    if (arg == argc) {
+        fprintf(msg_fp, "usage: %s [-v] [-o output-DVI-file] "
+                "input-DVI-file ...\n", program_name);
+        dexit(EXIT_FAILURE);
+    }
+    if (out_name != NULL && (dvo = fopen(out_name, "wb")) == NULL) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "Cannot open \"%s\" for binary writing.\n", out_name);
+        dexit(EXIT_FAILURE);
+    }
+    fflush(dvo);
+    dvi_build_init(&out, fileno(dvo));
+
+    for (int i = arg; i < argc; i++) {
+        FILE* dvi;
+        DviReader r;
+        DviCommand pre;
+        DviFilter filter;
+        uint32_t pages = out.pages;
+        size_t fonts_before = nfont;
+        size_t nshared;
+
+        if ((dvi = fopen(argv[i], "rb")) == NULL) {
+            ERROR_SATRT;
+            fprintf(msg_fp, "Cannot open \"%s\" for binary reading.\n",
+                    argv[i]);
+            dexit(EXIT_FAILURE);
+        }
+        /* the inputs stay in memory: the fonts' names are in them */
+        read_input(dvi, &r);
+        if (!dvi_read_next(&r, &pre) || pre.opcode != PRE) {
+            bad_file(argv[i], (r.error != NULL ? r.error : "no preamble"),
+                     0);
+        }
+        if (i == arg) {
+            num = pre.arg[1];
+            den = pre.arg[2];
+            mag = pre.arg[3];
+            if (!dvi_build_copy(&out, &pre, r.dvi)) {
+                break;
+            }
+        } else if (pre.arg[1] != num || pre.arg[2] != den
+                   || pre.arg[3] != mag) {
+            ERROR_SATRT;
+            fprintf(msg_fp, "\"%s\" has another num, den or mag than "
+                    "\"%s\".\n", argv[i], argv[arg]);
+            dexit(EXIT_FAILURE);
+        }
+        number_fonts(&r, argv[i], &nshared);
+
+        dvi_filter_init(&filter);
+        dvi_filter_on(&filter, FNT_DEF1, FNT_DEF4, define_font, NULL);
+        if (renumbered) {
+            dvi_filter_on(&filter, FNT_NUM_0, FONT4, select_font, NULL);
+        }
+        if (!dvi_filter_pages(&filter, r.dvi, r.size, &out)) {
+            if (out.error != NULL) {
+                break;
+            }
+            bad_file(argv[i], filter.error, filter.error_at);
+        }
+        if (verbose) {
+            INFO_SATRT;
+            fprintf(msg_fp, "\"%s\": %u pages; %zu fonts shared, %zu new%s.\n",
+                    argv[i], (unsigned)(out.pages - pages), nshared,
+                    nfont - fonts_before,
+                    (renumbered ? ", fonts renumbered" : ""));
+        }
+        fclose(dvi);
+    }
+
+    if (out.error != NULL || !dvi_build_finish(&out, max_height, max_width)) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "cannot write the DVI file: %s.\n", out.error);
+        dexit(EXIT_FAILURE);
+    }
+    if (fclose(dvo) != 0) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "cannot close the DVI file.\n");
+        dexit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+} /* main */
+
+/* end of "dvcat.c" */
@@ -0,0 +1,599 @@
+/* dvdiff - the pages of two DVI files that differ, and how.
+
+   This file is public domain.
+
+   - Usage:  dvdiff [-q] [-v] old-DVI-file new-DVI-file
+     Exit status, as diff's: 0 if the files typeset the same pages, 1
+     if they do not, 2 if either cannot be read.
+   - Each page is hashed (FNV-1a, 64 bits) from its bytes, but for the
+     address in its bop, its font definitions and its nops: a font is
+     defined on the first page that selects it, so a page put in before
+     would move the definition.  Where a page selects a font, the hash
+     of the font's definition (the last given before, or else that of
+     the postamble) is hashed too: so a page that selects font 5 is not
+     the same if font 5 is another font.
+     The preambles are compared in num, den and mag, and in their
+     comments with any digit the same as any other: TeX gives the date
+     and time of the run there.
+   - The pages are then matched by their hashes, by the longest common
+     subsequence (Myers' O(ND) algorithm, in linear space): pages not
+     in it were deleted, put in, or changed.  These are listed as diff
+     lists lines: "3,4d2" (old pages 3 and 4 deleted, after new page
+     2), "5a6,7" (new pages 6 and 7 put in after old page 5), "8c9"
+     (old page 8 changed, into new page 9).
+   - Unless -q, each page changed, and only such a page, is copied by
+     itself into a DVI file in memory, by dvicopy, and turned into DTL
+     by libdtl; the DTL lines of the two pages, but for font
+     definitions and nops, are matched the same way, and shown as by
+     diff -U0.
+*/
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L /* fileno */
+#endif
+
+#include <stddef.h> // ptrdiff_t
+#include <stdint.h> // uint64_t, UINT64_C
+#include <stdlib.h> // calloc, realloc, free
+#include <string.h> // memchr, strcmp, strncmp
+
+#include "dtl.h"
+#include "dvibuild.h"
+#include "dvicopy.h"
+#include "dviread.h"
+#include "dvtool.h"
+#include "libdtl.h"
+
+/* exit status, as diff's */
+#define SAME    0
+#define DIFFER  1
+#define TROUBLE 2
+
+/* the bytes of bop before its address: opcode, and c0 .. c9 */
+#define BOP_COUNTS (1 + 10 * 4)
+
+/* FNV-1a, 64 bits, as dtlindex hashes DTL text */
+#define FNV_START UINT64_C(0xcbf29ce484222325)
+#define FNV_PRIME UINT64_C(0x100000001b3)
+
+/* a DVI file being compared */
+typedef struct {
+    const char* name;
+    DviReader r;        /* the whole file */
+    DviCopy c;          /* its pages and postamble fonts */
+    uint64_t* font;     /* hash of each postamble font's definition */
+    uint64_t* hash;     /* hash of each page */
+} Side;
+
+/* a DTL line of a page */
+typedef struct {
+    const char* text;
+    size_t len;
+} Line;
+
+static Side older, newer;
+static int quiet = 0;
+
+/* room for the forward and backward furthest reaching paths */
+static ptrdiff_t* vf = NULL;
+static ptrdiff_t* vb = NULL;
+
+/* stop: DVI file s is bad */
+static void bad_file(const Side* s) {
+    ERROR_SATRT;
+    if (s->c.error_at != DVI_READ_NONE) {
+        fprintf(msg_fp, "\"%s\": bad DVI file, at byte %zu: %s.\n", s->name,
+                s->c.error_at, s->c.error);
+    } else {
+        fprintf(msg_fp, "\"%s\": %s.\n", s->name, s->c.error);
+    }
+    dexit(TROUBLE);
+} /* bad_file */
+
+/* h, having hashed the n bytes at p too */
+static uint64_t fnv(uint64_t h, const unsigned char* p, size_t n) {
+    for (const unsigned char* end = p + n; p < end; p++) {
+        h ^= *p;
+        h *= FNV_PRIME;
+    }
+    return h;
+} /* fnv */
+
+/* hash of fnt_def def: its checksum, scale, design size and name, all
+   of it after k */
+static uint64_t def_hash(const Side* s, const DviCommand* def) {
+    size_t skip = 1 + (size_t)(def->opcode - FNT_DEF1 + 1);
+
+    return fnv(FNV_START, s->r.dvi + def->offset + skip, def->size - skip);
+} /* def_hash */
+
+/* index of s's font k in its postamble; s->c.nfont if it has none */
+static size_t font_index(const Side* s, int32_t k) {
+    size_t lo = 0, hi = s->c.nfont;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (s->c.font[mid].k < k) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < s->c.nfont && s->c.font[lo].k == k ? lo : s->c.nfont);
+} /* font_index */
+
+/* open DVI file s, find its pages and fonts, and hash its fonts */
+static void open_side(Side* s, const char* name) {
+    FILE* fp;
+    int fd;
+
+    s->name = name;
+    if ((fp = fopen(name, "rb")) == NULL) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "Cannot open \"%s\" for binary reading.\n", name);
+        dexit(TROUBLE);
+    }
+    fd = read_input(fp, &s->r);
+    dvi_copy_init(&s->c);
+    if (!dvi_copy_open(&s->c, s->r.dvi, s->r.size, fd)) {
+        bad_file(s);
+    }
+
+    s->font = (uint64_t*)calloc(s->c.nfont + 1, sizeof(uint64_t));
+    s->hash = (uint64_t*)calloc(s->c.npage + 1, sizeof(uint64_t));
+    if (s->font == NULL || s->hash == NULL) {
+        no_memory("hashes");
+    }
+    for (size_t i = 0; i < s->c.nfont; i++) {
+        s->font[i] = def_hash(s, &s->c.font[i].def);
+    }
+} /* open_side */
+
+/* hash page n (from 1) of s: its bytes, a run at a time, between what
+   is left out; pages are hashed in order, so that a definition holds
+   for the pages after it */
+static uint64_t hash_page(Side* s, size_t n) {
+    DviReader r = s->c.in;
+    DviCommand cmd;
+    const unsigned char* dvi = s->r.dvi;
+    uint64_t h = FNV_START;
+    size_t from;
+
+    r.pos = r.bop = s->c.bop[n - 1];
+    from = r.pos;
+    for (;;) {
+        int op;
+        size_t end;
+
+        /* most commands are set_char, of one byte: pass them here */
+        while (r.pos < r.end && dvi[r.pos] < SET1) {
+            ++r.pos;
+        }
+        if (!dvi_read_next(&r, &cmd)) {
+            break;
+        }
+        op = cmd.opcode;
+        end = cmd.offset + cmd.size;
+
+        if (op == BOP) {
+            h = fnv(h, dvi + cmd.offset, BOP_COUNTS);
+            from = end;
+        } else if (op == EOP) {
+            return fnv(h, dvi + from, end - from);
+        } else if (op == NOP || (op >= FNT_DEF1 && op <= FNT_DEF4)) {
+            size_t f = (op == NOP ? s->c.nfont
+                                  : font_index(s, (int32_t)cmd.arg[0]));
+
+            if (f < s->c.nfont) {
+                s->font[f] = def_hash(s, &cmd);
+            }
+            h = fnv(h, dvi + from, cmd.offset - from);
+            from = end;
+        } else if (op >= FNT_NUM_0 && op <= FONT4) {
+            size_t i = font_index(s, (op <= FNT_NUM_63 ? op - FNT_NUM_0
+                                                       : (int32_t)cmd.arg[0]));
+            uint64_t f = (i < s->c.nfont ? s->font[i] : 0);
+            unsigned char b[8];
+
+            for (int j = 0; j < 8; j++) {
+                b[j] = (unsigned char)(f >> (8 * j));
+            }
+            h = fnv(fnv(h, dvi + from, end - from), b, sizeof(b));
+            from = end;
+        } else if (op == PRE || op == POST) {
+            break;
+        }
+    }
+    if (r.error != NULL) {
+        s->c.error = r.error;
+        s->c.error_at = r.error_at;
+    } else {
+        s->c.error = "page without eop";
+        s->c.error_at = s->c.bop[n - 1];
+    }
+    bad_file(s);
+    return 0;
+} /* hash_page */
+
+/* are comments a and b the same, with any digit the same as any other? */
+static int same_comment(const DviCommand* a, const DviCommand* b) {
+    if (a->len != b->len) {
+        return 0;
+    }
+    for (size_t i = 0; i < a->len; i++) {
+        int c = (unsigned char)a->str[i];
+        int d = (unsigned char)b->str[i];
+
+        if (c != d && !(c >= '0' && c <= '9' && d >= '0' && d <= '9')) {
+            return 0;
+        }
+    }
+    return 1;
+} /* same_comment */
+
+/* do the preambles differ, but for the time of the run? */
+static int compare_pre(void) {
+    DviReader a = older.r, b = newer.r;
+    DviCommand p, q;
+
+    if (!dvi_read_next(&a, &p) || p.opcode != PRE
+        || !dvi_read_next(&b, &q) || q.opcode != PRE) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "no preamble.\n");
+        dexit(TROUBLE);
+    }
+    if (p.arg[1] != q.arg[1] || p.arg[2] != q.arg[2]
+        || p.arg[3] != q.arg[3]) {
+        printf("preamble: num %lld den %lld mag %lld; now num %lld den %lld "
+               "mag %lld\n", (long long)p.arg[1], (long long)p.arg[2],
+               (long long)p.arg[3], (long long)q.arg[1], (long long)q.arg[2],
+               (long long)q.arg[3]);
+        return 1;
+    }
+    if (!same_comment(&p, &q)) {
+        printf("preamble: '%.*s'; now '%.*s'\n", (int)p.len, p.str,
+               (int)q.len, q.str);
+        return 1;
+    }
+    return 0;
+} /* compare_pre */
+
+/* the middle snake of a[0 .. n) and b[0 .. m), from (*x0, *y0) to
+   (*x1, *y1): the matches on the middle of a shortest edit */
+static void middle_snake(const uint64_t* a, ptrdiff_t n, const uint64_t* b,
+                         ptrdiff_t m, ptrdiff_t* x0, ptrdiff_t* y0,
+                         ptrdiff_t* x1, ptrdiff_t* y1) {
+    ptrdiff_t delta = n - m;
+    ptrdiff_t max = (n + m + 1) / 2;
+    int odd = (delta & 1) != 0;
+
+    vf[1] = 0;
+    vb[1] = 0;
+    for (ptrdiff_t d = 0; d <= max; d++) {
+        for (ptrdiff_t k = -d; k <= d; k += 2) {
+            ptrdiff_t x = (k == -d || (k != d && vf[k - 1] < vf[k + 1])
+                           ? vf[k + 1] : vf[k - 1] + 1);
+            ptrdiff_t sx = x, y = x - k;
+
+            while (x < n && y < m && a[x] == b[y]) {
+                ++x;
+                ++y;
+            }
+            vf[k] = x;
+            if (odd && delta - k >= -(d - 1) && delta - k <= d - 1
+                && x + vb[delta - k] >= n) {
+                *x0 = sx;
+                *y0 = sx - k;
+                *x1 = x;
+                *y1 = y;
+                return;
+            }
+        }
+        /* from the ends back: x and y count from n and m */
+        for (ptrdiff_t k = -d; k <= d; k += 2) {
+            ptrdiff_t x = (k == -d || (k != d && vb[k - 1] < vb[k + 1])
+                           ? vb[k + 1] : vb[k - 1] + 1);
+            ptrdiff_t sx = x, y = x - k;
+
+            while (x < n && y < m && a[n - 1 - x] == b[m - 1 - y]) {
+                ++x;
+                ++y;
+            }
+            vb[k] = x;
+            if (!odd && delta - k >= -d && delta - k <= d
+                && x + vf[delta - k] >= n) {
+                *x0 = n - x;
+                *y0 = m - y;
+                *x1 = n - sx;
+                *y1 = m - (sx - k);
+                return;
+            }
+        }
+    }
+    *x0 = *x1 = 0; /* not reached */
+    *y0 = *y1 = 0;
+} /* middle_snake */
+
+/* match[i] = j + 1, for each a[i] and b[j] of a longest common
+   subsequence of a[alo .. ahi) and b[blo .. bhi) */
+static void lcs(const uint64_t* a, size_t alo, size_t ahi, const uint64_t* b,
+                size_t blo, size_t bhi, size_t* match) {
+    ptrdiff_t x0, y0, x1, y1;
+
+    while (alo < ahi && blo < bhi && a[alo] == b[blo]) {
+        match[alo++] = ++blo;
+    }
+    while (alo < ahi && blo < bhi && a[ahi - 1] == b[bhi - 1]) {
+        match[--ahi] = bhi--;
+    }
+    if (alo == ahi || blo == bhi) {
+        return;
+    }
+    middle_snake(a + alo, (ptrdiff_t)(ahi - alo), b + blo,
+                 (ptrdiff_t)(bhi - blo), &x0, &y0, &x1, &y1);
+    lcs(a, alo, alo + (size_t)x0, b, blo, blo + (size_t)y0, match);
+    for (ptrdiff_t i = x0; i < x1; i++) {
+        match[alo + (size_t)i] = blo + (size_t)(y0 + i - x0) + 1;
+    }
+    lcs(a, alo + (size_t)x1, ahi, b, blo + (size_t)y1, bhi, match);
+} /* lcs */
+
+/* for each of a[0 .. n), 1 + the index in b[0 .. m) that it matches, or
+   0; the caller is to free it */
+static size_t* match_hashes(const uint64_t* a, size_t n, const uint64_t* b,
+                            size_t m) {
+    size_t max = (n + m + 1) / 2 + 1;
+    size_t* match = (size_t*)calloc(n + 1, sizeof(size_t));
+
+    vf = (ptrdiff_t*)calloc(2 * max + 1, sizeof(ptrdiff_t));
+    vb = (ptrdiff_t*)calloc(2 * max + 1, sizeof(ptrdiff_t));
+    if (match == NULL || vf == NULL || vb == NULL) {
+        no_memory("matching");
+    }
+    vf += max;
+    vb += max;
+    lcs(a, 0, n, b, 0, m, match);
+    free(vf - max);
+    free(vb - max);
+    vf = vb = NULL;
+    return match;
+} /* match_hashes */
+
+/* the DTL lines of page n (from 1) of s, from bop to eop, but for font
+   definitions and nops, in *line; their text, to be freed, in *text */
+static size_t page_lines(Side* s, size_t n, Line** line, char** text) {
+    DviCopyOut o;
+    DtlContext ctx;
+    unsigned char* dvi;
+    size_t dvi_len, len, nline = 0, max = 0;
+    int in_page = 0;
+
+    if (!dvi_copy_out_init(&s->c, &o, -1) || !dvi_copy_page(&s->c, n, &o)
+        || !dvi_copy_finish(&s->c, &o)) {
+        bad_file(s);
+    }
+    dvi = dvi_build_take(&o.b, &dvi_len);
+    dvi_copy_out_free(&o);
+    if (dvi == NULL) {
+        no_memory("a page");
+    }
+
+    dtl_context_init(&ctx);
+    ctx.quiet = 1;
+    ctx.messages = msg_fp;
+    ctx.name = s->name;
+    if (dtl_dv2dt_buffer(&ctx, (const char*)dvi, dvi_len, text, &len)
+        != DTL_OK) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "\"%s\": page %zu: %s.\n", s->name, n,
+                dtl_status_string(ctx.status));
+        dexit(TROUBLE);
+    }
+    free(dvi);
+
+    *line = NULL;
+    for (const char* p = *text; p < *text + len;) {
+        const char* nl = (const char*)memchr(p, '\n',
+                                             (size_t)(*text + len - p));
+        size_t l = (size_t)((nl != NULL ? nl : *text + len) - p);
+
+        if (!in_page && l >= 4 && strncmp(p, "bop ", 4) == 0) {
+            in_page = 1;
+        }
+        if (in_page && !(l >= 2 && strncmp(p, "fd", 2) == 0)
+            && !(l == 3 && strncmp(p, "nop", 3) == 0)) {
+            if (nline == max) {
+                max = (max == 0 ? 256 : 2 * max);
+                *line = (Line*)realloc(*line, max * sizeof(Line));
+                if (*line == NULL) {
+                    no_memory("lines");
+                }
+            }
+            (*line)[nline].text = p;
+            (*line)[nline].len = l;
+            ++nline;
+            if (l == 3 && strncmp(p, "eop", 3) == 0) {
+                break;
+            }
+        }
+        p += l + 1;
+    }
+    return nline;
+} /* page_lines */
+
+/* diff -U0's start and count of lines first .. last (from 0) */
+static void print_range(size_t first, size_t last) {
+    if (last - first == 1) {
+        printf("%zu", first + 1);
+    } else {
+        printf("%zu,%zu", (last == first ? first : first + 1), last - first);
+    }
+} /* print_range */
+
+/* show how old page i differs from new page j, as diff -U0 would */
+static void diff_page(size_t i, size_t j) {
+    Line* a;
+    Line* b;
+    char* atext;
+    char* btext;
+    size_t na = page_lines(&older, i, &a, &atext);
+    size_t nb = page_lines(&newer, j, &b, &btext);
+    uint64_t* ha = (uint64_t*)calloc(na + 1, sizeof(uint64_t));
+    uint64_t* hb = (uint64_t*)calloc(nb + 1, sizeof(uint64_t));
+    size_t* match;
+    size_t x = 0, y = 0;
+    int shown = 0;
+
+    if (ha == NULL || hb == NULL) {
+        no_memory("lines");
+    }
+    for (size_t k = 0; k < na; k++) {
+        ha[k] = fnv(FNV_START, (const unsigned char*)a[k].text, a[k].len);
+    }
+    for (size_t k = 0; k < nb; k++) {
+        hb[k] = fnv(FNV_START, (const unsigned char*)b[k].text, b[k].len);
+    }
+    match = match_hashes(ha, na, hb, nb);
+
+    printf("--- %s page %zu\n+++ %s page %zu\n", older.name, i, newer.name,
+           j);
+    while (x < na || y < nb) {
+        size_t x0 = x, y0 = y;
+
+        /* a hunk: old lines up to the next match, new lines up to it */
+        while (x < na && match[x] == 0) {
+            ++x;
+        }
+        y = (x < na ? match[x] - 1 : nb);
+        if (x > x0 || y > y0) {
+            printf("@@ -");
+            print_range(x0, x);
+            printf(" +");
+            print_range(y0, y);
+            printf(" @@\n");
+            for (size_t k = x0; k < x; k++) {
+                printf("-%.*s\n", (int)a[k].len, a[k].text);
+            }
+            for (size_t k = y0; k < y; k++) {
+                printf("+%.*s\n", (int)b[k].len, b[k].text);
+            }
+            shown = 1;
+        }
+        if (x < na) {
+            ++x;
+            ++y;
+        }
+    }
+    if (!shown) {
+        printf("(the same commands, in other fonts)\n");
+    }
+
+    free(match);
+    free(ha);
+    free(hb);
+    free(a);
+    free(b);
+    free(atext);
+    free(btext);
+} /* diff_page */
+
+/* diff's name of pages first .. last (from 0) */
+static void print_pages(size_t first, size_t last) {
+    if (last - first > 1) {
+        printf("%zu,%zu", first + 1, last);
+    } else {
+        printf("%zu", (last == first ? first : last));
+    }
+} /* print_pages */
+
+/* show old pages x0 .. x, and new pages y0 .. y (from 0), which differ:
+   pages changed, then those deleted or put in */
+static void show_hunk(size_t x0, size_t x, size_t y0, size_t y) {
+    size_t n = (x - x0 < y - y0 ? x - x0 : y - y0);
+
+    if (n > 0) {
+        print_pages(x0, x0 + n);
+        printf("c");
+        print_pages(y0, y0 + n);
+        printf("\n");
+        for (size_t k = 0; k < n && !quiet; k++) {
+            diff_page(x0 + k + 1, y0 + k + 1);
+        }
+    }
+    if (x > x0 + n) {
+        print_pages(x0 + n, x);
+        printf("d%zu\n", y0 + n);
+    }
+    if (y > y0 + n) {
+        printf("%zua", x0 + n);
+        print_pages(y0 + n, y);
+        printf("\n");
+    }
+} /* show_hunk */
+
+int main(int argc, char* argv[]) {
+    size_t* match;
+    size_t x = 0, y = 0, nold, nnew, nchanged = 0;
+    int verbose = 0;
+    int differ;
+    int arg = 1;
+
+    program_name = argv[0];
+    msg_fp = stderr;
+    tool_failure = TROUBLE;
+
+    while (arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0') {
+        if (strcmp(argv[arg], "-q") == 0) {
+            quiet = 1;
+        } else if (strcmp(argv[arg], "-v") == 0) {
+            verbose = 1;
+        } else {
+            break;
+        }
+        ++arg;
+    }
+    if (argc - arg != 2) {
+        fprintf(msg_fp, "usage: %s [-q] [-v] old-DVI-file new-DVI-file\n",
+                program_name);
+        dexit(TROUBLE);
+    }
+    open_side(&older, argv[arg]);
+    open_side(&newer, argv[arg + 1]);
+    nold = older.c.npage;
+    nnew = newer.c.npage;
+    for (size_t n = 1; n <= nold; n++) {
+        older.hash[n - 1] = hash_page(&older, n);
+    }
+    for (size_t n = 1; n <= nnew; n++) {
+        newer.hash[n - 1] = hash_page(&newer, n);
+    }
+
+    differ = compare_pre();
+    match = match_hashes(older.hash, nold, newer.hash, nnew);
+    while (x < nold || y < nnew) {
+        size_t x0 = x, y0 = y;
+
+        while (x < nold && match[x] == 0) {
+            ++x;
+        }
+        y = (x < nold ? match[x] - 1 : nnew);
+        if (x > x0 || y > y0) {
+            show_hunk(x0, x, y0, y);
+            nchanged += (x - x0 > y - y0 ? x - x0 : y - y0);
+            differ = 1;
+        }
+        if (x < nold) {
+            ++x;
+            ++y;
+        }
+    }
+    if (verbose) {
+        INFO_SATRT;
+        fprintf(msg_fp, "\"%s\": %zu pages; \"%s\": %zu pages; %zu "
+                "differ.\n", older.name, nold, newer.name, nnew, nchanged);
+    }
+    free(match);
+    return (differ ? DIFFER : SAME);
+} /* main */
+
+/* end of "dvdiff.c" */
@@ -0,0 +1,710 @@
+/* dvibuild.c - DVI files built by calls, as dt2dv would encode them.
+
+   This file is public domain.
+
+   Each call chooses its command's form as dt2dv chooses it for the
+   unsuffixed DTL command: set_char_n for a character 0 to 127,
+   fnt_num_n for a font 0 to 63, and otherwise the fewest bytes that
+   hold the argument (4 for a negative character or font number).
+   The postamble is as dt2dv -post writes it: the first definition of
+   each font, the higher font number first, and 223s to a multiple
+   of 4.
+
+   Bytes are gathered in buf; with a file descriptor, buf is written
+   out whenever it holds DVI_BUILD_FLUSH bytes, and at the end.
+*/
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L /* write */
+#define HAVE_WRITE 1
+#include <unistd.h> // write
+#endif
+
+#include <errno.h>  // errno, EINTR
+#include <stdint.h> // SIZE_MAX
+#include <stdlib.h> // malloc, realloc, free, qsort
+#include <string.h> // memcpy, memset
+
+#include "dvibuild.h"
+#include "dviop.h"
+
+/* bytes of the one argument of a move (right1 .. z4) with opcode op,
+   from DVI_COMMANDS: its suffix */
+static inline int move_bytes(int op) {
+#define MOVE_BYTES(first, last, prefix, suffix, kind)                  \
+    if (kind == KIND_MOVE && op >= (first) && op <= (last)) {          \
+        return (suffix) + op - (first);                                \
+    }
+    DVI_COMMANDS(MOVE_BYTES)
+#undef MOVE_BYTES
+    return 0;
+} /* move_bytes */
+
+/* with a file descriptor, bytes gathered before they are written */
+#define DVI_BUILD_FLUSH (64 * 1024)
+
+/** Number of bytes, 1 to 4, needed for unsigned number u: the suffix
+ *  of the command (set, fnt, xxx, fnt_def) that has it as argument.
+ *  dt2dv and dvopt choose opcodes by it too.
+ */
+int dvi_build_unsigned_width(uint32_t u) {
+    int n = 1;
+
+    while (n < 4 && u >> (8 * n) != 0) {
+        ++n;
+    }
+    return n;
+} /* dvi_build_unsigned_width */
+
+/** Number of bytes, 1 to 4, needed for signed number s: the suffix of
+ *  the move that has it as argument.
+ */
+int dvi_build_signed_width(int32_t s) {
+    /* the bits above the lowest 8n - 1 must all equal the sign */
+    uint32_t high = (uint32_t)(s < 0 ? ~s : s);
+
+    return dvi_build_unsigned_width(high << 1);
+} /* dvi_build_signed_width */
+
+/* make b fail, because of why; return 0 */
+static int build_error(DviBuilder* b, const char* why) {
+    if (b->error == NULL) {
+        b->error = why;
+    }
+    return 0;
+} /* build_error */
+
+/* write out buf to b->fd; return 1 if all was written */
+static int flush_buf(DviBuilder* b) {
+#ifdef HAVE_WRITE
+    size_t done = 0;
+
+    while (done < b->len) {
+        ssize_t n = write(b->fd, b->buf + done, b->len - done);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            b->error_errno = errno;
+            return build_error(b, "cannot write DVI file");
+        }
+        done += (size_t)n;
+    }
+    b->len = 0;
+    return 1;
+#else
+    return build_error(b, "cannot write to a file descriptor");
+#endif
+} /* flush_buf */
+
+/* room for n more bytes in buf, at buf + len; NULL if none */
+static unsigned char* reserve(DviBuilder* b, size_t n) {
+    if (b->error != NULL) {
+        return NULL;
+    }
+    if (b->fd >= 0 && b->len + n > DVI_BUILD_FLUSH && b->len > 0
+        && !flush_buf(b)) {
+        return NULL;
+    }
+    if (n > SIZE_MAX - b->len) {
+        build_error(b, "no memory for DVI bytes");
+        return NULL;
+    }
+    if (b->len + n > b->max) {
+        size_t m = (b->max == 0 ? 4096 : b->max);
+        unsigned char* p;
+
+        while (m < b->len + n) {
+            if (m > SIZE_MAX / 2) {
+                build_error(b, "no memory for DVI bytes");
+                return NULL;
+            }
+            m *= 2;
+        }
+        p = (unsigned char*)realloc(b->buf, m);
+        if (p == NULL) {
+            build_error(b, "no memory for DVI bytes");
+            return NULL;
+        }
+        b->buf = p;
+        b->max = m;
+    }
+    return b->buf + b->len;
+} /* reserve */
+
+/* write u into n bytes at p, big-endian; return p + n */
+static unsigned char* encode(unsigned char* p, int n, uint32_t u) {
+    for (int i = n - 1; i >= 0; i--) {
+        p[i] = (unsigned char)(u & 0xFF);
+        u >>= 8;
+    }
+    return p + n;
+} /* encode */
+
+/* write opcode op, then u in n bytes (none if n is 0) */
+static int put_op(DviBuilder* b, int op, int n, uint32_t u) {
+    unsigned char* p = reserve(b, 1 + n);
+
+    if (p == NULL) {
+        return 0;
+    }
+    *p++ = (unsigned char)op;
+    encode(p, n, u);
+    b->len += 1 + n;
+    b->written += 1 + n;
+    return 1;
+} /* put_op */
+
+/* write the n bytes at s */
+static int put_bytes(DviBuilder* b, const void* s, size_t n) {
+    unsigned char* p;
+
+    if (n == 0) {
+        return (b->error == NULL);
+    }
+    p = reserve(b, n);
+    if (p == NULL) {
+        return 0;
+    }
+    memcpy(p, s, n);
+    b->len += n;
+    b->written += n;
+    return 1;
+} /* put_bytes */
+
+/** Start building a DVI file, written to file descriptor fd, or to
+ *  memory if fd is negative.
+ *
+ *  @param[out] b
+ *  @param[in]  fd
+ */
+void dvi_build_init(DviBuilder* b, int fd) {
+    memset(b, 0, sizeof(*b));
+    b->fd = (fd < 0 ? -1 : fd);
+    b->last_bop = -1;
+} /* dvi_build_init */
+
+/* free what b holds; the file descriptor is the caller's to close */
+void dvi_build_free(DviBuilder* b) {
+    free(b->buf);
+    free(b->font);
+    free(b->fonts);
+    memset(b, 0, sizeof(*b));
+    b->fd = -1;
+} /* dvi_build_free */
+
+/** Take the DVI bytes built in memory; the caller is to free them.
+ *
+ *  @param[inout] b
+ *  @param[out]   len  number of bytes.
+ *  @return the bytes, or NULL if b failed, or writes to a file.
+ */
+unsigned char* dvi_build_take(DviBuilder* b, size_t* len) {
+    unsigned char* p = b->buf;
+
+    *len = 0;
+    if (b->error != NULL || b->fd >= 0) {
+        return NULL;
+    }
+    *len = b->len;
+    b->buf = NULL;
+    b->len = b->max = 0;
+    return p;
+} /* dvi_build_take */
+
+/* write the preamble, with comment of len bytes */
+int dvi_build_pre(DviBuilder* b, uint32_t id, uint32_t num, uint32_t den,
+                  uint32_t mag, const char* comment, size_t len) {
+    unsigned char p[1 + 1 + 3 * 4 + 1];
+
+    if (len > 255) {
+        return build_error(b, "preamble comment is longer than 255 bytes");
+    }
+    if (b->written != 0) {
+        return build_error(b, "preamble is not at the start");
+    }
+    p[0] = PRE;
+    p[1] = (unsigned char)id;
+    encode(encode(encode(p + 2, 4, num), 4, den), 4, mag);
+    p[14] = (unsigned char)len;
+
+    b->id = id & 0xFF;
+    b->num = num;
+    b->den = den;
+    b->mag = mag;
+    return put_bytes(b, p, sizeof(p)) && put_bytes(b, comment, len);
+} /* dvi_build_pre */
+
+/** Begin a page: bop, with \count0 .. \count9, and the previous bop's
+ *  address.
+ */
+int dvi_build_begin_page(DviBuilder* b, const int32_t count[10]) {
+    unsigned char p[1 + 11 * 4];
+    unsigned char* q = p + 1;
+
+    if (b->in_page) {
+        return build_error(b, "bop within a page");
+    }
+    p[0] = BOP;
+    for (int i = 0; i < 10; i++) {
+        q = encode(q, 4, (uint32_t)count[i]);
+    }
+    encode(q, 4, (uint32_t)b->last_bop);
+
+    b->last_bop = (int32_t)b->written;
+    if (!put_bytes(b, p, sizeof(p))) {
+        return 0;
+    }
+    ++b->pages;
+    b->depth = 0;
+    b->in_page = 1;
+    return 1;
+} /* dvi_build_begin_page */
+
+/* end a page: eop */
+int dvi_build_end_page(DviBuilder* b) {
+    if (!b->in_page) {
+        return build_error(b, "eop outside a page");
+    }
+    b->in_page = 0;
+    return put_op(b, EOP, 0, 0);
+} /* dvi_build_end_page */
+
+/* typeset character c and move right: set_char_c, or set1 .. set4 */
+int dvi_build_set_char(DviBuilder* b, int32_t c) {
+    if (c >= 0 && c <= 127) {
+        return put_op(b, c, 0, 0);
+    }
+    {
+        int n = (c < 0 ? 4 : dvi_build_unsigned_width((uint32_t)c));
+
+        return put_op(b, SET1 + n - 1, n, (uint32_t)c);
+    }
+} /* dvi_build_set_char */
+
+/* typeset the n characters (bytes) at s, as a DTL sequence would */
+int dvi_build_set_chars(DviBuilder* b, const char* s, size_t n) {
+    unsigned char* p = reserve(b, 2 * n);
+    size_t len = 0;
+
+    if (p == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)s[i];
+
+        if (c > 127) {
+            p[len++] = SET1;
+        }
+        p[len++] = c;
+    }
+    b->len += len;
+    b->written += len;
+    return 1;
+} /* dvi_build_set_chars */
+
+/* typeset character c without moving: put1 .. put4 */
+int dvi_build_put_char(DviBuilder* b, int32_t c) {
+    int n = (c < 0 ? 4 : dvi_build_unsigned_width((uint32_t)c));
+
+    return put_op(b, PUT1 + n - 1, n, (uint32_t)c);
+} /* dvi_build_put_char */
+
+/* set_rule or put_rule, of the given height and width */
+static int rule(DviBuilder* b, int op, int32_t height, int32_t width) {
+    unsigned char p[1 + 2 * 4];
+
+    p[0] = (unsigned char)op;
+    encode(encode(p + 1, 4, (uint32_t)height), 4, (uint32_t)width);
+    return put_bytes(b, p, sizeof(p));
+} /* rule */
+
+/* typeset a rule, and move right by its width */
+int dvi_build_set_rule(DviBuilder* b, int32_t height, int32_t width) {
+    return rule(b, SET_RULE, height, width);
+} /* dvi_build_set_rule */
+
+/* typeset a rule without moving */
+int dvi_build_put_rule(DviBuilder* b, int32_t height, int32_t width) {
+    return rule(b, PUT_RULE, height, width);
+} /* dvi_build_put_rule */
+
+/* move by amount: right1 .. right4, w1 .. w4, and so on, as small as fits */
+int dvi_build_move(DviBuilder* b, DviMove move, int32_t amount) {
+    int n = dvi_build_signed_width(amount);
+
+    switch (move) {
+        case DVI_MOVE_RIGHT:
+        case DVI_MOVE_W:
+        case DVI_MOVE_X:
+        case DVI_MOVE_DOWN:
+        case DVI_MOVE_Y:
+        case DVI_MOVE_Z:
+            return put_op(b, (int)move + n - 1, n, (uint32_t)amount);
+    }
+    return build_error(b, "not a movement");
+} /* dvi_build_move */
+
+/* move right by dx */
+int dvi_build_move_right(DviBuilder* b, int32_t dx) {
+    return dvi_build_move(b, DVI_MOVE_RIGHT, dx);
+} /* dvi_build_move_right */
+
+/* move down by dy */
+int dvi_build_move_down(DviBuilder* b, int32_t dy) {
+    return dvi_build_move(b, DVI_MOVE_DOWN, dy);
+} /* dvi_build_move_down */
+
+/* a command of no arguments: nop, push, pop, w0, x0, y0 or z0 */
+int dvi_build_op(DviBuilder* b, int opcode) {
+    switch (opcode) {
+        case PUSH:
+            if (++b->depth > b->max_depth) {
+                b->max_depth = b->depth;
+            }
+            break;
+        case POP:
+            if (b->depth == 0) {
+                return build_error(b, "pop without push");
+            }
+            --b->depth;
+            break;
+        case NOP:
+        case W0:
+        case X0:
+        case Y0:
+        case Z0:
+            break;
+        default:
+            return build_error(b, "opcode is not of a command without "
+                                  "arguments");
+    }
+    return put_op(b, opcode, 0, 0);
+} /* dvi_build_op */
+
+/* save h, v, w, x, y, z */
+int dvi_build_push(DviBuilder* b) {
+    return dvi_build_op(b, PUSH);
+} /* dvi_build_push */
+
+/* restore h, v, w, x, y, z */
+int dvi_build_pop(DviBuilder* b) {
+    return dvi_build_op(b, POP);
+} /* dvi_build_pop */
+
+/** Remember the definition of font k, of len bytes at def, for the
+ *  postamble, without writing it; only its first definition is kept.
+ */
+int dvi_build_note_font(DviBuilder* b, uint32_t k, const void* def,
+                        size_t len) {
+    DviBuildFont* f;
+
+    for (size_t i = 0; i < b->nfont; i++) {
+        if (b->font[i].k == k) {
+            return 1;
+        }
+    }
+
+    if (b->nfont == b->maxfont) {
+        size_t m = (b->maxfont == 0 ? 16 : 2 * b->maxfont);
+
+        f = (DviBuildFont*)realloc(b->font, m * sizeof(DviBuildFont));
+        if (f == NULL) {
+            return build_error(b, "no memory for font definitions");
+        }
+        b->font = f;
+        b->maxfont = m;
+    }
+    if (b->fonts_len + len > b->fonts_max) {
+        size_t m = (b->fonts_max == 0 ? 1024 : 2 * b->fonts_max);
+        unsigned char* p;
+
+        while (m < b->fonts_len + len) {
+            m *= 2;
+        }
+        p = (unsigned char*)realloc(b->fonts, m);
+        if (p == NULL) {
+            return build_error(b, "no memory for font definitions");
+        }
+        b->fonts = p;
+        b->fonts_max = m;
+    }
+
+    f = &b->font[b->nfont++];
+    f->k = k;
+    f->at = b->fonts_len;
+    f->len = len;
+    memcpy(b->fonts + b->fonts_len, def, len);
+    b->fonts_len += len;
+    return 1;
+} /* dvi_build_note_font */
+
+/* write fnt_def, with k in n bytes, and note it for the postamble */
+static int font_def(DviBuilder* b, int n, int32_t k, uint32_t checksum,
+                    uint32_t scale, uint32_t design, const char* area,
+                    size_t area_len, const char* name, size_t name_len) {
+    size_t len = 1 + n + 3 * 4 + 2 + area_len + name_len;
+    unsigned char* def;
+    unsigned char* p;
+
+    if (area_len > 255 || name_len > 255) {
+        return build_error(b, "font area or name is longer than 255 bytes");
+    }
+    def = reserve(b, len);
+    if (def == NULL) {
+        return 0;
+    }
+
+    p = def;
+    *p++ = (unsigned char)(FNT_DEF1 + n - 1);
+    p = encode(p, n, (uint32_t)k);
+    p = encode(p, 4, checksum);
+    p = encode(p, 4, scale);
+    p = encode(p, 4, design);
+    *p++ = (unsigned char)area_len;
+    *p++ = (unsigned char)name_len;
+    memcpy(p, area, area_len);
+    memcpy(p + area_len, name, name_len);
+
+    b->len += len;
+    b->written += len;
+    return dvi_build_note_font(b, (uint32_t)k, def, len);
+} /* font_def */
+
+/** Define font k: fnt_def1 .. fnt_def4, with its checksum, scale
+ *  and design size, and its area (directory) and name.
+ */
+int dvi_build_define_font(DviBuilder* b, int32_t k, uint32_t checksum,
+                          uint32_t scale, uint32_t design, const char* area,
+                          size_t area_len, const char* name, size_t name_len) {
+    int n = (k < 0 ? 4 : dvi_build_unsigned_width((uint32_t)k));
+
+    return font_def(b, n, k, checksum, scale, design, area, area_len, name,
+                    name_len);
+} /* dvi_build_define_font */
+
+/* select font k: fnt_num_k, or fnt1 .. fnt4 */
+int dvi_build_font(DviBuilder* b, int32_t k) {
+    if (k >= 0 && k <= FNT_NUM_63 - FNT_NUM_0) {
+        return put_op(b, FNT_NUM_0 + k, 0, 0);
+    }
+    {
+        int n = (k < 0 ? 4 : dvi_build_unsigned_width((uint32_t)k));
+
+        return put_op(b, FONT1 + n - 1, n, (uint32_t)k);
+    }
+} /* dvi_build_font */
+
+/* a special, of the len bytes at s: xxx1 .. xxx4 */
+int dvi_build_special(DviBuilder* b, const char* s, size_t len) {
+    int n;
+
+    if (len > UINT32_MAX) {
+        return build_error(b, "special is longer than 4 GB");
+    }
+    n = dvi_build_unsigned_width((uint32_t)len);
+    return put_op(b, XXX1 + n - 1, n, (uint32_t)len)
+           && put_bytes(b, s, len);
+} /* dvi_build_special */
+
+/** Write the n bytes at bytes as they are: whole DVI commands, which
+ *  are not to be counted as dvi_build_copy counts them (so no bop, eop,
+ *  push, pop, fnt_def, pre, post or post_post).
+ */
+int dvi_build_raw(DviBuilder* b, const void* bytes, size_t n) {
+    return put_bytes(b, bytes, n);
+} /* dvi_build_raw */
+
+/** Write out the bytes gathered so far, so that the caller may write
+ *  to b's file descriptor itself, and count what it writes with
+ *  dvi_build_count_raw.
+ */
+int dvi_build_flush(DviBuilder* b) {
+    if (b->error != NULL) {
+        return 0;
+    }
+    if (b->fd < 0) {
+        return build_error(b, "DVI file is built in memory");
+    }
+    return flush_buf(b);
+} /* dvi_build_flush */
+
+/** Count n bytes that the caller wrote to b's file descriptor, after
+ *  dvi_build_flush: whole DVI commands, as for dvi_build_raw.
+ */
+int dvi_build_count_raw(DviBuilder* b, size_t n) {
+    if (b->error != NULL) {
+        return 0;
+    }
+    if (b->len != 0) {
+        return build_error(b, "DVI bytes written before a flush");
+    }
+    b->written += n;
+    return 1;
+} /* dvi_build_count_raw */
+
+/** Copy command cmd, as dvi_read_next read it, from its bytes at bytes.
+ *  It is written as it is, but for a bop's address, which is that of
+ *  the last bop built; and bop, eop, push, pop, fnt_def and pre are
+ *  counted as if built.  post and post_post are not copied, since
+ *  dvi_build_finish writes them.
+ */
+int dvi_build_copy(DviBuilder* b, const DviCommand* cmd, const void* bytes) {
+    const unsigned char* p = (const unsigned char*)bytes;
+
+    switch (cmd->opcode) {
+        case BOP: {
+            int32_t count[10];
+
+            for (int i = 0; i < 10; i++) {
+                count[i] = (int32_t)cmd->arg[i];
+            }
+            return dvi_build_begin_page(b, count);
+        }
+        case EOP:
+            return dvi_build_end_page(b);
+        case PUSH:
+        case POP:
+            return dvi_build_op(b, cmd->opcode);
+        case FNT_DEF1:
+        case FNT_DEF1 + 1:
+        case FNT_DEF1 + 2:
+        case FNT_DEF1 + 3:
+            return put_bytes(b, p, cmd->size)
+                   && dvi_build_note_font(b, (uint32_t)cmd->arg[0], p,
+                                          cmd->size);
+        case PRE:
+            if (b->written != 0) {
+                return build_error(b, "preamble is not at the start");
+            }
+            b->id = (uint32_t)cmd->arg[0];
+            b->num = (uint32_t)cmd->arg[1];
+            b->den = (uint32_t)cmd->arg[2];
+            b->mag = (uint32_t)cmd->arg[3];
+            return put_bytes(b, p, cmd->size);
+        case POST:
+        case POSTPOST:
+            return build_error(b, "postamble is written by dvi_build_finish");
+    }
+    return put_bytes(b, p, cmd->size);
+} /* dvi_build_copy */
+
+/** Encode command cmd anew, with its own opcode, from its arguments and
+ *  string, as dt2dv encodes a suffixed DTL command: so set2 stays set2,
+ *  whatever its argument.  cmd's size and offset are not used.  A bop's
+ *  address is that of the last bop built; post and post_post are not
+ *  encoded, since dvi_build_finish writes them.
+ */
+int dvi_build_command(DviBuilder* b, const DviCommand* cmd) {
+    int op = cmd->opcode;
+    const int64_t* arg = cmd->arg;
+
+    if (op < SET1 || (op >= FNT_NUM_0 && op <= FNT_NUM_63)
+        || op > POSTPOST) {
+        /* set_char_n, fnt_num_n and the undefined opcodes: no arguments */
+        return put_op(b, op, 0, 0);
+    } else if (op == SET_RULE || op == PUT_RULE) {
+        return rule(b, op, (int32_t)arg[0], (int32_t)arg[1]);
+    } else if (op < SET_RULE || (op > SET_RULE && op < PUT_RULE)) {
+        /* set1 .. set4, put1 .. put4 */
+        return put_op(b, op, (op - SET1) % 5 + 1, (uint32_t)arg[0]);
+    } else if (op == BOP) {
+        int32_t count[10];
+
+        for (int i = 0; i < 10; i++) {
+            count[i] = (int32_t)arg[i];
+        }
+        return dvi_build_begin_page(b, count);
+    } else if (op == EOP) {
+        return dvi_build_end_page(b);
+    } else if (op < RIGHT1) {
+        /* nop, push, pop */
+        return dvi_build_op(b, op);
+    } else if (op <= Z4) {
+        return put_op(b, op, move_bytes(op), (uint32_t)arg[0]);
+    } else if (op < XXX1) {
+        return put_op(b, op, op - FONT1 + 1, (uint32_t)arg[0]);
+    } else if (op < FNT_DEF1) {
+        int n = op - XXX1 + 1;
+
+        if (n < 4 && cmd->len >> (8 * n) != 0) {
+            return build_error(b, "special is too long for its opcode");
+        }
+        return put_op(b, op, n, (uint32_t)cmd->len)
+               && put_bytes(b, cmd->str, cmd->len);
+    } else if (op < PRE) {
+        const char* area = (cmd->str != NULL ? cmd->str : "");
+        size_t a = (size_t)arg[4];
+
+        return font_def(b, op - FNT_DEF1 + 1, (int32_t)arg[0],
+                        (uint32_t)arg[1], (uint32_t)arg[2], (uint32_t)arg[3],
+                        area, a, area + a, (size_t)arg[5]);
+    } else if (op == PRE) {
+        return dvi_build_pre(b, (uint32_t)arg[0], (uint32_t)arg[1],
+                             (uint32_t)arg[2], (uint32_t)arg[3], cmd->str,
+                             cmd->len);
+    }
+    return build_error(b, "postamble is written by dvi_build_finish");
+} /* dvi_build_command */
+
+/* the higher font number first */
+static int by_number_down(const void* a, const void* b) {
+    uint32_t j = ((const DviBuildFont*)a)->k;
+    uint32_t k = ((const DviBuildFont*)b)->k;
+
+    return (j > k ? -1 : j < k);
+} /* by_number_down */
+
+/** Finish the DVI file: write the postamble, as dt2dv -post does, and
+ *  (with a file descriptor) write out what is left.
+ *  max_height is l[4], the height plus depth of the tallest page,
+ *  and max_width is u[4], the width of the widest.
+ */
+int dvi_build_finish(DviBuilder* b, uint32_t max_height, uint32_t max_width) {
+    unsigned char p[1 + 6 * 4 + 2 * 2];
+    unsigned char* q = p + 1;
+    uint32_t post = (uint32_t)b->written;
+
+    if (b->in_page) {
+        return build_error(b, "postamble within a page");
+    }
+    p[0] = POST;
+    q = encode(q, 4, (uint32_t)b->last_bop);
+    q = encode(q, 4, b->num);
+    q = encode(q, 4, b->den);
+    q = encode(q, 4, b->mag);
+    q = encode(q, 4, max_height);
+    q = encode(q, 4, max_width);
+    q = encode(q, 2, (uint32_t)b->max_depth);
+    encode(q, 2, b->pages);
+    if (!put_bytes(b, p, sizeof(p))) {
+        return 0;
+    }
+
+    qsort(b->font, b->nfont, sizeof(DviBuildFont), by_number_down);
+    for (size_t i = 0; i < b->nfont; i++) {
+        if (!put_bytes(b, b->fonts + b->font[i].at, b->font[i].len)) {
+            return 0;
+        }
+    }
+
+    {
+        unsigned char pp[1 + 4 + 1 + 4 + 3];
+        size_t n = 1 + 4 + 1;
+
+        pp[0] = POSTPOST;
+        encode(pp + 1, 4, post);
+        pp[5] = (unsigned char)b->id;
+        /* at least four 223s, to a multiple of 4 bytes */
+        do {
+            pp[n++] = 223;
+        } while (n < 1 + 4 + 1 + 4 || (b->written + n) % 4 != 0);
+        if (!put_bytes(b, pp, n)) {
+            return 0;
+        }
+    }
+
+    return (b->fd < 0 || flush_buf(b));
+} /* dvi_build_finish */
+
+/* end of "dvibuild.c" */
@@ -0,0 +1,112 @@
+#ifndef INC_DVIBUILD_H
+/* dvibuild.h - DVI files built by calls, as dt2dv would encode them.
+
+   This file is public domain.
+
+   - A DviBuilder writes a DVI file command by command, for a program
+     that would otherwise write DTL text only for dt2dv to read back.
+   - Each command is written in its smallest form, as dt2dv writes an
+     unsuffixed DTL command; bop and postamble addresses are tracked,
+     and finishing writes the postamble, as dt2dv -post does.  So the
+     bytes are those dt2dv writes from the same commands in DTL.
+   - Commands read by dviread may be copied as they are, with their
+     bop addresses corrected, so that a DVI file can be rewritten
+     with few commands encoded anew; or encoded anew from their
+     arguments, each with its own opcode.
+   - The DVI bytes go to a file descriptor, or to a buffer in memory
+     that grows as needed.  With a file descriptor, the caller may
+     write whole commands to it between the builder's own, after a
+     flush, and have them counted.
+   - A call that fails returns 0, and sets the builder's error; every
+     later call then fails too, and nothing exits.
+*/
+#define INC_DVIBUILD_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // int32_t, uint32_t
+
+#include "dviread.h"
+
+/* the commands whose argument's size dvi_build_move chooses */
+typedef enum _DviMove {
+    DVI_MOVE_RIGHT = 143, ///< right1 .. right4.
+    DVI_MOVE_W = 148,     ///< w1 .. w4: move right, and set w.
+    DVI_MOVE_X = 153,     ///< x1 .. x4: move right, and set x.
+    DVI_MOVE_DOWN = 157,  ///< down1 .. down4.
+    DVI_MOVE_Y = 162,     ///< y1 .. y4: move down, and set y.
+    DVI_MOVE_Z = 167,     ///< z1 .. z4: move down, and set z.
+} DviMove;
+
+/* a font defined, for the postamble */
+typedef struct _DviBuildFont {
+    uint32_t k;  ///< font number.
+    size_t at;   ///< where its fnt_def is, in fonts.
+    size_t len;  ///< bytes of its fnt_def.
+} DviBuildFont;
+
+/* a DVI file being built */
+typedef struct _DviBuilder {
+    int fd;              ///< file descriptor written, or -1 for memory.
+    unsigned char* buf;  ///< bytes not yet written to fd; all, if memory.
+    size_t len;          ///< bytes in buf.
+    size_t max;          ///< room in buf.
+    size_t written;      ///< bytes in the DVI file so far.
+    int32_t last_bop;    ///< address of the last bop, or -1.
+    int in_page;         ///< between bop and eop?
+    int depth;           ///< push depth.
+    int max_depth;       ///< greatest push depth.
+    uint32_t pages;      ///< number of bops.
+    uint32_t id;         ///< from the preamble: DVI format identification.
+    uint32_t num, den;   ///< from the preamble: unit of measurement.
+    uint32_t mag;        ///< from the preamble: magnification.
+    size_t nfont;        ///< number of fonts defined.
+    size_t maxfont;      ///< room in font.
+    DviBuildFont* font;  ///< fonts, in order of first definition.
+    unsigned char* fonts; ///< their fnt_def commands, one after another.
+    size_t fonts_len, fonts_max;
+    const char* error;   ///< why the builder failed; NULL if it has not.
+    int error_errno;     ///< errno, if a write failed.
+} DviBuilder;
+
+void dvi_build_init(DviBuilder* b, int fd);
+void dvi_build_free(DviBuilder* b);
+unsigned char* dvi_build_take(DviBuilder* b, size_t* len);
+
+int dvi_build_unsigned_width(uint32_t u);
+int dvi_build_signed_width(int32_t s);
+
+int dvi_build_pre(DviBuilder* b, uint32_t id, uint32_t num, uint32_t den,
+                  uint32_t mag, const char* comment, size_t len);
+int dvi_build_begin_page(DviBuilder* b, const int32_t count[10]);
+int dvi_build_end_page(DviBuilder* b);
+
+int dvi_build_set_char(DviBuilder* b, int32_t c);
+int dvi_build_set_chars(DviBuilder* b, const char* s, size_t n);
+int dvi_build_put_char(DviBuilder* b, int32_t c);
+int dvi_build_set_rule(DviBuilder* b, int32_t height, int32_t width);
+int dvi_build_put_rule(DviBuilder* b, int32_t height, int32_t width);
+
+int dvi_build_move(DviBuilder* b, DviMove move, int32_t amount);
+int dvi_build_move_right(DviBuilder* b, int32_t dx);
+int dvi_build_move_down(DviBuilder* b, int32_t dy);
+int dvi_build_op(DviBuilder* b, int opcode);
+int dvi_build_push(DviBuilder* b);
+int dvi_build_pop(DviBuilder* b);
+
+int dvi_build_define_font(DviBuilder* b, int32_t k, uint32_t checksum,
+                          uint32_t scale, uint32_t design, const char* area,
+                          size_t area_len, const char* name, size_t name_len);
+int dvi_build_font(DviBuilder* b, int32_t k);
+int dvi_build_special(DviBuilder* b, const char* s, size_t len);
+int dvi_build_note_font(DviBuilder* b, uint32_t k, const void* def,
+                        size_t len);
+
+int dvi_build_raw(DviBuilder* b, const void* bytes, size_t n);
+int dvi_build_flush(DviBuilder* b);
+int dvi_build_count_raw(DviBuilder* b, size_t n);
+int dvi_build_copy(DviBuilder* b, const DviCommand* cmd, const void* bytes);
+int dvi_build_command(DviBuilder* b, const DviCommand* cmd);
+
+int dvi_build_finish(DviBuilder* b, uint32_t max_height, uint32_t max_width);
+
+#endif /* INC_DVIBUILD_H */
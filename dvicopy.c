@@ -0,0 +1,425 @@
+/* dvicopy.c - whole pages of a DVI file, copied as bytes to others.
+
+   This file is public domain.
+
+   The pages are found from the postamble, back through the bop
+   addresses, once.  A page is read, for the fonts that it selects and
+   defines, and its push depth, when it is first copied, and again
+   only when another page has been read since: a page copied to many
+   outputs in turn is read once.
+
+   The page's bytes after its bop are copied in runs, between the
+   definitions that the output does not need.  Each run is copied by
+   copy_file_range, if it is large, the input has a file descriptor,
+   and the output's has taken such copies so far; otherwise by
+   dvi_build_raw.  The builder is flushed before, and counts the bytes
+   after, so that bop addresses stay right.
+*/
+#if defined(__linux__)
+#define _GNU_SOURCE /* copy_file_range */
+#define HAVE_COPY_FILE_RANGE 1
+#include <unistd.h> // copy_file_range
+#endif
+
+#include <errno.h>  // errno, EINTR
+#include <stdlib.h> // calloc, realloc, free, qsort
+#include <string.h> // memset
+
+#include "dvicopy.h"
+#include "dviop.h"
+
+/* runs of fewer bytes than this are copied through the builder's buffer:
+   a system call for each would cost more than the copy */
+#define DIRECT_MIN 4096
+
+/* fail, because of why, at the input's command at offset at */
+static int copy_error(DviCopy* c, const char* why, size_t at) {
+    c->error = why;
+    c->error_at = at;
+    return 0;
+} /* copy_error */
+
+/* fail, because output o failed */
+static int out_error(DviCopy* c, const DviCopyOut* o) {
+    return copy_error(c, (o->b.error != NULL ? o->b.error
+                                             : "cannot write DVI file"),
+                      DVI_READ_NONE);
+} /* out_error */
+
+/* set c to hold no file */
+void dvi_copy_init(DviCopy* c) {
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    c->error_at = DVI_READ_NONE;
+} /* dvi_copy_init */
+
+/* free what c holds, and set it to hold no file; the file is the
+   caller's to unmap or free */
+void dvi_copy_free(DviCopy* c) {
+    free(c->bop);
+    free(c->font);
+    free(c->need);
+    free(c->def);
+    free(c->seen);
+    dvi_copy_init(c);
+} /* dvi_copy_free */
+
+/* index in c->font of font k; c->nfont if the postamble has none */
+static size_t find_font(const DviCopy* c, int32_t k) {
+    size_t lo = 0, hi = c->nfont;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (c->font[mid].k < k) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < c->nfont && c->font[lo].k == k ? lo : c->nfont);
+} /* find_font */
+
+/* the lower font number first */
+static int by_number(const void* a, const void* b) {
+    int32_t j = ((const DviCopyFont*)a)->k;
+    int32_t k = ((const DviCopyFont*)b)->k;
+
+    return (j < k ? -1 : j > k);
+} /* by_number */
+
+/* the postamble's l, u and fonts */
+static int read_postamble(DviCopy* c) {
+    DviReader r;
+    DviCommand cmd;
+    size_t max = 0;
+
+    if (!dvi_read_postamble(&c->in, &r)) {
+        return copy_error(c, r.error, r.error_at);
+    }
+    while (dvi_read_next(&r, &cmd) && cmd.opcode != POSTPOST) {
+        if (cmd.opcode == POST) {
+            c->max_height = (uint32_t)cmd.arg[4];
+            c->max_width = (uint32_t)cmd.arg[5];
+        } else if (cmd.opcode >= FNT_DEF1 && cmd.opcode <= FNT_DEF4) {
+            if (c->nfont == max) {
+                DviCopyFont* font;
+
+                max = (max == 0 ? 64 : 2 * max);
+                font = (DviCopyFont*)realloc(c->font,
+                                             max * sizeof(DviCopyFont));
+                if (font == NULL) {
+                    return copy_error(c, "no memory for fonts", cmd.offset);
+                }
+                c->font = font;
+            }
+            c->font[c->nfont].k = (int32_t)cmd.arg[0];
+            c->font[c->nfont].def = cmd;
+            ++c->nfont;
+        } else if (cmd.opcode != NOP) {
+            return copy_error(c, "not a font definition, in the postamble",
+                              cmd.offset);
+        }
+    }
+    if (r.error != NULL) {
+        return copy_error(c, r.error, r.error_at);
+    }
+    if (c->nfont > 1) {
+        qsort(c->font, c->nfont, sizeof(DviCopyFont), by_number);
+    }
+    c->seen = (size_t*)calloc(c->nfont + 1, sizeof(size_t));
+    if (c->seen == NULL) {
+        return copy_error(c, "no memory for fonts", DVI_READ_NONE);
+    }
+    return 1;
+} /* read_postamble */
+
+/* the bops of the pages, from the last back, through their addresses */
+static int find_pages(DviCopy* c) {
+    DviReader r;
+    size_t max = 0;
+    int found = dvi_read_last_page(&c->in, &r);
+
+    while (found) {
+        if (c->npage == max) {
+            size_t* bop;
+
+            max = (max == 0 ? 1024 : 2 * max);
+            bop = (size_t*)realloc(c->bop, max * sizeof(size_t));
+            if (bop == NULL) {
+                return copy_error(c, "no memory for pages", r.bop);
+            }
+            c->bop = bop;
+        }
+        c->bop[c->npage++] = r.bop;
+        found = dvi_read_prev_page(&r, &r);
+    }
+    if (r.error != NULL) {
+        return copy_error(c, r.error, r.error_at);
+    }
+    for (size_t i = 0; i < c->npage / 2; i++) {
+        size_t bop = c->bop[i];
+
+        c->bop[i] = c->bop[c->npage - 1 - i];
+        c->bop[c->npage - 1 - i] = bop;
+    }
+    return 1;
+} /* find_pages */
+
+/** Find the pages and fonts of the DVI file of size bytes at dvi, which
+ *  must outlive c; fd is its file descriptor, or -1.  c is set by
+ *  dvi_copy_init, or holds another file, which it no longer holds.
+ *
+ *  @return 1 if OK; 0 (with c->error set) if the file is bad, or there
+ *          is no memory.
+ */
+int dvi_copy_open(DviCopy* c, const void* dvi, size_t size, int fd) {
+    dvi_copy_free(c);
+    dvi_read_init(&c->in, dvi, size);
+    c->fd = fd;
+    return read_postamble(c) && find_pages(c);
+} /* dvi_copy_open */
+
+/** Start output o, to file descriptor fd (or to memory, if negative),
+ *  with c's preamble.
+ *
+ *  @return 1 if OK; 0 (with c->error set) if not.
+ */
+int dvi_copy_out_init(DviCopy* c, DviCopyOut* o, int fd) {
+    DviReader r;
+    DviCommand pre;
+
+    memset(o, 0, sizeof(*o));
+    dvi_build_init(&o->b, fd);
+    o->direct = (fd >= 0);
+    o->defined = (unsigned char*)calloc(c->nfont + 1, 1);
+    if (o->defined == NULL) {
+        return copy_error(c, "no memory for fonts", DVI_READ_NONE);
+    }
+
+    r = c->in;
+    r.pos = 0;
+    if (!dvi_read_next(&r, &pre) || pre.opcode != PRE) {
+        return copy_error(c, (r.error != NULL ? r.error : "no preamble"),
+                          0);
+    }
+    return (dvi_build_copy(&o->b, &pre, c->in.dvi) || out_error(c, o));
+} /* dvi_copy_out_init */
+
+/* free what o holds; its file descriptor is the caller's to close */
+void dvi_copy_out_free(DviCopyOut* o) {
+    dvi_build_free(&o->b);
+    free(o->defined);
+    o->defined = NULL;
+} /* dvi_copy_out_free */
+
+/* note that the page being read selects font k, unless it has defined it */
+static int select_font(DviCopy* c, int32_t k, size_t at) {
+    size_t f = find_font(c, k);
+
+    if (f == c->nfont) {
+        return copy_error(c, "font is not defined in the postamble", at);
+    }
+    if (c->seen[f] == c->reads) {
+        return 1;
+    }
+    c->seen[f] = c->reads;
+    if (c->nneed == c->maxneed) {
+        size_t m = (c->maxneed == 0 ? 64 : 2 * c->maxneed);
+        size_t* need = (size_t*)realloc(c->need, m * sizeof(size_t));
+
+        if (need == NULL) {
+            return copy_error(c, "no memory for fonts", at);
+        }
+        c->need = need;
+        c->maxneed = m;
+    }
+    c->need[c->nneed++] = f;
+    return 1;
+} /* select_font */
+
+/* note a definition of the page being read */
+static int define_font(DviCopy* c, const DviCommand* cmd) {
+    size_t f = find_font(c, (int32_t)cmd->arg[0]);
+
+    if (f < c->nfont) {
+        c->seen[f] = c->reads;
+    }
+    if (c->ndef == c->maxdef) {
+        size_t m = (c->maxdef == 0 ? 16 : 2 * c->maxdef);
+        DviCommand* def = (DviCommand*)realloc(c->def,
+                                               m * sizeof(DviCommand));
+
+        if (def == NULL) {
+            return copy_error(c, "no memory for fonts", cmd->offset);
+        }
+        c->def = def;
+        c->maxdef = m;
+    }
+    c->def[c->ndef++] = *cmd;
+    return 1;
+} /* define_font */
+
+/* read page n (from 1), for its fonts and push depth */
+static int read_page(DviCopy* c, size_t n) {
+    DviReader r = c->in;
+    DviCommand cmd;
+    int depth = 0;
+
+    r.pos = r.bop = c->bop[n - 1];
+    c->page = 0;
+    c->depth = 0;
+    c->nneed = 0;
+    c->ndef = 0;
+    ++c->reads;
+
+    while (dvi_read_next(&r, &cmd)) {
+        int op = cmd.opcode;
+        int ok = 1;
+
+        if (op == BOP) {
+            if (cmd.offset != c->bop[n - 1]) {
+                return copy_error(c, "bop within a page", cmd.offset);
+            }
+            for (int i = 0; i < 10; i++) {
+                c->count[i] = (int32_t)cmd.arg[i];
+            }
+            c->body = cmd.offset + cmd.size;
+        } else if (op == EOP) {
+            c->end = cmd.offset;
+            c->page = n;
+            return 1;
+        } else if (op == PUSH) {
+            if (++depth > c->depth) {
+                c->depth = depth;
+            }
+        } else if (op == POP) {
+            --depth;
+        } else if (op >= FNT_NUM_0 && op <= FNT_NUM_63) {
+            ok = select_font(c, op - FNT_NUM_0, cmd.offset);
+        } else if (op >= FONT1 && op <= FONT4) {
+            ok = select_font(c, (int32_t)cmd.arg[0], cmd.offset);
+        } else if (op >= FNT_DEF1 && op <= FNT_DEF4) {
+            ok = define_font(c, &cmd);
+        } else if (op == PRE || op == POST) {
+            break;
+        }
+        if (!ok) {
+            return 0;
+        }
+    }
+    if (r.error != NULL) {
+        return copy_error(c, r.error, r.error_at);
+    }
+    return copy_error(c, "page without eop", c->bop[n - 1]);
+} /* read_page */
+
+/* copy the n input bytes at offset at to o: by copy_file_range, if it
+   can, else through o's builder */
+static int copy_bytes(DviCopy* c, DviCopyOut* o, size_t at, size_t n) {
+#ifdef HAVE_COPY_FILE_RANGE
+    if (c->fd >= 0 && o->direct && n >= DIRECT_MIN) {
+        size_t done = 0;
+
+        if (!dvi_build_flush(&o->b)) {
+            return out_error(c, o);
+        }
+        while (done < n) {
+            loff_t off = (loff_t)(at + done);
+            ssize_t k = copy_file_range(c->fd, &off, o->b.fd, NULL,
+                                        n - done, 0);
+
+            if (k < 0 && errno == EINTR) {
+                continue;
+            }
+            if (k <= 0) {
+                /* not between these files: copy the rest as bytes */
+                o->direct = 0;
+                break;
+            }
+            done += (size_t)k;
+        }
+        if (!dvi_build_count_raw(&o->b, done)) {
+            return out_error(c, o);
+        }
+        o->copied += done;
+        at += done;
+        n -= done;
+    }
+#endif
+    return (dvi_build_raw(&o->b, c->in.dvi + at, n) || out_error(c, o));
+} /* copy_bytes */
+
+/** Copy page n (from 1) of c to o, after the fonts that it needs.
+ *
+ *  @return 1 if OK; 0 (with c->error set) if the page is bad, or o
+ *          cannot be written.
+ */
+int dvi_copy_page(DviCopy* c, size_t n, DviCopyOut* o) {
+    DviBuilder* b = &o->b;
+    size_t from;
+
+    if (n < 1 || n > c->npage) {
+        return copy_error(c, "no such page", DVI_READ_NONE);
+    }
+    if (c->page != n && !read_page(c, n)) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < c->nneed; i++) {
+        size_t f = c->need[i];
+
+        if (!o->defined[f]) {
+            o->defined[f] = 1;
+            dvi_build_copy(b, &c->font[f].def,
+                           c->in.dvi + c->font[f].def.offset);
+        }
+    }
+    if (!dvi_build_begin_page(b, c->count)) {
+        return out_error(c, o);
+    }
+
+    /* the page's bytes, but for definitions that o has */
+    from = c->body;
+    for (size_t i = 0; i < c->ndef; i++) {
+        const DviCommand* def = &c->def[i];
+        size_t f = find_font(c, (int32_t)def->arg[0]);
+
+        if (def->offset < from) {
+            return copy_error(c, "font definition before the page",
+                              def->offset);
+        }
+        if (f < c->nfont && o->defined[f]) {
+            if (!copy_bytes(c, o, from, def->offset - from)) {
+                return 0;
+            }
+            from = def->offset + def->size;
+            continue;
+        }
+        if (f < c->nfont) {
+            o->defined[f] = 1;
+        }
+        dvi_build_note_font(b, (uint32_t)def->arg[0],
+                            c->in.dvi + def->offset, def->size);
+    }
+    if (!copy_bytes(c, o, from, c->end - from)) {
+        return 0;
+    }
+
+    dvi_build_end_page(b);
+    if (c->depth > b->max_depth) {
+        b->max_depth = c->depth;
+    }
+    return (b->error == NULL || out_error(c, o));
+} /* dvi_copy_page */
+
+/** Finish o: its postamble, with c's l and u, and the fonts o defines.
+ *
+ *  @return 1 if OK; 0 (with c->error set) if o cannot be written.
+ */
+int dvi_copy_finish(DviCopy* c, DviCopyOut* o) {
+    return (dvi_build_finish(&o->b, c->max_height, c->max_width)
+            || out_error(c, o));
+} /* dvi_copy_finish */
+
+/* end of "dvicopy.c" */
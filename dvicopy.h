@@ -0,0 +1,79 @@
+#ifndef INC_DVICOPY_H
+/* dvicopy.h - whole pages of a DVI file, copied as bytes to others.
+
+   This file is public domain.
+
+   - A DviCopy holds what is needed to copy the pages of a DVI file to
+     other DVI files, in any order: the offset of each page's bop,
+     found through the chain of bop addresses, and the fonts of the
+     postamble.  Its memory is in proportion to the pages, not to the
+     bytes, which are read in place, as dviread reads them.
+   - A page is copied as it is, but for its bop, which is written anew
+     with the address of the output's page before, and the definitions
+     of fonts that the output has already defined, which are left out.
+     The fonts that it selects, and that the output has not yet
+     defined, are defined before it, from the postamble: so each page
+     can be read whichever pages come before it.
+   - The bytes go to a DviBuilder.  Where the system has
+     copy_file_range, and the input and output are files, the bytes of
+     large pages go from file to file without passing through memory.
+*/
+#define INC_DVICOPY_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // int32_t, uint32_t
+
+#include "dvibuild.h"
+#include "dviread.h"
+
+/* a font of the postamble */
+typedef struct _DviCopyFont {
+    int32_t k;       ///< its number.
+    DviCommand def;  ///< its fnt_def.
+} DviCopyFont;
+
+/* a DVI file whose pages are copied */
+typedef struct _DviCopy {
+    DviReader in;        ///< the DVI file.
+    int fd;              ///< its file descriptor, for copy_file_range; or -1.
+    size_t npage;        ///< number of pages.
+    size_t* bop;         ///< offset of each page's bop.
+    size_t nfont;        ///< number of fonts in the postamble.
+    DviCopyFont* font;   ///< those fonts, in order of k.
+    uint32_t max_height; ///< the postamble's l.
+    uint32_t max_width;  ///< the postamble's u.
+    size_t page;         ///< the page last read, from 1; 0 if none.
+    int32_t count[10];   ///< its bop's c0 .. c9.
+    size_t body;         ///< offset of its bytes after the bop.
+    size_t end;          ///< offset of its eop.
+    int depth;           ///< its greatest push depth.
+    size_t nneed;        ///< fonts it selects before it defines them.
+    size_t maxneed;      ///< room in need.
+    size_t* need;        ///< their indices in font.
+    size_t ndef;         ///< its fnt_defs.
+    size_t maxdef;       ///< room in def.
+    DviCommand* def;     ///< those fnt_defs.
+    size_t* seen;        ///< for each font, the read that last saw it.
+    size_t reads;        ///< pages read.
+    const char* error;   ///< why the last call failed; NULL if it did not.
+    size_t error_at;     ///< offset of the input's command in error, if any.
+} DviCopy;
+
+/* a DVI file that pages are copied to */
+typedef struct _DviCopyOut {
+    DviBuilder b;            ///< the DVI file being built.
+    unsigned char* defined;  ///< has it defined each font of the input?
+    int direct;              ///< may copy_file_range write to it?
+    size_t copied;           ///< bytes copied by copy_file_range.
+} DviCopyOut;
+
+void dvi_copy_init(DviCopy* c);
+int dvi_copy_open(DviCopy* c, const void* dvi, size_t size, int fd);
+void dvi_copy_free(DviCopy* c);
+
+int dvi_copy_out_init(DviCopy* c, DviCopyOut* o, int fd);
+void dvi_copy_out_free(DviCopyOut* o);
+int dvi_copy_page(DviCopy* c, size_t n, DviCopyOut* o);
+int dvi_copy_finish(DviCopy* c, DviCopyOut* o);
+
+#endif /* INC_DVICOPY_H */
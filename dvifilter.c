@@ -0,0 +1,220 @@
+/* dvifilter.c - DVI to DVI, changing commands by callbacks.
+
+   This file is public domain.
+
+   Commands are read in place.  Those with no callback, and nothing for
+   the builder to count, are gathered as a run of input bytes, which is
+   copied to the output in one piece when a command that needs more
+   (a callback, a bop, a push, a font definition) is reached.  The run
+   is copied before any callback is called, so that what the callback
+   builds comes after the commands before it.
+
+   The input's postamble is not copied: its font definitions are noted,
+   so that fonts that are defined only there are kept, and the builder
+   writes a postamble for the output.  Its l[4] and u[4] are kept.  The
+   fnt_def callbacks see the postamble's definitions too, with
+   in_postamble set: one that is kept is noted as it is; one that is
+   dropped is not noted, unless the callback notes another for it.
+*/
+#include <string.h> // memset
+
+#include "dvifilter.h"
+#include "dviop.h"
+
+/* may a command of opcode op be copied without the builder seeing it? */
+#define PLAIN(op) ((op) <= NOP || ((op) > POP && (op) < FNT_DEF1) \
+                   || (op) > POSTPOST)
+
+/* stop filtering, because of the input command at offset at */
+static int filter_error(DviFilter* f, const char* why, size_t at) {
+    if (f->error == NULL) {
+        f->error = why;
+        f->error_at = at;
+    }
+    return 0;
+} /* filter_error */
+
+/* copy the run of plain commands, if any */
+static int copy_run(DviFilter* f) {
+    size_t run = f->run;
+
+    if (run == DVI_READ_NONE) {
+        return 1;
+    }
+    f->run = DVI_READ_NONE;
+    if (!dvi_build_raw(f->out, f->in.dvi + run, f->run_end - run)) {
+        return filter_error(f, f->out->error, run);
+    }
+    return 1;
+} /* copy_run */
+
+/* set f to filter with no callbacks */
+void dvi_filter_init(DviFilter* f) {
+    memset(f, 0, sizeof(*f));
+    f->run = DVI_READ_NONE;
+    f->error_at = DVI_READ_NONE;
+} /* dvi_filter_init */
+
+/** Give each command of opcodes first to last to callback fn, with data;
+ *  or to none, if fn is NULL.
+ */
+void dvi_filter_on(DviFilter* f, int first, int last, DviFilterFn fn,
+                   void* data) {
+    for (int op = (first < 0 ? 0 : first); op <= last && op < 256; op++) {
+        f->fn[op] = fn;
+        f->data[op] = data;
+    }
+} /* dvi_filter_on */
+
+/** In a callback: copy cmd to the output now, so that what the callback
+ *  builds next comes after it; the callback then returns DVI_FILTER_DROP.
+ */
+int dvi_filter_copy(DviFilter* f, const DviCommand* cmd) {
+    if (!dvi_build_copy(f->out, cmd, f->in.dvi + cmd->offset)) {
+        return filter_error(f, f->out->error, cmd->offset);
+    }
+    return 1;
+} /* dvi_filter_copy */
+
+/* read the rest of the input's postamble, after post, noting its fonts */
+static int read_postamble(DviFilter* f) {
+    DviCommand cmd;
+
+    while (dvi_read_next(&f->in, &cmd)) {
+        if (cmd.opcode >= FNT_DEF1 && cmd.opcode <= FNT_DEF4) {
+            DviFilterAction action = DVI_FILTER_KEEP;
+
+            if (f->fn[cmd.opcode] != NULL) {
+                f->in_postamble = 1;
+                ++f->ncalls;
+                action = f->fn[cmd.opcode](f, &cmd, f->data[cmd.opcode]);
+            }
+            if (action == DVI_FILTER_DROP) {
+                ++f->ndropped;
+                if (f->out->error != NULL) {
+                    return filter_error(f, f->out->error, cmd.offset);
+                }
+                continue;
+            }
+            if (action != DVI_FILTER_KEEP) {
+                return filter_error(f, "a callback failed", cmd.offset);
+            }
+            if (!dvi_build_note_font(f->out, (uint32_t)cmd.arg[0],
+                                     f->in.dvi + cmd.offset, cmd.size)) {
+                return filter_error(f, f->out->error, cmd.offset);
+            }
+        } else if (cmd.opcode == POSTPOST) {
+            return 1;
+        } else if (cmd.opcode != NOP) {
+            return filter_error(f, "not a font definition, in the postamble",
+                                cmd.offset);
+        }
+    }
+    return (f->in.error == NULL
+            || filter_error(f, f->in.error, f->in.error_at));
+} /* read_postamble */
+
+/* filter the DVI file of size bytes at dvi into out: the whole file,
+   or (if not whole) its pages, without its preamble and postamble */
+static int filter(DviFilter* f, const void* dvi, size_t size,
+                  DviBuilder* out, int whole) {
+    DviCommand cmd;
+    uint32_t max_height = 0, max_width = 0;
+
+    dvi_read_init(&f->in, dvi, size);
+    f->out = out;
+    f->run = DVI_READ_NONE;
+    f->in_postamble = 0;
+    f->error = NULL;
+    f->error_at = DVI_READ_NONE;
+
+    while (dvi_read_next(&f->in, &cmd)) {
+        int op = cmd.opcode;
+
+        if (op == PRE && !whole) {
+            continue;
+        }
+        if (op == POST) {
+            if (!whole) {
+                break;
+            }
+            max_height = (uint32_t)cmd.arg[4];
+            max_width = (uint32_t)cmd.arg[5];
+            if (!read_postamble(f)) {
+                return 0;
+            }
+            break;
+        }
+
+        if (f->fn[op] == NULL) {
+            if (PLAIN(op)) {
+                if (f->run == DVI_READ_NONE) {
+                    f->run = cmd.offset;
+                }
+                f->run_end = cmd.offset + cmd.size;
+            } else if (!copy_run(f) || !dvi_filter_copy(f, &cmd)) {
+                return 0;
+            }
+            continue;
+        }
+
+        if (!copy_run(f)) {
+            return 0;
+        }
+        ++f->ncalls;
+        switch (f->fn[op](f, &cmd, f->data[op])) {
+            case DVI_FILTER_KEEP:
+                if (!dvi_filter_copy(f, &cmd)) {
+                    return 0;
+                }
+                break;
+            case DVI_FILTER_DROP:
+                ++f->ndropped;
+                break;
+            default:
+                return filter_error(f, "a callback failed", cmd.offset);
+        }
+        if (out->error != NULL) {
+            return filter_error(f, out->error, cmd.offset);
+        }
+    }
+    if (f->in.error != NULL) {
+        return filter_error(f, f->in.error, f->in.error_at);
+    }
+
+    if (!copy_run(f)) {
+        return 0;
+    }
+    if (whole && !dvi_build_finish(out, max_height, max_width)) {
+        return filter_error(f, out->error, f->in.pos);
+    }
+    return 1;
+} /* filter */
+
+/** Filter the DVI file of size bytes at dvi into out, which is finished
+ *  (its postamble written), but not freed.
+ *
+ *  @param[inout] f
+ *  @param[in]    dvi
+ *  @param[in]    size
+ *  @param[inout] out
+ *  @return 1 if OK; 0 (with f->error set) if the input is bad, or a
+ *          callback or the builder failed.
+ */
+int dvi_filter_run(DviFilter* f, const void* dvi, size_t size,
+                   DviBuilder* out) {
+    return filter(f, dvi, size, out, 1);
+} /* dvi_filter_run */
+
+/** Filter the pages of the DVI file of size bytes at dvi into out, after
+ *  what out has already: its preamble is left out, and it stops at its
+ *  post, so that out may be given other pages, and finished, after it.
+ *
+ *  @return as dvi_filter_run.
+ */
+int dvi_filter_pages(DviFilter* f, const void* dvi, size_t size,
+                     DviBuilder* out) {
+    return filter(f, dvi, size, out, 0);
+} /* dvi_filter_pages */
+
+/* end of "dvifilter.c" */
@@ -0,0 +1,64 @@
+#ifndef INC_DVIFILTER_H
+/* dvifilter.h - DVI to DVI, changing commands by callbacks.
+
+   This file is public domain.
+
+   - A DviFilter reads a DVI file with dviread, and writes another
+     with dvibuild, in one pass, without DTL text between them:
+     what `dv2dt | sed | dt2dv' does, in the process.
+   - Callbacks are set for the opcodes of interest.  A callback sees
+     each command of its opcodes, and keeps it or drops it; before
+     that, it may build other commands into the output, so that it
+     can rewrite a command, or insert commands before or after it.
+   - Commands that no callback sees are copied as they are, a run of
+     them at a time.  bop addresses, and the postamble, are written
+     anew, so that they are right however the pages have changed.
+   - fnt_def callbacks see the postamble's font definitions as well,
+     with in_postamble set; what they keep is noted for the new one.
+   - The pages of several files may be filtered into one builder, one
+     file after another, for the caller to finish.
+*/
+#define INC_DVIFILTER_H
+
+#include <stddef.h> // size_t
+
+#include "dvibuild.h"
+#include "dviread.h"
+
+/* what becomes of a command that a callback has seen */
+typedef enum _DviFilterAction {
+    DVI_FILTER_KEEP,  ///< copy it as it is, after what the callback built.
+    DVI_FILTER_DROP,  ///< leave it out; the callback may have built others.
+    DVI_FILTER_ERROR, ///< stop filtering; the callback may set f->error.
+} DviFilterAction;
+
+typedef struct _DviFilter DviFilter;
+
+/* a callback, given the filter, the command, and the data it was set with */
+typedef DviFilterAction (*DviFilterFn)(DviFilter* f, const DviCommand* cmd,
+                                       void* data);
+
+struct _DviFilter {
+    DviFilterFn fn[256]; ///< callback for each opcode, or NULL.
+    void* data[256];     ///< its data.
+    DviReader in;        ///< DVI file being read.
+    DviBuilder* out;     ///< DVI file being built.
+    size_t run;          ///< start of the commands to copy, or DVI_READ_NONE.
+    size_t run_end;      ///< end of them.
+    int in_postamble;    ///< are the commands from the postamble?
+    size_t ncalls;       ///< commands given to callbacks.
+    size_t ndropped;     ///< commands they dropped.
+    const char* error;   ///< why filtering failed; NULL if it did not.
+    size_t error_at;     ///< offset of the command, in the input.
+};
+
+void dvi_filter_init(DviFilter* f);
+void dvi_filter_on(DviFilter* f, int first, int last, DviFilterFn fn,
+                   void* data);
+int dvi_filter_copy(DviFilter* f, const DviCommand* cmd);
+int dvi_filter_run(DviFilter* f, const void* dvi, size_t size,
+                   DviBuilder* out);
+int dvi_filter_pages(DviFilter* f, const void* dvi, size_t size,
+                     DviBuilder* out);
+
+#endif /* INC_DVIFILTER_H */
@@ -0,0 +1,259 @@
+/* dvifonts.c - DVI font numbers, given by how often each font is used.
+
+   This file is public domain.
+
+   Counting reads the file with dviread, and keeps one DviFontUse per
+   font number, in order of k, found by binary search: a file has tens
+   or hundreds of fonts, and many thousands of selections.  The fonts
+   selected are then numbered by their uses, most first (and, of two
+   used alike, the lower number first), so that a file is always
+   numbered alike.
+
+   Renumbering is a DviFilter, with callbacks for fnt_num, fnt and
+   fnt_def: each selection is built anew by dvi_build_font, and each
+   definition of a selected font by dvi_build_define_font, in its
+   smallest form.  The postamble's definitions are encoded apart, and
+   noted for the postamble that the builder writes.
+*/
+#include <stdlib.h> // qsort, realloc, free
+#include <string.h> // memmove, memset
+
+#include "dvifilter.h"
+#include "dvifonts.h"
+#include "dviop.h"
+#include "dviread.h"
+
+/* fail, because of why, at the DVI command at offset at */
+static int fonts_error(DviFonts* f, const char* why, size_t at) {
+    f->error = why;
+    f->error_at = at;
+    return 0;
+} /* fonts_error */
+
+/* set f to hold no fonts */
+void dvi_fonts_init(DviFonts* f) {
+    memset(f, 0, sizeof(*f));
+    f->error_at = DVI_READ_NONE;
+} /* dvi_fonts_init */
+
+/* free what f holds, and set it to hold no fonts */
+void dvi_fonts_free(DviFonts* f) {
+    free(f->font);
+    dvi_fonts_init(f);
+} /* dvi_fonts_free */
+
+/* index of font k in f->font, or where it would go */
+static size_t font_index(const DviFonts* f, int32_t k) {
+    size_t lo = 0, hi = f->nfont;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (f->font[mid].k < k) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+} /* font_index */
+
+/* font k of f, or NULL if it was not seen */
+const DviFontUse* dvi_fonts_find(const DviFonts* f, int32_t k) {
+    size_t i = font_index(f, k);
+
+    return (i < f->nfont && f->font[i].k == k ? &f->font[i] : NULL);
+} /* dvi_fonts_find */
+
+/* font k of f, added if it is new; NULL if there is no memory */
+static DviFontUse* font_use(DviFonts* f, int32_t k) {
+    size_t i = font_index(f, k);
+
+    if (i < f->nfont && f->font[i].k == k) {
+        return &f->font[i];
+    }
+    if (f->nfont == f->maxfont) {
+        size_t m = (f->maxfont == 0 ? 64 : 2 * f->maxfont);
+        DviFontUse* font = (DviFontUse*)realloc(f->font,
+                                                m * sizeof(DviFontUse));
+
+        if (font == NULL) {
+            return NULL;
+        }
+        f->font = font;
+        f->maxfont = m;
+    }
+    memmove(f->font + i + 1, f->font + i,
+            (f->nfont - i) * sizeof(DviFontUse));
+    ++f->nfont;
+    memset(&f->font[i], 0, sizeof(DviFontUse));
+    f->font[i].k = k;
+    return &f->font[i];
+} /* font_use */
+
+/* the font selected by cmd, a fnt_num or fnt */
+static int32_t selected(const DviCommand* cmd) {
+    return (cmd->opcode <= FNT_NUM_63 ? cmd->opcode - FNT_NUM_0
+                                         : (int32_t)cmd->arg[0]);
+} /* selected */
+
+/* the most used font first; of two used alike, the lower number */
+static int by_uses(const void* a, const void* b) {
+    const DviFontUse* u = (const DviFontUse*)a;
+    const DviFontUse* v = (const DviFontUse*)b;
+
+    if (u->uses != v->uses) {
+        return (u->uses > v->uses ? -1 : 1);
+    }
+    return (u->k < v->k ? -1 : u->k > v->k);
+} /* by_uses */
+
+/* the lower font number first */
+static int by_number(const void* a, const void* b) {
+    const DviFontUse* u = (const DviFontUse*)a;
+    const DviFontUse* v = (const DviFontUse*)b;
+
+    return (u->k < v->k ? -1 : u->k > v->k);
+} /* by_number */
+
+/** Count the selections of each font of the DVI file of size bytes at
+ *  dvi, and give each font selected its new number: 0 to the most used.
+ *
+ *  @return 1 if OK; 0 (with f->error set) if the file is bad, or there
+ *          is no memory.
+ */
+int dvi_fonts_count(DviFonts* f, const void* dvi, size_t size) {
+    DviReader r;
+    DviCommand cmd;
+    int32_t n = 0;
+
+    f->nfont = 0;
+    f->nselect = 0;
+    f->error = NULL;
+    f->error_at = DVI_READ_NONE;
+
+    dvi_read_init(&r, dvi, size);
+    while (dvi_read_next(&r, &cmd)) {
+        int op = cmd.opcode;
+        DviFontUse* u;
+
+        if (op < FNT_NUM_0 || (op > FONT4 && op < FNT_DEF1)
+            || op > FNT_DEF4) {
+            continue;
+        }
+        u = font_use(f, (op <= FONT4 ? selected(&cmd)
+                                       : (int32_t)cmd.arg[0]));
+        if (u == NULL) {
+            return fonts_error(f, "no memory for fonts", cmd.offset);
+        }
+        if (op <= FONT4) {
+            ++u->uses;
+            ++f->nselect;
+        } else {
+            u->defined = 1;
+        }
+    }
+    if (r.error != NULL) {
+        return fonts_error(f, r.error, r.error_at);
+    }
+
+    if (f->nfont > 1) {
+        qsort(f->font, f->nfont, sizeof(DviFontUse), by_uses);
+    }
+    for (size_t i = 0; i < f->nfont; i++) {
+        f->font[i].new_k = (f->font[i].uses > 0 ? n++ : -1);
+    }
+    if (f->nfont > 1) {
+        qsort(f->font, f->nfont, sizeof(DviFontUse), by_number);
+    }
+    return 1;
+} /* dvi_fonts_count */
+
+/* the font counted for k; NULL (with the filter's error set) if none */
+static const DviFontUse* counted(DviFilter* filter, const DviFonts* f,
+                                 int32_t k) {
+    const DviFontUse* u = dvi_fonts_find(f, k);
+
+    if (u == NULL) {
+        filter->error = "font was not counted";
+    }
+    return u;
+} /* counted */
+
+/* fnt_num, fnt: select the font by its new number */
+static DviFilterAction select_font(DviFilter* filter, const DviCommand* cmd,
+                                   void* data) {
+    const DviFontUse* u = counted(filter, (const DviFonts*)data,
+                                  selected(cmd));
+
+    if (u == NULL) {
+        return DVI_FILTER_ERROR;
+    }
+    dvi_build_font(filter->out, u->new_k);
+    return DVI_FILTER_DROP;
+} /* select_font */
+
+/* fnt_def: define a selected font by its new number; drop the others */
+static DviFilterAction define_font(DviFilter* filter, const DviCommand* cmd,
+                                   void* data) {
+    DviFonts* f = (DviFonts*)data;
+    const DviFontUse* u = counted(filter, f, (int32_t)cmd->arg[0]);
+    size_t area_len = (size_t)cmd->arg[4];
+    size_t name_len = (size_t)cmd->arg[5];
+    DviBuilder def;
+
+    if (u == NULL) {
+        return DVI_FILTER_ERROR;
+    }
+    if (u->uses == 0) {
+        ++f->ndropped;
+        return DVI_FILTER_DROP;
+    }
+    if (!filter->in_postamble) {
+        dvi_build_define_font(filter->out, u->new_k, (uint32_t)cmd->arg[1],
+                              (uint32_t)cmd->arg[2], (uint32_t)cmd->arg[3],
+                              cmd->str, area_len, cmd->str + area_len,
+                              name_len);
+        return DVI_FILTER_DROP;
+    }
+
+    /* in the postamble: encode it apart, to note its bytes */
+    dvi_build_init(&def, -1);
+    if (dvi_build_define_font(&def, u->new_k, (uint32_t)cmd->arg[1],
+                              (uint32_t)cmd->arg[2], (uint32_t)cmd->arg[3],
+                              cmd->str, area_len, cmd->str + area_len,
+                              name_len)) {
+        dvi_build_note_font(filter->out, (uint32_t)u->new_k, def.buf,
+                            def.len);
+    } else if (filter->out->error == NULL) {
+        filter->out->error = def.error;
+    }
+    dvi_build_free(&def);
+    return DVI_FILTER_DROP;
+} /* define_font */
+
+/** Write the DVI file of size bytes at dvi, as counted by
+ *  dvi_fonts_count, to out, with its fonts renumbered, and the
+ *  definitions of fonts never selected left out.  out is finished.
+ *
+ *  @return 1 if OK; 0 (with f->error set) if the file is bad, is not
+ *          the one counted, or out failed.
+ */
+int dvi_fonts_renumber(DviFonts* f, const void* dvi, size_t size,
+                       DviBuilder* out) {
+    DviFilter filter;
+
+    f->ndropped = 0;
+    f->error = NULL;
+    f->error_at = DVI_READ_NONE;
+
+    dvi_filter_init(&filter);
+    dvi_filter_on(&filter, FNT_NUM_0, FONT4, select_font, f);
+    dvi_filter_on(&filter, FNT_DEF1, FNT_DEF4, define_font, f);
+    if (!dvi_filter_run(&filter, dvi, size, out)) {
+        return fonts_error(f, filter.error, filter.error_at);
+    }
+    return 1;
+} /* dvi_fonts_renumber */
+
+/* end of "dvifonts.c" */
@@ -0,0 +1,48 @@
+#ifndef INC_DVIFONTS_H
+/* dvifonts.h - DVI font numbers, given by how often each font is used.
+
+   This file is public domain.
+
+   - fnt_num_0 .. fnt_num_63 select a font in one byte; fnt1 .. fnt4
+     take two to five.  A DviFonts counts the font selections of a
+     DVI file, and numbers the fonts 0, 1, 2 ... from the most used,
+     so that the fonts selected most often are selected in one byte.
+   - Renumbering rewrites every fnt_num, fnt and fnt_def, in the pages
+     and the postamble, in one pass of dvifilter; fonts that are never
+     selected lose their definitions.  Nothing else is changed.
+*/
+#define INC_DVIFONTS_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // int32_t
+
+#include "dvibuild.h"
+
+/* a font number of the input, and what becomes of it */
+typedef struct _DviFontUse {
+    int32_t k;     ///< font number in the input.
+    int32_t new_k; ///< font number in the output, if it is selected.
+    size_t uses;   ///< fnt_num and fnt commands that select it.
+    int defined;   ///< has it a fnt_def?
+} DviFontUse;
+
+/* the fonts of a DVI file */
+typedef struct _DviFonts {
+    size_t nfont;      ///< number of font numbers seen.
+    size_t maxfont;    ///< room in font.
+    DviFontUse* font;  ///< fonts, in order of k.
+    size_t nselect;    ///< font selections, that is, uses of all fonts.
+    size_t ndropped;   ///< fnt_defs left out by the last renumbering.
+    const char* error; ///< why the last call failed; NULL if it did not.
+    size_t error_at;   ///< offset of the DVI command in error, if any.
+} DviFonts;
+
+void dvi_fonts_init(DviFonts* f);
+void dvi_fonts_free(DviFonts* f);
+
+int dvi_fonts_count(DviFonts* f, const void* dvi, size_t size);
+const DviFontUse* dvi_fonts_find(const DviFonts* f, int32_t k);
+int dvi_fonts_renumber(DviFonts* f, const void* dvi, size_t size,
+                       DviBuilder* out);
+
+#endif /* INC_DVIFONTS_H */
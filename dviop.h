@@ -0,0 +1,219 @@
+#ifndef INC_DVIOP_H
+/* dviop.h - the DVI opcodes, and the DVI commands in order of opcode.
+
+   This file is public domain.
+
+   - Names only: no data and no functions, so that the DVI modules
+     (dviread.c, dvibuild.c and the like) may include it as well as
+     dt2dv and dv2dt, through dtl.h.
+   - Reference:  "The DVI Driver Standard, Level 0",
+                 by  The TUG DVI Driver Standards Committee.
+                 Appendix A, "Device-Independent File Format".
+*/
+#define INC_DVIOP_H
+
+/** command names in DTL
+ */
+enum DVICmd {
+    SET1 = 128,
+    SET2,
+    SET3,
+    SET4,
+    SET_RULE,
+
+    PUT1 = 133,
+    PUT2,
+    PUT3,
+    PUT4,
+    PUT_RULE,
+
+    NOP = 138,
+    BOP,
+    EOP,
+    PUSH,
+    POP,
+
+    RIGHT1 = 143,
+    RIGHT2,
+    RIGHT3,
+    RIGHT4,
+
+    W0 = 147,
+    W1,
+    W2,
+    W3,
+    W4,
+
+    X0 = 152,
+    X1,
+    X2,
+    X3,
+    X4,
+
+    DOWN1 = 157,
+    DOWN2,
+    DOWN3,
+    DOWN4,
+
+    Y0 = 161,
+    Y1,
+    Y2,
+    Y3,
+    Y4,
+
+    Z0 = 166,
+    Z1,
+    Z2,
+    Z3,
+    Z4,
+
+    FNT_NUM_0 = 171,
+    /// [171, 234] fnt_num_N
+    FNT_NUM_63 = 234,
+
+    FONT1 = 235,
+    FONT2,
+    FONT3,
+    FONT4,
+
+    XXX1 = 239,
+    XXX2,
+    XXX3,
+    XXX4,
+
+    FNT_DEF1 = 243,
+    FNT_DEF2,
+    FNT_DEF3,
+    FNT_DEF4,
+
+    PRE = 247,
+    POST,
+    POSTPOST,
+
+    UNDEFINED = 250,
+}; /* enum DVICmd */
+
+#define SETCHAR_STR     "\\"
+#define SET_STR         "s"
+#define SET1_STR        "s1"
+#define SET2_STR        "s2"
+#define SET3_STR        "s3"
+#define SET4_STR        "s4"
+#define SET_RULE_STR    "sr"
+#define PUT_STR         "p"
+#define PUT1_STR        "p1"
+#define PUT2_STR        "p2"
+#define PUT3_STR        "p3"
+#define PUT4_STR        "p4"
+#define PUT_RULE_STR    "pr"
+#define NOP_STR         "nop"
+#define BOP_STR         "bop"
+#define EOP_STR         "eop"
+#define PUSH_STR        "["
+#define POP_STR         "]"
+#define RIGHT_STR       "r"
+#define RIGHT1_STR      "r1"
+#define RIGHT2_STR      "r2"
+#define RIGHT3_STR      "r3"
+#define RIGHT4_STR      "r4"
+#define W_STR           "w"
+#define W0_STR          "w0"
+#define W1_STR          "w1"
+#define W2_STR          "w2"
+#define W3_STR          "w3"
+#define W4_STR          "w4"
+#define X_STR           "x"
+#define X0_STR          "x0"
+#define X1_STR          "x1"
+#define X2_STR          "x2"
+#define X3_STR          "x3"
+#define X4_STR          "x4"
+#define DOWN_STR        "d"
+#define DOWN1_STR       "d1"
+#define DOWN2_STR       "d2"
+#define DOWN3_STR       "d3"
+#define DOWN4_STR       "d4"
+#define Y_STR           "y"
+#define Y0_STR          "y0"
+#define Y1_STR          "y1"
+#define Y2_STR          "y2"
+#define Y3_STR          "y3"
+#define Y4_STR          "y4"
+#define Z_STR           "z"
+#define Z0_STR          "z0"
+#define Z1_STR          "z1"
+#define Z2_STR          "z2"
+#define Z3_STR          "z3"
+#define Z4_STR          "z4"
+#define FONT_STR        "f"
+#define FONT1_STR       "f1"
+#define FONT2_STR       "f2"
+#define FONT3_STR       "f3"
+#define FONT4_STR       "f4"
+#define FONT_DEF_STR    "fd"
+#define FONT_NUM_STR    "fn"
+#define SPECIAL_STR     "special"
+#define PRE_STR         "pre"
+#define POST_STR        "post"
+#define POSTPOST_STR    "post_post"
+#define OPCODE_STR      "opcode"
+
+/* Number of DVI commands, including those officially undefined */
+#define NCMDS 256
+
+/** what a DVI command's arguments are, and what the programs do with it
+ */
+typedef enum _DviKind {
+    KIND_SETCHAR,  ///< setchar: no arguments.
+    KIND_CHAR,     ///< set, put, fnt: unsigned, of suffix bytes; 4 are signed.
+    KIND_RULE,     ///< set_rule, put_rule: height and width, signed 4 each.
+    KIND_NONE,     ///< nop, fnt_num, the undefined opcodes: no arguments.
+    KIND_BOP,      ///< bop: c0[4] .. c9[4], and p[4], signed.
+    KIND_EOP,      ///< eop: no arguments.
+    KIND_PUSH,     ///< push: no arguments.
+    KIND_POP,      ///< pop: no arguments.
+    KIND_MOVE,     ///< right, w, x, down, y, z: signed, of suffix bytes.
+    KIND_SPECIAL,  ///< xxx: k, of suffix bytes, and k bytes.
+    KIND_FONT_DEF, ///< fnt_def: k, of suffix bytes, c, s, d, a, l, and name.
+    KIND_PRE,      ///< pre.
+    KIND_POST,     ///< post.
+    KIND_POSTPOST, ///< post_post, and the padding after it.
+    NKINDS
+} DviKind;
+
+/** The DVI commands, for dt2dv, dv2dt and the DVI modules, in order
+ *  of opcode.
+ *  Each row is a run of opcodes, first to last, of one kind, named in DTL
+ *  by a prefix and a suffix (-1 if none): the first opcode has the suffix
+ *  given, and the next ones count up from it.  setchar's suffix is in
+ *  hexadecimal, the others' in decimal.
+ *
+ *  X(first, last, prefix, first suffix, kind)
+ */
+#define DVI_COMMANDS(X)                                          \
+    X(0,         127,        SETCHAR_STR,  0,   KIND_SETCHAR)    \
+    X(SET1,      SET4,       SET_STR,      1,   KIND_CHAR)       \
+    X(SET_RULE,  SET_RULE,   SET_RULE_STR, -1,  KIND_RULE)       \
+    X(PUT1,      PUT4,       PUT_STR,      1,   KIND_CHAR)       \
+    X(PUT_RULE,  PUT_RULE,   PUT_RULE_STR, -1,  KIND_RULE)       \
+    X(NOP,       NOP,        NOP_STR,      -1,  KIND_NONE)       \
+    X(BOP,       BOP,        BOP_STR,      -1,  KIND_BOP)        \
+    X(EOP,       EOP,        EOP_STR,      -1,  KIND_EOP)        \
+    X(PUSH,      PUSH,       PUSH_STR,     -1,  KIND_PUSH)       \
+    X(POP,       POP,        POP_STR,      -1,  KIND_POP)        \
+    X(RIGHT1,    RIGHT4,     RIGHT_STR,    1,   KIND_MOVE)       \
+    X(W0,        W4,         W_STR,        0,   KIND_MOVE)       \
+    X(X0,        X4,         X_STR,        0,   KIND_MOVE)       \
+    X(DOWN1,     DOWN4,      DOWN_STR,     1,   KIND_MOVE)       \
+    X(Y0,        Y4,         Y_STR,        0,   KIND_MOVE)       \
+    X(Z0,        Z4,         Z_STR,        0,   KIND_MOVE)       \
+    X(FNT_NUM_0, FNT_NUM_63, FONT_NUM_STR, 0,   KIND_NONE)       \
+    X(FONT1,     FONT4,      FONT_STR,     1,   KIND_CHAR)       \
+    X(XXX1,      XXX4,       SPECIAL_STR,  1,   KIND_SPECIAL)    \
+    X(FNT_DEF1,  FNT_DEF4,   FONT_DEF_STR, 1,   KIND_FONT_DEF)   \
+    X(PRE,       PRE,        PRE_STR,      -1,  KIND_PRE)        \
+    X(POST,      POST,       POST_STR,     -1,  KIND_POST)       \
+    X(POSTPOST,  POSTPOST,   POSTPOST_STR, -1,  KIND_POSTPOST)   \
+    X(UNDEFINED, 255,        OPCODE_STR,   UNDEFINED, KIND_NONE)
+
+#endif /* INC_DVIOP_H */
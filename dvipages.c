@@ -0,0 +1,368 @@
+/* dvipages.c - the commands of whole DVI pages, decoded once, as arrays.
+
+   This file is public domain.
+
+   Each command is read by dvi_read_next, and its arguments are put in
+   the pool as dviread gives them, but for those in the opcode; its
+   string, if any, is copied to the arena.  Written out, each command
+   is given back to dvi_build_command as a DviCommand, with its own
+   opcode, so that a DviPages read and written unchanged gives what
+   dvifilter gives with no callbacks: the same pages, bop addresses
+   corrected, and the postamble written by dvibuild.
+
+   The arrays grow by doubling, as dvibuild's buffer does; they are
+   kept by dvi_pages_clear, for the next file.
+*/
+#include <stdlib.h> // realloc, free
+#include <string.h> // memchr, memcpy, memset
+
+#include "dviop.h"
+#include "dvipages.h"
+
+/* has a command of opcode op a string? */
+#define HAS_STRING(op) (((op) >= XXX1 && (op) <= FNT_DEF4) \
+                        || (op) == PRE)
+
+/* fail, because of why, at the DVI command at offset at */
+static int pages_error(DviPages* p, const char* why, size_t at) {
+    p->error = why;
+    p->error_at = at;
+    return 0;
+} /* pages_error */
+
+/* room for need things, doubling max */
+static size_t grown(size_t max, size_t need) {
+    size_t m = (max == 0 ? 1024 : max);
+
+    while (m < need) {
+        m *= 2;
+    }
+    return m;
+} /* grown */
+
+/* room for n more arguments, len more bytes, and one more command */
+static int reserve(DviPages* p, size_t n, size_t len) {
+    if (p->ncmd + 1 > p->maxcmd) {
+        size_t m = grown(p->maxcmd, p->ncmd + 1);
+        uint8_t* op = (uint8_t*)realloc(p->op, m);
+        uint32_t* arg;
+
+        if (op == NULL) {
+            return pages_error(p, "no memory for DVI commands",
+                               DVI_PAGES_NONE);
+        }
+        p->op = op;
+        arg = (uint32_t*)realloc(p->arg, (m + 1) * sizeof(uint32_t));
+        if (arg == NULL) {
+            return pages_error(p, "no memory for DVI commands",
+                               DVI_PAGES_NONE);
+        }
+        p->arg = arg;
+        p->maxcmd = m;
+    }
+    if (p->nargs + n > p->maxargs) {
+        size_t m = grown(p->maxargs, p->nargs + n);
+        int32_t* args = (int32_t*)realloc(p->args, m * sizeof(int32_t));
+
+        if (args == NULL) {
+            return pages_error(p, "no memory for DVI arguments",
+                               DVI_PAGES_NONE);
+        }
+        p->args = args;
+        p->maxargs = m;
+    }
+    if (p->nbytes + len > p->maxbytes) {
+        size_t m = grown(p->maxbytes, p->nbytes + len);
+        char* bytes = (char*)realloc(p->bytes, m);
+
+        if (bytes == NULL) {
+            return pages_error(p, "no memory for DVI strings",
+                               DVI_PAGES_NONE);
+        }
+        p->bytes = bytes;
+        p->maxbytes = m;
+    }
+    return 1;
+} /* reserve */
+
+/* set p to hold no commands */
+void dvi_pages_init(DviPages* p) {
+    memset(p, 0, sizeof(*p));
+    p->post = DVI_PAGES_NONE;
+    p->error_at = DVI_PAGES_NONE;
+} /* dvi_pages_init */
+
+/* free what p holds */
+void dvi_pages_free(DviPages* p) {
+    free(p->op);
+    free(p->arg);
+    free(p->args);
+    free(p->bytes);
+    free(p->page);
+    dvi_pages_init(p);
+} /* dvi_pages_free */
+
+/* empty p, keeping its room for the next commands */
+void dvi_pages_clear(DviPages* p) {
+    p->ncmd = p->nargs = p->nbytes = p->npage = 0;
+    p->post = DVI_PAGES_NONE;
+    p->error = NULL;
+    p->error_at = DVI_PAGES_NONE;
+} /* dvi_pages_clear */
+
+/* drop the commands from index ncmd on, keeping their room */
+void dvi_pages_truncate(DviPages* p, size_t ncmd) {
+    if (ncmd >= p->ncmd) {
+        return;
+    }
+    /* the first string dropped starts where the kept ones end */
+    for (size_t i = ncmd; i < p->ncmd; i++) {
+        if (HAS_STRING(p->op[i])) {
+            p->nbytes = (size_t)p->args[p->arg[i + 1] - 1];
+            break;
+        }
+    }
+    while (p->npage > 0 && p->page[p->npage - 1] >= ncmd) {
+        --p->npage;
+    }
+    if (p->post != DVI_PAGES_NONE && p->post >= ncmd) {
+        p->post = DVI_PAGES_NONE;
+    }
+    p->ncmd = ncmd;
+    p->nargs = p->arg[ncmd];
+} /* dvi_pages_truncate */
+
+/** Append a command: its opcode, its nargs arguments (none for
+ *  set_char_n and fnt_num_n; without the string's offset for special,
+ *  fnt_def and pre), and its string of len bytes at str, if it has one.
+ *
+ *  @return 1 if OK; 0 (with p->error set) if out of memory or room.
+ */
+int dvi_pages_add(DviPages* p, int opcode, const int32_t* args, int nargs,
+                  const char* str, size_t len) {
+    int string = HAS_STRING(opcode);
+    size_t n = (size_t)nargs + (string ? 1 : 0);
+
+    if (opcode < 0 || opcode > 255 || nargs < 0) {
+        return pages_error(p, "not a DVI command", DVI_PAGES_NONE);
+    }
+    if (p->ncmd >= UINT32_MAX || p->nargs + n > UINT32_MAX
+        || p->nbytes + len > INT32_MAX) {
+        return pages_error(p, "too many DVI commands to hold",
+                           DVI_PAGES_NONE);
+    }
+    if (!reserve(p, n, len)) {
+        return 0;
+    }
+
+    if (opcode == BOP) {
+        if (p->npage == p->maxpage) {
+            size_t m = grown(p->maxpage, p->npage + 1);
+            uint32_t* page = (uint32_t*)realloc(p->page,
+                                                m * sizeof(uint32_t));
+
+            if (page == NULL) {
+                return pages_error(p, "no memory for DVI pages",
+                                   DVI_PAGES_NONE);
+            }
+            p->page = page;
+            p->maxpage = m;
+        }
+        p->page[p->npage++] = (uint32_t)p->ncmd;
+    } else if (opcode == POST) {
+        p->post = p->ncmd;
+    }
+
+    p->op[p->ncmd] = (uint8_t)opcode;
+    p->arg[p->ncmd] = (uint32_t)p->nargs;
+    if (nargs > 0) {
+        memcpy(p->args + p->nargs, args, (size_t)nargs * sizeof(int32_t));
+    }
+    p->nargs += (size_t)nargs;
+    if (string) {
+        p->args[p->nargs++] = (int32_t)p->nbytes;
+        if (len > 0) {
+            memcpy(p->bytes + p->nbytes, str, len);
+        }
+        p->nbytes += len;
+    }
+    ++p->ncmd;
+    p->arg[p->ncmd] = (uint32_t)p->nargs;
+    return 1;
+} /* dvi_pages_add */
+
+/** Append every command that r yields, to its end.
+ *
+ *  @param[inout] p
+ *  @param[inout] r
+ *  @return 1 if OK; 0 (with p->error set) if r's input is bad, or out of
+ *          memory.
+ */
+int dvi_pages_read(DviPages* p, DviReader* r) {
+    DviCommand cmd;
+
+    p->error = NULL;
+    p->error_at = DVI_PAGES_NONE;
+
+    while (dvi_read_next(r, &cmd)) {
+        int32_t args[DVI_READ_MAX_ARGS];
+        int op = cmd.opcode;
+        int nargs = 0;
+
+        if (op >= SET1 && (op < FNT_NUM_0 || op > FNT_NUM_63)) {
+            nargs = cmd.nargs;
+            for (int i = 0; i < nargs; i++) {
+                args[i] = (int32_t)(uint32_t)cmd.arg[i];
+            }
+        }
+        if (!dvi_pages_add(p, op, args, nargs, cmd.str, cmd.len)) {
+            p->error_at = cmd.offset;
+            return 0;
+        }
+    }
+    if (r->error != NULL) {
+        return pages_error(p, r->error, r->error_at);
+    }
+    return 1;
+} /* dvi_pages_read */
+
+/** Give command i as dvi_read_next would, but with no offset or size:
+ *  its string points into p's arena, and is valid until p next changes.
+ */
+void dvi_pages_get(const DviPages* p, size_t i, DviCommand* cmd) {
+    const int32_t* args = p->args + p->arg[i];
+    int op = p->op[i];
+    int nargs = (int)DVI_PAGES_NARGS(p, i);
+
+    cmd->opcode = op;
+    cmd->offset = DVI_READ_NONE;
+    cmd->size = 0;
+    cmd->str = NULL;
+    cmd->len = 0;
+
+    if (op < SET1) {
+        cmd->nargs = 1;
+        cmd->arg[0] = op;
+        return;
+    }
+    if (op >= FNT_NUM_0 && op <= FNT_NUM_63) {
+        cmd->nargs = 1;
+        cmd->arg[0] = op - FNT_NUM_0;
+        return;
+    }
+
+    if (HAS_STRING(op)) {
+        --nargs;
+        cmd->str = p->bytes + args[nargs];
+        cmd->len = (op == PRE ? (uint32_t)args[4]
+                    : op < FNT_DEF1 ? (uint32_t)args[0]
+                    : (size_t)(uint32_t)args[4] + (uint32_t)args[5]);
+    }
+
+    cmd->nargs = nargs;
+    if (op < XXX1) {
+        /* the arguments of set, put, rules, bop, moves and fnt */
+        /* are signed, or of fewer than 4 bytes */
+        for (int j = 0; j < nargs; j++) {
+            cmd->arg[j] = args[j];
+        }
+    } else {
+        /* those of the others are unsigned, but fnt_def4's k */
+        for (int j = 0; j < nargs; j++) {
+            cmd->arg[j] = (uint32_t)args[j];
+        }
+        if (op == FNT_DEF4) {
+            cmd->arg[0] = args[0];
+        }
+    }
+} /* dvi_pages_get */
+
+/* index of the first command of the given opcode from index from; */
+/* DVI_PAGES_NONE if none */
+size_t dvi_pages_find(const DviPages* p, size_t from, int opcode) {
+    const uint8_t* at;
+
+    if (from >= p->ncmd) {
+        return DVI_PAGES_NONE;
+    }
+    at = (const uint8_t*)memchr(p->op + from, opcode, p->ncmd - from);
+    return (at == NULL ? DVI_PAGES_NONE : (size_t)(at - p->op));
+} /* dvi_pages_find */
+
+/* index after the eop of page number page (from 0); DVI_PAGES_NONE if */
+/* there is no such page, or it has no eop */
+size_t dvi_pages_page_end(const DviPages* p, size_t page) {
+    size_t eop;
+
+    if (page >= p->npage) {
+        return DVI_PAGES_NONE;
+    }
+    eop = dvi_pages_find(p, p->page[page], EOP);
+    return (eop == DVI_PAGES_NONE ? eop : eop + 1);
+} /* dvi_pages_page_end */
+
+/* note for b's postamble the fonts defined after post, at index post */
+static int note_post_fonts(const DviPages* p, size_t post, DviBuilder* b) {
+    for (size_t i = post + 1; i < p->ncmd; i++) {
+        DviBuilder def;
+        DviCommand cmd;
+        int ok;
+
+        if (p->op[i] < FNT_DEF1 || p->op[i] > FNT_DEF4) {
+            continue;
+        }
+        /* encode the definition apart, to give its bytes to b */
+        dvi_pages_get(p, i, &cmd);
+        dvi_build_init(&def, -1);
+        ok = dvi_build_command(&def, &cmd)
+             && dvi_build_note_font(b, (uint32_t)cmd.arg[0], def.buf,
+                                    def.len);
+        if (def.error != NULL && b->error == NULL) {
+            b->error = def.error;
+        }
+        dvi_build_free(&def);
+        if (!ok) {
+            return 0;
+        }
+    }
+    return 1;
+} /* note_post_fonts */
+
+/** Encode commands first to last - 1 into b.  If post is among them,
+ *  the fonts defined after it are kept for b's postamble, and b is
+ *  finished, with post's l[4] and u[4]; the commands after post are
+ *  not otherwise written.
+ *
+ *  @return 1 if OK; 0 (with b->error set) if b failed.
+ */
+int dvi_pages_write(const DviPages* p, size_t first, size_t last,
+                    DviBuilder* b) {
+    DviCommand cmd;
+
+    if (last > p->ncmd) {
+        last = p->ncmd;
+    }
+    for (size_t i = first; i < last; i++) {
+        int op = p->op[i];
+
+        if (op < SET1) {
+            /* most commands are set_char_0 .. set_char_127 */
+            if (!dvi_build_set_char(b, op)) {
+                return 0;
+            }
+            continue;
+        }
+        dvi_pages_get(p, i, &cmd);
+        if (op == POST) {
+            return note_post_fonts(p, i, b)
+                   && dvi_build_finish(b, (uint32_t)cmd.arg[4],
+                                       (uint32_t)cmd.arg[5]);
+        }
+        if (op != POSTPOST && !dvi_build_command(b, &cmd)) {
+            return 0;
+        }
+    }
+    return 1;
+} /* dvi_pages_write */
+
+/* end of "dvipages.c" */
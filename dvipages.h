@@ -0,0 +1,71 @@
+#ifndef INC_DVIPAGES_H
+/* dvipages.h - the commands of whole DVI pages, decoded once, as arrays.
+
+   This file is public domain.
+
+   - A DviPages holds the commands of a DVI file, or of some of its
+     pages, for passes that look at them, or rewrite them, many times
+     over, without decoding the DVI bytes each time.
+   - The commands are not held one struct each, but in parallel arrays:
+     an opcode byte for each command, and the index of its first
+     argument in one pool of 32-bit arguments.  Strings (of specials,
+     font definitions and the preamble) are in one arena of bytes,
+     and a command's last argument is where its string starts.  A
+     pass that looks for some opcodes reads a byte per command.
+   - set_char_n and fnt_num_n have no arguments here: n is in the
+     opcode.  Unsigned arguments are held as their 32 bits.  The 223s
+     after post_post are not held; dvibuild writes them anew.
+   - Commands are read by dviread, and encoded again by dvibuild, each
+     with its own opcode: what a pass does not change is written as it
+     was read, but for bop addresses and the postamble.
+*/
+#define INC_DVIPAGES_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // int32_t, uint8_t, uint32_t
+
+#include "dvibuild.h"
+#include "dviread.h"
+
+/// no such command
+#define DVI_PAGES_NONE ((size_t)-1)
+
+/// number of arguments of command i of DviPages p
+#define DVI_PAGES_NARGS(p, i) ((p)->arg[(i) + 1] - (p)->arg[i])
+
+/* DVI commands, as parallel arrays */
+typedef struct _DviPages {
+    size_t ncmd;       ///< number of commands.
+    size_t maxcmd;     ///< room in op and arg.
+    uint8_t* op;       ///< opcode of each command.
+    uint32_t* arg;     ///< index in args of each one's first argument;
+                       ///< arg[ncmd] is nargs.
+    size_t nargs;      ///< number of arguments.
+    size_t maxargs;    ///< room in args.
+    int32_t* args;     ///< the commands' arguments, one after another.
+    size_t nbytes;     ///< bytes of strings.
+    size_t maxbytes;   ///< room in bytes.
+    char* bytes;       ///< the commands' strings, one after another.
+    size_t npage;      ///< number of pages.
+    size_t maxpage;    ///< room in page.
+    uint32_t* page;    ///< index of each page's bop.
+    size_t post;       ///< index of post, or DVI_PAGES_NONE.
+    const char* error; ///< why the last call failed; NULL if it did not.
+    size_t error_at;   ///< offset of the DVI command in error, if read.
+} DviPages;
+
+void dvi_pages_init(DviPages* p);
+void dvi_pages_free(DviPages* p);
+void dvi_pages_clear(DviPages* p);
+void dvi_pages_truncate(DviPages* p, size_t ncmd);
+
+int dvi_pages_add(DviPages* p, int opcode, const int32_t* args, int nargs,
+                  const char* str, size_t len);
+int dvi_pages_read(DviPages* p, DviReader* r);
+void dvi_pages_get(const DviPages* p, size_t i, DviCommand* cmd);
+size_t dvi_pages_find(const DviPages* p, size_t from, int opcode);
+size_t dvi_pages_page_end(const DviPages* p, size_t page);
+int dvi_pages_write(const DviPages* p, size_t first, size_t last,
+                    DviBuilder* b);
+
+#endif /* INC_DVIPAGES_H */
@@ -0,0 +1,419 @@
+/* dviread.c - DVI commands, read in place from a DVI file in memory.
+
+   This file is public domain.
+
+   Commands are decoded as dv2dt decodes them: each argument is read
+   big-endian, signed or unsigned as dv2dt's tables say, and a string
+   is given by where it lies in the DVI bytes.  Nothing is allocated
+   and nothing is copied, so that reading is bounded by memory.
+
+   A page reader starts at a `bop', and stops after the next `eop'.
+   The last page's `bop' is found from the end of the file:
+   post_post's q[4] gives `post', whose p[4] gives the last `bop';
+   each `bop' gives the one before it in its own p[4].
+*/
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L /* fileno, mmap */
+#endif
+
+#include <string.h> // memcpy, memset
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_MMAP 1
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat
+#endif
+
+#include "dviop.h"
+#include "dviread.h"
+
+/* bytes of bop, post and post_post's fixed part */
+#define RD_BOP_SIZE      45
+#define RD_POST_SIZE     29
+#define RD_POSTPOST_SIZE 6
+
+/* the byte that pads the end of a DVI file */
+#define RD_PAD 223
+
+/* the argument of a command of kind set, put, fnt or move, with opcode
+   op, from DVI_COMMANDS: its number of bytes (the command's suffix),
+   negative if signed; 0 for the other commands */
+static inline int arg_bytes(int op) {
+#define ARG_BYTES(first, last, prefix, suffix, kind)                   \
+    if (op >= (first) && op <= (last)) {                               \
+        int n = (kind == KIND_CHAR || kind == KIND_MOVE                \
+                 ? (suffix) + op - (first) : 0);                       \
+        return (kind == KIND_MOVE || n == 4 ? -n : n);                 \
+    }
+    DVI_COMMANDS(ARG_BYTES)
+#undef ARG_BYTES
+    return 0;
+} /* arg_bytes */
+
+/* n unsigned big-endian bytes at p */
+static inline int64_t get_unsigned(const unsigned char* p, int n) {
+    uint32_t v = 0;
+
+    for (int i = 0; i < n; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+} /* get_unsigned */
+
+/* n signed big-endian bytes at p */
+static inline int64_t get_signed(const unsigned char* p, int n) {
+    int32_t v = (signed char)p[0];
+
+    for (int i = 1; i < n; i++) {
+        v = (int32_t)((uint32_t)v << 8 | p[i]);
+    }
+    return v;
+} /* get_signed */
+
+/* read the dvi bytes from p onwards into cmd's arguments, as bytes
+   gives them (negative if signed); return the bytes read */
+static size_t get_args(DviCommand* cmd, const unsigned char* p,
+                       const signed char* bytes, int nargs) {
+    size_t n = 0;
+
+    for (int i = 0; i < nargs; i++) {
+        int b = bytes[i];
+
+        cmd->arg[i] = (b < 0 ? get_signed(p + n, -b) : get_unsigned(p + n, b));
+        n += (b < 0 ? -b : b);
+    }
+    cmd->nargs = nargs;
+    return n;
+} /* get_args */
+
+/* stop reading r, because of its command at pos */
+static int read_error(DviReader* r, size_t pos, const char* why) {
+    r->error = why;
+    r->error_at = pos;
+    r->end = r->pos;
+    return 0;
+} /* read_error */
+
+/** Read the size bytes at dvi, from the start.
+ *
+ *  @param[out] r
+ *  @param[in]  dvi
+ *  @param[in]  size
+ */
+void dvi_read_init(DviReader* r, const void* dvi, size_t size) {
+    memset(r, 0, sizeof(*r));
+    r->dvi = (const unsigned char*)dvi;
+    r->size = size;
+    r->end = size;
+    r->bop = DVI_READ_NONE;
+    r->error_at = DVI_READ_NONE;
+} /* dvi_read_init */
+
+/** Map the DVI file fp into memory, if it is a nonempty regular file
+ *  that has not been read yet, and read it from the start.
+ *
+ *  @param[out] r
+ *  @param[in]  fp
+ *  @return 1 if mapped, 0 if fp must be read some other way.
+ */
+int dvi_read_map(DviReader* r, FILE* fp) {
+    dvi_read_init(r, NULL, 0);
+
+#ifdef HAVE_MMAP
+    {
+        struct stat st;
+        int fd = fileno(fp);
+        void* p;
+
+        if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)
+            || st.st_size <= 0 || ftell(fp) != 0) {
+            return 0;
+        }
+
+        p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            return 0;
+        }
+        dvi_read_init(r, p, (size_t)st.st_size);
+        r->mapped = 1;
+        return 1;
+    }
+#else
+    (void)fp;
+    return 0;
+#endif
+} /* dvi_read_map */
+
+/* unmap what dvi_read_map mapped; page readers of r are then invalid */
+void dvi_read_unmap(DviReader* r) {
+#ifdef HAVE_MMAP
+    if (r->mapped) {
+        munmap((void*)r->dvi, r->size);
+    }
+#endif
+    dvi_read_init(r, NULL, 0);
+} /* dvi_read_unmap */
+
+/* bytes of the command with opcode op (not set_char_n), but for its
+   string or padding */
+static size_t fixed_size(int op) {
+    int b;
+
+    if ((op >= FNT_NUM_0 && op < FONT1) || op > POSTPOST) {
+        return 1;
+    } else if (op == SET_RULE || op == PUT_RULE) {
+        return 1 + 8;
+    } else if (op == BOP) {
+        return RD_BOP_SIZE;
+    } else if (op <= Z4) {
+        b = arg_bytes(op);
+        return 1 + (b < 0 ? -b : b);
+    } else if (op < XXX1) {
+        return 1 + (op - FONT1 + 1);
+    } else if (op < FNT_DEF1) {
+        return 1 + (op - XXX1 + 1);
+    } else if (op < PRE) {
+        return 1 + (op - FNT_DEF1 + 1) + 14;
+    } else if (op == PRE) {
+        return 1 + 14;
+    } else if (op == POST) {
+        return RD_POST_SIZE;
+    } else {
+        return RD_POSTPOST_SIZE;
+    }
+} /* fixed_size */
+
+/** Read the next command.
+ *
+ *  @param[inout] r
+ *  @param[out]   cmd
+ *  @return 1 if a command was read; 0 at the end, or (with r->error
+ *          set) at a command that is truncated or malformed.
+ */
+int dvi_read_next(DviReader* r, DviCommand* cmd) {
+    static const signed char fnt_def[6] = {0, 4, 4, 4, 1, 1};
+    static const signed char pre[5] = {1, 4, 4, 4, 1};
+    static const signed char post[8] = {4, 4, 4, 4, 4, 4, 2, 2};
+    static const signed char post_post[2] = {4, 1};
+    static const signed char four[11] = {-4, -4, -4, -4, -4, -4,
+                                         -4, -4, -4, -4, -4};
+    const unsigned char* p;
+    size_t avail, need;
+    int op;
+
+    if (r->pos >= r->end) {
+        return 0;
+    }
+
+    p = r->dvi + r->pos;
+    op = p[0];
+    cmd->opcode = op;
+    cmd->offset = r->pos;
+    cmd->str = NULL;
+    cmd->len = 0;
+
+    /* most commands are set_char_0 .. set_char_127 */
+    if (op < SET1) {
+        cmd->size = 1;
+        cmd->nargs = 1;
+        cmd->arg[0] = op;
+        ++r->pos;
+        return 1;
+    }
+
+    avail = r->end - r->pos;
+    need = fixed_size(op);
+    if (need > avail) {
+        return read_error(r, r->pos, "command is cut short");
+    }
+
+    if (op == SET_RULE || op == PUT_RULE) {
+        get_args(cmd, p + 1, four, 2);
+    } else if (op == BOP) {
+        get_args(cmd, p + 1, four, 11);
+    } else if (op <= Z4) {
+        signed char b = (signed char)arg_bytes(op);
+
+        get_args(cmd, p + 1, &b, need > 1);
+    } else if (op < FONT1) {
+        /* fnt_num_0 .. fnt_num_63 */
+        cmd->nargs = 1;
+        cmd->arg[0] = op - FNT_NUM_0;
+    } else if (op < XXX1) {
+        /* fnt1 .. fnt4; fnt4 is signed */
+        signed char b = (signed char)arg_bytes(op);
+
+        get_args(cmd, p + 1, &b, 1);
+    } else if (op < FNT_DEF1) {
+        /* xxx1 .. xxx4: k[n], x[k] */
+        signed char b = (signed char)(need - 1);
+
+        get_args(cmd, p + 1, &b, 1);
+        cmd->len = (size_t)cmd->arg[0];
+    } else if (op < PRE) {
+        /* fnt_def1 .. fnt_def4: k[n], c[4], s[4], d[4], a[1], l[1], n[a+l] */
+        signed char b[6];
+
+        memcpy(b, fnt_def, sizeof(b));
+        b[0] = (signed char)(op == FNT_DEF1 + 3 ? -4 : op - FNT_DEF1 + 1);
+        get_args(cmd, p + 1, b, 6);
+        cmd->len = (size_t)(cmd->arg[4] + cmd->arg[5]);
+    } else if (op == PRE) {
+        get_args(cmd, p + 1, pre, 5);
+        cmd->len = (size_t)cmd->arg[4];
+    } else if (op == POST) {
+        get_args(cmd, p + 1, post, 8);
+    } else if (op == POSTPOST) {
+        /* q[4], i[1], then four or more 223s, to the end of the file */
+        get_args(cmd, p + 1, post_post, 2);
+        while (need < avail && p[need] == RD_PAD) {
+            ++need;
+        }
+        if (need < RD_POSTPOST_SIZE + 4) {
+            return read_error(r, r->pos, "fewer than four 223s after post_post");
+        }
+        if (need < avail) {
+            return read_error(r, r->pos, "post_post doesn't end with a 223");
+        }
+    } else {
+        /* undefined opcodes 250 .. 255, which dv2dt keeps as they are */
+        cmd->nargs = 0;
+    }
+
+    /* the string of special, fnt_def or pre follows its fixed part */
+    if (cmd->len > 0) {
+        if (cmd->len > avail - need) {
+            return read_error(r, r->pos, "string is cut short");
+        }
+        cmd->str = (const char*)p + need;
+        need += cmd->len;
+    }
+
+    cmd->size = need;
+    r->pos += need;
+    if (op == EOP && r->bop != DVI_READ_NONE) {
+        r->end = r->pos;
+    }
+    return 1;
+} /* dvi_read_next */
+
+/* set page to read nothing, because why (if not NULL) at offset at */
+static int no_page(const DviReader* r, DviReader* page, const char* why,
+                   size_t at) {
+    *page = *r;
+    page->mapped = 0;
+    page->bop = DVI_READ_NONE;
+    page->pos = page->end = 0;
+    page->error = why;
+    page->error_at = (why != NULL ? at : DVI_READ_NONE);
+    return 0;
+} /* no_page */
+
+/* set page to read r's page whose bop is at offset bop, which the command
+   at offset from gave, and which must be before it */
+static int page_at(const DviReader* r, DviReader* page, size_t bop,
+                   size_t from) {
+    if (bop >= from || bop + RD_BOP_SIZE > r->size || r->dvi[bop] != BOP) {
+        return no_page(r, page, "bop address is not that of a bop", from);
+    }
+    *page = *r;
+    page->mapped = 0;
+    page->bop = bop;
+    page->pos = bop;
+    page->end = r->size;
+    page->error = NULL;
+    page->error_at = DVI_READ_NONE;
+    return 1;
+} /* page_at */
+
+/* offset of the post of the DVI file that r reads, from its post_post;
+   DVI_READ_NONE (with page set to read nothing, and why) if it is bad */
+static size_t find_post(const DviReader* r, DviReader* page) {
+    size_t pp = r->size;
+    size_t q;
+
+    while (pp > 0 && r->dvi[pp - 1] == RD_PAD) {
+        --pp;
+    }
+    if (r->size - pp < 4 || pp < RD_POSTPOST_SIZE
+        || r->dvi[pp - RD_POSTPOST_SIZE] != POSTPOST) {
+        no_page(r, page, "no post_post at the end of the file", r->size);
+        return DVI_READ_NONE;
+    }
+    pp -= RD_POSTPOST_SIZE;
+
+    q = (size_t)get_unsigned(r->dvi + pp + 1, 4);
+    if (q >= pp || q + RD_POST_SIZE > r->size || r->dvi[q] != POST) {
+        no_page(r, page, "post address is not that of a post", pp);
+        return DVI_READ_NONE;
+    }
+    return q;
+} /* find_post */
+
+/** Find the postamble of the DVI file that r reads, from its post_post.
+ *
+ *  @param[in]  r
+ *  @param[out] post  reader of the postamble: post, the font definitions,
+ *                    and post_post.
+ *  @return 1 if found; 0 (with post->error set) if it is not.
+ */
+int dvi_read_postamble(const DviReader* r, DviReader* post) {
+    size_t q = find_post(r, post);
+
+    if (q == DVI_READ_NONE) {
+        return 0;
+    }
+    *post = *r;
+    post->mapped = 0;
+    post->bop = DVI_READ_NONE;
+    post->pos = q;
+    post->end = r->size;
+    post->error = NULL;
+    post->error_at = DVI_READ_NONE;
+    return 1;
+} /* dvi_read_postamble */
+
+/** Find the last page of the DVI file that r reads, from its postamble.
+ *
+ *  @param[in]  r
+ *  @param[out] page  reader of the last page.
+ *  @return 1 if found; 0 if there are no pages, or (with page->error set)
+ *          if the postamble or its bop address is bad.
+ */
+int dvi_read_last_page(const DviReader* r, DviReader* page) {
+    size_t q = find_post(r, page);
+    int64_t p;
+
+    if (q == DVI_READ_NONE) {
+        return 0;
+    }
+    p = get_signed(r->dvi + q + 1, 4);
+    if (p == -1) {
+        return no_page(r, page, NULL, 0);
+    }
+    return page_at(r, page, p < 0 ? r->size : (size_t)p, q);
+} /* dvi_read_last_page */
+
+/** Find the page before that of page reader r, from its bop address.
+ *
+ *  @param[in]  r
+ *  @param[out] page  reader of the page before; may be r.
+ *  @return 1 if found; 0 if r's page is the first, or (with page->error
+ *          set) if its bop address is bad.
+ */
+int dvi_read_prev_page(const DviReader* r, DviReader* page) {
+    size_t bop = r->bop;
+    int64_t p;
+
+    if (bop == DVI_READ_NONE) {
+        return no_page(r, page, NULL, 0);
+    }
+
+    p = get_signed(r->dvi + bop + RD_BOP_SIZE - 4, 4);
+    if (p == -1) {
+        return no_page(r, page, NULL, 0);
+    }
+    return page_at(r, page, p < 0 ? r->size : (size_t)p, bop);
+} /* dvi_read_prev_page */
+
+/* end of "dviread.c" */
@@ -0,0 +1,63 @@
+#ifndef INC_DVIREAD_H
+/* dviread.h - DVI commands, read in place from a DVI file in memory.
+
+   This file is public domain.
+
+   - A DviReader walks DVI bytes that are mapped (or otherwise held)
+     in memory, and yields one DviCommand at a time, as dv2dt decodes
+     it: opcode, arguments, and byte offset.
+   - Strings (of special, fnt_def and pre) are not copied: a command
+     points into the DVI bytes, which must outlive it.
+   - Reading allocates nothing; a bad or truncated command ends the
+     reading with an error, and nothing is written anywhere.
+   - A page reader covers one page, from its `bop' to its `eop'.
+     Page readers are found from the `post' command, through the
+     chain of `bop' addresses, without reading the pages between;
+     and a reader of the postamble, from `post_post'.
+*/
+#define INC_DVIREAD_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // int64_t
+#include <stdio.h>  // FILE
+
+/// most arguments of a DVI command: bop's c0 .. c9 and p
+#define DVI_READ_MAX_ARGS 11
+
+/// no such byte offset
+#define DVI_READ_NONE ((size_t)-1)
+
+/* one DVI command */
+typedef struct _DviCommand {
+    int opcode;     ///< 0 .. 255.
+    size_t offset;  ///< byte offset of the opcode.
+    size_t size;    ///< bytes in the command, opcode and all.
+    int nargs;      ///< number of arguments in arg.
+    int64_t arg[DVI_READ_MAX_ARGS]; ///< arguments, as dv2dt writes them.
+    const char* str; ///< string of special, fnt_def (area, then name) or pre.
+    size_t len;      ///< its length; 0 if none.
+} DviCommand;
+
+/* where reading is, in DVI bytes held in memory */
+typedef struct _DviReader {
+    const unsigned char* dvi; ///< the whole DVI file.
+    size_t size;   ///< its number of bytes.
+    size_t pos;    ///< offset of the next command.
+    size_t end;    ///< reading stops here.
+    size_t bop;    ///< a page reader's `bop', or DVI_READ_NONE.
+    int mapped;    ///< dvi was mapped by dvi_read_map.
+    const char* error; ///< why reading stopped early; NULL if it did not.
+    size_t error_at;   ///< offset of the command in error.
+} DviReader;
+
+void dvi_read_init(DviReader* r, const void* dvi, size_t size);
+int dvi_read_map(DviReader* r, FILE* fp);
+void dvi_read_unmap(DviReader* r);
+
+int dvi_read_next(DviReader* r, DviCommand* cmd);
+
+int dvi_read_postamble(const DviReader* r, DviReader* post);
+int dvi_read_last_page(const DviReader* r, DviReader* page);
+int dvi_read_prev_page(const DviReader* r, DviReader* page);
+
+#endif /* INC_DVIREAD_H */
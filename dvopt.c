@@ -0,0 +1,656 @@
+/* dvopt - make a DVI file smaller, without changing what it typesets.
+
+   This file is public domain.
+
+   - Usage:  dvopt [-f] [-v] [input-DVI-file [output-DVI-file]]
+     (stdin and stdout, if the file names are omitted).
+   - -f first renumbers the fonts by dvifonts, the most used from 0, so
+     that most font changes take one byte, and drops the definitions
+     of fonts never selected.
+   - Each page is decoded once, into dvipages' arrays, and rewritten in
+     two passes:
+     + the first follows the input's h, v, w, x, y, z and font: each run
+       of movements with nothing typeset between them becomes one right
+       and one down; movements of zero, and those just before pop or
+       eop, are dropped; fnt is kept only before a character that needs
+       another font; push ... pop groups that typeset nothing are dropped;
+     + the second gives the movements to the w and x (or y and z)
+       registers, saved by push and restored by pop as DVI says, so that
+       an amount that recurs is moved by w0, x0, y0 or z0.  An amount
+       not in a register is loaded into the one whose amount is needed
+       again last, if that is after this amount is; otherwise it is
+       moved by right or down, keeping both registers.
+   - Every command is written with the fewest argument bytes.
+   - dvopt knows no character widths, so movements are not merged
+     across a character, a rule or a special.  The postamble is written
+     anew, as dt2dv -post writes it.
+*/
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L /* fileno */
+#endif
+
+#include <stdlib.h> // EXIT_SUCCESS, EXIT_FAILURE, malloc, realloc
+#include <string.h> // memset, strcmp
+
+#include "dtl.h"
+#include "dvibuild.h"
+#include "dvifonts.h"
+#include "dvipages.h"
+#include "dviread.h"
+#include "dvtool.h"
+
+
+/* a page's movements, after the first pass: right or down, by arg */
+#define MOVE_H RIGHT4
+#define MOVE_V DOWN4
+
+/* the input's movement registers */
+typedef struct {
+    int32_t w, x, y, z;
+} InRegs;
+
+/* a push ... pop group of the input, in the first pass */
+typedef struct {
+    InRegs regs;    /* registers at push */
+    size_t at;      /* page commands before the movements flushed at push */
+    int64_t dh, dv; /* movements that were pending at push */
+    int visible;    /* had the enclosing group typeset anything? */
+} Group;
+
+/* the two output registers of one direction: w and x, or y and z */
+typedef struct {
+    int32_t val[2]; /* their amounts */
+    size_t last[2]; /* page index of the movement that last used each */
+} Regs;
+
+/* the output's registers, saved by push */
+typedef struct {
+    Regs h, v;
+} OutRegs;
+
+/* an amount's last movement, while finding next uses */
+typedef struct {
+    uint64_t key;   /* opcode and amount; 0 if the entry is empty */
+    size_t at;
+} Use;
+
+static DviPages in;     /* the input file */
+static DviPages page;   /* a page, after the first pass */
+static DviBuilder out;  /* the output file */
+
+static Group* groups = NULL;  /* the first pass's push stack */
+static OutRegs* saved = NULL; /* the second pass's push stack */
+static size_t max_groups = 0;
+
+static size_t* next_use = NULL; /* next movement of equal amount */
+static size_t max_next = 0;
+static Use* uses = NULL;        /* hash of amounts, for next_use */
+static size_t nuses = 0;
+
+/* commands of each opcode, read and written, for -v */
+static size_t count_in[NCMDS];
+static size_t count_out[NCMDS];
+
+/* room for depth + 1 groups on both push stacks */
+static void reserve_groups(size_t depth) {
+    if (depth < max_groups) {
+        return;
+    }
+    max_groups = (max_groups == 0 ? 64 : 2 * max_groups);
+    groups = (Group*)realloc(groups, max_groups * sizeof(Group));
+    saved = (OutRegs*)realloc(saved, max_groups * sizeof(OutRegs));
+    if (groups == NULL || saved == NULL) {
+        no_memory("push groups");
+    }
+} /* reserve_groups */
+
+/* append command cmd, of opcode op, to page */
+static void add(int op, const DviCommand* cmd) {
+    int32_t args[DVI_READ_MAX_ARGS];
+    int nargs = 0;
+
+    if (op >= SET1 && (op < FNT_NUM_0 || op > FNT_NUM_63)) {
+        nargs = cmd->nargs;
+        for (int i = 0; i < nargs; i++) {
+            args[i] = (int32_t)(uint32_t)cmd->arg[i];
+        }
+    }
+    if (!dvi_pages_add(&page, op, args, nargs, cmd->str, cmd->len)) {
+        no_memory(page.error);
+    }
+} /* add */
+
+/* append a movement, op, by *d (then zero), to page */
+static void add_move(int op, int64_t* d) {
+    while (*d != 0) {
+        int32_t arg = (int32_t)(*d > INT32_MAX ? INT32_MAX
+                                : *d < INT32_MIN ? INT32_MIN : *d);
+
+        if (!dvi_pages_add(&page, op, &arg, 1, NULL, 0)) {
+            no_memory(page.error);
+        }
+        *d -= arg;
+    }
+} /* add_move */
+
+/* stop: the input's command at index i is wrong, because of why */
+static void bad_command(size_t i, const char* why) {
+    DviCommand cmd;
+
+    dvi_pages_get(&in, i, &cmd);
+    ERROR_SATRT;
+    fprintf(msg_fp, "%s: %s.\n", dvi_op[cmd.opcode].name, why);
+    dexit(EXIT_FAILURE);
+} /* bad_command */
+
+/** First pass: the input's page, commands first to last - 1, into page,
+ *  with its movements as MOVE_H and MOVE_V, merged, and the fonts,
+ *  and groups, that it needs.
+ */
+static void follow_page(size_t first, size_t last) {
+    InRegs r = {0, 0, 0, 0};
+    int64_t dh = 0, dv = 0;  /* movements pending */
+    int32_t font = 0, font_out = 0;
+    int have_font = 0, have_font_out = 0;
+    int visible = 0;         /* has the current group typeset anything? */
+    size_t depth = 0;
+    DviCommand cmd;
+
+    dvi_pages_clear(&page);
+    for (size_t i = first; i < last; i++) {
+        int op = in.op[i];
+
+        ++count_in[op];
+        dvi_pages_get(&in, i, &cmd);
+
+        if (op <= PUT_RULE) {
+            /* set_char, set, set_rule, put, put_rule */
+            add_move(MOVE_H, &dh);
+            add_move(MOVE_V, &dv);
+            if (op != SET_RULE && op != PUT_RULE && have_font
+                && (!have_font_out || font_out != font)) {
+                int32_t k = font;
+
+                if (!dvi_pages_add(&page, FONT4, &k, 1, NULL, 0)) {
+                    no_memory(page.error);
+                }
+                font_out = font;
+                have_font_out = 1;
+            }
+            add(op, &cmd);
+            visible = 1;
+            continue;
+        }
+
+        switch (op) {
+            case NOP:
+                break;
+            case BOP:
+                add(op, &cmd);
+                break;
+            case EOP:
+                if (depth != 0) {
+                    bad_command(i, "push without pop, in the page");
+                }
+                add(op, &cmd);
+                break;
+            case PUSH:
+                reserve_groups(depth);
+                groups[depth].regs = r;
+                groups[depth].at = page.ncmd;
+                groups[depth].dh = dh;
+                groups[depth].dv = dv;
+                groups[depth].visible = visible;
+                ++depth;
+                add_move(MOVE_H, &dh);
+                add_move(MOVE_V, &dv);
+                add(op, &cmd);
+                visible = 0;
+                break;
+            case POP:
+                if (depth == 0) {
+                    bad_command(i, "pop without push");
+                }
+                --depth;
+                r = groups[depth].regs;
+                if (visible) {
+                    /* movements before pop are undone by it */
+                    dh = dv = 0;
+                    add(op, &cmd);
+                } else {
+                    /* drop the group, and what it moved */
+                    dvi_pages_truncate(&page, groups[depth].at);
+                    dh = groups[depth].dh;
+                    dv = groups[depth].dv;
+                    visible = groups[depth].visible;
+                }
+                break;
+            case RIGHT1: case RIGHT2: case RIGHT3: case RIGHT4:
+                dh += cmd.arg[0];
+                break;
+            case W0:
+                dh += r.w;
+                break;
+            case W1: case W2: case W3: case W4:
+                r.w = (int32_t)cmd.arg[0];
+                dh += r.w;
+                break;
+            case X0:
+                dh += r.x;
+                break;
+            case X1: case X2: case X3: case X4:
+                r.x = (int32_t)cmd.arg[0];
+                dh += r.x;
+                break;
+            case DOWN1: case DOWN2: case DOWN3: case DOWN4:
+                dv += cmd.arg[0];
+                break;
+            case Y0:
+                dv += r.y;
+                break;
+            case Y1: case Y2: case Y3: case Y4:
+                r.y = (int32_t)cmd.arg[0];
+                dv += r.y;
+                break;
+            case Z0:
+                dv += r.z;
+                break;
+            case Z1: case Z2: case Z3: case Z4:
+                r.z = (int32_t)cmd.arg[0];
+                dv += r.z;
+                break;
+            case FONT1: case FONT2: case FONT3: case FONT4:
+                font = (int32_t)cmd.arg[0];
+                have_font = 1;
+                break;
+            case FNT_DEF1: case FNT_DEF2: case FNT_DEF3: case FNT_DEF4:
+                /* kept where it is, for the fnt that needs it */
+                add(op, &cmd);
+                visible = 1;
+                break;
+            case PRE:
+            case POST:
+            case POSTPOST:
+                bad_command(i, "not allowed in a page");
+                break;
+            default:
+                if (op >= FNT_NUM_0 && op <= FNT_NUM_63) {
+                    font = op - FNT_NUM_0;
+                    have_font = 1;
+                    break;
+                }
+                /* specials, and the undefined opcodes, where they are */
+                add_move(MOVE_H, &dh);
+                add_move(MOVE_V, &dv);
+                add(op, &cmd);
+                visible = 1;
+                break;
+        }
+    }
+} /* follow_page */
+
+/* hash of a movement's opcode and amount */
+static size_t hash_use(uint64_t key) {
+    key *= 0x9E3779B97F4A7C15u;
+    return (size_t)(key >> 32) & (nuses - 1);
+} /* hash_use */
+
+/* set next_use[] for page's movements: the next of equal amount */
+static void find_next_uses(void) {
+    size_t nmoves = 0;
+
+    if (page.ncmd > max_next) {
+        max_next = page.ncmd;
+        next_use = (size_t*)realloc(next_use, max_next * sizeof(size_t));
+        if (next_use == NULL) {
+            no_memory("movements");
+        }
+    }
+    for (size_t i = 0; i < page.ncmd; i++) {
+        nmoves += (page.op[i] == MOVE_H || page.op[i] == MOVE_V);
+    }
+    if (2 * nmoves > nuses) {
+        while (2 * nmoves > nuses) {
+            nuses = (nuses == 0 ? 1024 : 2 * nuses);
+        }
+        free(uses);
+        uses = (Use*)malloc(nuses * sizeof(Use));
+        if (uses == NULL) {
+            no_memory("movements");
+        }
+    }
+    memset(uses, 0, nuses * sizeof(Use));
+
+    for (size_t i = page.ncmd; i-- > 0;) {
+        int op = page.op[i];
+        uint64_t key;
+        size_t h;
+
+        next_use[i] = DVI_PAGES_NONE;
+        if (op != MOVE_H && op != MOVE_V) {
+            continue;
+        }
+        key = (uint64_t)op << 32 | (uint32_t)page.args[page.arg[i]];
+        for (h = hash_use(key); uses[h].key != 0 && uses[h].key != key;
+             h = (h + 1) & (nuses - 1)) {
+        }
+        if (uses[h].key == key) {
+            next_use[i] = uses[h].at;
+        }
+        uses[h].key = key;
+        uses[h].at = i;
+    }
+} /* find_next_uses */
+
+/* write cmd, with opcode op */
+static void emit(int op, DviCommand* cmd) {
+    cmd->opcode = op;
+    ++count_out[op];
+    if (!dvi_build_command(&out, cmd)) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "%s: %s.\n", dvi_op[op].name, out.error);
+        dexit(EXIT_FAILURE);
+    }
+} /* emit */
+
+/* write cmd, of opcode op, with the fewest bytes for its argument */
+static void emit_fewest(int op, DviCommand* cmd) {
+    int32_t a = (int32_t)cmd->arg[0];
+    /* bytes for a, as the argument of set, put, fnt or fnt_def */
+    int n = (a < 0 ? 4 : dvi_build_unsigned_width((uint32_t)a));
+
+    switch (op) {
+        case SET1: case SET2: case SET3: case SET4:
+            if (a >= 0 && a < SET1) {
+                emit(a, cmd);
+            } else {
+                emit(SET1 + n - 1, cmd);
+            }
+            break;
+        case PUT1: case PUT2: case PUT3: case PUT4:
+            emit(PUT1 + n - 1, cmd);
+            break;
+        case FONT4:
+            /* from the first pass: fnt_num, or the fewest bytes */
+            if (a >= 0 && a <= FNT_NUM_63 - FNT_NUM_0) {
+                emit(FNT_NUM_0 + a, cmd);
+            } else {
+                emit(FONT1 + n - 1, cmd);
+            }
+            break;
+        case XXX1: case XXX2: case XXX3: case XXX4:
+            emit(XXX1 + dvi_build_unsigned_width((uint32_t)cmd->len) - 1, cmd);
+            break;
+        case FNT_DEF1: case FNT_DEF2: case FNT_DEF3: case FNT_DEF4:
+            emit(FNT_DEF1 + n - 1, cmd);
+            break;
+        default:
+            emit(op, cmd);
+            break;
+    }
+} /* emit_fewest */
+
+/* the next use, from page index now on, of the register last used at */
+static size_t reg_next_use(size_t at, size_t now) {
+    if (at == DVI_PAGES_NONE) {
+        return DVI_PAGES_NONE;
+    }
+    do {
+        at = next_use[at];
+    } while (at != DVI_PAGES_NONE && at < now);
+    return at;
+} /* reg_next_use */
+
+/** Write the movement at page index i, by d, with registers r: reg0
+ *  and reg1 are the opcodes of their 0-byte forms (w0 and x0, or y0
+ *  and z0), and plain that of the 1-byte movement without them.
+ */
+static void emit_move(size_t i, int32_t d, Regs* r, int reg0, int reg1,
+                      int plain, DviCommand* cmd) {
+    int n = dvi_build_signed_width(d);
+    int k;
+
+    cmd->nargs = 1;
+    cmd->arg[0] = d;
+    cmd->str = NULL;
+    cmd->len = 0;
+
+    if (r->val[0] == d || r->val[1] == d) {
+        k = (r->val[0] == d ? 0 : 1);
+        r->last[k] = i;
+        cmd->nargs = 0;
+        emit(k == 0 ? reg0 : reg1, cmd);
+        return;
+    }
+
+    if (next_use[i] != DVI_PAGES_NONE) {
+        size_t use0 = reg_next_use(r->last[0], i);
+        size_t use1 = reg_next_use(r->last[1], i);
+
+        /* the register needed again last; DVI_PAGES_NONE is never */
+        k = (use0 == DVI_PAGES_NONE || (use1 != DVI_PAGES_NONE && use0 > use1)
+                 ? 0 : 1);
+        if ((k == 0 ? use0 : use1) >= next_use[i]) {
+            r->val[k] = d;
+            r->last[k] = i;
+            emit((k == 0 ? reg0 : reg1) + n, cmd);
+            return;
+        }
+    }
+    emit(plain + n - 1, cmd);
+} /* emit_move */
+
+/** Second pass: write page, with its movements given to registers, and
+ *  every command in its fewest bytes.
+ */
+static void write_page(void) {
+    OutRegs r;
+    size_t depth = 0;
+    DviCommand cmd;
+
+    find_next_uses();
+    for (size_t i = 0; i < page.ncmd; i++) {
+        int op = page.op[i];
+
+        dvi_pages_get(&page, i, &cmd);
+        switch (op) {
+            case MOVE_H:
+                emit_move(i, (int32_t)cmd.arg[0], &r.h, W0, X0, RIGHT1, &cmd);
+                break;
+            case MOVE_V:
+                emit_move(i, (int32_t)cmd.arg[0], &r.v, Y0, Z0, DOWN1, &cmd);
+                break;
+            case BOP:
+                memset(&r, 0, sizeof(r));
+                r.h.last[0] = r.h.last[1] = DVI_PAGES_NONE;
+                r.v.last[0] = r.v.last[1] = DVI_PAGES_NONE;
+                emit(op, &cmd);
+                break;
+            case PUSH:
+                reserve_groups(depth);
+                saved[depth++] = r;
+                emit(op, &cmd);
+                break;
+            case POP:
+                r = saved[--depth];
+                emit(op, &cmd);
+                break;
+            default:
+                emit_fewest(op, &cmd);
+                break;
+        }
+    }
+} /* write_page */
+
+/* unmap, or free, the DVI bytes that r reads */
+static void release_input(DviReader* r) {
+    if (r->mapped) {
+        dvi_read_unmap(r);
+    } else {
+        free((void*)r->dvi);
+        dvi_read_init(r, NULL, 0);
+    }
+} /* release_input */
+
+/* -f: renumber r's fonts into memory, and read that instead */
+static void renumber_fonts(DviReader* r, int verbose) {
+    DviFonts fonts;
+    DviBuilder b;
+    unsigned char* buf;
+    size_t len;
+
+    dvi_fonts_init(&fonts);
+    dvi_build_init(&b, -1);
+    if (!dvi_fonts_count(&fonts, r->dvi, r->size)
+        || !dvi_fonts_renumber(&fonts, r->dvi, r->size, &b)) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "bad DVI file, at byte %zu: %s.\n", fonts.error_at,
+                fonts.error);
+        dexit(EXIT_FAILURE);
+    }
+    buf = dvi_build_take(&b, &len);
+    if (verbose) {
+        size_t n = 0;
+
+        for (size_t i = 0; i < fonts.nfont; i++) {
+            n += (fonts.font[i].uses > 0);
+        }
+        INFO_SATRT;
+        fprintf(msg_fp, "%zu fonts selected %zu times, renumbered; "
+                "%zu definitions dropped.\n", n, fonts.nselect,
+                fonts.ndropped);
+    }
+    dvi_build_free(&b);
+    dvi_fonts_free(&fonts);
+
+    release_input(r);
+    dvi_read_init(r, buf, len);
+} /* renumber_fonts */
+
+/* -v: bytes, and the commands whose numbers changed */
+static void report(size_t size) {
+    INFO_SATRT;
+    fprintf(msg_fp, "%zu DVI bytes in, %zu out", size, out.written);
+    if (size > 0) {
+        fprintf(msg_fp, " (%.1f%% fewer)",
+                100.0 * ((double)size - (double)out.written) / size);
+    }
+    fprintf(msg_fp, ".\n");
+    for (int op = SET1; op < NCMDS; op++) {
+        if (count_in[op] != count_out[op]) {
+            fprintf(msg_fp, "  %-10s %10zu -> %zu\n", dvi_op[op].name,
+                    count_in[op], count_out[op]);
+        }
+    }
+} /* report */
+
+int main(int argc, char* argv[]) {
+    FILE* dvi = stdin;
+    FILE* dvo = stdout;
+    DviReader r;
+    size_t size;
+    int renumber = 0;
+    int verbose = 0;
+    int arg = 1;
+
+    program_name = argv[0];
+    msg_fp = stderr;
+    init_dvi_ops();
+
+    for (; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-f") == 0) {
+            renumber = 1;
+        } else if (strcmp(argv[arg], "-v") == 0) {
+            verbose = 1;
+        } else {
+            break;
+        }
+    }
+    if (argc - arg > 2 || (arg < argc && argv[arg][0] == '-'
+                           && argv[arg][1] != '\0')) {
+        fprintf(msg_fp,
+                "usage: %s [-f] [-v] [input-DVI-file [output-DVI-file]]\n",
+                program_name);
+        dexit(EXIT_FAILURE);
+    }
+    if (arg < argc && (dvi = fopen(argv[arg], "rb")) == NULL) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "Cannot open \"%s\" for binary reading.\n", argv[arg]);
+        dexit(EXIT_FAILURE);
+    }
+    if (arg + 1 < argc && (dvo = fopen(argv[arg + 1], "wb")) == NULL) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "Cannot open \"%s\" for binary writing.\n",
+                argv[arg + 1]);
+        dexit(EXIT_FAILURE);
+    }
+
+    read_input(dvi, &r);
+    size = r.size;
+    if (renumber) {
+        renumber_fonts(&r, verbose);
+    }
+    dvi_pages_init(&in);
+    dvi_pages_init(&page);
+    if (!dvi_pages_read(&in, &r)) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "bad DVI file, at byte %zu: %s.\n", in.error_at,
+                in.error);
+        dexit(EXIT_FAILURE);
+    }
+    release_input(&r);  /* in holds what is needed of it */
+    if (in.post == DVI_PAGES_NONE) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "DVI file has no postamble.\n");
+        dexit(EXIT_FAILURE);
+    }
+
+    fflush(dvo);
+    dvi_build_init(&out, fileno(dvo));
+    for (size_t i = 0; i < in.post;) {
+        int op = in.op[i];
+
+        if (op == BOP) {
+            size_t end = dvi_pages_find(&in, i, EOP);
+
+            if (end == DVI_PAGES_NONE || end > in.post) {
+                bad_command(i, "page without eop");
+            }
+            follow_page(i, end + 1);
+            write_page();
+            i = end + 1;
+        } else {
+            DviCommand cmd;
+
+            /* between pages: pre, fnt_def and nop */
+            ++count_in[op];
+            if (op != NOP) {
+                dvi_pages_get(&in, i, &cmd);
+                emit_fewest(op, &cmd);
+            }
+            ++i;
+        }
+    }
+    ++count_in[POST];
+    ++count_out[POST];
+    if (!dvi_pages_write(&in, in.post, in.ncmd, &out)) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "cannot write the DVI file: %s.\n", out.error);
+        dexit(EXIT_FAILURE);
+    }
+
+    if (verbose) {
+        report(size);
+    }
+    dvi_build_free(&out);
+    dvi_pages_free(&page);
+    dvi_pages_free(&in);
+    if (fclose(dvo) != 0) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "cannot close the DVI file.\n");
+        dexit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+} /* main */
+
+/* end of "dvopt.c" */
@@ -0,0 +1,241 @@
+/* dvorder - the pages of a DVI file, in another order.
+
+   This file is public domain.
+
+   - Usage:  dvorder [-v] input-DVI-file order output-DVI-file
+     where order is one of
+       reverse   the last page first;
+       odd       pages 1, 3, 5 ...;
+       even      pages 2, 4, 6 ...;
+       booklet   the pages for a booklet, folded from sheets printed
+                 two pages a side: n, 1, 2, n-1, n-2, 3, 4, n-3 ...,
+                 with blank pages at the end, to make n a multiple
+                 of 4;
+     or a list of pages, separated by commas, each n (page n), m-n
+     (pages m to n, backwards if m is greater), m- (page m to the last)
+     or -n (the first page to page n).  Pages are counted from 1, in
+     the order of the file, whatever their \count0 .. \count9.
+   - The pages are copied by dvicopy: found through the chain of bop
+     addresses, and copied as they are, but for the bop, with the
+     address of the page before it in the output, and definitions of
+     fonts that the output has.  Before a page, the output is given the
+     definitions, from the input's postamble, of the fonts that the
+     page selects and the output has not defined: so each page is
+     whole, whichever pages come before it.
+   - A blank page has only a bop, with \count0 .. \count9 zero, and an
+     eop.
+*/
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L /* fileno */
+#endif
+
+#include <stdlib.h> // EXIT_SUCCESS, EXIT_FAILURE, realloc, strtoul
+#include <string.h> // strchr, strcmp, strlen
+
+#include "dtl.h"
+#include "dvicopy.h"
+#include "dviread.h"
+#include "dvtool.h"
+
+/* in the order, a blank page */
+#define BLANK 0
+
+static DviCopy in;          /* the input file */
+static size_t* order = NULL; /* the pages to write, from 1; or BLANK */
+static size_t norder = 0;
+static size_t maxorder = 0;
+
+/* stop: the input is bad, or the output (named name) cannot be written */
+static void copy_failed(const DviCopyOut* o, const char* name) {
+    ERROR_SATRT;
+    if (o != NULL && o->b.error != NULL) {
+        fprintf(msg_fp, "cannot write \"%s\": %s.\n", name, o->b.error);
+    } else if (in.error_at != DVI_READ_NONE) {
+        fprintf(msg_fp, "bad DVI file, at byte %zu: %s.\n", in.error_at,
+                in.error);
+    } else {
+        fprintf(msg_fp, "%s.\n", in.error);
+    }
+    dexit(EXIT_FAILURE);
+} /* copy_failed */
+
+/* write page n (or BLANK) after those in the order */
+static void add_page(size_t n) {
+    if (norder == maxorder) {
+        maxorder = (maxorder == 0 ? 1024 : 2 * maxorder);
+        order = (size_t*)realloc(order, maxorder * sizeof(size_t));
+        if (order == NULL) {
+            no_memory("pages");
+        }
+    }
+    order[norder++] = n;
+} /* add_page */
+
+/* the pages for a booklet: each sheet has, on one side, the last page
+   not yet placed and the first, and, on the other, the next first and
+   the next last; pages past the input's are blank */
+static void booklet(size_t npage) {
+    size_t m = (npage + 3) / 4 * 4;
+
+    for (size_t i = 0; i < m / 2; i += 2) {
+        size_t page[4] = { m - i, 1 + i, 2 + i, m - 1 - i };
+
+        for (int j = 0; j < 4; j++) {
+            add_page(page[j] <= npage ? page[j] : BLANK);
+        }
+    }
+} /* booklet */
+
+/* parse one item of a list: n, m-n, m- or -n; 0 if it is none of them,
+   or names a page that the input does not have */
+static int parse_range(const char* s, const char* end, size_t npage) {
+    size_t first = 1, last = npage;
+    char* after;
+
+    if (*s != '-') {
+        first = strtoul(s, &after, 10);
+        if (after == s) {
+            return 0;
+        }
+        s = after;
+        if (s == end) {
+            last = first;
+        } else if (*s != '-') {
+            return 0;
+        }
+    }
+    if (s < end) {
+        ++s;
+        if (s < end) {
+            last = strtoul(s, &after, 10);
+            if (after != end) {
+                return 0;
+            }
+        }
+    }
+    if (first < 1 || last < 1 || first > npage || last > npage) {
+        return 0;
+    }
+    if (first <= last) {
+        for (size_t n = first; n <= last; n++) {
+            add_page(n);
+        }
+    } else {
+        for (size_t n = first; n >= last; n--) {
+            add_page(n);
+        }
+    }
+    return 1;
+} /* parse_range */
+
+/* the pages to write, in order; 0 if s is no order */
+static int parse_order(const char* s, size_t npage) {
+    if (strcmp(s, "reverse") == 0) {
+        for (size_t n = npage; n >= 1; n--) {
+            add_page(n);
+        }
+    } else if (strcmp(s, "odd") == 0 || strcmp(s, "even") == 0) {
+        for (size_t n = (s[0] == 'o' ? 1 : 2); n <= npage; n += 2) {
+            add_page(n);
+        }
+    } else if (strcmp(s, "booklet") == 0) {
+        booklet(npage);
+    } else {
+        for (;;) {
+            const char* comma = strchr(s, ',');
+            const char* end = (comma != NULL ? comma : s + strlen(s));
+
+            if (end == s || !parse_range(s, end, npage)) {
+                return 0;
+            }
+            if (comma == NULL) {
+                break;
+            }
+            s = comma + 1;
+        }
+    }
+    return 1;
+} /* parse_order */
+
+int main(int argc, char* argv[]) {
+    FILE* dvi;
+    FILE* out;
+    DviReader r;
+    DviCopyOut o;
+    const char* name;
+    int32_t zero[10] = { 0 };
+    size_t nblank = 0;
+    int fd;
+    int verbose = 0;
+    int arg = 1;
+
+    program_name = argv[0];
+    msg_fp = stderr;
+
+    if (arg < argc && strcmp(argv[arg], "-v") == 0) {
+        verbose = 1;
+        ++arg;
+    }
+    if (argc - arg != 3) {
+        fprintf(msg_fp, "usage: %s [-v] input-DVI-file order output-DVI-file\n"
+                "  order: reverse, odd, even, booklet, or pages n, m-n, m- "
+                "or -n,\n  separated by commas\n", program_name);
+        dexit(EXIT_FAILURE);
+    }
+    if ((dvi = fopen(argv[arg], "rb")) == NULL) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "Cannot open \"%s\" for binary reading.\n", argv[arg]);
+        dexit(EXIT_FAILURE);
+    }
+    fd = read_input(dvi, &r);
+    dvi_copy_init(&in);
+    if (!dvi_copy_open(&in, r.dvi, r.size, fd)) {
+        copy_failed(NULL, NULL);
+    }
+    if (!parse_order(argv[arg + 1], in.npage)) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "\"%s\" is no order of the %zu pages.\n",
+                argv[arg + 1], in.npage);
+        dexit(EXIT_FAILURE);
+    }
+
+    name = argv[arg + 2];
+    if ((out = fopen(name, "wb")) == NULL) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "Cannot open \"%s\" for binary writing.\n", name);
+        dexit(EXIT_FAILURE);
+    }
+    if (!dvi_copy_out_init(&in, &o, fileno(out))) {
+        copy_failed(&o, name);
+    }
+    for (size_t i = 0; i < norder; i++) {
+        if (order[i] != BLANK) {
+            if (!dvi_copy_page(&in, order[i], &o)) {
+                copy_failed(&o, name);
+            }
+        } else if (!dvi_build_begin_page(&o.b, zero)
+                   || !dvi_build_end_page(&o.b)) {
+            copy_failed(&o, name);
+        } else {
+            ++nblank;
+        }
+    }
+    if (!dvi_copy_finish(&in, &o)) {
+        copy_failed(&o, name);
+    }
+    if (verbose) {
+        INFO_SATRT;
+        fprintf(msg_fp, "\"%s\": %zu pages, %zu of them blank, %zu bytes, "
+                "%zu of them copied by the system.\n", name, norder, nblank,
+                o.b.written, o.copied);
+    }
+    dvi_copy_out_free(&o);
+    if (fclose(out) != 0) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "cannot close \"%s\".\n", name);
+        dexit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+} /* main */
+
+/* end of "dvorder.c" */
@@ -0,0 +1,218 @@
+/* dvplace - what each page of a DVI file typesets, and where.
+
+   This file is public domain.
+
+   - Usage:  dvplace [input-DVI-file [output-file]]
+     If the filenames are omitted, stdin and stdout are assumed.
+   - For each page, one line for its bop, with \count0 .. \count9;
+     one for each character, rule and special that the page typesets,
+     with where, as h and v in DVI units; and one for its eop:
+       bop c0 .. c9
+       char font scale c at h v
+       rule a b at h v
+       special 'x' at h v
+       eop
+   - No TFM files are read: a character set moves h by a made-up width,
+     1000 times its code plus the first byte of its font's name.  So
+     two DVI files that dvplace lists alike typeset the same things in
+     the same places, whatever widths the fonts really have.
+   - Fonts are listed by their names (area and name) and scale, not
+     their numbers, so that renumbering them changes nothing.
+   - dvplace is for the tests of the DVI tools (make check): it lists
+     the pages of a DVI file that dvopt, dvcat, dvsplit or dvorder
+     wrote, to be compared with those of the file they read.
+*/
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L /* fileno */
+#endif
+
+#include <inttypes.h> // PRId64
+#include <stdint.h>   // int64_t
+#include <stdlib.h>   // EXIT_SUCCESS, EXIT_FAILURE, realloc
+
+#include "dtl.h"
+#include "dviread.h"
+#include "dvtool.h"
+
+/* a font, as defined */
+typedef struct _Font {
+    int64_t k;       /* its number */
+    int64_t s;       /* its scale */
+    const char* str; /* its area and name, in the DVI bytes */
+    size_t len;
+} Font;
+
+/* where typesetting is */
+typedef struct _Place {
+    int64_t h, v, w, x, y, z;
+} Place;
+
+static Font* fonts = NULL;
+static size_t nfonts = 0;
+static size_t maxfonts = 0;
+
+static Place* stack = NULL; /* the places pushed */
+static size_t depth = 0;
+static size_t maxdepth = 0;
+
+/* define font cmd->arg[0], as fnt_def cmd; a font defined again is the
+   same font, in a whole DVI file */
+static void define_font(const DviCommand* cmd) {
+    size_t i;
+
+    for (i = 0; i < nfonts && fonts[i].k != cmd->arg[0]; i++) {
+    }
+    if (i == nfonts) {
+        if (nfonts == maxfonts) {
+            maxfonts = (maxfonts == 0 ? 64 : 2 * maxfonts);
+            fonts = (Font*)realloc(fonts, maxfonts * sizeof(Font));
+            if (fonts == NULL) {
+                no_memory("fonts");
+            }
+        }
+        ++nfonts;
+    }
+    fonts[i].k = cmd->arg[0];
+    fonts[i].s = cmd->arg[2];
+    fonts[i].str = cmd->str;
+    fonts[i].len = cmd->len;
+} /* define_font */
+
+/* font number k, or NULL if none is defined */
+static const Font* find_font(int64_t k) {
+    for (size_t i = 0; i < nfonts; i++) {
+        if (fonts[i].k == k) {
+            return &fonts[i];
+        }
+    }
+    return NULL;
+} /* find_font */
+
+/* push place p */
+static void push(const Place* p) {
+    if (depth == maxdepth) {
+        maxdepth = (maxdepth == 0 ? 64 : 2 * maxdepth);
+        stack = (Place*)realloc(stack, maxdepth * sizeof(Place));
+        if (stack == NULL) {
+            no_memory("the stack");
+        }
+    }
+    stack[depth++] = *p;
+} /* push */
+
+/* list, on out, what the DVI file read by r typesets, and where;
+   return 0 if the file cannot be read to its end */
+static int place(DviReader* r, FILE* out) {
+    DviCommand cmd;
+    Place p = { 0, 0, 0, 0, 0, 0 };
+    int64_t font = 0;
+    int selected = 0; /* a font is selected */
+
+    while (dvi_read_next(r, &cmd)) {
+        int op = cmd.opcode;
+        int64_t a = cmd.arg[0];
+
+        if (op <= SET4 || (op >= PUT1 && op <= PUT4)) {
+            const Font* f = (selected ? find_font(font) : NULL);
+
+            if (f != NULL) {
+                fprintf(out, "char %.*s %" PRId64, (int)f->len, f->str, f->s);
+            } else {
+                fprintf(out, "char ? 0");
+            }
+            fprintf(out, " %" PRId64 " at %" PRId64 " %" PRId64 "\n", a,
+                    p.h, p.v);
+            if (op <= SET4) {
+                p.h += 1000 * a + (f != NULL && f->len > 0 ? f->str[0] : 0);
+            }
+        } else if (op == SET_RULE || op == PUT_RULE) {
+            fprintf(out, "rule %" PRId64 " %" PRId64 " at %" PRId64 " %"
+                    PRId64 "\n", a, cmd.arg[1], p.h, p.v);
+            if (op == SET_RULE) {
+                p.h += cmd.arg[1];
+            }
+        } else if (op == BOP) {
+            fprintf(out, "bop");
+            for (int i = 0; i < 10; i++) {
+                fprintf(out, " %" PRId64, cmd.arg[i]);
+            }
+            fprintf(out, "\n");
+            p.h = p.v = p.w = p.x = p.y = p.z = 0;
+            selected = 0;
+            depth = 0;
+        } else if (op == EOP) {
+            fprintf(out, "eop\n");
+        } else if (op == PUSH) {
+            push(&p);
+        } else if (op == POP) {
+            if (depth > 0) {
+                p = stack[--depth];
+            }
+        } else if (op <= RIGHT4) {
+            p.h += a;
+        } else if (op <= W4) {
+            p.w = (op == W0 ? p.w : a);
+            p.h += p.w;
+        } else if (op <= X4) {
+            p.x = (op == X0 ? p.x : a);
+            p.h += p.x;
+        } else if (op <= DOWN4) {
+            p.v += a;
+        } else if (op <= Y4) {
+            p.y = (op == Y0 ? p.y : a);
+            p.v += p.y;
+        } else if (op <= Z4) {
+            p.z = (op == Z0 ? p.z : a);
+            p.v += p.z;
+        } else if (op <= FONT4) {
+            font = a;
+            selected = 1;
+        } else if (op <= XXX4) {
+            fprintf(out, "special '%.*s' at %" PRId64 " %" PRId64 "\n",
+                    (int)cmd.len, cmd.str, p.h, p.v);
+        } else if (op <= FNT_DEF4) {
+            define_font(&cmd);
+        }
+    }
+    return r->error == NULL;
+} /* place */
+
+int main(int argc, char* argv[]) {
+    FILE* dvi = stdin;
+    FILE* out = stdout;
+    DviReader r;
+
+    program_name = argv[0];
+    msg_fp = stderr;
+
+    if (argc > 3) {
+        fprintf(msg_fp, "usage: %s [input-DVI-file [output-file]]\n",
+                program_name);
+        dexit(EXIT_FAILURE);
+    }
+    if (argc > 1 && (dvi = fopen(argv[1], "rb")) == NULL) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "Cannot open \"%s\" for binary reading.\n", argv[1]);
+        dexit(EXIT_FAILURE);
+    }
+    if (argc > 2 && (out = fopen(argv[2], "w")) == NULL) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "Cannot open \"%s\" for text writing.\n", argv[2]);
+        dexit(EXIT_FAILURE);
+    }
+    read_input(dvi, &r);
+    if (!place(&r, out)) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "bad DVI file, at byte %zu: %s.\n", r.error_at,
+                r.error);
+        dexit(EXIT_FAILURE);
+    }
+    if (fclose(out) != 0) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "cannot close the output.\n");
+        dexit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+} /* main */
+
+/* end of "dvplace.c" */
@@ -0,0 +1,192 @@
+/* dvsplit - copy pages of a DVI file to other DVI files, in one pass.
+
+   This file is public domain.
+
+   - Usage:  dvsplit [-v] input-DVI-file pages output-DVI-file
+                     [pages output-DVI-file ...]
+     where pages is n (page n), m-n (pages m to n), m- (page m to the
+     last) or -n (the first page to page n).  Pages are counted from 1,
+     in the order of the file, whatever their \count0 .. \count9.
+   - The pages are copied by dvicopy: found through the chain of bop
+     addresses, without reading what is between them; each read once,
+     for the fonts it selects and defines; and copied as they are, but
+     for the bop, and definitions of fonts that the output file has,
+     by copy_file_range where the system has it.  Before a page, an
+     output file is given the definitions, from the input's postamble,
+     of the fonts that the page selects and the file has not defined.
+   - The output files are written side by side, in one pass over the
+     input's pages.
+*/
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L /* fileno */
+#endif
+
+#include <stdint.h> // SIZE_MAX
+#include <stdlib.h> // EXIT_SUCCESS, EXIT_FAILURE, calloc, realloc, strtoul
+#include <string.h> // strcmp
+
+#include "dtl.h"
+#include "dvicopy.h"
+#include "dviread.h"
+#include "dvtool.h"
+
+
+/* an output file, and the pages it has */
+typedef struct {
+    const char* name;
+    size_t first, last;  /* its pages, from 1 */
+    FILE* fp;
+    DviCopyOut out;
+} Output;
+
+static DviCopy in;      /* the input file */
+static Output* outs = NULL;
+static size_t nout = 0;
+
+/* stop: the input is bad, or output o (if not NULL) cannot be written */
+static void copy_failed(const Output* o) {
+    ERROR_SATRT;
+    if (o != NULL && o->out.b.error != NULL) {
+        fprintf(msg_fp, "cannot write \"%s\": %s.\n", o->name,
+                o->out.b.error);
+    } else if (in.error_at != DVI_READ_NONE) {
+        fprintf(msg_fp, "bad DVI file, at byte %zu: %s.\n", in.error_at,
+                in.error);
+    } else {
+        fprintf(msg_fp, "%s.\n", in.error);
+    }
+    dexit(EXIT_FAILURE);
+} /* copy_failed */
+
+/* parse pages: n, m-n, m- or -n; 0 if it is none of them */
+static int parse_pages(const char* s, Output* o) {
+    char* end;
+
+    o->first = 1;
+    o->last = SIZE_MAX;
+    if (*s != '-') {
+        o->first = strtoul(s, &end, 10);
+        if (end == s) {
+            return 0;
+        }
+        s = end;
+        if (*s == '\0') {
+            o->last = o->first;
+            return (o->first > 0);
+        }
+        if (*s != '-') {
+            return 0;
+        }
+    }
+    ++s;
+    if (*s != '\0') {
+        o->last = strtoul(s, &end, 10);
+        if (end == s || *end != '\0') {
+            return 0;
+        }
+    }
+    return (o->first > 0 && o->first <= o->last);
+} /* parse_pages */
+
+/* open output o, and copy the input's preamble to it */
+static void open_output(Output* o) {
+    if (o->last == SIZE_MAX) {
+        o->last = in.npage;
+    }
+    if (o->first > in.npage || o->last > in.npage) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "\"%s\": the DVI file has only %zu pages.\n",
+                o->name, in.npage);
+        dexit(EXIT_FAILURE);
+    }
+    if ((o->fp = fopen(o->name, "wb")) == NULL) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "Cannot open \"%s\" for binary writing.\n", o->name);
+        dexit(EXIT_FAILURE);
+    }
+    if (!dvi_copy_out_init(&in, &o->out, fileno(o->fp))) {
+        copy_failed(o);
+    }
+} /* open_output */
+
+int main(int argc, char* argv[]) {
+    FILE* dvi;
+    DviReader r;
+    int fd;
+    int verbose = 0;
+    int arg = 1;
+
+    program_name = argv[0];
+    msg_fp = stderr;
+
+    if (arg < argc && strcmp(argv[arg], "-v") == 0) {
+        verbose = 1;
+        ++arg;
+    }
+    if (argc - arg < 3 || (argc - arg) % 2 != 1) {
+        fprintf(msg_fp, "usage: %s [-v] input-DVI-file pages output-DVI-file"
+                " [pages output-DVI-file ...]\n", program_name);
+        dexit(EXIT_FAILURE);
+    }
+    if ((dvi = fopen(argv[arg], "rb")) == NULL) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "Cannot open \"%s\" for binary reading.\n", argv[arg]);
+        dexit(EXIT_FAILURE);
+    }
+    fd = read_input(dvi, &r);
+    dvi_copy_init(&in);
+    if (!dvi_copy_open(&in, r.dvi, r.size, fd)) {
+        copy_failed(NULL);
+    }
+
+    nout = (size_t)(argc - arg - 1) / 2;
+    outs = (Output*)calloc(nout, sizeof(Output));
+    if (outs == NULL) {
+        no_memory("output files");
+    }
+    for (size_t i = 0; i < nout; i++) {
+        Output* o = &outs[i];
+
+        o->name = argv[arg + 2 + 2 * i];
+        if (!parse_pages(argv[arg + 1 + 2 * i], o)) {
+            ERROR_SATRT;
+            fprintf(msg_fp, "\"%s\" is not n, m-n, m- or -n pages.\n",
+                    argv[arg + 1 + 2 * i]);
+            dexit(EXIT_FAILURE);
+        }
+        open_output(o);
+    }
+
+    /* in the input's order: each page is read once, for all its outputs */
+    for (size_t n = 1; n <= in.npage; n++) {
+        for (size_t i = 0; i < nout; i++) {
+            if (n >= outs[i].first && n <= outs[i].last
+                && !dvi_copy_page(&in, n, &outs[i].out)) {
+                copy_failed(&outs[i]);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < nout; i++) {
+        Output* o = &outs[i];
+
+        if (!dvi_copy_finish(&in, &o->out)) {
+            copy_failed(o);
+        }
+        if (verbose) {
+            INFO_SATRT;
+            fprintf(msg_fp, "\"%s\": pages %zu to %zu, %zu bytes, %zu of "
+                    "them copied by the system.\n", o->name, o->first,
+                    o->last, o->out.b.written, o->out.copied);
+        }
+        dvi_copy_out_free(&o->out);
+        if (fclose(o->fp) != 0) {
+            ERROR_SATRT;
+            fprintf(msg_fp, "cannot close \"%s\".\n", o->name);
+            dexit(EXIT_FAILURE);
+        }
+    }
+    return EXIT_SUCCESS;
+} /* main */
+
+/* end of "dvsplit.c" */
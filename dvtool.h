@@ -0,0 +1,63 @@
+#ifndef INC_DVTOOL_H
+/* dvtool.h - what the DVI tools (dvcat, dvdiff, dvopt, dvorder and
+   dvsplit) do alike: stop, and read their input.
+
+   This file is public domain.
+
+   - A tool includes it after dtl.h.  Its functions are static, as
+     dtl.h's messages are, so that they write to the tool's msg_fp.
+   - A tool that fails exits with tool_failure: EXIT_FAILURE, unless
+     the tool sets another (dvdiff's trouble is 2, as diff's).
+*/
+#define INC_DVTOOL_H
+
+#include <stdio.h>  // FILE, fileno, fread, ferror
+#include <stdlib.h> // EXIT_FAILURE, exit, realloc
+
+#include "dtl.h"
+#include "dviread.h"
+
+/// exit status of a tool that fails
+static int tool_failure DTL_UNUSED = EXIT_FAILURE;
+
+static DTL_UNUSED void dexit(int n) {
+    exit(n);
+} /* dexit */
+
+/* stop: out of memory for what */
+static DTL_UNUSED void no_memory(const char* what) {
+    ERROR_SATRT;
+    fprintf(msg_fp, "no memory for %s.\n", what);
+    dexit(tool_failure);
+} /* no_memory */
+
+/* read all of fp into memory, for r, if it cannot be mapped;
+   return its file descriptor, if it is mapped, or -1 */
+static DTL_UNUSED int read_input(FILE* fp, DviReader* r) {
+    unsigned char* buf = NULL;
+    size_t len = 0, max = 0, n;
+
+    if (dvi_read_map(r, fp)) {
+        return fileno(fp);
+    }
+    do {
+        if (len == max) {
+            max = (max == 0 ? 65536 : 2 * max);
+            buf = (unsigned char*)realloc(buf, max);
+            if (buf == NULL) {
+                no_memory("the DVI file");
+            }
+        }
+        n = fread(buf + len, 1, max - len, fp);
+        len += n;
+    } while (n > 0);
+    if (ferror(fp)) {
+        ERROR_SATRT;
+        fprintf(msg_fp, "cannot read the DVI file.\n");
+        dexit(tool_failure);
+    }
+    dvi_read_init(r, buf, len);
+    return -1;
+} /* read_input */
+
+#endif /* INC_DVTOOL_H */
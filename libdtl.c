@@ -0,0 +1,154 @@
+/* libdtl.c - dt2dv and dv2dt, as a library: contexts, and conversions
+   between buffers in memory.
+
+   This file is public domain.
+
+   dtl_dt2dv is in dt2dv.c, and dtl_dv2dt in dv2dt.c, each compiled
+   with DTL_LIBRARY; the buffer conversions here read the input buffer
+   as a file in place, and write the output to a file in memory.
+*/
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L /* fmemopen, open_memstream */
+#define HAVE_MEMSTREAM 1
+#endif
+
+#include <stdio.h>  // FILE, fmemopen, open_memstream, tmpfile
+#include <stdlib.h> // malloc, free
+
+#include "libdtl.h"
+
+/* a context with the programs' default options, but quiet: warnings
+   are only counted, and their table is the only message of a conversion
+   that goes well */
+void dtl_context_init(DtlContext* ctx) {
+    ctx->debug = 0;
+    ctx->group = 0;
+    ctx->auto_post = 0;
+    ctx->quiet = 1;
+    ctx->max_warnings = 10;
+    ctx->messages = NULL;
+    ctx->name = NULL;
+    ctx->status = DTL_OK;
+    ctx->dvi_bytes = 0;
+    ctx->ncom = 0;
+} /* dtl_context_init */
+
+/* what a status means, for messages */
+const char* dtl_status_string(DtlStatus status) {
+    switch (status) {
+        case DTL_OK:
+            return "OK";
+        case DTL_ERROR_INPUT:
+            return "input cannot be converted";
+        case DTL_ERROR_OUTPUT:
+            return "output cannot be written";
+        case DTL_ERROR_MEMORY:
+            return "out of memory";
+    }
+    return "unknown status";
+} /* dtl_status_string */
+
+/* the len bytes at buf, as a file to read */
+static FILE* open_input(const char* buf, size_t len, const char* mode) {
+#ifdef HAVE_MEMSTREAM
+    if (len > 0) {
+        return fmemopen((void*)buf, len, mode);
+    }
+#endif
+    {
+        FILE* fp = tmpfile();
+
+        if (fp != NULL
+            && (fwrite(buf, 1, len, fp) != len || fseek(fp, 0L, SEEK_SET))) {
+            fclose(fp);
+            fp = NULL;
+        }
+        return fp;
+    }
+} /* open_input */
+
+/* a file to write, whose bytes close_output leaves at *buf */
+static FILE* open_output(char** buf, size_t* len) {
+    *buf = NULL;
+    *len = 0;
+#ifdef HAVE_MEMSTREAM
+    return open_memstream(buf, len);
+#else
+    return tmpfile();
+#endif
+} /* open_output */
+
+/* close fp, from open_output; return 1, with its bytes at *buf, if OK */
+static int close_output(FILE* fp, char** buf, size_t* len) {
+#ifdef HAVE_MEMSTREAM
+    return fclose(fp) == 0;
+#else
+    long n = ftell(fp);
+    int ok = (n >= 0 && fseek(fp, 0L, SEEK_SET) == 0);
+
+    if (ok) {
+        *len = (size_t)n;
+        *buf = (char*)malloc(*len + 1);
+        ok = (*buf != NULL && fread(*buf, 1, *len, fp) == *len);
+    }
+    fclose(fp);
+    return ok;
+#endif
+} /* close_output */
+
+/* convert buffer in to a buffer *out, that the caller is to free */
+static DtlStatus convert_buffer(DtlContext* ctx,
+                                DtlStatus (*convert)(DtlContext*, FILE*,
+                                                     FILE*),
+                                const char* in, size_t in_len,
+                                const char* in_mode, char** out,
+                                size_t* out_len) {
+    FILE* in_fp = open_input(in, in_len, in_mode);
+    FILE* out_fp = (in_fp != NULL ? open_output(out, out_len) : NULL);
+
+    if (out_fp == NULL) {
+        if (in_fp != NULL) {
+            fclose(in_fp);
+        }
+        *out = NULL;
+        *out_len = 0;
+        ctx->status = DTL_ERROR_MEMORY;
+        return ctx->status;
+    }
+
+    convert(ctx, in_fp, out_fp);
+    fclose(in_fp);
+    if (!close_output(out_fp, out, out_len) && ctx->status == DTL_OK) {
+        ctx->status = DTL_ERROR_MEMORY;
+    }
+    if (ctx->status != DTL_OK) {
+        free(*out);
+        *out = NULL;
+        *out_len = 0;
+    }
+    return ctx->status;
+} /* convert_buffer */
+
+/** Convert the DTL text dtl[0 .. dtl_len-1] to DVI, as dt2dv would.
+ *  The DVI bytes are put in *dvi, of *dvi_len bytes, for the caller to
+ *  free; or, if the conversion fails, *dvi is NULL.
+ *
+ *  @return ctx->status
+ */
+DtlStatus dtl_dt2dv_buffer(DtlContext* ctx, const char* dtl, size_t dtl_len,
+                           char** dvi, size_t* dvi_len) {
+    return convert_buffer(ctx, dtl_dt2dv, dtl, dtl_len, "r", dvi, dvi_len);
+} /* dtl_dt2dv_buffer */
+
+/** Convert the DVI bytes dvi[0 .. dvi_len-1] to DTL, as dv2dt would.
+ *  The DTL text is put in *dtl, of *dtl_len bytes, for the caller to
+ *  free; or, if the conversion fails, *dtl is NULL.
+ *
+ *  @return ctx->status
+ */
+DtlStatus dtl_dv2dt_buffer(DtlContext* ctx, const char* dvi, size_t dvi_len,
+                           char** dtl, size_t* dtl_len) {
+    return convert_buffer(ctx, dtl_dv2dt, dvi, dvi_len, "rb", dtl, dtl_len);
+} /* dtl_dv2dt_buffer */
+
+/* end of "libdtl.c" */
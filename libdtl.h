@@ -0,0 +1,55 @@
+#ifndef INC_LIBDTL_H
+/* libdtl.h - dt2dv and dv2dt, as a library.
+
+   This file is public domain.
+
+   - libdtl.a converts DTL to DVI, and DVI to DTL, as the programs do,
+     between files or between buffers in memory.
+   - Each conversion is given a DtlContext: its options, as on the
+     command line, and where its messages go; and it reports there
+     how it went.  A conversion that fails returns an error code,
+     having closed and freed all it held; libdtl never exits.
+   - Each thread has its own conversion state, so conversions may run
+     on many threads at once, each with a context of its own.
+   - Programs using libdtl.a are linked with -lpthread.
+*/
+#define INC_LIBDTL_H
+
+#include <stddef.h> // size_t
+#include <stdio.h>  // FILE
+
+/* outcome of a conversion */
+typedef enum _DtlStatus {
+    DTL_OK = 0,
+    DTL_ERROR_INPUT,  ///< input is not DTL, or DVI, that can be converted.
+    DTL_ERROR_OUTPUT, ///< output could not be written.
+    DTL_ERROR_MEMORY, ///< memory ran out.
+} DtlStatus;
+
+/* a conversion's options, and what it reports */
+typedef struct _DtlContext {
+    int debug;           ///< detailed debugging (-debug).
+    int group;           ///< each DTL command is in BCOM and ECOM (-group).
+    int auto_post;       ///< dt2dv: write a postamble, if none (-post).
+    int quiet;           ///< no summary of bytes read and written, nor
+                         ///< counted warnings, but their table (-quiet).
+    size_t max_warnings; ///< warnings of each kind shown (-warnings).
+    FILE* messages;      ///< where messages go; NULL for stderr.
+    const char* name;    ///< input's file name, for messages and includes.
+    DtlStatus status;    ///< how the last conversion went.
+    size_t dvi_bytes;    ///< DVI bytes written (dt2dv) or read (dv2dt).
+    size_t ncom;         ///< DVI commands converted.
+} DtlContext;
+
+void dtl_context_init(DtlContext* ctx);
+const char* dtl_status_string(DtlStatus status);
+
+DtlStatus dtl_dt2dv(DtlContext* ctx, FILE* dtl, FILE* dvi);
+DtlStatus dtl_dv2dt(DtlContext* ctx, FILE* dvi, FILE* dtl);
+
+DtlStatus dtl_dt2dv_buffer(DtlContext* ctx, const char* dtl, size_t dtl_len,
+                           char** dvi, size_t* dvi_len);
+DtlStatus dtl_dv2dt_buffer(DtlContext* ctx, const char* dvi, size_t dvi_len,
+                           char** dtl, size_t* dtl_len);
+
+#endif /* INC_LIBDTL_H */